@@ -80,6 +80,7 @@ static socket_command_struct commands[CLIENT_CMD_NROF] = {
     {socket_command_interface},
     {socket_command_notification},
     {socket_command_keepalive},
+    {socket_command_compressed_stream},
 };
 
 /**
@@ -96,7 +97,6 @@ void DoClient(void)
 
         uint8_t *decrypted_data;
         size_t decrypted_len;
-        bool was_decrypted = true;
         if (socket_is_secure(csocket.sc)) {
             if (!socket_crypto_decrypt(csocket.sc,
                                        data,
@@ -112,7 +112,6 @@ void DoClient(void)
         } else {
             decrypted_data = data;
             decrypted_len = len;
-            was_decrypted = false;
         }
 
         size_t pos = 0;
@@ -134,10 +133,6 @@ void DoClient(void)
             commands[type].handle_func(decrypted_data, decrypted_len, pos);
         }
 
-        if (was_decrypted) {
-            efree(decrypted_data);
-        }
-
         command_buffer_free(cmd);
     }
 }
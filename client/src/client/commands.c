@@ -36,6 +36,17 @@
 #include <toolkit/x11.h>
 #include <toolkit/socket_crypto.h>
 
+/**
+ * Inflate stream used to decompress the data packets compressed by the
+ * server's streaming compression.
+ */
+static z_stream compressed_stream;
+
+/**
+ * Whether ::compressed_stream has been initialized.
+ */
+static bool compressed_stream_init = false;
+
 /** @copydoc socket_command_struct::handle_func */
 void socket_command_book(uint8_t *data, size_t len, size_t pos)
 {
@@ -64,6 +75,17 @@ void socket_command_setup(uint8_t *data, size_t len, size_t pos)
         } else if (type == CMD_SETUP_DATA_URL) {
             packet_to_string(data, len, &pos, cpl.http_url,
                     sizeof(cpl.http_url));
+        } else if (type == CMD_SETUP_COMPRESSION) {
+            if (packet_to_uint8(data, len, &pos) == 1) {
+                /* Start with a fresh stream for the new connection. */
+                if (compressed_stream_init) {
+                    inflateReset(&compressed_stream);
+                } else if (inflateInit(&compressed_stream) == Z_OK) {
+                    compressed_stream_init = true;
+                } else {
+                    LOG(ERROR, "inflateInit() failed");
+                }
+            }
         }
     }
 
@@ -952,6 +974,46 @@ void socket_command_compressed(uint8_t *data, size_t len, size_t pos)
     efree(dest);
 }
 
+/** @copydoc socket_command_struct::handle_func */
+void socket_command_compressed_stream(uint8_t *data, size_t len, size_t pos)
+{
+    unsigned long ucomp_len;
+    uint8_t type, *dest;
+
+    type = packet_to_uint8(data, len, &pos);
+    ucomp_len = packet_to_uint32(data, len, &pos);
+
+    if (!compressed_stream_init) {
+        LOG(BUG, "Received compressed stream data without a stream");
+        return;
+    }
+
+    /* One byte of extra room, so that the flush marker at the end of the
+     * data gets consumed as well. */
+    dest = emalloc(ucomp_len + 2);
+    dest[0] = type;
+
+    compressed_stream.next_in = data + pos;
+    compressed_stream.avail_in = len - pos;
+    compressed_stream.next_out = dest + 1;
+    compressed_stream.avail_out = ucomp_len + 1;
+
+    int ret = inflate(&compressed_stream, Z_SYNC_FLUSH);
+
+    if (ret == Z_OK && compressed_stream.avail_in == 0 &&
+            compressed_stream.avail_out == 1) {
+        command_buffer *buf;
+
+        buf = command_buffer_new(ucomp_len + 1, dest);
+        add_input_command(buf);
+    } else {
+        LOG(BUG, "Failed to decompress data: %s", compressed_stream.msg !=
+                NULL ? compressed_stream.msg : "unknown error");
+    }
+
+    efree(dest);
+}
+
 /** @copydoc socket_command_struct::handle_func */
 void socket_command_control(uint8_t *data, size_t len, size_t pos)
 {
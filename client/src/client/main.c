@@ -347,6 +347,13 @@ static int game_status_chain(void)
         packet_append_uint8(packet, setting_get_int(OPT_CAT_MAP, OPT_MAP_HEIGHT));
         packet_append_uint8(packet, CMD_SETUP_DATA_URL);
         packet_append_string_terminated(packet, "");
+
+        /* Older servers don't know about streaming compression. */
+        if (cpl.server_socket_version >= 1067) {
+            packet_append_uint8(packet, CMD_SETUP_COMPRESSION);
+            packet_append_uint8(packet, 1);
+        }
+
         socket_send_packet(packet);
 
         cpl.state = ST_WAITSETUP;
@@ -28,6 +28,7 @@ extern void socket_command_mapstats(uint8_t *data, size_t len, size_t pos);
 extern void socket_command_map(uint8_t *data, size_t len, size_t pos);
 extern void socket_command_version(uint8_t *data, size_t len, size_t pos);
 extern void socket_command_compressed(uint8_t *data, size_t len, size_t pos);
+extern void socket_command_compressed_stream(uint8_t *data, size_t len, size_t pos);
 extern void socket_command_control(uint8_t *data, size_t len, size_t pos);
 void
 socket_command_crypto(uint8_t *data, size_t len, size_t pos);
@@ -264,6 +264,30 @@ clioptions_option_logger_filter_logfile (const char *arg,
     return true;
 }
 
+/**
+ * Description of the --logger_async command.
+ */
+static const char *clioptions_option_logger_async_desc =
+"Whether to write out log messages on a separate thread, so that logging "
+"doesn't block the calling thread on console and disk I/O. Errors and "
+"bugs are still written out before the logging call returns.";
+/** @copydoc clioptions_handler_func */
+static bool
+clioptions_option_logger_async (const char *arg,
+                                char      **errmsg)
+{
+    if (KEYWORD_IS_TRUE(arg)) {
+        logger_set_async(true);
+    } else if (KEYWORD_IS_FALSE(arg)) {
+        logger_set_async(false);
+    } else {
+        string_fmt(*errmsg, "Invalid value: %s", arg);
+        return false;
+    }
+
+    return true;
+}
+
 TOOLKIT_INIT_FUNC(clioptions)
 {
     clioptions = NULL;
@@ -289,6 +313,11 @@ TOOLKIT_INIT_FUNC(clioptions)
                                logger_filter_logfile,
                                "Specify log levels filtering for the logfile.");
     clioptions_enable_changeable(cli);
+
+    CLIOPTIONS_CREATE_ARGUMENT(cli,
+                               logger_async,
+                               "Whether to log asynchronously.");
+    clioptions_enable_changeable(cli);
 }
 TOOLKIT_INIT_FUNC_FINISH
 
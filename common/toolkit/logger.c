@@ -26,6 +26,12 @@
  * @file
  * Logger API.
  *
+ * In asynchronous mode (see logger_set_async()), logger_print() only
+ * formats the message and pushes it into a ring buffer owned by the
+ * calling thread. The rings are single-producer, single-consumer, so
+ * pushing doesn't take any locks; a background thread drains them,
+ * formats the timestamps and writes the messages out in batches.
+ *
  * @author Alex Tokar
  */
 
@@ -105,8 +111,109 @@ static uint64_t logger_filter_stdout;
  */
 static uint64_t logger_filter_logfile;
 
+/**
+ * Size of the per-thread ring buffers used in asynchronous mode. Must be a
+ * power of two.
+ */
+#define LOGGER_RING_SIZE (256 * 1024)
+
+/**
+ * How often the logger thread checks the ring buffers if it's not woken
+ * up sooner, in milliseconds.
+ */
+#define LOGGER_THREAD_INTERVAL 50
+
+/**
+ * Record in a ring buffer, followed by the NUL-terminated message.
+ */
+typedef struct logger_record {
+    uint32_t len; ///< Length of the record, including the message.
+    logger_level level; ///< Log level; LOG_MAX marks padding.
+    uint64_t line; ///< Line the message was logged from.
+    const char *function; ///< Function the message was logged from.
+    struct timeval tv; ///< When the message was logged.
+} logger_record_t;
+
+/**
+ * Ring buffer of records, written by a single thread and read by the
+ * logger thread.
+ */
+typedef struct logger_ring {
+    struct logger_ring *next; ///< Next ring.
+
+    char *buf; ///< The buffer, ::LOGGER_RING_SIZE bytes.
+
+    uint64_t head; ///< Number of bytes written; updated by the owner.
+    uint64_t tail; ///< Number of bytes read; updated by the logger thread.
+
+    /**
+     * If set, the owning thread has exited, and the ring can be freed once
+     * it has been drained.
+     */
+    bool orphaned;
+} logger_ring_t;
+
+/**
+ * Cached formatted timestamp.
+ */
+typedef struct logger_time_cache {
+    time_t sec; ///< Second the timestamp was formatted for.
+    char str[MAX_BUF]; ///< The formatted timestamp, without microseconds.
+} logger_time_cache_t;
+
+/**
+ * Whether asynchronous mode is enabled.
+ */
+static bool logger_async;
+/**
+ * The logger thread.
+ */
+static pthread_t logger_thread;
+/**
+ * Whether the logger thread should stop once it has drained the rings.
+ */
+static bool logger_thread_stop;
+/**
+ * Lock for ::logger_rings and ::logger_thread_stop.
+ */
+static pthread_mutex_t logger_mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Signalled to wake up the logger thread.
+ */
+static pthread_cond_t logger_cond = PTHREAD_COND_INITIALIZER;
+/**
+ * Signalled by the logger thread after it has drained the rings.
+ */
+static pthread_cond_t logger_drained_cond = PTHREAD_COND_INITIALIZER;
+/**
+ * All the ring buffers.
+ */
+static logger_ring_t *logger_rings;
+/**
+ * Increased whenever the rings are freed, so that threads don't use their
+ * stale rings.
+ */
+static uint32_t logger_rings_generation;
+/**
+ * Key used to mark a ring orphaned when its owning thread exits.
+ */
+static pthread_key_t logger_ring_key;
+/**
+ * Ring buffer of the current thread.
+ */
+static __thread logger_ring_t *logger_ring_local;
+/**
+ * Value of ::logger_rings_generation when ::logger_ring_local was created.
+ */
+static __thread uint32_t logger_ring_local_generation;
+/**
+ * Set in the logger thread, which writes out its own messages directly.
+ */
+static __thread bool logger_is_thread;
+
 /* Prototypes */
 static bool logger_term_has_ansi_colors(void);
+static void logger_ring_orphan(void *ptr);
 
 TOOLKIT_API(DEPENDS(string));
 
@@ -115,6 +222,11 @@ TOOLKIT_INIT_FUNC(logger)
     log_fp = NULL;
     logger_set_print_func(logger_do_print);
 
+    logger_async = false;
+    logger_rings = NULL;
+    logger_rings_generation++;
+    pthread_key_create(&logger_ring_key, logger_ring_orphan);
+
     logger_filter_stdout = logger_filter_logfile = 0;
 
     logger_set_filter_stdout("all,-dumptx,-dumprx,-http");
@@ -137,6 +249,17 @@ TOOLKIT_INIT_FUNC_FINISH
 
 TOOLKIT_DEINIT_FUNC(logger)
 {
+    logger_set_async(false);
+
+    logger_ring_t *ring, *tmp;
+    LL_FOREACH_SAFE(logger_rings, ring, tmp) {
+        LL_DELETE(logger_rings, ring);
+        efree(ring->buf);
+        efree(ring);
+    }
+
+    pthread_key_delete(logger_ring_key);
+
     if (log_fp != NULL) {
         fclose(log_fp);
     }
@@ -152,11 +275,16 @@ void logger_open_log(const char *path)
 {
     TOOLKIT_PROTECT();
 
+    /* Make sure the logger thread is not writing to the old file. */
+    bool async = logger_async;
+    logger_set_async(false);
+
     if (log_fp != NULL) {
         fclose(log_fp);
     }
 
     log_fp = fopen(path, "w");
+    logger_set_async(async);
 }
 
 /**
@@ -293,12 +421,369 @@ void logger_do_print(const char *str)
 #endif
 }
 
+/**
+ * Format the timestamp of a message.
+ * @param cache
+ * Cache of the last formatted timestamp.
+ * @param tv
+ * When the message was logged.
+ * @param buf
+ * Buffer to write the timestamp to.
+ * @param len
+ * Size of the buffer.
+ */
+static void logger_format_time(logger_time_cache_t *cache,
+        const struct timeval *tv, char *buf, size_t len)
+{
+    if (cache->str[0] == '\0' || cache->sec != tv->tv_sec) {
+        time_t sec = tv->tv_sec;
+        struct tm *tm = localtime(&sec);
+
+        if (tm == NULL) {
+            buf[0] = '\0';
+            return;
+        }
+
+        strftime(VS(cache->str), "%Y/%m/%d %H:%M:%S", tm);
+        cache->sec = sec;
+    }
+
+    snprintf(buf, len, "[%s.%06"PRIu64 "] ", cache->str,
+            (uint64_t) tv->tv_usec);
+}
+
+/**
+ * Write out a message to stdout and the log file, according to the
+ * filters.
+ * @param level
+ * Log level of the message.
+ * @param function
+ * Name of the function the message was logged from.
+ * @param line
+ * Line the message was logged from.
+ * @param timebuf
+ * Formatted timestamp.
+ * @param formatted
+ * The message.
+ */
+static void logger_output(logger_level level, const char *function,
+        uint64_t line, const char *timebuf, const char *formatted)
+{
+    char buf[HUGE_BUF * 2];
+
+    if ((1U << level) & logger_filter_stdout) {
+        snprintf(VS(buf), "%s%s%s""%s%-6s%s ""%s[%s:%" PRIu64 "]%s ""%s%s%s\n",
+                LOGGER_ESC_SEQ(BOLD), timebuf, LOGGER_ESC_SEQ(END),
+                LOGGER_ESC_SEQ(RED), logger_names[level], LOGGER_ESC_SEQ(END),
+                LOGGER_ESC_SEQ(CYAN), function, line, LOGGER_ESC_SEQ(END),
+                LOGGER_ESC_SEQ(YELLOW), formatted, LOGGER_ESC_SEQ(END));
+        print_func(buf);
+    }
+
+    if (log_fp != NULL && (1U << level) & logger_filter_logfile) {
+        fprintf(log_fp, "%s%-6s [%s:%"PRIu64 "] %s\n", timebuf,
+                logger_names[level], function, line, formatted);
+    }
+}
+
+/**
+ * Called when a thread that has logged messages in asynchronous mode
+ * exits.
+ * @param ptr
+ * The thread's ring.
+ */
+static void logger_ring_orphan(void *ptr)
+{
+    logger_ring_t *ring = ptr;
+    __atomic_store_n(&ring->orphaned, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get the ring buffer of the current thread, creating it if needed.
+ * @return
+ * The ring.
+ */
+static logger_ring_t *logger_ring_get(void)
+{
+    if (logger_ring_local != NULL &&
+            logger_ring_local_generation == logger_rings_generation) {
+        return logger_ring_local;
+    }
+
+    logger_ring_t *ring = ecalloc(1, sizeof(*ring));
+    ring->buf = emalloc(LOGGER_RING_SIZE);
+
+    pthread_mutex_lock(&logger_mutex);
+    LL_PREPEND(logger_rings, ring);
+    pthread_mutex_unlock(&logger_mutex);
+
+    pthread_setspecific(logger_ring_key, ring);
+    logger_ring_local = ring;
+    logger_ring_local_generation = logger_rings_generation;
+
+    return ring;
+}
+
+/**
+ * Wait until the logger thread has drained the specified ring up to the
+ * specified position.
+ * @param ring
+ * The ring.
+ * @param pos
+ * Position to wait for.
+ */
+static void logger_ring_wait(logger_ring_t *ring, uint64_t pos)
+{
+    pthread_mutex_lock(&logger_mutex);
+
+    while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) < pos) {
+        pthread_cond_signal(&logger_cond);
+        pthread_cond_wait(&logger_drained_cond, &logger_mutex);
+    }
+
+    pthread_mutex_unlock(&logger_mutex);
+}
+
+/**
+ * Push a message into the current thread's ring buffer.
+ * @param level
+ * Log level of the message.
+ * @param function
+ * Name of the function the message was logged from.
+ * @param line
+ * Line the message was logged from.
+ * @param tv
+ * When the message was logged.
+ * @param formatted
+ * The message.
+ */
+static void logger_ring_push(logger_level level, const char *function,
+        uint64_t line, const struct timeval *tv, const char *formatted)
+{
+    logger_ring_t *ring = logger_ring_get();
+    size_t msg_len = strlen(formatted) + 1;
+    size_t len = (sizeof(logger_record_t) + msg_len + 7) & ~(size_t) 7;
+    uint64_t head = ring->head;
+    size_t offset = head & (LOGGER_RING_SIZE - 1);
+    size_t waste = 0;
+
+    /* Records are never split; skip the end of the buffer if needed. */
+    if (LOGGER_RING_SIZE - offset < len) {
+        waste = LOGGER_RING_SIZE - offset;
+    }
+
+    /* If the ring is full, wait for the logger thread to catch up. */
+    if (head + waste + len - __atomic_load_n(&ring->tail,
+            __ATOMIC_ACQUIRE) > LOGGER_RING_SIZE) {
+        logger_ring_wait(ring, head + waste + len - LOGGER_RING_SIZE);
+    }
+
+    if (waste != 0) {
+        if (waste >= sizeof(logger_record_t)) {
+            logger_record_t *pad = (logger_record_t *) (ring->buf + offset);
+            pad->len = waste;
+            pad->level = LOG_MAX;
+        }
+
+        head += waste;
+        offset = 0;
+    }
+
+    logger_record_t *record = (logger_record_t *) (ring->buf + offset);
+    record->len = len;
+    record->level = level;
+    record->line = line;
+    record->function = function;
+    record->tv = *tv;
+    memcpy(record + 1, formatted, msg_len);
+
+    __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+
+    /* Wake up the logger thread early if the ring is filling up. */
+    if (head + len - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >
+            LOGGER_RING_SIZE / 2) {
+        pthread_cond_signal(&logger_cond);
+    }
+}
+
+/**
+ * Drain all the ring buffers. Only called from the logger thread.
+ * @return
+ * Whether any messages were written.
+ */
+static bool logger_drain(void)
+{
+    static logger_time_cache_t time_cache;
+    char timebuf[MAX_BUF * 2];
+    bool did_write = false;
+
+    pthread_mutex_lock(&logger_mutex);
+    logger_ring_t *rings = logger_rings;
+    pthread_mutex_unlock(&logger_mutex);
+
+    /* New rings are only ever prepended and only this thread frees them,
+     * so the list can be walked without holding the lock. */
+    for (logger_ring_t *ring = rings; ring != NULL; ring = ring->next) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = ring->tail;
+
+        while (tail < head) {
+            size_t offset = tail & (LOGGER_RING_SIZE - 1);
+
+            if (LOGGER_RING_SIZE - offset < sizeof(logger_record_t)) {
+                tail += LOGGER_RING_SIZE - offset;
+                continue;
+            }
+
+            logger_record_t *record = (logger_record_t *) (ring->buf + offset);
+
+            if (record->level != LOG_MAX) {
+                logger_format_time(&time_cache, &record->tv, VS(timebuf));
+                logger_output(record->level, record->function, record->line,
+                        timebuf, (const char *) (record + 1));
+                did_write = true;
+            }
+
+            tail += record->len;
+        }
+
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if (did_write && log_fp != NULL) {
+        fflush(log_fp);
+    }
+
+    pthread_mutex_lock(&logger_mutex);
+
+    /* Free the drained rings of threads that have exited. */
+    logger_ring_t *ring, *tmp;
+    LL_FOREACH_SAFE(logger_rings, ring, tmp) {
+        if (__atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE) &&
+                ring->tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+            LL_DELETE(logger_rings, ring);
+            efree(ring->buf);
+            efree(ring);
+        }
+    }
+
+    pthread_cond_broadcast(&logger_drained_cond);
+    pthread_mutex_unlock(&logger_mutex);
+
+    return did_write;
+}
+
+/**
+ * The logger thread.
+ * @param arg
+ * Unused.
+ * @return
+ * NULL.
+ */
+static void *logger_thread_func(void *arg)
+{
+    logger_is_thread = true;
+
+    while (true) {
+        pthread_mutex_lock(&logger_mutex);
+        bool stop = logger_thread_stop;
+        pthread_mutex_unlock(&logger_mutex);
+
+        if (logger_drain()) {
+            continue;
+        }
+
+        if (stop) {
+            break;
+        }
+
+        struct timeval tv;
+        struct timespec ts;
+        gettimeofday(&tv, NULL);
+        ts.tv_sec = tv.tv_sec;
+        ts.tv_nsec = (tv.tv_usec + LOGGER_THREAD_INTERVAL * 1000) * 1000;
+
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+
+        pthread_mutex_lock(&logger_mutex);
+
+        if (!logger_thread_stop) {
+            pthread_cond_timedwait(&logger_cond, &logger_mutex, &ts);
+        }
+
+        pthread_mutex_unlock(&logger_mutex);
+    }
+
+    return NULL;
+}
+
+/**
+ * Enable or disable asynchronous mode. Disabling it writes out all the
+ * pending messages first.
+ * @param async
+ * Whether to enable asynchronous mode.
+ */
+void logger_set_async(bool async)
+{
+    TOOLKIT_PROTECT();
+
+    if (async == logger_async) {
+        return;
+    }
+
+    if (async) {
+        logger_thread_stop = false;
+
+        int rc = pthread_create(&logger_thread, NULL, logger_thread_func,
+                NULL);
+        if (rc != 0) {
+            LOG(ERROR, "Failed to create thread: %s (%d)", strerror(rc), rc);
+            return;
+        }
+
+        logger_async = true;
+        return;
+    }
+
+    logger_async = false;
+
+    pthread_mutex_lock(&logger_mutex);
+    logger_thread_stop = true;
+    pthread_cond_signal(&logger_cond);
+    pthread_mutex_unlock(&logger_mutex);
+
+    pthread_join(logger_thread, NULL);
+}
+
+/**
+ * Wait until all the messages logged by the current thread have been
+ * written out. Does nothing if asynchronous mode is not enabled.
+ */
+void logger_flush(void)
+{
+    TOOLKIT_PROTECT();
+
+    if (!logger_async || logger_ring_local == NULL ||
+            logger_ring_local_generation != logger_rings_generation) {
+        return;
+    }
+
+    logger_ring_wait(logger_ring_local, logger_ring_local->head);
+}
+
 /**
  * Print a message to the console/stdout/log file/etc.
+ *
+ * In asynchronous mode, the message is written out by the logger thread;
+ * errors and bugs are waited for before returning.
  * @param level
  * Log level to use.
  * @param function
- * Name of the function that is calling this.
+ * Name of the function that is calling this. Must stay valid for the
+ * lifetime of the program, like __FUNCTION__.
  * @param line
  * Line in the code that is calling this.
  * @param format
@@ -309,10 +794,9 @@ void logger_do_print(const char *str)
 void logger_print(logger_level level, const char *function, uint64_t line,
         const char *format, ...)
 {
-    char formatted[HUGE_BUF], timebuf[HUGE_BUF], buf[sizeof(formatted) * 2];
+    char formatted[HUGE_BUF], timebuf[MAX_BUF * 2];
     va_list ap;
     struct timeval tv;
-    struct tm *tm;
 
     TOOLKIT_PROTECT();
 
@@ -332,30 +816,22 @@ void logger_print(logger_level level, const char *function, uint64_t line,
     va_end(ap);
 
     gettimeofday(&tv, NULL);
-    tm = localtime(&tv.tv_sec);
 
-    if (tm != NULL) {
-        char timebuf2[MAX_BUF];
+    if (logger_async && !logger_is_thread) {
+        logger_ring_push(level, function, line, &tv, formatted);
 
-        strftime(VS(timebuf2), "%Y/%m/%d %H:%M:%S", tm);
-        snprintf(VS(timebuf), "[%s.%06"PRIu64 "] ", timebuf2,
-                (uint64_t) tv.tv_usec);
-    } else {
-        timebuf[0] = '\0';
-    }
+        if (level == LOG_ERROR || level == LOG_BUG) {
+            logger_flush();
+        }
 
-    if ((1U << level) & logger_filter_stdout) {
-        snprintf(VS(buf), "%s%s%s""%s%-6s%s ""%s[%s:%" PRIu64 "]%s ""%s%s%s\n",
-                LOGGER_ESC_SEQ(BOLD), timebuf, LOGGER_ESC_SEQ(END),
-                LOGGER_ESC_SEQ(RED), logger_names[level], LOGGER_ESC_SEQ(END),
-                LOGGER_ESC_SEQ(CYAN), function, line, LOGGER_ESC_SEQ(END),
-                LOGGER_ESC_SEQ(YELLOW), formatted, LOGGER_ESC_SEQ(END));
-        print_func(buf);
+        return;
     }
 
+    logger_time_cache_t time_cache = {0};
+    logger_format_time(&time_cache, &tv, VS(timebuf));
+    logger_output(level, function, line, timebuf, formatted);
+
     if (log_fp != NULL && (1U << level) & logger_filter_logfile) {
-        fprintf(log_fp, "%s%-6s [%s:%"PRIu64 "] %s\n", timebuf,
-                logger_names[level], function, line, formatted);
         fflush(log_fp);
     }
 }
@@ -78,6 +78,8 @@ void logger_set_print_func(logger_print_func func);
 void logger_do_print(const char *str);
 void logger_print(logger_level level, const char *function, uint64_t line,
         const char *format, ...) __attribute__((format(printf, 4, 5)));
+void logger_set_async(bool async);
+void logger_flush(void);
 void logger_traceback(void);
 
 #endif
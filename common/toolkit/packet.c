@@ -32,9 +32,53 @@
 #include "packet.h"
 #include "string.h"
 #include "mempool.h"
+#include "socket.h"
 
 #include <zlib.h>
 
+/**
+ * Persistent compression stream of a connection.
+ */
+struct packet_compressor {
+    /**
+     * The deflate stream.
+     */
+    z_stream stream;
+};
+
+/**
+ * Immutable data shared between multiple packets.
+ */
+struct packet_shared {
+    /**
+     * The data.
+     */
+    uint8_t *data;
+
+    /**
+     * Length of 'data'.
+     */
+    size_t len;
+
+    /**
+     * Number of packets referencing the data.
+     */
+    uint32_t refcount;
+
+    /**
+     * The data compressed by packet_precompress(), shared by all the
+     * packets referencing this data. NULL if the data has not been
+     * compressed yet.
+     */
+    struct packet_shared *compressed;
+
+    /**
+     * Whether the data does not compress, or must not be compressed
+     * again.
+     */
+    bool incompressible;
+};
+
 /**
  * The packets memory pool.
  */
@@ -79,6 +123,108 @@ static void packet_debugger(packet_struct *packet, char *buf, size_t size)
     }
 }
 
+/**
+ * Create shared packet data, referenced once.
+ * @param data
+ * The data; the shared data takes ownership of it.
+ * @param len
+ * Length of the data.
+ * @return
+ * The shared data.
+ */
+static struct packet_shared *packet_shared_create(uint8_t *data, size_t len)
+{
+    struct packet_shared *shared = ecalloc(1, sizeof(*shared));
+    shared->data = data;
+    shared->len = len;
+    shared->refcount = 1;
+    return shared;
+}
+
+/**
+ * Drop a reference to shared packet data, freeing it once it is no longer
+ * referenced.
+ * @param shared
+ * The shared data.
+ */
+static void packet_shared_release(struct packet_shared *shared)
+{
+    HARD_ASSERT(shared->refcount != 0);
+
+    if (--shared->refcount != 0) {
+        return;
+    }
+
+    if (shared->compressed != NULL) {
+        packet_shared_release(shared->compressed);
+    }
+
+    if (shared->data != NULL) {
+        efree(shared->data);
+    }
+
+    efree(shared);
+}
+
+/**
+ * Make a packet reference the specified shared data.
+ * @param packet
+ * The packet; must not have any data.
+ * @param shared
+ * The shared data.
+ */
+static void packet_shared_attach(packet_struct *packet,
+        struct packet_shared *shared)
+{
+    HARD_ASSERT(packet->data == NULL);
+
+    shared->refcount++;
+    packet->shared = shared;
+    packet->data = shared->data;
+    packet->len = packet->size = shared->len;
+}
+
+/**
+ * Free the packet's data, or drop its reference to the shared data.
+ * @param packet
+ * The packet.
+ */
+static void packet_data_free(packet_struct *packet)
+{
+    if (packet->shared != NULL) {
+        packet_shared_release(packet->shared);
+        packet->shared = NULL;
+    } else if (packet->data != NULL) {
+        efree(packet->data);
+    }
+
+    packet->data = NULL;
+}
+
+/**
+ * Give the packet a private copy of its data if it references shared
+ * data, so that the data can be modified.
+ * @param packet
+ * The packet.
+ */
+static void packet_unshare(packet_struct *packet)
+{
+    if (packet->shared == NULL) {
+        return;
+    }
+
+    uint8_t *data = NULL;
+
+    if (packet->len != 0) {
+        data = emalloc(packet->len);
+        memcpy(data, packet->data, packet->len);
+    }
+
+    packet_data_free(packet);
+    packet->data = data;
+    packet->size = packet->len;
+}
+
 /**
  * Allocates a new packet.
  * @param type
@@ -125,9 +271,7 @@ void packet_free(packet_struct *packet)
 {
     TOOLKIT_PROTECT();
 
-    if (packet->data) {
-        efree(packet->data);
-    }
+    packet_data_free(packet);
 
 #ifndef NDEBUG
     if (packet->sb != NULL) {
@@ -138,6 +282,133 @@ void packet_free(packet_struct *packet)
     mempool_return(pool_packet, packet);
 }
 
+/**
+ * Make the packet's data shared, if it isn't already.
+ * @param packet
+ * The packet.
+ */
+static void packet_make_shared(packet_struct *packet)
+{
+    if (packet->shared != NULL && packet->len != packet->shared->len) {
+        /* The packet's length was changed since it was shared. */
+        packet_unshare(packet);
+    }
+
+    if (packet->shared == NULL) {
+        packet->shared = packet_shared_create(packet->data, packet->len);
+        packet->size = packet->len;
+    }
+}
+
+/**
+ * Compress data into the format of a ::CLIENT_CMD_COMPRESSED packet.
+ * @param type
+ * Command type of the packet the data is from.
+ * @param data
+ * The data to compress.
+ * @param len
+ * Length of the data.
+ * @param[out] new_len
+ * Will contain length of the compressed data.
+ * @return
+ * The compressed data, NULL if it would not be any smaller.
+ */
+static uint8_t *packet_compress_data(uint8_t type, const uint8_t *data,
+        size_t len, size_t *new_len)
+{
+    uLong new_size = compressBound(len);
+    uint8_t *dest = emalloc(new_size + 5);
+    dest[0] = type;
+    /* Add original length of the packet. */
+    dest[1] = (len >> 24) & 0xff;
+    dest[2] = (len >> 16) & 0xff;
+    dest[3] = (len >> 8) & 0xff;
+    dest[4] = (len) & 0xff;
+    /* Compress it. */
+    compress2((Bytef *) dest + 5,
+              &new_size,
+              (const unsigned char FAR *) data,
+              len,
+              Z_BEST_COMPRESSION);
+
+    if (new_size + 5 >= len) {
+        efree(dest);
+        return NULL;
+    }
+
+    *new_len = new_size + 5;
+    return dest;
+}
+
+/**
+ * Compress the packet's data once, so that all the packets sharing it
+ * (see packet_share()) can be sent compressed without compressing it
+ * again. Both the raw data and the compressed variant are kept.
+ *
+ * Intended for static data that is sent many times, such as faces; it's
+ * done even if COMPRESS_DATA_PACKETS is disabled.
+ * @param packet
+ * The packet.
+ */
+void packet_precompress(packet_struct *packet)
+{
+    TOOLKIT_PROTECT();
+    HARD_ASSERT(packet != NULL);
+
+    packet_make_shared(packet);
+
+    struct packet_shared *shared = packet->shared;
+
+    if (shared->compressed != NULL || shared->incompressible) {
+        return;
+    }
+
+    size_t new_len;
+    uint8_t *dest = packet_compress_data(packet->type, shared->data,
+            shared->len, &new_len);
+
+    if (dest == NULL) {
+        shared->incompressible = true;
+        return;
+    }
+
+    shared->compressed = packet_shared_create(dest, new_len);
+    /* Already compressed, no point in trying again. */
+    shared->compressed->incompressible = true;
+}
+
+/**
+ * Use the result of packet_precompress() for the packet, if its data was
+ * precompressed: the packet is switched to the compressed data, unless the
+ * data did not compress.
+ * @param packet
+ * The packet.
+ * @return
+ * True if the packet's data was precompressed and should not be
+ * compressed again, false otherwise.
+ */
+bool packet_compress_cached(packet_struct *packet)
+{
+    TOOLKIT_PROTECT();
+    HARD_ASSERT(packet != NULL);
+
+    struct packet_shared *shared = packet->shared;
+
+    if (shared == NULL || packet->len != shared->len) {
+        return false;
+    }
+
+    if (shared->compressed != NULL) {
+        packet->data = NULL;
+        packet_shared_attach(packet, shared->compressed);
+        packet_shared_release(shared);
+        packet->type = CLIENT_CMD_COMPRESSED;
+        return true;
+    }
+
+    return shared->incompressible;
+}
+
 /**
  * Compress a data packet, if possible.
  * @param packet
@@ -148,36 +419,138 @@ void packet_compress(packet_struct *packet)
     TOOLKIT_PROTECT();
     HARD_ASSERT(packet != NULL);
 
+    if (packet_compress_cached(packet)) {
+        return;
+    }
+
 #if defined(COMPRESS_DATA_PACKETS) && COMPRESS_DATA_PACKETS
     if (packet->len <= COMPRESS_DATA_PACKETS_SIZE) {
         return;
     }
 
-    size_t new_size = compressBound(packet->len);
-    uint8_t *dest = emalloc(new_size + 5);
+    /* Keep the compressed data for the other packets sharing it. */
+    if (packet->shared != NULL) {
+        packet_precompress(packet);
+        packet_compress_cached(packet);
+        return;
+    }
+
+    size_t new_len;
+    uint8_t *dest = packet_compress_data(packet->type, packet->data,
+            packet->len, &new_len);
+
+    if (dest == NULL) {
+        return;
+    }
+
+    efree(packet->data);
+    packet->data = dest;
+    packet->size = packet->len = new_len;
+    packet->type = CLIENT_CMD_COMPRESSED;
+#endif
+}
+
+/**
+ * Create a persistent compression stream for packets sent over a single
+ * connection.
+ * @param level
+ * Compression level, 1-9.
+ * @return
+ * The compressor, NULL on failure.
+ */
+packet_compressor_t *packet_compressor_create(int level)
+{
+    TOOLKIT_PROTECT();
+
+    packet_compressor_t *compressor = ecalloc(1, sizeof(*compressor));
+
+    if (deflateInit(&compressor->stream, level) != Z_OK) {
+        LOG(ERROR, "deflateInit() failed: %s",
+                compressor->stream.msg != NULL ? compressor->stream.msg :
+                "unknown error");
+        efree(compressor);
+        return NULL;
+    }
+
+    return compressor;
+}
+
+/**
+ * Free a compressor created with packet_compressor_create().
+ * @param compressor
+ * Compressor to free.
+ */
+void packet_compressor_free(packet_compressor_t *compressor)
+{
+    TOOLKIT_PROTECT();
+    HARD_ASSERT(compressor != NULL);
+
+    deflateEnd(&compressor->stream);
+    efree(compressor);
+}
+
+/**
+ * Compress a data packet using the specified persistent compression
+ * stream. Unlike packet_compress(), the compression context is kept
+ * between packets, so small packets that repeat earlier data compress
+ * well. The stream is flushed after each packet, so the receiver can
+ * decompress it right away.
+ *
+ * Once a packet is compressed, it must be sent, as the receiver's
+ * decompression stream must see every compressed packet in order.
+ * @param packet
+ * Packet to compress.
+ * @param compressor
+ * Compressor to use.
+ */
+void packet_compress_stream(packet_struct *packet,
+        packet_compressor_t *compressor)
+{
+    TOOLKIT_PROTECT();
+    HARD_ASSERT(packet != NULL);
+    HARD_ASSERT(compressor != NULL);
+
+    if (packet->len <= PACKET_COMPRESS_STREAM_SIZE) {
+        return;
+    }
+
+    z_stream *stream = &compressor->stream;
+    /* deflateBound() does not account for the flush marker. */
+    size_t size = deflateBound(stream, packet->len) + 16;
+    uint8_t *dest = emalloc(size + 5);
     dest[0] = packet->type;
     /* Add original length of the packet. */
     dest[1] = (packet->len >> 24) & 0xff;
     dest[2] = (packet->len >> 16) & 0xff;
     dest[3] = (packet->len >> 8) & 0xff;
     dest[4] = (packet->len) & 0xff;
-    /* Compress it. */
-    compress2((Bytef *) dest + 5,
-              (uLong *) &new_size,
-              (const unsigned char FAR *) packet->data,
-              packet->len,
-              Z_BEST_COMPRESSION);
 
-    if (new_size >= packet->len) {
-        efree(dest);
-        return;
+    stream->next_in = packet->data;
+    stream->avail_in = packet->len;
+    stream->next_out = dest + 5;
+    stream->avail_out = size;
+
+    while (true) {
+        int ret = deflate(stream, Z_SYNC_FLUSH);
+        HARD_ASSERT(ret == Z_OK || ret == Z_BUF_ERROR);
+
+        /* Everything was flushed out if there's room to spare. */
+        if (stream->avail_out != 0) {
+            break;
+        }
+
+        size_t done = size - stream->avail_out;
+        size *= 2;
+        dest = erealloc(dest, size + 5);
+        stream->next_out = dest + 5 + done;
+        stream->avail_out = size - done;
     }
 
-    efree(packet->data);
+    packet_data_free(packet);
     packet->data = dest;
-    packet->size = packet->len = new_size + 5;
-    packet->type = CLIENT_CMD_COMPRESSED;
-#endif
+    packet->len = size - stream->avail_out + 5;
+    packet->size = size + 5;
+    packet->type = CLIENT_CMD_COMPRESSED_STREAM;
 }
 
 /**
@@ -217,10 +590,38 @@ packet_struct *packet_dup(packet_struct *packet)
     return cp;
 }
 
+/**
+ * Create a packet that shares the data of the specified packet, without
+ * copying it. Used to send the same data to many sockets.
+ *
+ * After this, the data of both packets is immutable: modifying either
+ * packet (appending to it, for example) makes a private copy of the data
+ * first.
+ * @param packet
+ * The packet to share.
+ * @return
+ * New packet referencing the same data.
+ */
+packet_struct *packet_share(packet_struct *packet)
+{
+    TOOLKIT_PROTECT();
+    HARD_ASSERT(packet != NULL);
+
+    packet_make_shared(packet);
+
+    packet_struct *cp = packet_new(packet->type, 0, packet->expand);
+    cp->ndelay = packet->ndelay;
+    packet_shared_attach(cp, packet->shared);
+
+    return cp;
+}
+
 void packet_delete(packet_struct *packet, size_t pos, size_t len)
 {
     TOOLKIT_PROTECT();
 
+    packet_unshare(packet);
+
     if (len > packet->len - pos) {
         return;
     }
@@ -264,10 +665,12 @@ void packet_load(packet_struct *packet, const packet_save_t *packet_save_buf)
  * @param size
  * How many bytes we need.
  */
-static void packet_ensure(packet_struct *packet, size_t size)
+void packet_ensure(packet_struct *packet, size_t size)
 {
     TOOLKIT_PROTECT();
 
+    packet_unshare(packet);
+
     if (packet->len + size < packet->size) {
         return;
     }
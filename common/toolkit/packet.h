@@ -36,6 +36,13 @@
 #include "stringbuffer_dec.h"
 #include "packet_dec.h"
 
+/**
+ * Only packets longer than this are compressed by packet_compress_stream().
+ * Shorter ones would not get any smaller due to the compressed packet
+ * header and the flush marker.
+ */
+#define PACKET_COMPRESS_STREAM_SIZE 32
+
 /**
  * A single data packet.
  */
@@ -85,6 +92,13 @@ struct packet_struct {
      */
     uint8_t type;
 
+    /**
+     * Data shared with other packets, created by packet_share(). If set,
+     * 'data' points to the shared data, which must not be modified; the
+     * packet makes a private copy of it before it's modified.
+     */
+    struct packet_shared *shared;
+
 #ifndef NDEBUG
     /**
      * StringBuffer instance used to describe the packet contents.
@@ -136,12 +150,20 @@ TOOLKIT_FUNCS_DECLARE(packet);
 void toolkit_packet_deinit(void);
 packet_struct *packet_new(uint8_t type, size_t size, size_t expand);
 void packet_free(packet_struct *packet);
+void packet_precompress(packet_struct *packet);
+bool packet_compress_cached(packet_struct *packet);
 void packet_compress(packet_struct *packet);
+packet_compressor_t *packet_compressor_create(int level);
+void packet_compressor_free(packet_compressor_t *compressor);
+void packet_compress_stream(packet_struct *packet,
+        packet_compressor_t *compressor);
 void packet_enable_ndelay(packet_struct *packet);
 void packet_set_pos(packet_struct *packet, size_t pos);
 size_t packet_get_pos(packet_struct *packet);
 packet_struct *packet_dup(packet_struct *packet);
+packet_struct *packet_share(packet_struct *packet);
 void packet_delete(packet_struct *packet, size_t pos, size_t len);
+void packet_ensure(packet_struct *packet, size_t size);
 void packet_save(packet_struct *packet, packet_save_t *packet_save_buf);
 void packet_load(packet_struct *packet, const packet_save_t *packet_save_buf);
 char *packet_get_debug(packet_struct *packet);
@@ -33,6 +33,7 @@
 #define TOOLKIT_PACKET_DEC_H
 
 typedef struct packet_struct packet_struct;
+typedef struct packet_compressor packet_compressor_t;
 
 
 #endif
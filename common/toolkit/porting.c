@@ -437,4 +437,24 @@ _sincos (double x, double *s, double *c)
 }
 #endif
 
+#ifndef HAVE_FSYNC
+#ifdef WIN32
+#include <io.h>
+#endif
+
+/**
+ * Flushes a file's data to disk; uses _commit() on Windows.
+ */
+int
+_fsync (int fd)
+{
+#ifdef WIN32
+    return _commit(fd);
+#else
+    (void) fd;
+    return 0;
+#endif
+}
+#endif
+
 #endif
@@ -102,6 +102,11 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
 #endif
 
 #ifdef HAVE_DIRENT_H
@@ -161,6 +166,12 @@
 #endif
 
 #undef X509_NAME
+
+/* Scatter/gather buffer used by socket_writev(). */
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
 #endif
 
 #define GETTIMEOFDAY(last_time) gettimeofday(last_time, NULL);
@@ -333,4 +344,10 @@ extern void _sincos(double x, double *s, double *c);
 #define sincos _sincos
 #endif
 
+#ifndef HAVE_FSYNC
+extern int _fsync(int fd);
+#undef fsync
+#define fsync _fsync
+#endif
+
 #endif
@@ -32,7 +32,13 @@
 #include "string.h"
 
 /** Hash table to store our strings. */
-static shared_string *hash_table[TABLESIZE];
+static shared_string **hash_table;
+
+/** Number of buckets in ::hash_table; always a power of two. */
+static size_t hash_table_size;
+
+/** Number of strings in ::hash_table. */
+static size_t hash_table_num;
 
 static struct statistics {
     uint32_t calls;
@@ -42,11 +48,16 @@ static struct statistics {
     uint32_t linked;
 } add_stats, add_ref_stats, free_stats, find_stats, hash_stats;
 
-TOOLKIT_API(DEPENDS(logger));
+/** Number of times ::hash_table was resized. */
+static uint32_t hash_table_resizes;
+
+TOOLKIT_API(DEPENDS(logger), DEPENDS(memory));
 
 TOOLKIT_INIT_FUNC(shstr)
 {
-    memset(hash_table, 0, TABLESIZE * sizeof(shared_string *));
+    hash_table_size = SHSTR_TABLE_SIZE_MIN;
+    hash_table_num = 0;
+    hash_table = ecalloc(hash_table_size, sizeof(*hash_table));
 }
 TOOLKIT_INIT_FUNC_FINISH
 
@@ -55,45 +66,140 @@ TOOLKIT_DEINIT_FUNC(shstr)
     size_t i;
     shared_string *ss;
 
-    for (i = 0; i < TABLESIZE; i++) {
+    for (i = 0; i < hash_table_size; i++) {
         for (ss = hash_table[i]; ss != NULL; ss = ss->next) {
             LOG(ERROR, "String still has %lu references: '%s'",
-                    ss->refcount & ~TOPBIT, ss->string);
+                    ss->refcount, ss->string);
         }
     }
+
+    efree(hash_table);
+    hash_table = NULL;
 }
 TOOLKIT_DEINIT_FUNC_FINISH
 
 /**
- * Hashing function used by the shared string library.
+ * Hashing function used by the shared string library; 32-bit FNV-1a over
+ * the whole string, which also computes the string's length.
  *
  * @param str
  * String to hash.
+ * @param[out] len
+ * Will contain length of the string.
  * @return
- * Hash of string, suitable for use in ::hash_table.
+ * Hash of string.
  */
-static unsigned long
-hashstr (const char *str)
+static uint32_t
+hashstr (const char *str, size_t *len)
 {
-    unsigned long hash = 0;
-    int i = 0;
-    unsigned int rot = 0;
-    const char *p;
+    uint32_t hash = 2166136261U;
+    const unsigned char *p;
 
     TOOLKIT_PROTECT();
 
     hash_stats.calls++;
 
-    for (p = str; i < MAXSTRING && *p; p++, i++) {
-        hash ^= (unsigned long) *p << rot;
-        rot += 2;
+    for (p = (const unsigned char *) str; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 16777619U;
+    }
+
+    *len = (const char *) p - str;
+
+    return hash;
+}
+
+/**
+ * Get the bucket of ::hash_table for the specified hash.
+ *
+ * @param hash
+ * The hash.
+ * @return
+ * Pointer to the bucket.
+ */
+static inline shared_string **
+hash_table_bucket (uint32_t hash)
+{
+    return &hash_table[hash & (hash_table_size - 1)];
+}
+
+/**
+ * Double the size of ::hash_table, re-linking the strings into the new
+ * buckets using their stored hashes.
+ */
+static void
+hash_table_grow (void)
+{
+    shared_string **old_table = hash_table;
+    size_t old_size = hash_table_size;
+
+    hash_table_size *= 2;
+    hash_table = ecalloc(hash_table_size, sizeof(*hash_table));
+    hash_table_resizes++;
+
+    for (size_t i = 0; i < old_size; i++) {
+        shared_string *ss, *next;
+
+        for (ss = old_table[i]; ss != NULL; ss = next) {
+            shared_string **bucket = hash_table_bucket(ss->hash);
+            next = ss->next;
+            ss->next = *bucket;
+            *bucket = ss;
+        }
+    }
+
+    efree(old_table);
+}
+
+/**
+ * Look for a string in its ::hash_table bucket.
+ *
+ * @param str
+ * String to look for.
+ * @param len
+ * Length of the string.
+ * @param hash
+ * Hash of the string.
+ * @param stats
+ * Statistics to update.
+ * @return
+ * The shared string, NULL if not found.
+ */
+static shared_string *
+hash_table_find (const char *str, size_t len, uint32_t hash,
+                 struct statistics *stats)
+{
+    shared_string *ss;
+
+    for (ss = *hash_table_bucket(hash); ss != NULL; ss = ss->next) {
+        /* Simple case first: see if the pointer matches. */
+        if (ss->string == str) {
+            break;
+        }
+
+        if (ss->hash != hash || ss->len != len) {
+            stats->search++;
+            continue;
+        }
+
+        stats->strcmps++;
+
+        if (memcmp(ss->string, str, len) == 0) {
+            break;
+        }
+
+        stats->search++;
+    }
 
-        if (rot >= (sizeof(unsigned long) - sizeof(char)) * CHAR_BIT) {
-            rot = 0;
+    if (ss != NULL) {
+        if (ss == *hash_table_bucket(hash)) {
+            stats->hashed++;
+        } else {
+            stats->linked++;
         }
     }
 
-    return (hash % TABLESIZE);
+    return ss;
 }
 
 /**
@@ -101,27 +207,29 @@ hashstr (const char *str)
  * the string str.
  * @param str
  * String to store.
+ * @param len
+ * Length of the string.
+ * @param hash
+ * Hash of the string.
  * @return
  * Sharing structure.
  */
 static shared_string *
-new_shared_string (const char *str)
+new_shared_string (const char *str, size_t len, uint32_t hash)
 {
     shared_string *ss;
-    size_t n = strlen(str);
 
     TOOLKIT_PROTECT();
 
-    /* Allocate room for a struct which can hold str. Note
-     * that some bytes for the string are already allocated in the
-     * shared_string struct. */
-    ss = emalloc(sizeof(shared_string) - PADDING + n + 1);
+    HARD_ASSERT(len <= UINT32_MAX);
 
-    ss->u.previous = NULL;
+    ss = emalloc(sizeof(shared_string) + len + 1);
     ss->next = NULL;
     ss->refcount = 1;
-    memcpy(ss->string, str, n);
-    ss->string[n] = '\0';
+    ss->hash = hash;
+    ss->len = len;
+    memcpy(ss->string, str, len);
+    ss->string[len] = '\0';
 
     return ss;
 }
@@ -129,79 +237,35 @@ new_shared_string (const char *str)
 shstr *
 add_string (const char *str)
 {
-    shared_string *ss;
-    unsigned long ind;
+    shared_string *ss, **bucket;
+    size_t len;
+    uint32_t hash;
 
     TOOLKIT_PROTECT();
 
     add_stats.calls++;
 
-    ind = hashstr(str);
-    ss = hash_table[ind];
-
-    /* Is there an entry for that hash? */
-    if (ss) {
-        /* Simple case first: See if the first pointer matches. */
-        if (str != ss->string) {
-            add_stats.strcmps++;
-
-            if (strcmp(ss->string, str)) {
-                /* Apparently, a string with the same hash value has this
-                 * slot. We must see in the list if "str" has been
-                 * registered earlier. */
-                while (ss->next) {
-                    add_stats.search++;
-                    ss = ss->next;
-
-                    if (ss->string != str) {
-                        add_stats.strcmps++;
-
-                        if (strcmp(ss->string, str)) {
-                            /* This wasn't the right string... */
-                            continue;
-                        }
-                    }
-
-                    /* We found an entry for this string. Fix the
-                     * refcount and exit. */
-                    add_stats.linked++;
-                    ++(ss->refcount);
-
-                    return ss->string;
-                }
-
-                /* There are no occurrences of this string in the hash table. */
-                {
-                    shared_string *new_ss;
-
-                    add_stats.linked++;
-                    new_ss = new_shared_string(str);
-                    ss->next = new_ss;
-                    new_ss->u.previous = ss;
-
-                    return new_ss->string;
-                }
-            }
-
-            /* Fall through. */
-        }
+    hash = hashstr(str, &len);
+    ss = hash_table_find(str, len, hash, &add_stats);
 
-        add_stats.hashed++;
+    if (ss != NULL) {
         ++(ss->refcount);
-
         return ss->string;
-    } else {
-        /* The string isn't registered, and the slot is empty. */
+    }
 
-        add_stats.hashed++;
-        hash_table[ind] = new_shared_string(str);
+    /* The string isn't registered yet. */
+    if ((hash_table_num + 1) * 100 >
+        hash_table_size * SHSTR_TABLE_LOAD_FACTOR) {
+        hash_table_grow();
+    }
 
-        /* One bit in refcount is used to keep track of the union. */
-        hash_table[ind]->refcount |= TOPBIT;
-        hash_table[ind]->u.array = &(hash_table[ind]);
+    ss = new_shared_string(str, len, hash);
+    bucket = hash_table_bucket(hash);
+    ss->next = *bucket;
+    *bucket = ss;
+    hash_table_num++;
 
-        return hash_table[ind]->string;
-    }
+    return ss->string;
 }
 
 shstr *
@@ -218,89 +282,80 @@ int
 query_refcount (shstr *str)
 {
     TOOLKIT_PROTECT();
-    return SS(str)->refcount & ~TOPBIT;
+    return SS(str)->refcount;
 }
 
 shstr *
 find_string (const char *str)
 {
     shared_string *ss;
-    unsigned long ind;
+    size_t len;
+    uint32_t hash;
 
     TOOLKIT_PROTECT();
 
     find_stats.calls++;
 
-    ind = hashstr(str);
-    ss = hash_table[ind];
-
-    /* Is there an entry for that hash? */
-    if (ss) {
-        /* Simple case first: Is the first string the right one? */
-        find_stats.strcmps++;
+    hash = hashstr(str, &len);
+    ss = hash_table_find(str, len, hash, &find_stats);
 
-        if (!strcmp(ss->string, str)) {
-            find_stats.hashed++;
-            return ss->string;
-        } else {
-            /* Recurse through the linked list, if there's one. */
-            while (ss->next) {
-                find_stats.search++;
-                find_stats.strcmps++;
-                ss = ss->next;
-
-                if (!strcmp(ss->string, str)) {
-                    find_stats.linked++;
-                    return ss->string;
-                }
-            }
-
-            /* No match. Fall through. */
-        }
-    }
-
-    return NULL;
+    return ss != NULL ? ss->string : NULL;
 }
 
 void
 free_string_shared (shstr *str)
 {
-    shared_string *ss;
+    shared_string *ss, **bucket;
 
     TOOLKIT_PROTECT();
 
     free_stats.calls++;
     ss = SS(str);
 
-    if ((--ss->refcount & ~TOPBIT) == 0) {
-        /* Remove this entry. */
-        if (ss->refcount & TOPBIT) {
-            /* We must put a new value into the hash_table[]. */
-            if (ss->next) {
-                *(ss->u.array) = ss->next;
-                ss->next->u.array = ss->u.array;
-                ss->next->refcount |= TOPBIT;
-            } else {
-                *(ss->u.array) = NULL;
-            }
-
-            efree(ss);
-        } else {
-            /* Relink and free this struct. */
-            if (ss->next) {
-                ss->next->u.previous = ss->u.previous;
-            }
+    if (--ss->refcount != 0) {
+        return;
+    }
 
-            ss->u.previous->next = ss->next;
-            efree(ss);
-        }
+    /* Unlink the entry from its bucket. */
+    for (bucket = hash_table_bucket(ss->hash); *bucket != ss;
+         bucket = &(*bucket)->next) {
+        HARD_ASSERT(*bucket != NULL);
     }
+
+    *bucket = ss->next;
+    hash_table_num--;
+    efree(ss);
 }
 
 void
 shstr_stats (char *buf, size_t size)
 {
+    size_t used = 0, chain_max = 0;
+
+    for (size_t i = 0; i < hash_table_size; i++) {
+        size_t chain = 0;
+
+        for (shared_string *ss = hash_table[i]; ss != NULL; ss = ss->next) {
+            chain++;
+        }
+
+        if (chain != 0) {
+            used++;
+        }
+
+        chain_max = MAX(chain_max, chain);
+    }
+
     snprintfcat(buf, size, "\n=== SHSTR ===\n");
+    snprintfcat(buf, size, "\n%-13s %" PRIu64 "\n", "strings:",
+                (uint64_t) hash_table_num);
+    snprintfcat(buf, size, "%-13s %" PRIu64 " (%" PRIu64 " used, %u resizes)\n",
+                "buckets:", (uint64_t) hash_table_size, (uint64_t) used,
+                hash_table_resizes);
+    snprintfcat(buf, size, "%-13s %.2f\n", "load factor:",
+                (double) hash_table_num / hash_table_size);
+    snprintfcat(buf, size, "%-13s %" PRIu64 "\n", "longest chain:",
+                (uint64_t) chain_max);
     snprintfcat(buf, size, "\n%-13s %6s %6s %6s %6s %6s\n", "", "calls",
             "hashed", "strcmp", "search", "linked");
     snprintfcat(buf, size, "%-13s %6d %6d %6d %6d %6d\n", "add_string:",
@@ -38,9 +38,16 @@
 typedef const char shstr;
 
 /**
- * The size of the shared strings hashtable.
+ * Initial number of buckets in the shared strings hashtable; must be a
+ * power of two.
  */
-#define TABLESIZE 8266
+#define SHSTR_TABLE_SIZE_MIN 8192
+
+/**
+ * The shared strings hashtable is doubled in size once the number of
+ * strings exceeds this percentage of its buckets.
+ */
+#define SHSTR_TABLE_LOAD_FACTOR 75
 
 /*
  * This will make the shared string interface more secure by checking for
@@ -50,19 +57,8 @@ typedef const char shstr;
 /*#define SECURE_SHSTR_HASH*/
 
 /**
- * This specifies how many characters the hashing routine should look at.
- * You may actually save CPU by increasing this number if the typical string
- * is large.
- */
-#ifndef MAXSTRING
-#define MAXSTRING 20
-#endif
-
-/**
- * In the unlikely occurrence that 16383 references to a string are too
+ * In the unlikely occurrence that the references to a string are too
  * few, you can modify the below type to something bigger.
- * (The top bit of "refcount" is used to signify that "u.array" points
- * at the array entry.)
  */
 #define REFCOUNT_TYPE long
 
@@ -78,39 +74,24 @@ typedef const char shstr;
  */
 #define SS(x) ((shared_string *) ((x) - offsetof(shared_string, string)))
 
-#define SS_DUMP_TABLE   1
-#define SS_DUMP_TOTALS  2
-
-#define TOPBIT ((unsigned REFCOUNT_TYPE) 1 << (sizeof(REFCOUNT_TYPE) * CHAR_BIT - 1))
-
-#define PADDING ((2 * sizeof(long) - sizeof(REFCOUNT_TYPE)) % sizeof(long)) + 1
-
 /**
  * One actual shared string.
  */
 typedef struct _shared_string {
-
-    union {
-        struct _shared_string **array;
-
-        struct _shared_string *previous;
-    } u;
-
-    /** Next shared string. */
+    /** Next shared string in the same hashtable bucket. */
     struct _shared_string *next;
 
-    /**
-     * The top bit of "refcount" is used to signify that "u.array" points
-     * at the array entry.
-     */
+    /** Number of references to the string. */
     unsigned REFCOUNT_TYPE refcount;
 
-    /**
-     * Padding will be unused memory, since we can't know how large the
-     * padding when allocating memory. We assume here that sizeof(long)
-     * is a good boundary.
-     */
-    char string[PADDING];
+    /** Hash of the string, so that it doesn't need to be recomputed. */
+    uint32_t hash;
+
+    /** Length of the string. */
+    uint32_t len;
+
+    /** The string itself. */
+    char string[];
 } shared_string;
 
 /**
@@ -232,6 +213,21 @@ add_string(const char *str);
 extern shstr *
 add_refcount(shstr *str);
 
+/**
+ * Get the length of a shared string, without having to compute it.
+ *
+ * @param str
+ * String which <b>must</b> have been returned from a previous
+ * add_string().
+ * @return
+ * Length of the string.
+ */
+static inline size_t
+shstr_len (shstr *str)
+{
+    return SS(str)->len;
+}
+
 /**
  * This will return the refcount of the string str.
  *
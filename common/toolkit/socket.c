@@ -591,6 +591,69 @@ bool socket_write(socket_t *sc, const void *buf, size_t len, size_t *amt)
     return true;
 }
 
+/**
+ * Write data gathered from multiple buffers to the socket, using a single
+ * system call where possible.
+ * @param sc
+ * Socket to write to.
+ * @param iov
+ * Buffers to write.
+ * @param iovcnt
+ * Number of buffers in 'iov'.
+ * @param amt
+ * Total amount of bytes written.
+ * @return
+ * True on success, false if there was an error and the connection
+ * should be closed.
+ */
+bool socket_writev(socket_t *sc, const struct iovec *iov, int iovcnt,
+        size_t *amt)
+{
+    HARD_ASSERT(sc != NULL);
+    HARD_ASSERT(iov != NULL);
+    HARD_ASSERT(amt != NULL);
+
+    SOFT_ASSERT_RC(sc->handle != -1, false, "Invalid socket file handle");
+    SOFT_ASSERT_RC(iovcnt > 0, true, "Sending zero buffers");
+
+    *amt = 0;
+
+#ifdef WIN32
+    for (int i = 0; i < iovcnt; i++) {
+        size_t written;
+        if (!socket_write(sc, iov[i].iov_base, iov[i].iov_len, &written)) {
+            return false;
+        }
+
+        *amt += written;
+
+        if (written != iov[i].iov_len) {
+            break;
+        }
+    }
+#else
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *) iov;
+    msg.msg_iovlen = iovcnt;
+
+    ssize_t ret = sendmsg(sc->handle, &msg, 0);
+    if (ret == -1) {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        }
+
+        LOG(INFO, "Error writing to %s: %s (%d)", socket_get_str(sc),
+                strerror(errno), errno);
+        return false;
+    }
+
+    *amt = (size_t) ret;
+#endif
+
+    return true;
+}
+
 /**
  * Checks if socket's file descriptor is valid.
  * @param sc
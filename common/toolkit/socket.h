@@ -100,6 +100,7 @@ enum {
     CLIENT_CMD_INTERFACE,
     CLIENT_CMD_NOTIFICATION,
     CLIENT_CMD_KEEPALIVE,
+    CLIENT_CMD_COMPRESSED_STREAM,
 
     CLIENT_CMD_NROF
 };
@@ -205,6 +206,11 @@ typedef enum socket_role {
 #define CMD_SETUP_BOT 2
 /** URL of the data files to use. */
 #define CMD_SETUP_DATA_URL 3
+/**
+ * Enable/disable streaming compression of the data packets. Requires
+ * socket version 1067 on both sides.
+ */
+#define CMD_SETUP_COMPRESSION 4
 /*@}*/
 
 /**
@@ -888,6 +894,8 @@ bool socket_bind(socket_t *sc);
 socket_t *socket_accept(socket_t *sc);
 bool socket_read(socket_t *sc, void *buf, size_t len, size_t *amt);
 bool socket_write(socket_t *sc, const void *buf, size_t len, size_t *amt);
+bool socket_writev(socket_t *sc, const struct iovec *iov, int iovcnt,
+        size_t *amt);
 bool socket_is_fd_valid(socket_t *sc);
 bool socket_opt_linger(socket_t *sc, bool enable, unsigned short linger);
 bool socket_opt_reuse_addr(socket_t *sc, bool enable);
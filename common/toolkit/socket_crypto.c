@@ -58,13 +58,23 @@ struct socket_crypto {
     socket_t *sc; ///< Socket this was created for.
     unsigned char *key; ///< The secret key.
     uint8_t key_len; ///< Length of the secret key.
-    EVP_CIPHER_CTX *cipher_ctx; ///< Cipher context used for AES.
+    /**
+     * Cipher context used for AES encryption. The cipher and the key are
+     * set up once, only the IV is reset for every packet.
+     */
+    EVP_CIPHER_CTX *cipher_ctx;
+    /**
+     * Cipher context used for AES decryption; see ::cipher_ctx.
+     */
+    EVP_CIPHER_CTX *decipher_ctx;
     unsigned char iv[AES_BLOCK_SIZE]; ///< AES IV buffer.
     unsigned char iv2[AES_BLOCK_SIZE]; ///< AES IV buffer.
     unsigned char secret[SHA512_DIGEST_LENGTH]; ///< Secret for checksums.
     unsigned char secret2[SHA512_DIGEST_LENGTH]; ///< Secret for checksums.
     socket_crypto_cb_t cb; ///< Callback function.
     bool done:1; ///< Whether the handshake has been completed.
+    uint8_t *buf; ///< Reusable buffer that packets are decrypted into.
+    size_t buf_size; ///< Size of the decryption buffer.
 };
 
 /**
@@ -1245,6 +1255,18 @@ socket_crypto_free (socket_crypto_t *crypto)
         efree(crypto->key);
     }
 
+    if (crypto->cipher_ctx != NULL) {
+        EVP_CIPHER_CTX_free(crypto->cipher_ctx);
+    }
+
+    if (crypto->decipher_ctx != NULL) {
+        EVP_CIPHER_CTX_free(crypto->decipher_ctx);
+    }
+
+    if (crypto->buf != NULL) {
+        efree(crypto->buf);
+    }
+
     efree(crypto);
 }
 
@@ -1863,13 +1885,40 @@ socket_crypto_set_key (socket_crypto_t *crypto,
         EVP_CIPHER_CTX_free(crypto->cipher_ctx);
     }
 
+    if (crypto->decipher_ctx != NULL) {
+        EVP_CIPHER_CTX_free(crypto->decipher_ctx);
+    }
+
     crypto->cipher_ctx = EVP_CIPHER_CTX_new();
-    if (crypto->cipher_ctx == NULL) {
+    crypto->decipher_ctx = EVP_CIPHER_CTX_new();
+    if (crypto->cipher_ctx == NULL || crypto->decipher_ctx == NULL) {
         LOG(ERROR, "EVP_CIPHER_CTX_new() failed: %s",
             ERR_error_string(ERR_get_error(), NULL));
         goto error;
     }
 
+    /* Set up the cipher and the key schedule once; the IV is set for
+     * every packet. */
+    if (EVP_EncryptInit_ex(crypto->cipher_ctx,
+                           EVP_aes_256_gcm(),
+                           NULL,
+                           crypto->key,
+                           NULL) != 1) {
+        LOG(ERROR, "EVP_EncryptInit_ex() failed: %s",
+            ERR_error_string(ERR_get_error(), NULL));
+        goto error;
+    }
+
+    if (EVP_DecryptInit_ex(crypto->decipher_ctx,
+                           EVP_aes_256_gcm(),
+                           NULL,
+                           crypto->key,
+                           NULL) != 1) {
+        LOG(ERROR, "EVP_DecryptInit_ex() failed: %s",
+            ERR_error_string(ERR_get_error(), NULL));
+        goto error;
+    }
+
     if (reset_iv) {
         if (RAND_bytes(crypto->iv, AES_BLOCK_SIZE) != 1) {
             LOG(ERROR, "RAND_bytes() failed: %s",
@@ -1891,6 +1940,11 @@ error:
         crypto->cipher_ctx = NULL;
     }
 
+    if (crypto->decipher_ctx != NULL) {
+        EVP_CIPHER_CTX_free(crypto->decipher_ctx);
+        crypto->decipher_ctx = NULL;
+    }
+
     return false;
 }
 
@@ -2327,7 +2381,11 @@ socket_crypto_encrypt (socket_t      *sc,
         enc_len = (((packet_orig_len + AES_BLOCK_SIZE) / AES_BLOCK_SIZE) *
                    AES_BLOCK_SIZE);
         packet_len += enc_len;
-        packet = packet_new(0, packet_len, 0);
+        /* The packet is encrypted in place; make room for the padding,
+         * the tag and the checksum. */
+        packet = packet_orig;
+        packet_orig = NULL;
+        packet_ensure(packet, packet_len - packet->len + 128 / CHAR_BIT);
         packet_len += 2 + 128 / CHAR_BIT;
     } else {
         LOG(ERROR, "Cannot encrypt packet!");
@@ -2376,42 +2434,32 @@ socket_crypto_encrypt (socket_t      *sc,
         packet->len += new_len;
     } else if (crypto->key != NULL) {
         if (EVP_EncryptInit_ex(crypto->cipher_ctx,
-                               EVP_aes_256_gcm(),
                                NULL,
-                               crypto->key,
+                               NULL,
+                               NULL,
                                crypto->iv) != 1) {
             LOG(ERROR, "EVP_EncryptInit_ex() failed: %s",
                 ERR_error_string(ERR_get_error(), NULL));
             goto error;
         }
 
-        packet->len += enc_len;
-        enc_len = 0;
+        size_t padded_len = enc_len;
+
+        /* Prepend the Atrinik packet type to the data. */
+        memmove(packet->data + 1, packet->data, packet->len);
+        packet->data[0] = packet_orig_type;
 
         int new_len = 0;
         if (EVP_EncryptUpdate(crypto->cipher_ctx,
                               packet->data,
                               &new_len,
-                              &packet_orig_type,
-                              sizeof(packet_orig_type)) != 1) {
+                              packet->data,
+                              packet_orig_len) != 1) {
             LOG(ERROR, "EVP_EncryptUpdate() failed: %s",
                 ERR_error_string(ERR_get_error(), NULL));
             goto error;
         }
-        enc_len += new_len;
-
-        if (packet_orig->len != 0) {
-            if (EVP_EncryptUpdate(crypto->cipher_ctx,
-                                  packet->data + enc_len,
-                                  &new_len,
-                                  packet_orig->data,
-                                  packet_orig->len) != 1) {
-                LOG(ERROR, "EVP_EncryptUpdate() failed: %s",
-                    ERR_error_string(ERR_get_error(), NULL));
-                goto error;
-            }
-            enc_len += new_len;
-        }
+        enc_len = new_len;
 
         if (EVP_EncryptFinal_ex(crypto->cipher_ctx,
                                 packet->data + enc_len,
@@ -2422,6 +2470,8 @@ socket_crypto_encrypt (socket_t      *sc,
         }
         enc_len += new_len;
 
+        packet->len = padded_len;
+
         /* Zero out the rest of the packet. */
         memset(packet->data + enc_len, 0, packet->len - enc_len);
 
@@ -2513,6 +2563,28 @@ out:
     return packet;
 }
 
+/**
+ * Ensures the decryption buffer of the specified crypto socket can hold at
+ * least the specified number of bytes.
+ *
+ * @param crypto
+ * Crypto socket.
+ * @param len
+ * Number of bytes required.
+ * @return
+ * The decryption buffer.
+ */
+static uint8_t *
+socket_crypto_buf_reserve (socket_crypto_t *crypto, size_t len)
+{
+    if (crypto->buf_size < len) {
+        crypto->buf = erealloc(crypto->buf, len);
+        crypto->buf_size = len;
+    }
+
+    return crypto->buf;
+}
+
 /**
  * Decrypts the specified packet data.
  *
@@ -2523,7 +2595,9 @@ out:
  * @param len
  * Length of the encrypted packet.
  * @param[out] data_out
- * Will contain decrypted packet on success. Must be freed.
+ * Will contain decrypted packet on success. Points either into 'data', or
+ * into a buffer owned by the socket's crypto state, which is reused by the
+ * next call; must not be freed.
  * @param[out] len_out
  * Length of the decrypted packet.
  * @return
@@ -2543,7 +2617,6 @@ socket_crypto_decrypt (socket_t *sc,
 
     socket_crypto_t *crypto = socket_get_crypto(sc);
 
-    unsigned char *decrypted = NULL;
     *data_out = NULL;
     *len_out = 0;
 
@@ -2604,10 +2677,9 @@ socket_crypto_decrypt (socket_t *sc,
         decrypted_len = packet_to_uint16(data, len, &pos);
     }
 
-    *len_out = len - pos - SHA256_DIGEST_LENGTH;
-    *data_out = emalloc(*len_out);
-    memcpy(*data_out, data + pos, *len_out);
-    pos += *len_out;
+    uint8_t *payload = data + pos;
+    size_t payload_len = len - pos - SHA256_DIGEST_LENGTH;
+    pos += payload_len;
 
     SHA256_CTX ctx;
     if (SHA256_Init(&ctx) != 1) {
@@ -2625,7 +2697,7 @@ socket_crypto_decrypt (socket_t *sc,
     }
 
     /* Checksum the payload */
-    if (SHA256_Update(&ctx, *data_out, *len_out) != 1) {
+    if (SHA256_Update(&ctx, payload, payload_len) != 1) {
         LOG(ERROR, "SHA256_Update() failed: %s",
             ERR_error_string(ERR_get_error(), NULL));
         goto error;
@@ -2672,13 +2744,16 @@ socket_crypto_decrypt (socket_t *sc,
         goto error;
     }
 
-    /* Only wanted to verify the checksum, so stop right here. */
+    /* Only wanted to verify the checksum, so stop right here; the payload
+     * can be used as-is. */
     if (crypto == NULL || type == CRYPTO_CMD_CHECKSUM) {
+        *data_out = payload;
+        *len_out = payload_len;
         return true;
     }
 
     if (crypto->key == NULL && crypto_cert_ctx != NULL) {
-        if (*len_out < 1) {
+        if (payload_len < 1) {
             LOG(PACKET, "Malformed packet detected: %s",
                 socket_get_str(sc));
             goto error;
@@ -2688,26 +2763,25 @@ socket_crypto_decrypt (socket_t *sc,
         if (EVP_PKEY_decrypt(crypto_cert_ctx,
                              NULL,
                              &enc_len,
-                             (*data_out) + 1,
-                             (*len_out) - 1) != 1) {
+                             payload + 1,
+                             payload_len - 1) != 1) {
             LOG(ERROR, "EVP_PKEY_decrypt() failed: %s",
                 ERR_error_string(ERR_get_error(), NULL));
             goto error;
         }
 
-        decrypted = emalloc(enc_len + 1);
+        uint8_t *decrypted = socket_crypto_buf_reserve(crypto, enc_len + 1);
         if (EVP_PKEY_decrypt(crypto_cert_ctx,
                              decrypted + 1,
                              &enc_len,
-                             (*data_out) + 1,
-                             (*len_out) - 1) != 1) {
+                             payload + 1,
+                             payload_len - 1) != 1) {
             LOG(ERROR, "EVP_PKEY_decrypt() failed: %s",
                 ERR_error_string(ERR_get_error(), NULL));
             goto error;
         }
 
-        decrypted[0] = *data_out[0];
-        efree(*data_out);
+        decrypted[0] = payload[0];
         *data_out = decrypted;
         *len_out = enc_len + 1;
 
@@ -2718,35 +2792,36 @@ socket_crypto_decrypt (socket_t *sc,
     }
 
     size_t tag_len = 128 / CHAR_BIT;
-    pos = 0;
-    if (*len_out < tag_len) {
+    if (payload_len < tag_len) {
         LOG(PACKET, "Malformed packet detected: %s",
             socket_get_str(sc));
         goto error;
     }
 
-    unsigned char *tag = *data_out + (*len_out - tag_len);
-    *len_out -= tag_len;
+    unsigned char *tag = payload + (payload_len - tag_len);
+    payload_len -= tag_len;
 
-    if (EVP_DecryptInit_ex(crypto->cipher_ctx,
-                           EVP_aes_256_gcm(),
+    if (EVP_DecryptInit_ex(crypto->decipher_ctx,
+                           NULL,
+                           NULL,
                            NULL,
-                           crypto->key,
                            crypto->iv) != 1) {
         LOG(ERROR, "EVP_DecryptInit_ex() failed: %s",
             ERR_error_string(ERR_get_error(), NULL));
         goto error;
     }
 
-    decrypted = emalloc(*len_out);
+    uint8_t *decrypted = socket_crypto_buf_reserve(crypto,
+                                                   payload_len +
+                                                   AES_BLOCK_SIZE);
 
     int new_len = 0;
     size_t dec_len = 0;
-    if (EVP_DecryptUpdate(crypto->cipher_ctx,
+    if (EVP_DecryptUpdate(crypto->decipher_ctx,
                           decrypted,
                           &new_len,
-                          *data_out,
-                          *len_out) != 1) {
+                          payload,
+                          payload_len) != 1) {
         LOG(ERROR, "EVP_DecryptUpdate() failed: %s",
             ERR_error_string(ERR_get_error(), NULL));
         goto error;
@@ -2754,7 +2829,7 @@ socket_crypto_decrypt (socket_t *sc,
     dec_len += new_len;
 
     /* Set expected tag value. Works in OpenSSL 1.0.1d and later */
-    if (EVP_CIPHER_CTX_ctrl(crypto->cipher_ctx,
+    if (EVP_CIPHER_CTX_ctrl(crypto->decipher_ctx,
                             EVP_CTRL_GCM_SET_TAG,
                             tag_len,
                             tag) != 1) {
@@ -2764,7 +2839,7 @@ socket_crypto_decrypt (socket_t *sc,
     }
 
     new_len = 0;
-    if (EVP_DecryptFinal_ex(crypto->cipher_ctx,
+    if (EVP_DecryptFinal_ex(crypto->decipher_ctx,
                             decrypted + dec_len,
                             &new_len) > 0) {
         LOG(ERROR, "EVP_DecryptFinal_ex() failed: %s",
@@ -2782,21 +2857,13 @@ socket_crypto_decrypt (socket_t *sc,
         goto error;
     }
 
-    efree(*data_out);
     *data_out = decrypted;
     *len_out = decrypted_len;
 
     return true;
 
 error:
-    if (*data_out != NULL) {
-        efree(*data_out);
-    }
-
-    if (decrypted != NULL) {
-        efree(decrypted);
-    }
-
+    *data_out = NULL;
     *len_out = 0;
 
     return false;
@@ -141,8 +141,6 @@
 /** How many entries there is room for. */
 #define HIGHSCORE_LENGTH 1000
 
-#define MAXSTRING 20
-
 /**
  * This is the access rights for the players savefiles.
  *
@@ -178,7 +176,7 @@
 #define AUTOSAVE 5000
 
 /** Socket version. */
-#define SOCKET_VERSION 1066
+#define SOCKET_VERSION 1067
 
 /**
  * If 1, all data packets that are longer than @ref COMPRESS_DATA_PACKETS_SIZE
@@ -458,6 +458,12 @@ typedef struct settings_struct {
      */
     char http_url[MAX_BUF];
 
+    /**
+     * Compression level of the data packets sent to clients that support
+     * streaming compression, 1-9; 0 disables it.
+     */
+    int compression_level;
+
     /**
      * Desired network stack to use.
      */
@@ -489,6 +495,10 @@ typedef struct shstr_constants {
     const char *of_poison;
     const char *of_hideous_poison;
     const char *of_vile_poison;
+
+    const char *faction;
+    const char *was_provoked;
+    const char *soulbound_name;
 } shstr_constants;
 
 /**
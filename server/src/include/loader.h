@@ -48,6 +48,11 @@
 #define LO_NOREAD   3
 #define LO_MEMORYMODE 4
 
+/**
+ * Binary object file; see object_binary.c.
+ */
+typedef struct object_binary object_binary_t;
+
 /* Prototypes */
 void
 free_object_loader(void);
@@ -66,4 +71,35 @@ set_variable(object *op, const char *buf);
 void
 get_ob_diff(StringBuffer *sb, const object *op, const object *op2);
 
+/* object_binary.c */
+bool
+object_binary_check(FILE *fp);
+uint64_t
+object_binary_format_checksum(void);
+object_binary_t *
+object_binary_create(FILE *fp);
+object_binary_t *
+object_binary_open(FILE *fp);
+void
+object_binary_free(object_binary_t *ob);
+void
+object_binary_put_uint(object_binary_t *ob, uint64_t val);
+void
+object_binary_put_string(object_binary_t *ob, const char *str);
+void
+object_binary_put_data(object_binary_t *ob, const void *data, size_t len);
+uint64_t
+object_binary_get_uint(object_binary_t *ob);
+shstr *
+object_binary_get_string(object_binary_t *ob);
+void *
+object_binary_get_data(object_binary_t *ob, size_t *len);
+void
+object_binary_save(object_binary_t *ob, const object *op);
+void
+object_binary_save_base(object_binary_t *ob, const object *op,
+                        const object *base);
+int
+object_binary_load(object_binary_t *ob, object *op, int map_flags);
+
 #endif
@@ -125,6 +125,17 @@
  * places.
  */
 #define MAP_SIZE(m)            ((m)->width * (m)->height)
+/**
+ * Live object buckets cover squares of (1 << MAP_LIVE_BUCKET_SHIFT) tiles
+ * on each side.
+ */
+#define MAP_LIVE_BUCKET_SHIFT  3
+/** Number of live object buckets across the width of a map */
+#define MAP_LIVE_BUCKETS_X(m) \
+    (((m)->width + (1 << MAP_LIVE_BUCKET_SHIFT) - 1) >> MAP_LIVE_BUCKET_SHIFT)
+/** Number of live object buckets across the height of a map */
+#define MAP_LIVE_BUCKETS_Y(m) \
+    (((m)->height + (1 << MAP_LIVE_BUCKET_SHIFT) - 1) >> MAP_LIVE_BUCKET_SHIFT)
 /** Enter X position of a map */
 #define MAP_ENTER_X(m)         (m)->enter_x
 /** Enter Y position of a map */
@@ -194,24 +205,28 @@
 #define SET_MAP_SPACE_LAYER(M_, L_, SL_, O_) \
     ((M_)->layer[NUM_LAYERS * (SL_) + (L_) -1] = (O_))
 
+/** Index of the specified coordinates in the per-space arrays of a map. */
+#define GET_MAP_SPACE_INDEX(M, X, Y) \
+    ((X) + (M)->width * (Y))
+
 #define GET_MAP_UPDATE_COUNTER(M, X, Y) \
-    ((M)->spaces[(X) + (M)->width * (Y)].update_tile)
+    ((M)->space_update[GET_MAP_SPACE_INDEX(M, X, Y)])
 
 #define INC_MAP_UPDATE_COUNTER(M, X, Y) \
-    ((M)->spaces[((X) + (M)->width * (Y))].update_tile++)
+    ((M)->space_update[GET_MAP_SPACE_INDEX(M, X, Y)]++)
 
 #define GET_MAP_MOVE_FLAGS(M, X, Y) \
-    ((M)->spaces[(X) + (M)->width * (Y)].move_flags)
+    ((M)->space_move_flags[GET_MAP_SPACE_INDEX(M, X, Y)])
 #define SET_MAP_MOVE_FLAGS(M, X, Y, C) \
-    ((M)->spaces[(X) + (M)->width * (Y)].move_flags = C)
+    ((M)->space_move_flags[GET_MAP_SPACE_INDEX(M, X, Y)] = C)
 #define GET_MAP_FLAGS(M, X, Y) \
-    ((M)->spaces[(X) + (M)->width * (Y)].flags)
+    ((M)->space_flags[GET_MAP_SPACE_INDEX(M, X, Y)])
 #define SET_MAP_FLAGS(M, X, Y, C) \
-    ((M)->spaces[(X) + (M)->width * (Y)].flags = C)
+    ((M)->space_flags[GET_MAP_SPACE_INDEX(M, X, Y)] = C)
 #define GET_MAP_LIGHT(M, X, Y) \
-    ((M)->spaces[(X) + (M)->width * (Y)].light_value)
+    ((M)->space_light[GET_MAP_SPACE_INDEX(M, X, Y)])
 #define SET_MAP_LIGHT(M, X, Y, L) \
-    ((M)->spaces[(X) + (M)->width * (Y)].light_value = L)
+    ((M)->space_light[GET_MAP_SPACE_INDEX(M, X, Y)] = L)
 
 #define GET_MAP_OB(M, X, Y) \
     ((M)->spaces[(X) + (M)->width * (Y)].first)
@@ -286,6 +301,11 @@
  * no_pass will overrule pass_thru
  */
 #define P_PASS_THRU           0x400
+/**
+ * Not a tile flag; marks an object that blocks its tile (with
+ * @ref P_NO_PASS or @ref P_DOOR_CLOSED) in object::map_flags.
+ */
+#define P_BLOCKER             0x800
 /** For moving objects and what happens when they enter */
 #define P_WALK_ON             0x1000
 /** For moving objects and what happens when they leave */
@@ -312,6 +332,15 @@
 #define P_NO_TERRAIN          0x80000000
 /*@}*/
 
+/**
+ * Number of per-tile object counters kept for the flags in
+ * @ref map_look_flags; one for each bit up to and including
+ * @ref P_OUTDOOR.
+ */
+#define MAP_SPACE_FLAG_COUNTS 18
+/** Number of per-tile object counters kept for the terrain flags. */
+#define MAP_SPACE_TERRAIN_COUNTS 16
+
 /**
  * @defgroup MSP_EXTRA_xxx Map space extra flags
  * Map space extra flags
@@ -330,7 +359,12 @@
 #define MSP_EXTRA_IS_OVERLOOK 32
 /*@}*/
 
-/** Single tile on a map */
+/**
+ * Cold data of a single map square. The fields read on every movement,
+ * line of sight and map drawing check (flags, terrain flags, light and
+ * update counter) are kept in parallel arrays in ::mapstruct instead;
+ * access them using the GET_MAP_xxx() macros.
+ */
 typedef struct MapSpace_s {
     /** Start of the objects on this map tile */
     object *first;
@@ -362,34 +396,54 @@ typedef struct MapSpace_s {
     /** ID of ::sound_ambient. */
     tag_t sound_ambient_count;
 
-    /** Counter for update tile */
-    uint32_t update_tile;
-
     /** Light source counter - the higher the brighter light source here */
     int32_t light_source;
 
-    /**
-     * How much light is on this tile. 0 = total dark
-     * 255+ = full daylight.
-     */
-    int32_t light_value;
+    /** last_damage tmp backbuffer */
+    int16_t last_damage[NUM_SUB_LAYERS];
 
     /**
-     * Flags about this space
-     * @see map_look_flags
+     * Number of objects on this tile contributing each of the bits in
+     * @ref map_look_flags; the tile flags are derived from these.
      */
-    int flags;
+    uint16_t flag_count[MAP_SPACE_FLAG_COUNTS];
 
-    /** last_damage tmp backbuffer */
-    int16_t last_damage[NUM_SUB_LAYERS];
-
-    /** Terrain type flags (water, underwater,...) */
-    uint16_t move_flags;
+    /** Number of floor objects on this tile with each terrain flag. */
+    uint16_t terrain_count[MAP_SPACE_TERRAIN_COUNTS];
 
     /** Extra flags from @ref MSP_EXTRA_xxx. */
     uint8_t extra_flags;
 } MapSpace;
 
+/**
+ * Player-independent rendering information about a map space. It is
+ * computed the first time the space is drawn for a player in a map update
+ * pass, and shared with all the other players that can see the space in
+ * the same pass.
+ */
+typedef struct map_render_cache {
+    /** Map update pass this entry is valid for. */
+    uint32_t tag;
+
+    /** Update counter of the space when this entry was computed. */
+    uint32_t update_tile;
+
+    /** Highest Z of the floors on this space and the levels below it. */
+    int16_t zadj;
+
+    /**
+     * Depth of the lowest level below the space that is drawn instead of
+     * the space itself, 0 if none.
+     */
+    int8_t bottom_map_depth;
+
+    /** Whether there is a map on the same level below the space. */
+    uint8_t have_down : 1;
+
+    /** Whether the levels below override the rendering of the space. */
+    uint8_t override_rendering : 1;
+} map_render_cache_t;
+
 /**
  * @defgroup map_flags Map flags
  * Map flags for global map settings, used in @ref mapstruct::map_flags.
@@ -573,6 +627,33 @@ typedef struct mapdef {
     /** Array of spaces on this map */
     MapSpace *spaces;
 
+    /**
+     * Flags about each space.
+     * @see map_look_flags
+     */
+    int *space_flags;
+
+    /** Terrain type flags (water, underwater,...) of each space. */
+    uint16_t *space_move_flags;
+
+    /**
+     * How much light is on each space. 0 = total dark, 255+ = full
+     * daylight.
+     */
+    int32_t *space_light;
+
+    /** Update counter of each space. */
+    uint32_t *space_update;
+
+    /**
+     * Spatial index of the living objects (players and monsters) on this
+     * map; see map_live_find().
+     */
+    struct obj **live_buckets;
+
+    /** Rendering information of each space; see map_render_cache_get(). */
+    map_render_cache_t *render_cache;
+
     /** List of tile spaces with light sources */
     MapSpace *first_light;
 
@@ -593,14 +674,6 @@ typedef struct mapdef {
     /** Chained list of players on this map */
     object *player_first;
 
-    /** Bitmap used for marking visited tiles in pathfinding */
-    uint32_t *bitmap;
-
-    /** For which traversal is @ref mapstruct::bitmap valid. */
-    uint32_t pathfinding_id;
-
-    struct path_node **path_nodes;
-
     /** Map flags for various map settings */
     uint32_t map_flags;
 
@@ -684,6 +757,11 @@ typedef struct mapdef {
     bool global_removed; ///< If true, the map was removed from the global list.
 
     tag_t count; ///< Unique identifier for the map.
+
+    /**
+     * Pathfinding cluster of the map; built on demand by the pathfinder.
+     */
+    struct path_cluster *path_cluster;
 } mapstruct;
 
 /**
@@ -900,6 +978,8 @@ mapstruct *
 load_original_map(const char *filename, mapstruct *originator, int flags);
 int
 new_save_map(mapstruct *m, int flag);
+int
+new_save_map_async(mapstruct *m);
 void
 free_map(mapstruct *m, int flag);
 void
@@ -913,6 +993,12 @@ free_all_maps(void);
 void
 update_position(mapstruct *m, int x, int y);
 void
+map_space_add_object(object *op);
+void
+map_space_remove_object(object *op);
+void
+map_space_update_object(object *op);
+void
 set_map_reset_time(mapstruct *map);
 mapstruct *
 get_map_from_tiled(mapstruct *m, int tiled);
@@ -932,6 +1018,10 @@ int
 wall_blocked(mapstruct *m, int x, int y);
 int
 map_get_darkness(mapstruct *m, int x, int y, object **mirror);
+void
+map_render_cache_pass(void);
+bool
+map_render_cache_get(mapstruct *m, int x, int y, map_render_cache_t **entry);
 int
 map_path_isabs(const char *path);
 char *
@@ -958,5 +1048,13 @@ map_free_spot_first(mapstruct   *m,
                     int          y,
                     archetype_t *at,
                     object      *op);
+void
+map_live_add(object *op);
+void
+map_live_remove(object *op);
+void
+map_live_update(object *op);
+object **
+map_live_find(mapstruct *m, int x, int y, int range, size_t *num);
 
 #endif
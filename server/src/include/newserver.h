@@ -169,6 +169,12 @@ typedef struct socket_struct {
     /** Outgoing packets. */
     struct packet_struct *packets;
 
+    /**
+     * Compression stream of the outgoing data packets, NULL unless the
+     * client requested streaming compression.
+     */
+    struct packet_compressor *compressor;
+
     /**
      * Buffer for how many ticks have passed since the last keep alive
      * command. When this reaches @ref SOCKET_KEEPALIVE_TIMEOUT, the
@@ -180,6 +186,18 @@ typedef struct socket_struct {
 
     struct packet_struct *packet_recv;
     struct packet_struct *packet_recv_cmd;
+
+    /**
+     * Whether the socket is registered with the socket server's event
+     * polling backend.
+     */
+    bool polled;
+
+    /**
+     * Events the socket is currently registered for; only meaningful if
+     * 'polled' is set.
+     */
+    uint32_t poll_events;
 } socket_struct;
 
 /**
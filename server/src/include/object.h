@@ -88,6 +88,26 @@ typedef struct key_value {
     struct key_value *next;
 } key_value_t;
 
+/**
+ * Once an object has more than this many key-values, they are indexed in a
+ * hash table by key, see object::key_values_index.
+ */
+#define KEY_VALUES_INDEX_MIN 8
+
+/**
+ * Entry of the hash table index of an object's key-values.
+ */
+typedef struct key_value_index {
+    /** Key of the indexed field. Shared string. */
+    shstr *key;
+
+    /** The indexed field. */
+    key_value_t *field;
+
+    /** Hash handle. */
+    UT_hash_handle hh;
+} key_value_index_t;
+
 /**
  * Object structure.
  */
@@ -110,6 +130,21 @@ struct obj {
      */
     struct obj *active_prev;
 
+    /**
+     * Slot of the active objects timer wheel this object is sleeping in,
+     * NULL if it is not sleeping.
+     */
+    struct obj **active_slot;
+
+    /** Tick at which the object wakes up from the timer wheel. */
+    long active_wake;
+
+    /**
+     * First tick the object was not processed on because it was sleeping
+     * in the timer wheel, 0 if none.
+     */
+    long active_skipped;
+
     /** Pointer to the object stacked below this one */
     struct obj *below;
 
@@ -138,6 +173,27 @@ struct obj {
     /** Pointer to the map in which this object is present */
     struct mapdef *map;
 
+    /** Next object in the map's live object bucket. */
+    struct obj *live_next;
+
+    /** Previous object in the map's live object bucket. */
+    struct obj *live_prev;
+
+    /**
+     * Map live object bucket this object is linked into, NULL if the
+     * object is not indexed.
+     */
+    struct obj **live_bucket;
+
+    /**
+     * Map space flags (@ref map_look_flags) this object is counted with on
+     * the tile it is on.
+     */
+    uint32_t map_flags;
+
+    /** Terrain flags this object is counted with on the tile it is on. */
+    uint16_t map_terrain;
+
     /** Unique object number for this object */
     tag_t count;
 
@@ -482,6 +538,15 @@ struct obj {
 
     /** Fields not explicitly known by the loader. */
     key_value_t *key_values;
+
+    /**
+     * Hash table index of ::key_values by key; only built once the object
+     * has more than #KEY_VALUES_INDEX_MIN key-values, NULL otherwise.
+     */
+    key_value_index_t *key_values_index;
+
+    /** Number of entries in ::key_values. */
+    uint32_t key_values_num;
 };
 
 /** Used to link together several objects. */
@@ -899,6 +964,12 @@ object_update_turnable(object *op);
 void
 object_update_speed(object *op);
 void
+object_active_sleep(object *op, long delay);
+void
+object_active_wake(void);
+uint64_t
+object_active_wheel_count(bool show_list);
+void
 object_update(object *op, int action);
 void
 object_drop_inventory(object *op);
@@ -939,6 +1010,8 @@ object_free_key_values(object *op);
 key_value_t *
 object_get_key_link(const object *op, shstr *key);
 shstr *
+object_get_value_s(const object *op, shstr *key);
+shstr *
 object_get_value(const object *op, const char *const key);
 bool
 object_set_value(object *op, const char *key, const char *value, bool add_key);
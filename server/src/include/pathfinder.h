@@ -59,10 +59,12 @@ typedef struct path_node {
     struct path_node *parent; ///< Node this was reached from.
 
     struct mapdef *map; ///< Pointer to the map.
+    int map_id; ///< Snapshot map index; used by searches on worker threads.
     int16_t x; ///< X position on the map for this node.
     int16_t y; ///< Y position on the map for this node.
     uint8_t flags; ///< A combination of @ref PATH_NODE_xxx.
     int distance_z; ///< Z distance from this node to the goal.
+    int heap_index; ///< Index in the open set heap; -1 if not in it.
 
     double cost; ///< Cost of reaching this node (distance from origin).
     double heuristic; ///< Estimated cost of reaching the goal from this node.
@@ -96,15 +98,6 @@ typedef struct path_visualization {
     UT_hash_handle hh; ///< Hash handle.
 } path_visualization_t;
 
-#define PATHFINDING_CHECK_ID(m, id) \
-    if ((m)->pathfinding_id != (id)) { \
-        (m)->pathfinding_id = (id); \
-        memset((m)->bitmap, 0, ((MAP_WIDTH(m) + 31) / 32) * MAP_HEIGHT(m) * \
-                sizeof(*(m)->bitmap)); \
-        memset((m)->path_nodes, 0, MAP_WIDTH(m) * MAP_HEIGHT(m) * \
-                sizeof(*(m)->path_nodes)); \
-    }
-
 #define PATHFINDING_VISUALIZER_APPEND(visualizer, _m, _x, _y, _closed, _node) \
     if (visualizer != NULL) { \
         path_visualizer_t *__tmp; \
@@ -119,29 +112,6 @@ typedef struct path_visualization {
         DL_APPEND(*visualizer, __tmp); \
     }
 
-#define PATHFINDING_SET_CLOSED(m, x, y, id, visualizer) \
-    { \
-        PATHFINDING_CHECK_ID(m, id); \
-        PATHFINDING_VISUALIZER_APPEND(visualizer, m, x, y, true, NULL); \
-        (m)->bitmap[(x) / 32 + ((MAP_WIDTH(m) + 31) / 32) * (y)] |= \
-                (1U << ((x) % 32)); \
-    }
-
-#define PATHFINDING_QUERY_CLOSED(m, x, y, id) \
-    ((m)->pathfinding_id == (id) && ((m)->bitmap[(x) / 32 + \
-            ((MAP_WIDTH(m) + 31) / 32) * (y)] & (1U << ((x) % 32))))
-
-#define PATHFINDING_NODE_SET(m, x, y, id, node, visualizer) \
-    { \
-        PATHFINDING_CHECK_ID(m, id); \
-        PATHFINDING_VISUALIZER_APPEND(visualizer, m, x, y, false, node); \
-        (m)->path_nodes[(x) + MAP_WIDTH(m) * (y)] = node; \
-    }
-
-#define PATHFINDING_NODE_GET(m, x, y, id) \
-    ((m)->pathfinding_id != (id) ? NULL : (m)->path_nodes[(x) + \
-            MAP_WIDTH(m) * (y)])
-
 /**
  * Pseudo-flag used to mark waypoints as "has requested path".
  *
@@ -229,6 +229,18 @@ struct pl_player {
      */
     int blocked_los[MAP_CLIENT_X][MAP_CLIENT_Y];
 
+    /**
+     * What blocked view around the player when blocked_los was last
+     * calculated; used by update_los() to skip unchanged views.
+     */
+    uint8_t los_view[MAP_CLIENT_X][MAP_CLIENT_Y];
+
+    /**
+     * View size and player flags blocked_los was last calculated with,
+     * zero if blocked_los is not cached.
+     */
+    uint32_t los_key;
+
     /** This is initialized from init_player_exp(). */
     int last_skill_index;
 
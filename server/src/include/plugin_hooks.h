@@ -243,6 +243,7 @@ PLUGIN_HOOK_FUNCTION(void, main_process, void)
 PLUGIN_HOOK_FUNCTION(char *, socket_get_addr, socket_t *)
 PLUGIN_HOOK_FUNCTION(char *, socket_get_str, socket_t *)
 PLUGIN_HOOK_FUNCTION(bool, faction_is_friend, struct faction *, object *)
+PLUGIN_HOOK_FUNCTION(void, object_update, object *, int)
 
 PLUGIN_HOOK_ARRAY(const char *, season_name)
 PLUGIN_HOOK_ARRAY(const char *, weekdays)
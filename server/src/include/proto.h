@@ -102,6 +102,8 @@ extern int map_lex_load(mapstruct *m);
 extern int map_set_variable(mapstruct *m, char *buf);
 extern void free_map_header_loader(void);
 extern int load_map_header(mapstruct *m, FILE *fp);
+extern int load_map_header_str(mapstruct *m, const char *str);
+extern char *save_map_header_str(mapstruct *m, int flag);
 extern void save_map_header(mapstruct *m, FILE *fp, int flag);
 /* src/loaders/object.c */
 /* src/loaders/random_map.c */
@@ -368,6 +370,10 @@ extern int path_get_next(shstr *buf, int16_t *off, shstr **mappath, mapstruct **
 extern path_node_t *path_compress(path_node_t *path);
 extern void path_visualize(path_visualization_t **visualization, path_visualizer_t **visualizer);
 extern path_node_t *path_find(object *op, mapstruct *map1, int x, int y, mapstruct *map2, int x2, int y2, path_visualizer_t **visualizer);
+extern bool path_find_async(object *waypoint, object *op, mapstruct *map1, int x, int y, mapstruct *map2, int x2, int y2);
+extern object *path_get_next_result(path_node_t **path);
+extern void path_cluster_free(mapstruct *m);
+extern void path_cluster_tile_changed(mapstruct *m, int x, int y);
 /* src/server/plugins.c */
 extern object *get_event_object(object *op, int event_nr);
 extern void display_plugins_list(object *op);
@@ -490,6 +496,12 @@ extern void read_map_log(void);
 extern void swap_map(mapstruct *map, int force_flag);
 extern void check_active_maps(void);
 extern void flush_old_maps(void);
+extern FILE *swap_memstream(char **data, size_t *len);
+extern void swap_write_file(const char *path, char *data, size_t len, int mode, const char *player_name);
+extern FILE *swap_open(const char *path);
+extern void swap_cancel(const char *path);
+extern void swap_wait(const char *path);
+extern void swap_deinit(void);
 /* src/server/time.c */
 extern long max_time;
 extern int max_time_multiplier;
@@ -566,6 +578,7 @@ extern void socket_command_item_mark(socket_struct *ns, player *pl, uint8_t *dat
 extern void esrv_move_object(object *pl, tag_t to, tag_t tag, long nrof);
 /* src/socket/lowlevel.c */
 extern void socket_buffer_clear(socket_struct *ns);
+extern bool socket_buffer_flush(socket_struct *ns);
 extern void socket_buffer_write(socket_struct *ns);
 extern void socket_send_packet(socket_struct *ns, struct packet_struct *packet);
 /* src/socket/metaserver.c */
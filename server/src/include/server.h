@@ -62,6 +62,8 @@ socket_server_handle_client(player *pl);
 bool
 socket_server_remove(socket_struct *cs);
 void
+socket_server_unwatch(socket_struct *cs);
+void
 socket_server_process(void);
 void
 socket_server_post_process(void);
@@ -2163,6 +2163,9 @@ static PyObject *Atrinik_Object_Load(Atrinik_Object *self, PyObject *args)
     }
 
     hooks->set_variable(self->obj, lines);
+    /* The lines may have changed the flags the object contributes to the
+     * tile it is on. */
+    hooks->object_update(self->obj, UP_OBJ_FLAGS);
 
     Py_INCREF(Py_None);
     return Py_None;
@@ -2423,6 +2426,13 @@ static int Object_SetAttribute(Atrinik_Object *obj, PyObject *value,
 
     hooks->esrv_send_item(obj->obj);
 
+    /* The type and terrain are counted in the flags of the tile the object
+     * is on. */
+    if (field->offset == offsetof(object, type) ||
+        field->offset == offsetof(object, terrain_type)) {
+        hooks->object_update(obj->obj, UP_OBJ_FLAGS);
+    }
+
     /* Special handling for some player stuff. */
     if (obj->obj->type == PLAYER) {
         if (field->flags & FIELDFLAG_PLAYER_FIX) {
@@ -2431,7 +2441,11 @@ static int Object_SetAttribute(Atrinik_Object *obj, PyObject *value,
     }
 
     /* Update object's speed. */
-    if (field->offset == offsetof(object, speed)) {
+    if (field->offset == offsetof(object, speed) ||
+        field->offset == offsetof(object, speed_left) ||
+        field->offset == offsetof(object, anim_speed)) {
+        /* Also wakes up the object if it is sleeping in the timer wheel,
+         * so that the change takes effect. */
         hooks->object_update_speed(obj->obj);
     } else if (field->offset == offsetof(object, type)) {
         /* Handle object's type changing. */
@@ -2532,6 +2546,8 @@ static int Object_SetFlag(Atrinik_Object *obj, PyObject *val, void *context)
         return -1;
     }
 
+    /* Recount the flags of the tile the object is on, if any. */
+    hooks->object_update(obj->obj, UP_OBJ_FLAGS);
     hooks->esrv_send_item(obj->obj);
     return 0;
 }
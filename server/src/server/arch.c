@@ -57,6 +57,34 @@ bool arch_in_init = false;
  */
 static object *clone_op;
 
+/**
+ * Name of the file in the data directory the results of arch_pass_first()
+ * are cached in.
+ */
+#define ARCH_CACHE_FILE "archetypes.cache"
+/**
+ * Version of the archetype cache layout; increase whenever it changes.
+ */
+#define ARCH_CACHE_VERSION 2
+/**
+ * Format of the text line the archetype cache starts with, which holds
+ * ::ARCH_CACHE_VERSION, object_binary_format_checksum() and the checksum
+ * of the archetype file. The cache is only used if all of them match.
+ */
+#define ARCH_CACHE_HEADER "archetypes cache %d %" PRIx64 " %" PRIx64 "\n"
+
+/**
+ * @defgroup ARCH_CACHE_xxx Archetype cache records
+ * Types of the records in the archetype cache.
+ *@{*/
+/** End of the cache. */
+#define ARCH_CACHE_END 0
+/** A new archetype. */
+#define ARCH_CACHE_HEAD 1
+/** Another part of the previous archetype. */
+#define ARCH_CACHE_MORE 2
+/*@}*/
+
 /**
  * Used to initialize the #arches array.
  */
@@ -200,6 +228,177 @@ static void arch_pass_first(FILE *fp)
     efree(at);
 }
 
+/**
+ * Calculates a checksum of the archetype file, which is used to tell
+ * whether the archetype cache is up-to-date.
+ * @param fp
+ * File to calculate the checksum of. Will be rewinded.
+ * @return
+ * The checksum.
+ */
+static uint64_t arch_cache_checksum(FILE *fp)
+{
+    HARD_ASSERT(fp != NULL);
+
+    /* 64-bit FNV-1a. */
+    uint64_t checksum = UINT64_C(14695981039346656037);
+    char buf[HUGE_BUF * 4];
+    size_t len;
+
+    while ((len = fread(buf, 1, sizeof(buf), fp)) != 0) {
+        for (size_t i = 0; i < len; i++) {
+            checksum ^= (unsigned char) buf[i];
+            checksum *= UINT64_C(1099511628211);
+        }
+    }
+
+    rewind(fp);
+    return checksum;
+}
+
+/**
+ * Loads the archetypes from the archetype cache, instead of parsing the
+ * archetype file with arch_pass_first().
+ * @param checksum
+ * Checksum of the archetype file.
+ * @return
+ * True on success, false if the cache is missing, out of date or could
+ * not be loaded, in which case nothing has been added to the arch table.
+ */
+static bool arch_cache_load(uint64_t checksum)
+{
+    char filename[MAX_BUF];
+    snprintf(VS(filename), "%s/" ARCH_CACHE_FILE, settings.datapath);
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    char header[MAX_BUF], expected[MAX_BUF];
+    snprintf(VS(expected), ARCH_CACHE_HEADER, ARCH_CACHE_VERSION,
+            object_binary_format_checksum(), checksum);
+
+    if (fgets(VS(header), fp) == NULL || strcmp(header, expected) != 0) {
+        LOG(INFO, "Archetype cache %s is out of date, rebuilding.", filename);
+        fclose(fp);
+        return false;
+    }
+
+    if (!object_binary_check(fp)) {
+        LOG(ERROR, "Archetype cache %s is invalid.", filename);
+        fclose(fp);
+        return false;
+    }
+
+    object_binary_t *ob = object_binary_open(fp);
+    if (ob == NULL) {
+        fclose(fp);
+        return false;
+    }
+
+    bool ret = false;
+    archetype_t *prev = NULL, *last_more = NULL;
+
+    while (true) {
+        uint64_t kind = object_binary_get_uint(ob);
+        if (kind == ARCH_CACHE_END) {
+            ret = true;
+            break;
+        }
+
+        if ((kind != ARCH_CACHE_HEAD && kind != ARCH_CACHE_MORE) ||
+            (kind == ARCH_CACHE_MORE && prev == NULL)) {
+            break;
+        }
+
+        shstr *name = object_binary_get_string(ob);
+        if (name == NULL) {
+            break;
+        }
+
+        archetype_t *at = arch_new();
+        at->clone.arch = at;
+        at->name = add_refcount(name);
+
+        if (object_binary_load(ob, &at->clone, MAP_STYLE) != LL_NORMAL) {
+            arch_free(at);
+            break;
+        }
+
+        if (kind == ARCH_CACHE_HEAD) {
+            arch_add(at);
+            prev = last_more = at;
+        } else {
+            at->head = prev;
+            at->clone.head = &prev->clone;
+            last_more->more = at;
+            last_more->clone.more = &at->clone;
+            last_more = at;
+        }
+    }
+
+    object_binary_free(ob);
+    fclose(fp);
+
+    if (!ret) {
+        LOG(ERROR, "Archetype cache %s is invalid.", filename);
+        arch_deinit();
+    }
+
+    return ret;
+}
+
+/**
+ * Saves the archetypes loaded by arch_pass_first() to the archetype
+ * cache.
+ * @param checksum
+ * Checksum of the archetype file.
+ */
+static void arch_cache_save(uint64_t checksum)
+{
+    char filename[MAX_BUF], filename_tmp[MAX_BUF];
+    snprintf(VS(filename), "%s/" ARCH_CACHE_FILE, settings.datapath);
+    snprintf(VS(filename_tmp), "%s.tmp", filename);
+
+    FILE *fp = fopen(filename_tmp, "wb");
+    if (fp == NULL) {
+        LOG(ERROR, "Can't open %s: %s (%d)", filename_tmp, strerror(errno),
+                errno);
+        return;
+    }
+
+    fprintf(fp, ARCH_CACHE_HEADER, ARCH_CACHE_VERSION,
+            object_binary_format_checksum(), checksum);
+
+    object_binary_t *ob = object_binary_create(fp);
+
+    archetype_t *at, *tmp;
+    HASH_ITER(hh, arch_table, at, tmp) {
+        for (archetype_t *part = at; part != NULL; part = part->more) {
+            object_binary_put_uint(ob, part == at ? ARCH_CACHE_HEAD :
+                    ARCH_CACHE_MORE);
+            object_binary_put_string(ob, part->name);
+            object_binary_save_base(ob, &part->clone, clone_op);
+        }
+    }
+
+    object_binary_put_uint(ob, ARCH_CACHE_END);
+    object_binary_free(ob);
+
+    if (fclose(fp) != 0) {
+        LOG(ERROR, "Failed to write %s: %s (%d)", filename_tmp,
+                strerror(errno), errno);
+        unlink(filename_tmp);
+        return;
+    }
+
+    if (rename(filename_tmp, filename) != 0) {
+        LOG(ERROR, "Failed to rename %s to %s: %s (%d)", filename_tmp,
+                filename, strerror(errno), errno);
+        unlink(filename_tmp);
+    }
+}
+
 /**
  * Reads the archetype file once more, and links all pointers between
  * archetypes and treasure lists. Must be called after first_arch_pass().
@@ -347,7 +546,8 @@ error:
 /**
  * Loads all archetypes, artifacts and treasures.
  *
- * Reads and parses the archetype file using arch_pass_first(), then initializes
+ * Reads and parses the archetype file using arch_pass_first() (or loads
+ * the archetype cache, if it's up-to-date), then initializes
  * the artifacts and treasures. Afterwards, calls arch_pass_second(), which
  * does the second pass initialization of archetypes and artifacts.
  */
@@ -365,8 +565,15 @@ static void arch_load(void)
         exit(1);
     }
 
-    arch_pass_first(fp);
-    rewind(fp);
+    /* The first pass only depends on the archetype file, so its results
+     * are cached and reused for as long as the file doesn't change. */
+    uint64_t checksum = arch_cache_checksum(fp);
+
+    if (!arch_cache_load(checksum)) {
+        arch_pass_first(fp);
+        rewind(fp);
+        arch_cache_save(checksum);
+    }
 
     /* If not called before, reads all artifacts from file */
     artifact_init();
@@ -1029,8 +1029,9 @@ attack_kill (object *op, object *hitter)
             CONTR(owner)->stat_kills_mob++;
             statistic_update("kills", owner, 1, op->name);
 
-            if (object_get_value(op, "was_provoked") == NULL) {
-                shstr *faction_name = object_get_value(op, "faction");
+            if (object_get_value_s(op, shstr_cons.was_provoked) == NULL) {
+                shstr *faction_name = object_get_value_s(op,
+                        shstr_cons.faction);
                 if (faction_name != NULL) {
                     faction_t faction = faction_find(faction_name);
                     if (faction != NULL) {
@@ -1236,6 +1237,7 @@ attack_perform_poison (object *op, object *hitter, double dam)
         }
 
         tmp->speed_left = 0;
+        object_update_speed(tmp);
     } else {
         tmp->stats.food++;
         esrv_update_item(UPD_EXTRA, tmp);
@@ -1282,6 +1284,7 @@ attack_perform_slow (object *op)
     }
 
     tmp->speed_left = 0;
+    object_update_speed(tmp);
 }
 
 /**
@@ -1325,6 +1328,7 @@ attack_perform_confusion (object *op)
     }
 
     tmp->speed_left = 0;
+    object_update_speed(tmp);
     esrv_update_item(UPD_EXTRA, tmp);
 }
 
@@ -1384,6 +1388,7 @@ attack_perform_blind (object *op, object *hitter, double dam)
     }
 
     tmp->speed_left = 0;
+    object_update_speed(tmp);
     esrv_update_item(UPD_EXTRA, tmp);
 }
 
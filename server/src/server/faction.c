@@ -562,7 +562,7 @@ static bool _faction_is_friend(faction_t faction, object *op,
     } else {
         reputation = 0;
 
-        if (faction->name == object_get_value(op, "faction")) {
+        if (faction->name == object_get_value_s(op, shstr_cons.faction)) {
             return true;
         }
     }
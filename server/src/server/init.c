@@ -96,6 +96,10 @@ static void init_strings(void)
     shstr_cons.of_poison = add_string("of poison");
     shstr_cons.of_hideous_poison = add_string("of hideous poison");
     shstr_cons.of_vile_poison = add_string("of vile poison");
+
+    shstr_cons.faction = add_string("faction");
+    shstr_cons.was_provoked = add_string("was_provoked");
+    shstr_cons.soulbound_name = add_string("soulbound_name");
 }
 
 /**
@@ -185,6 +189,8 @@ console_command_active_objects (const char *params)
         }
     }
 
+    num += object_active_wheel_count(show_list);
+
     LOG(INFO, "Total number of active objects: %" PRIu64, num);
 }
 
@@ -198,6 +204,7 @@ void cleanup(void)
     player_deinit();
     account_deinit();
     resources_deinit();
+    swap_deinit();
     free_all_maps();
     free_style_maps();
     arch_deinit();
@@ -800,6 +807,31 @@ clioptions_option_http_url (const char *arg,
     return true;
 }
 
+/**
+ * Description of the --compression_level command.
+ */
+static const char *clioptions_option_compression_level_desc =
+"Sets the zlib compression level (1-9) of the data packets sent to clients "
+"that support streaming compression. Each connection keeps its own "
+"compression stream, so repetitive data compresses well. 0 disables "
+"streaming compression.";
+/** @copydoc clioptions_handler_func */
+static bool
+clioptions_option_compression_level (const char *arg,
+                                     char      **errmsg)
+{
+    int val = atoi(arg);
+    if (val < 0 || val > 9) {
+        string_fmt(*errmsg,
+                   "Invalid value: %d; must be %d-%d",
+                   val, 0, 9);
+        return false;
+    }
+
+    settings.compression_level = val;
+    return true;
+}
+
 /**
  * Description of the --speed command.
  */
@@ -1002,6 +1034,9 @@ static void init_library(int argc, char *argv[])
     CLIOPTIONS_CREATE_ARGUMENT(cli, speed_multiplier, "Speed multiplier");
     clioptions_enable_changeable(cli);
     CLIOPTIONS_CREATE_ARGUMENT(cli, network_stack, "Configure network stack");
+    CLIOPTIONS_CREATE_ARGUMENT(cli,
+                               compression_level,
+                               "Set streaming compression level");
 
     CLIOPTIONS_CREATE_ARGUMENT(cli, http_server, "Enable the HTTP server");
 
@@ -196,11 +196,61 @@ static int get_real_light_source_value(int l)
     return light_mask[l];
 }
 
+/**
+ * Tiled map directions indexed by the horizontal and vertical sides of a
+ * map that a coordinate lies on (-1, 0 or 1, offset by one), used to
+ * resolve mask cells outside of a map without get_map_from_coord2().
+ */
+static const int light_tile_dir[3][3] = {
+    {TILED_NORTHWEST, TILED_WEST, TILED_SOUTHWEST},
+    {TILED_NORTH, -1, TILED_SOUTH},
+    {TILED_NORTHEAST, TILED_EAST, TILED_SOUTHEAST}
+};
+
+/**
+ * Horizontal and vertical side of a map for each of the tiled directions,
+ * the inverse of ::light_tile_dir.
+ */
+static const int light_tile_side[TILED_NUM_DIR][2] = {
+    {0, -1}, {1, 0}, {0, 1}, {-1, 0}, {1, -1}, {1, 1}, {-1, 1}, {-1, -1}
+};
+
+/** Tiled neighbour of a map has not been looked up yet. */
+#define LIGHT_TILE_UNKNOWN ((mapstruct *) -1)
+
+/**
+ * Resolve the tiled neighbour of a map in the specified direction.
+ * @param map
+ * The map.
+ * @param dir
+ * Tiled direction.
+ * @param[out] unloaded
+ * Set to true if the neighbour exists but is not loaded.
+ * @return
+ * The neighbour, NULL if there is no neighbour in memory.
+ */
+static mapstruct *light_tile_resolve(mapstruct *map, int dir, bool *unloaded)
+{
+    if (map->tile_path[dir] == NULL) {
+        *unloaded = false;
+        return NULL;
+    }
+
+    if (map->tile_map[dir] == NULL ||
+            map->tile_map[dir]->in_memory != MAP_IN_MEMORY) {
+        *unloaded = true;
+        return NULL;
+    }
+
+    *unloaded = false;
+    return map->tile_map[dir];
+}
+
 static int light_mask_adjust(mapstruct *map, int x, int y, int intensity, int mod, mapstruct *restore_map, int other_only)
 {
-    MapSpace *msp;
-    mapstruct *m;
-    int xt, yt, i, mlen, map_flag = 0;
+    mapstruct *m, *tiles[TILED_NUM_DIR];
+    bool unloaded[TILED_NUM_DIR];
+    int xt, yt, i, mlen, width, dir, map_flag = 0;
 
     if (intensity < 0) {
         mod = -mod;
@@ -208,17 +258,77 @@ static int light_mask_adjust(mapstruct *map, int x, int y, int intensity, int mo
 
     intensity = abs(intensity);
     mlen = light_mask_size[intensity];
+    width = light_mask_width[intensity];
+
+    /* Fast path: the whole mask lies inside this map, so the light values
+     * can be adjusted directly. */
+    if (x - width >= 0 && x + width < MAP_WIDTH(map) && y - width >= 0 &&
+            y + width < MAP_HEIGHT(map)) {
+        if ((restore_map != NULL && restore_map != map) || other_only) {
+            return 0;
+        }
+
+        for (i = 0; i < mlen; i++) {
+            GET_MAP_LIGHT(map, x + lmask_x[i], y + lmask_y[i]) +=
+                    light_masks[intensity][i] * mod;
+        }
+
+        return 0;
+    }
+
+    for (dir = 0; dir < TILED_NUM_DIR; dir++) {
+        tiles[dir] = LIGHT_TILE_UNKNOWN;
+    }
 
     for (i = 0; i < mlen; i++) {
         xt = x + lmask_x[i];
         yt = y + lmask_y[i];
 
-        if (!(m = get_map_from_coord2(map, &xt, &yt))) {
-            if (xt) {
-                map_flag = 1;
+        dir = light_tile_dir[(xt >= 0) + (xt >= MAP_WIDTH(map))]
+                [(yt >= 0) + (yt >= MAP_HEIGHT(map))];
+
+        if (dir == -1) {
+            m = map;
+        } else {
+            /* Look up each tiled neighbour only once per mask. */
+            if (tiles[dir] == LIGHT_TILE_UNKNOWN) {
+                tiles[dir] = light_tile_resolve(map, dir, &unloaded[dir]);
             }
 
-            continue;
+            m = tiles[dir];
+
+            if (m == NULL) {
+                if (unloaded[dir]) {
+                    map_flag = 1;
+                }
+
+                continue;
+            }
+
+            if (light_tile_side[dir][0] == -1) {
+                xt += MAP_WIDTH(m);
+            } else if (light_tile_side[dir][0] == 1) {
+                xt -= MAP_WIDTH(map);
+            }
+
+            if (light_tile_side[dir][1] == -1) {
+                yt += MAP_HEIGHT(m);
+            } else if (light_tile_side[dir][1] == 1) {
+                yt -= MAP_HEIGHT(map);
+            }
+
+            /* The neighbour is smaller than the mask; resolve the rest of
+             * the way the slow way. */
+            if (xt < 0 || xt >= MAP_WIDTH(m) || yt < 0 ||
+                    yt >= MAP_HEIGHT(m)) {
+                if (!(m = get_map_from_coord2(m, &xt, &yt))) {
+                    if (xt) {
+                        map_flag = 1;
+                    }
+
+                    continue;
+                }
+            }
         }
 
         if (restore_map && m != restore_map) {
@@ -234,13 +344,52 @@ static int light_mask_adjust(mapstruct *map, int x, int y, int intensity, int mo
             map_flag = 1;
         }
 
-        msp = GET_MAP_SPACE_PTR(m, xt, yt);
-        msp->light_value += light_masks[intensity][i] * mod;
+        GET_MAP_LIGHT(m, xt, yt) += light_masks[intensity][i] * mod;
     }
 
     return map_flag;
 }
 
+/**
+ * Check whether a light mask on a map reaches into the map's tiled
+ * neighbour in the specified direction.
+ * @param m
+ * Map the light is on.
+ * @param x
+ * X position of the light.
+ * @param y
+ * Y position of the light.
+ * @param intensity
+ * Intensity of the light.
+ * @param dir
+ * Direction of the neighbour, relative to 'm'.
+ * @return
+ * True if the light mask reaches the neighbour, false otherwise.
+ */
+static bool light_mask_reaches(mapstruct *m, int x, int y, int intensity,
+        int dir)
+{
+    int width = light_mask_width[abs(intensity)];
+
+    if (light_tile_side[dir][0] == -1 && x - width >= 0) {
+        return false;
+    }
+
+    if (light_tile_side[dir][0] == 1 && x + width < MAP_WIDTH(m)) {
+        return false;
+    }
+
+    if (light_tile_side[dir][1] == -1 && y - width >= 0) {
+        return false;
+    }
+
+    if (light_tile_side[dir][1] == 1 && y + width < MAP_HEIGHT(m)) {
+        return false;
+    }
+
+    return true;
+}
+
 /**
  * Add or remove a light source to a map space.
  * Adjust the light source map counter and apply
@@ -340,73 +489,8 @@ void check_light_source_list(mapstruct *map)
 
                 x = tmp->first->x;
                 y = tmp->first->y;
-                reaching = 1;
-
-                switch (i) {
-                case TILED_NORTH:
-
-                    if (y + light_mask_width[abs(intensity)] < MAP_HEIGHT(m)) {
-                        reaching = 0;
-                    }
-
-                    break;
-
-                case TILED_EAST:
-
-                    if (x - light_mask_width[abs(intensity)] >= 0) {
-                        reaching = 0;
-                    }
-
-                    break;
-
-                case TILED_SOUTH:
-
-                    if (y - light_mask_width[abs(intensity)] >= 0) {
-                        reaching = 0;
-                    }
-
-                    break;
-
-                case TILED_WEST:
-
-                    if (x + light_mask_width[abs(intensity)] < MAP_WIDTH(m)) {
-                        reaching = 0;
-                    }
-
-                    break;
-
-                case TILED_NORTHEAST:
-
-                    if ((y + light_mask_width[abs(intensity)]) < MAP_HEIGHT(m) || (x - light_mask_width[abs(intensity)]) >= 0) {
-                        reaching = 0;
-                    }
-
-                    break;
-
-                case TILED_SOUTHEAST:
-
-                    if ((x - light_mask_width[abs(intensity)]) >= 0 || (y - light_mask_width[abs(intensity)]) >= 0) {
-                        reaching = 0;
-                    }
-
-                    break;
-
-                case TILED_SOUTHWEST:
-
-                    if ((y - light_mask_width[abs(intensity)]) >= 0 || (x + light_mask_width[abs(intensity)]) < MAP_WIDTH(m)) {
-                        reaching = 0;
-                    }
-
-                    break;
-
-                case TILED_NORTHWEST:
-
-                    if ((y + light_mask_width[abs(intensity)]) < MAP_HEIGHT(m) || (x + light_mask_width[abs(intensity)]) < MAP_WIDTH(m)) {
-                        reaching = 0;
-                    }
-
-                    break;
-                }
+                reaching = light_mask_reaches(m, x, y, intensity,
+                        map_tiled_reverse[i]);
 
                 if (reaching) {
                     light_mask_adjust(m, x, y, intensity, 1, map, 0);
@@ -48,6 +48,29 @@ typedef struct blstr {
 
 static blocks block[MAP_CLIENT_X][MAP_CLIENT_Y];
 
+/**
+ * @defgroup LOS_VIEW_xxx LOS view flags
+ * Flags stored in the compact blocks view bitmap of the area around
+ * a player.
+ *@{*/
+/** The square blocks view. */
+#define LOS_VIEW_BLOCKSVIEW 0x01
+/** The square is outside of any map. */
+#define LOS_VIEW_OUT_OF_MAP 0x02
+/*@}*/
+
+/**
+ * @defgroup LOS_KEY_xxx LOS cache key flags
+ * Flags of player::los_key, besides the client view size.
+ *@{*/
+/** The cached line of sight is valid. */
+#define LOS_KEY_VALID (1U << 16)
+/** The player was blind. */
+#define LOS_KEY_BLIND (1U << 17)
+/** The player had xray. */
+#define LOS_KEY_XRAYS (1U << 18)
+/*@}*/
+
 static void expand_sight(object *op);
 
 /**
@@ -213,14 +236,18 @@ static void set_wall(object *op, int x, int y)
  * blocked, blocksview trigger or out of map.
  * @param op
  * The player object
+ * @param view
+ * Blocks view bitmap of the area around the player, as built by
+ * los_view_build().
  * @param x
  * X position based on MAP_CLIENT_X
  * @param y
  * Y position based on MAP_CLIENT_Y
  */
-static void check_wall(object *op, int x, int y)
+static void check_wall(object *op, uint8_t view[MAP_CLIENT_X][MAP_CLIENT_Y],
+        int x, int y)
 {
-    int ax, ay, flags;
+    int ax, ay;
 
     /* ax, ay are coordinates as indexed into the look window */
     ax = x - (MAP_CLIENT_X - CONTR(op)->cs->mapx) / 2;
@@ -235,7 +262,7 @@ static void check_wall(object *op, int x, int y)
          * blockview changes to this tiles will have no effect. */
 
         /* mark the space as OUT_OF_MAP. */
-        if (blocks_view(op->map, op->x + x - MAP_CLIENT_X / 2, op->y + y - MAP_CLIENT_Y / 2) & P_OUT_OF_MAP) {
+        if (view[x][y] & LOS_VIEW_OUT_OF_MAP) {
             CONTR(op)->blocked_los[ax][ay] = BLOCKED_LOS_OUT_OF_MAP;
         } else {
             /* ignore means ignore for LOS */
@@ -259,9 +286,9 @@ static void check_wall(object *op, int x, int y)
      * */
     if (CONTR(op)->blocked_los[ax][ay] & (BLOCKED_LOS_BLOCKED | BLOCKED_LOS_OUT_OF_MAP)) {
         if (CONTR(op)->blocked_los[ax][ay] & BLOCKED_LOS_BLOCKED) {
-            if ((flags = blocks_view(op->map, op->x + x - MAP_CLIENT_X / 2, op->y + y - MAP_CLIENT_Y / 2))) {
+            if (view[x][y]) {
                 /* mark the space as OUT_OF_MAP. */
-                if (flags & P_OUT_OF_MAP) {
+                if (view[x][y] & LOS_VIEW_OUT_OF_MAP) {
                     CONTR(op)->blocked_los[ax][ay] = BLOCKED_LOS_OUT_OF_MAP;
                 } else {
                     CONTR(op)->blocked_los[ax][ay] |= BLOCKED_LOS_BLOCKSVIEW;
@@ -271,13 +298,13 @@ static void check_wall(object *op, int x, int y)
         return;
     }
 
-    if ((flags = blocks_view(op->map, op->x + x - MAP_CLIENT_X / 2, op->y + y - MAP_CLIENT_Y / 2))) {
+    if (view[x][y]) {
         set_wall(op, x, y);
 
         /* out of map clears all other flags! */
 
         /* Mark the space as OUT_OF_MAP. */
-        if (flags & P_OUT_OF_MAP) {
+        if (view[x][y] & LOS_VIEW_OUT_OF_MAP) {
             CONTR(op)->blocked_los[ax][ay] = BLOCKED_LOS_OUT_OF_MAP;
         } else {
             CONTR(op)->blocked_los[ax][ay] |= BLOCKED_LOS_BLOCKSVIEW;
@@ -285,6 +312,42 @@ static void check_wall(object *op, int x, int y)
     }
 }
 
+/**
+ * Build a compact bitmap of the squares blocking view in the client
+ * view area around the player.
+ * @param op
+ * The player object.
+ * @param[out] view
+ * Where to store the bitmap, indexed the same as the ::block table.
+ */
+static void los_view_build(object *op, uint8_t view[MAP_CLIENT_X][MAP_CLIENT_Y])
+{
+    int x, y, xt, yt, flags;
+
+    memset(view, 0, sizeof(uint8_t) * MAP_CLIENT_X * MAP_CLIENT_Y);
+
+    for (x = (MAP_CLIENT_X - CONTR(op)->cs->mapx) / 2; x < (MAP_CLIENT_X + CONTR(op)->cs->mapx) / 2; x++) {
+        for (y = (MAP_CLIENT_Y - CONTR(op)->cs->mapy) / 2; y < (MAP_CLIENT_Y + CONTR(op)->cs->mapy) / 2; y++) {
+            xt = op->x + x - MAP_CLIENT_X / 2;
+            yt = op->y + y - MAP_CLIENT_Y / 2;
+
+            /* Most of the view is usually on the player's own map, so
+             * avoid resolving the coordinates for those squares. */
+            if (xt >= 0 && xt < MAP_WIDTH(op->map) && yt >= 0 && yt < MAP_HEIGHT(op->map)) {
+                flags = GET_MAP_FLAGS(op->map, xt, yt) & P_BLOCKSVIEW;
+            } else {
+                flags = blocks_view(op->map, xt, yt);
+            }
+
+            if (flags & P_OUT_OF_MAP) {
+                view[x][y] = LOS_VIEW_BLOCKSVIEW | LOS_VIEW_OUT_OF_MAP;
+            } else if (flags) {
+                view[x][y] = LOS_VIEW_BLOCKSVIEW;
+            }
+        }
+    }
+}
+
 /**
  * Sets all viewable squares to blocked except for the central one that
  * the player occupies. A little odd that you can see yourself (and what
@@ -314,24 +377,50 @@ static void blinded_sight(object *op)
 void update_los(object *op)
 {
     int dx = CONTR(op)->cs->mapx_2, dy = CONTR(op)->cs->mapy_2, x, y;
+    uint8_t view[MAP_CLIENT_X][MAP_CLIENT_Y];
+    uint32_t key;
 
     if (QUERY_FLAG(op, FLAG_REMOVED)) {
         return;
     }
 
-    clear_los(op);
-
     if (CONTR(op)->tls) {
+        clear_los(op);
+        CONTR(op)->los_key = 0;
         return;
     }
 
+    los_view_build(op, view);
+
+    key = CONTR(op)->cs->mapx | (CONTR(op)->cs->mapy << 8) | LOS_KEY_VALID;
+
+    if (QUERY_FLAG(op, FLAG_BLIND)) {
+        key |= LOS_KEY_BLIND;
+    }
+
+    if (QUERY_FLAG(op, FLAG_XRAYS)) {
+        key |= LOS_KEY_XRAYS;
+    }
+
+    /* The line of sight only depends on what blocks view around the
+     * player, so if that has not changed, neither has blocked_los. This
+     * is commonly the case when moving around in open areas. */
+    if (CONTR(op)->los_key == key && memcmp(CONTR(op)->los_view, view, sizeof(view)) == 0) {
+        return;
+    }
+
+    CONTR(op)->los_key = key;
+    memcpy(CONTR(op)->los_view, view, sizeof(view));
+
+    clear_los(op);
+
     /* For larger maps, this is more efficient than the old way which
      * used the chaining of the block array.  Since many space views could
      * be blocked by different spaces in front, this mean that a lot of spaces
      * could be examined multile times, as each path would be looked at. */
     for (x = (MAP_CLIENT_X - CONTR(op)->cs->mapx) / 2; x < (MAP_CLIENT_X + CONTR(op)->cs->mapx) / 2; x++) {
         for (y = (MAP_CLIENT_Y - CONTR(op)->cs->mapy) / 2; y < (MAP_CLIENT_Y + CONTR(op)->cs->mapy) / 2; y++) {
-            check_wall(op, x, y);
+            check_wall(op, view, x, y);
         }
     }
 
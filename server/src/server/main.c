@@ -142,8 +142,82 @@ void set_map_timeout(mapstruct *map)
 #endif
 }
 
+/**
+ * Accounts for the ticks an active object slept through in the timer wheel,
+ * as if it had been on the active list (but not processed) during them.
+ * @param op
+ * The object.
+ */
+static void
+process_events_catch_up (object *op)
+{
+    long skipped = pticks - op->active_skipped;
+    op->active_skipped = 0;
+
+    if (skipped <= 0) {
+        return;
+    }
+
+    if (op->weapon_speed_left > 0 && op->weapon_speed > 0) {
+        long ticks = (long) ceil(op->weapon_speed_left / op->weapon_speed);
+        op->weapon_speed_left -= op->weapon_speed * MIN(skipped, ticks);
+    }
+
+    if (op->speed_left <= 0) {
+        /* Leave the last increment to this tick, so that an object that
+         * became ready while sleeping is processed now. */
+        double speed = FABS(op->speed);
+        long ticks = (long) ceil(-op->speed_left / speed) - 1;
+        op->speed_left += speed * MIN(skipped, MAX(0, ticks));
+    }
+
+    if (QUERY_FLAG(op, FLAG_ANIMATE) && op->last_anim < op->anim_speed) {
+        op->last_anim = MIN(op->anim_speed, op->last_anim + skipped);
+    }
+}
+
+/**
+ * Calculates how many ticks it will be until an active object that was just
+ * processed needs to be looked at again.
+ * @param op
+ * The object.
+ * @return
+ * Number of ticks.
+ */
+static long
+process_events_delay (object *op)
+{
+    /* Players, weapon swing timers and moving/attacking animations need
+     * attention every tick. */
+    if (op->type == PLAYER || op->weapon_speed_left > 0 ||
+        op->anim_flags & (ANIM_FLAG_MOVING | ANIM_FLAG_ATTACKING |
+                          ANIM_FLAG_STOP_MOVING | ANIM_FLAG_STOP_ATTACKING)) {
+        return 1;
+    }
+
+    if (op->speed_left > 0) {
+        return 1;
+    }
+
+    long delay = MAX(1, (long) ceil(-op->speed_left / FABS(op->speed)));
+
+    if (QUERY_FLAG(op, FLAG_ANIMATE)) {
+        if (op->last_anim >= op->anim_speed) {
+            return 1;
+        }
+
+        delay = MIN(delay, op->anim_speed - op->last_anim + 1);
+    }
+
+    return delay;
+}
+
 /**
  * Process objects with speed, like teleporters, players, etc.
+ *
+ * Objects that will not need any attention for a number of ticks are put to
+ * sleep in a timer wheel (see object_active_sleep()), so only the objects
+ * that are due are walked.
  */
 void
 process_events (void)
@@ -151,6 +225,10 @@ process_events (void)
     object *op;
     tag_t tag;
 
+    /* Move the objects that are due from the timer wheel to the active
+     * list. */
+    object_active_wake();
+
     /* Put marker object at beginning of active list */
     marker.active_next = active_objects;
 
@@ -224,6 +302,10 @@ process_events (void)
             continue;
         }
 
+        if (op->active_skipped != 0) {
+            process_events_catch_up(op);
+        }
+
         /* As long we are > 0, we are not ready to swing. */
         if (op->weapon_speed_left > 0) {
             op->weapon_speed_left -= op->weapon_speed;
@@ -285,6 +367,14 @@ process_events (void)
                 op->last_anim++;
             }
         }
+
+        /* Still on the active list, so it can go to sleep until it is
+         * due again. */
+        if (op->active_slot == NULL &&
+            (op->active_next != NULL || op->active_prev != NULL ||
+             op == active_objects)) {
+            object_active_sleep(op, process_events_delay(op));
+        }
     }
 
     /* Remove marker object from active list */
@@ -334,21 +424,47 @@ void server_shutdown(void)
     exit(0);
 }
 
+/**
+ * Process the next finished path computation or path request.
+ *
+ * @return
+ * False if there was nothing to process, true otherwise.
+ */
+static bool dequeue_path_request(void)
+{
+    path_node_t *path;
+    object *wp = path_get_next_result(&path);
+
+    if (wp != NULL) {
+        if (path != NULL) {
+            waypoint_set_path(wp, path);
+        } else {
+            waypoint_compute_path(wp, false);
+        }
+
+        return true;
+    }
+
+    wp = path_get_next_request();
+
+    if (wp != NULL) {
+        waypoint_compute_path(wp, true);
+        return true;
+    }
+
+    return false;
+}
+
 /**
  * Dequeue path requests.
- * @todo Only compute time if there is something more in the queue,
- * something like if (path_request_queue_empty()) { break; }
  */
 static void dequeue_path_requests(void)
 {
 #ifdef LEFTOVER_CPU_FOR_PATHFINDING
     static struct timeval new_time;
     long leftover_sec, leftover_usec;
-    object *wp;
-
-    while ((wp = path_get_next_request())) {
-        waypoint_compute_path(wp);
 
+    while (dequeue_path_request()) {
         (void) GETTIMEOFDAY(&new_time);
 
         leftover_sec = last_time.tv_sec - new_time.tv_sec;
@@ -370,11 +486,7 @@ static void dequeue_path_requests(void)
         }
     }
 #else
-    object *wp = path_get_next_request();
-
-    if (wp) {
-        waypoint_compute_path(wp);
-    }
+    dequeue_path_request();
 #endif
 }
 
@@ -77,11 +77,33 @@ static int map_tiled_coords[TILED_NUM][3] = {
 
 static mempool_struct *pool_map; ///< Map structures pool.
 static uint32_t map_count;
+/** Current map update pass; see map_render_cache_get(). */
+static uint32_t map_render_tag = 1;
+
+/** Maximum number of tiled maps map_live_find() will look at. */
+#define MAP_LIVE_FIND_MAPS 32
+
+/**
+ * Candidate found by map_live_find().
+ */
+typedef struct map_live_candidate {
+    object *op; ///< Head of the living object.
+    int distance; ///< Distance from the search center.
+} map_live_candidate_t;
+
+/** Scratch buffer for candidates found by map_live_find(). */
+static map_live_candidate_t *map_live_candidates;
+/** Result buffer returned by map_live_find(). */
+static object **map_live_results;
+/** Allocated size of the map_live_find() buffers. */
+static size_t map_live_size;
 
 #define DEBUG_OLDFLAGS 0
 
-static void load_objects(mapstruct *m, FILE *fp, int mapflags);
-static void save_objects(mapstruct *m, FILE *fp, FILE *fp2);
+static void load_objects(mapstruct *m, FILE *fp, object_binary_t *ob,
+        int mapflags);
+static void save_objects(mapstruct *m, FILE *fp, FILE *fp2,
+        object_binary_t *bin, object_binary_t *bin2);
 static void allocate_map(mapstruct *m);
 static void free_all_objects(mapstruct *m);
 
@@ -598,9 +620,8 @@ blocked_self (object *op, mapstruct *m, int x, int y)
 int blocked(object *op, mapstruct *m, int x, int y, int terrain)
 {
     int flags;
-    MapSpace *msp;
 
-    flags = (msp = GET_MAP_SPACE_PTR(m, x, y))->flags;
+    flags = GET_MAP_FLAGS(m, x, y);
 
     /* Flying objects can move over various terrains. */
     if (op && QUERY_FLAG(op, FLAG_FLYING)) {
@@ -610,7 +631,7 @@ int blocked(object *op, mapstruct *m, int x, int y, int terrain)
 
     /* First, look at the terrain. If we don't have a valid terrain flag,
      * this is forbidden to enter. */
-    if (msp->move_flags & ~terrain) {
+    if (GET_MAP_MOVE_FLAGS(m, x, y) & ~terrain) {
         return flags | P_NO_TERRAIN;
     }
 
@@ -642,7 +663,8 @@ int blocked(object *op, mapstruct *m, int x, int y, int terrain)
      * area, in which case they can't. */
     if (flags & P_IS_PLAYER && IS_LIVE(op) && (op->type != PLAYER ||
             (m->map_flags & MAP_FLAG_PVP && !(flags & P_NO_PVP) &&
-            !(msp->extra_flags & MSP_EXTRA_NO_PVP)))) {
+            !(GET_MAP_SPACE_PTR(m, x, y)->extra_flags &
+            MSP_EXTRA_NO_PVP)))) {
         return flags;
     }
 
@@ -761,6 +783,86 @@ int arch_blocked(struct archetype *at, object *op, mapstruct *m, int x, int y)
     return 0;
 }
 
+/**
+ * Loads the map header from a map file, which can be in either the text or
+ * the binary format.
+ * @param m
+ * Map being loaded.
+ * @param fp
+ * File to read from.
+ * @param[out] ob
+ * Will contain the binary file to load the objects from, or NULL if the
+ * file is in the text format. Must be freed by the caller.
+ * @return
+ * 1 on success, 0 on failure.
+ */
+static int load_map_header_fp(mapstruct *m, FILE *fp, object_binary_t **ob)
+{
+    char *data;
+    size_t len;
+    int ret;
+
+    *ob = NULL;
+
+    if (!object_binary_check(fp)) {
+        return load_map_header(m, fp);
+    }
+
+    *ob = object_binary_open(fp);
+
+    if (*ob == NULL) {
+        return 0;
+    }
+
+    data = object_binary_get_data(*ob, &len);
+
+    if (data == NULL) {
+        return 0;
+    }
+
+    ret = load_map_header_str(m, data);
+    efree(data);
+    return ret;
+}
+
+/**
+ * Inserts an object loaded by load_objects() into the map.
+ * @param m
+ * Map being loaded.
+ * @param op
+ * The loaded object.
+ * @param mapflags
+ * The same as we get with load_original_map().
+ */
+static void load_objects_insert(mapstruct *m, object *op, int mapflags)
+{
+    /* Do some safety for containers */
+    if (op->type == CONTAINER) {
+        /* Used for containers as link to players viewing it */
+        op->attacked_by = NULL;
+        op->attacked_by_count = 0;
+        object_weight_sum(op);
+    }
+
+    if (op->type == MONSTER) {
+        living_update_monster(op);
+    }
+
+    /* Important pre set for the animation/face of a object */
+    if (QUERY_FLAG(op, FLAG_IS_TURNABLE) || QUERY_FLAG(op, FLAG_ANIMATE)) {
+        SET_ANIMATION(op, (NUM_ANIMATIONS(op) / NUM_FACINGS(op)) * op->direction + op->state);
+    }
+
+    object_insert_map(op, m, op, INS_NO_MERGE | INS_NO_WALK_ON);
+
+    if (QUERY_FLAG(op, FLAG_AUTO_APPLY)) {
+        object_auto_apply(op);
+    } else if ((mapflags & MAP_ORIGINAL) && op->randomitems) {
+        /* For fresh maps, create treasures */
+        treasure_generate(op->randomitems, op, op->level ? op->level : m->difficulty, op->type != TREASURE ? GT_APPLY : 0);
+    }
+}
+
 /**
  * Loads (and parses) the objects into a given map from the specified
  * file pointer.
@@ -768,19 +870,32 @@ int arch_blocked(struct archetype *at, object *op, mapstruct *m, int x, int y)
  * Map being loaded.
  * @param fp
  * File to read from.
+ * @param ob
+ * If not NULL, the objects are loaded from this binary file.
  * @param mapflags
  * The same as we get with load_original_map().
  */
-static void load_objects(mapstruct *m, FILE *fp, int mapflags)
+static void load_objects(mapstruct *m, FILE *fp, object_binary_t *ob,
+        int mapflags)
 {
     object *op = object_get();
     /* To handle buttons correctly */
     op->map = m;
 
-    void *buffer = create_loader_buffer(fp);
+    void *buffer = NULL;
+
+    if (ob == NULL) {
+        buffer = create_loader_buffer(fp);
+    }
 
     int rc;
-    while ((rc = load_object_buffer(buffer, op, mapflags)) != LL_EOF) {
+    while ((rc = ob != NULL ? object_binary_load(ob, op, mapflags) :
+            load_object_buffer(buffer, op, mapflags)) != LL_EOF) {
+        if (rc == LL_ERROR) {
+            LOG(ERROR, "Error loading objects for map %s.", m->path);
+            break;
+        }
+
         if (rc == LL_MORE) {
             LOG(ERROR, "Encountered tail object: %s", object_get_str(op));
             continue;
@@ -794,43 +909,40 @@ static void load_objects(mapstruct *m, FILE *fp, int mapflags)
             continue;
         }
 
-        /* Do some safety for containers */
-        if (op->type == CONTAINER) {
-            /* Used for containers as link to players viewing it */
-            op->attacked_by = NULL;
-            op->attacked_by_count = 0;
-            object_weight_sum(op);
-        }
-
-        if (op->type == MONSTER) {
-            living_update_monster(op);
-        }
-
-        /* Important pre set for the animation/face of a object */
-        if (QUERY_FLAG(op, FLAG_IS_TURNABLE) || QUERY_FLAG(op, FLAG_ANIMATE)) {
-            SET_ANIMATION(op, (NUM_ANIMATIONS(op) / NUM_FACINGS(op)) * op->direction + op->state);
-        }
-
-        object_insert_map(op, m, op, INS_NO_MERGE | INS_NO_WALK_ON);
-
-        if (QUERY_FLAG(op, FLAG_AUTO_APPLY)) {
-            object_auto_apply(op);
-        } else if ((mapflags & MAP_ORIGINAL) && op->randomitems) {
-            /* For fresh maps, create treasures */
-            treasure_generate(op->randomitems, op, op->level ? op->level : m->difficulty, op->type != TREASURE ? GT_APPLY : 0);
-        }
+        load_objects_insert(m, op, mapflags);
 
         op = object_get();
         op->map = m;
     }
 
-    delete_loader_buffer(buffer);
+    if (buffer != NULL) {
+        delete_loader_buffer(buffer);
+    }
+
     object_destroy(op);
 
     m->in_memory = MAP_IN_MEMORY;
     check_light_source_list(m);
 }
 
+/**
+ * Saves an object to a map file, in either the text or the binary format.
+ * @param op
+ * Object to save.
+ * @param fp
+ * File to save the object to, if saving in the text format.
+ * @param ob
+ * Binary file to save the object to; if NULL, the text format is used.
+ */
+static void save_object(object *op, FILE *fp, object_binary_t *ob)
+{
+    if (ob != NULL) {
+        object_binary_save(ob, op);
+    } else {
+        object_save(op, fp);
+    }
+}
+
 /**
  * This saves all the objects on the map in a non destructive fashion.
  * @param m
@@ -839,8 +951,13 @@ static void load_objects(mapstruct *m, FILE *fp, int mapflags)
  * File where regular objects are saved.
  * @param fp2
  * File to save unique objects.
+ * @param bin
+ * Binary file for regular objects, NULL to save them as text.
+ * @param bin2
+ * Binary file for unique objects, NULL to save them as text.
  */
-static void save_objects(mapstruct *m, FILE *fp, FILE *fp2)
+static void save_objects(mapstruct *m, FILE *fp, FILE *fp2,
+        object_binary_t *bin, object_binary_t *bin2)
 {
     int x, y;
     object *ob, *next, *head, *tmp, *owner;
@@ -878,9 +995,9 @@ static void save_objects(mapstruct *m, FILE *fp, FILE *fp2)
                             tmp->y = head->y;
 
                             if (unique || QUERY_FLAG(tmp, FLAG_UNIQUE)) {
-                                object_save(tmp, fp2);
+                                save_object(tmp, fp2, bin2);
                             } else {
-                                object_save(tmp, fp);
+                                save_object(tmp, fp, bin);
                             }
                         }
                     }
@@ -912,9 +1029,9 @@ static void save_objects(mapstruct *m, FILE *fp, FILE *fp2)
                 }
 
                 if (unique || QUERY_FLAG(head, FLAG_UNIQUE)) {
-                    object_save(head, fp2);
+                    save_object(head, fp2, bin2);
                 } else {
-                    object_save(head, fp);
+                    save_object(head, fp, bin);
                 }
             }
         }
@@ -960,15 +1077,17 @@ static void allocate_map(mapstruct *m)
 {
     SOFT_ASSERT(m->spaces == NULL, "Map spaces are not NULL: %s", m->path);
     SOFT_ASSERT(m->buttons == NULL, "Buttons are not NULL: %s", m->path);
-    SOFT_ASSERT(m->bitmap == NULL, "Bitmap is not NULL: %s", m->path);
-    SOFT_ASSERT(m->path_nodes == NULL, "Path nodes are not NULL: %s", m->path);
 
     m->in_memory = MAP_LOADING;
 
     m->spaces = ecalloc(1, MAP_WIDTH(m) * MAP_HEIGHT(m) * sizeof(MapSpace));
-    m->bitmap = emalloc(((MAP_WIDTH(m) + 31) / 32) * MAP_HEIGHT(m) *
-            sizeof(*m->bitmap));
-    m->path_nodes = emalloc(MAP_WIDTH(m) * MAP_HEIGHT(m) * sizeof(*m->path_nodes));
+    m->space_flags = ecalloc(MAP_SIZE(m), sizeof(*m->space_flags));
+    m->space_move_flags = ecalloc(MAP_SIZE(m), sizeof(*m->space_move_flags));
+    m->space_light = ecalloc(MAP_SIZE(m), sizeof(*m->space_light));
+    m->space_update = ecalloc(MAP_SIZE(m), sizeof(*m->space_update));
+    m->live_buckets = ecalloc(MAP_LIVE_BUCKETS_X(m) * MAP_LIVE_BUCKETS_Y(m),
+                              sizeof(*m->live_buckets));
+    m->render_cache = ecalloc(MAP_SIZE(m), sizeof(*m->render_cache));
 }
 
 /**
@@ -1056,6 +1175,7 @@ mapstruct *load_original_map(const char *filename, mapstruct *originator,
         int flags)
 {
     FILE *fp;
+    object_binary_t *ob = NULL;
     mapstruct *m;
     char pathname[HUGE_BUF], split[MAX_BUF];
     const char *basename;
@@ -1077,8 +1197,15 @@ mapstruct *load_original_map(const char *filename, mapstruct *originator,
         string_replace_char(real_path, "$", '/');
     }
 
-    if (flags & MAP_PLAYER_UNIQUE && !path_exists(pathname)) {
-        fp = fopen(create_pathname(real_path), "rb");
+    if (flags & MAP_PLAYER_UNIQUE) {
+        /* The map may have a save queued on the swap writer thread that
+         * hasn't reached the disk yet; swap_open() reads that instead.
+         * If the map was never saved, load the original map. */
+        fp = swap_open(pathname);
+
+        if (fp == NULL) {
+            fp = fopen(create_pathname(real_path), "rb");
+        }
     } else {
         fp = fopen(pathname, "rb");
     }
@@ -1096,11 +1223,16 @@ mapstruct *load_original_map(const char *filename, mapstruct *originator,
         m->map_flags |= MAP_FLAG_UNIQUE;
     }
 
-    if (fp != NULL && !load_map_header(m, fp)) {
+    if (fp != NULL && !load_map_header_fp(m, fp, &ob)) {
         log_error("Failure loading map header for %s, flags=%d",
                 filename, flags);
         delete_map(m);
         fclose(fp);
+
+        if (ob != NULL) {
+            object_binary_free(ob);
+        }
+
         return NULL;
     }
 
@@ -1204,8 +1336,12 @@ mapstruct *load_original_map(const char *filename, mapstruct *originator,
     m->in_memory = MAP_LOADING;
 
     if (fp != NULL) {
-        load_objects(m, fp, (flags & (MAP_BLOCK | MAP_STYLE)) | MAP_ORIGINAL);
+        load_objects(m, fp, ob, (flags & (MAP_BLOCK | MAP_STYLE)) | MAP_ORIGINAL);
         fclose(fp);
+
+        if (ob != NULL) {
+            object_binary_free(ob);
+        }
     } else {
         m->in_memory = MAP_IN_MEMORY;
     }
@@ -1235,6 +1371,7 @@ mapstruct *load_original_map(const char *filename, mapstruct *originator,
 static mapstruct *load_temporary_map(mapstruct *m)
 {
     FILE *fp;
+    object_binary_t *ob;
     char buf[HUGE_BUF];
 
     if (!m->tmpname) {
@@ -1245,7 +1382,7 @@ static mapstruct *load_temporary_map(mapstruct *m)
         return m;
     }
 
-    fp = fopen(m->tmpname, "rb");
+    fp = swap_open(m->tmpname);
 
     if (!fp) {
         if (!strncmp(m->path, "/random/", 8)) {
@@ -1259,20 +1396,30 @@ static mapstruct *load_temporary_map(mapstruct *m)
         return m;
     }
 
-    if (!load_map_header(m, fp)) {
+    if (!load_map_header_fp(m, fp, &ob)) {
         LOG(BUG, "Error loading map header for %s (%s)! Fallback to original!", m->path, m->tmpname);
         snprintf(buf, sizeof(buf), "%s", m->path);
         delete_map(m);
         m = load_original_map(buf, NULL, 0);
         fclose(fp);
+
+        if (ob != NULL) {
+            object_binary_free(ob);
+        }
+
         return m;
     }
 
     allocate_map(m);
 
     m->in_memory = MAP_LOADING;
-    load_objects (m, fp, 0);
+    load_objects(m, fp, ob, 0);
     fclose(fp);
+
+    if (ob != NULL) {
+        object_binary_free(ob);
+    }
+
     return m;
 }
 
@@ -1323,7 +1470,7 @@ static void load_unique_objects(mapstruct *m)
 
     for (count = 0; count < 10; count++) {
         snprintf(firstname, sizeof(firstname), "%s.v%02d", create_items_path(m->path), count);
-        fp = fopen(firstname, "rb");
+        fp = swap_open(firstname);
 
         if (fp != NULL) {
             break;
@@ -1342,10 +1489,37 @@ static void load_unique_objects(mapstruct *m)
         delete_unique_items(m);
     }
 
-    load_objects(m, fp, 0);
+    if (object_binary_check(fp)) {
+        object_binary_t *ob = object_binary_open(fp);
+
+        if (ob != NULL) {
+            load_objects(m, fp, ob, 0);
+            object_binary_free(ob);
+        } else {
+            LOG(BUG, "Failed to load unique items file %s", firstname);
+            m->in_memory = MAP_IN_MEMORY;
+        }
+    } else {
+        load_objects(m, fp, NULL, 0);
+    }
+
     fclose(fp);
 }
 
+/**
+ * Saves the map header to a binary map file.
+ * @param m
+ * The map.
+ * @param ob
+ * The binary file.
+ */
+static void save_map_header_binary(mapstruct *m, object_binary_t *ob)
+{
+    char *data = save_map_header_str(m, 0);
+    object_binary_put_data(ob, data, strlen(data));
+    efree(data);
+}
+
 /**
  * Saves a map to file.  If flag is set, it is saved into the same
  * file it was (originally) loaded from.  Otherwise a temporary
@@ -1353,17 +1527,27 @@ static void load_unique_objects(mapstruct *m)
  * The temporary filename will be stored in the mapstructure.
  * If the map is unique, we also save to the filename in the map
  * (this should have been updated when first loaded).
+ *
+ * In asynchronous mode the map is serialized into memory, and writing
+ * the files is left to the swap writer thread; see swap_write_file().
+ * Where swap_memstream() is not available, the map is saved
+ * synchronously.
  * @param m
  * The map to save.
  * @param flag
  * Save flag.
+ * @param async
+ * Whether to write the files asynchronously.
  * @return
- *
+ * 0 on success, -1 on failure.
  */
-int new_save_map(mapstruct *m, int flag)
+static int map_save(mapstruct *m, int flag, bool async)
 {
     FILE *fp, *fp2;
     char filename[MAX_BUF], buf[MAX_BUF];
+    char *data = NULL, *items_data = NULL;
+    size_t len = 0, items_len = 0;
+    object_binary_t *ob = NULL, *ob2;
 
     if (flag && !*m->path) {
         return -1;
@@ -1382,8 +1566,6 @@ int new_save_map(mapstruct *m, int flag)
         }
 
         path_ensure_directories(filename);
-
-        fp = fopen(filename, "w");
     } else {
         if (m->tmpname == NULL) {
             char path[MAX_BUF];
@@ -1400,21 +1582,28 @@ int new_save_map(mapstruct *m, int flag)
                 return -1;
             }
 
-            fp = fdopen(fd, "w");
-
-            if (fp == NULL) {
-                LOG(ERROR, "Can't open file %s for saving: %d (%s)",
-                        filename, errno, strerror(errno));
-                close(fd);
-                return -1;
-            }
-        } else {
-            fp = fopen(m->tmpname, "w");
+            close(fd);
         }
 
         snprintf(VS(filename), "%s", m->tmpname);
     }
 
+    if (async) {
+        fp = swap_memstream(&data, &len);
+
+        /* Write the file directly if it can't be serialized into
+         * memory. */
+        if (fp == NULL) {
+            async = false;
+        }
+    }
+
+    if (!async) {
+        /* Don't let a pending asynchronous save overwrite this one. */
+        swap_cancel(filename);
+        fp = fopen(filename, "w");
+    }
+
     if (fp == NULL) {
         LOG(ERROR, "Can't open file %s for saving: %d (%s)", filename,
                 errno, strerror(errno));
@@ -1423,42 +1612,114 @@ int new_save_map(mapstruct *m, int flag)
 
     m->in_memory = MAP_SAVING;
 
-    save_map_header(m, fp, flag);
+    /* Files that are only read back by the server are saved in the
+     * binary format. */
+    if (!flag) {
+        ob = object_binary_create(fp);
+        save_map_header_binary(m, ob);
+    } else {
+        save_map_header(m, fp, flag);
+    }
 
     /* Save unique items into fp2 */
     fp2 = fp;
+    ob2 = ob;
 
     if (!MAP_UNIQUE(m)) {
+        long items_start = 0;
+
         snprintf(buf, sizeof(buf), "%s.v00", create_items_path(m->path));
 
-        if ((fp2 = fopen(buf, "w")) == NULL) {
+        if (async) {
+            fp2 = swap_memstream(&items_data, &items_len);
+        } else {
+            swap_cancel(buf);
+            fp2 = fopen(buf, "w");
+        }
+
+        if (fp2 == NULL) {
             LOG(BUG, "Can't open unique items file %s", buf);
+            ob2 = NULL;
+        } else if (ob != NULL) {
+            ob2 = object_binary_create(fp2);
+            items_start = ftell(fp2);
+        }
+
+        save_objects(m, fp, fp2, ob, ob2);
+
+        if (ob2 != NULL) {
+            object_binary_free(ob2);
         }
 
-        save_objects(m, fp, fp2);
+        if (fp2 != NULL) {
+            bool empty = ftell(fp2) == items_start;
 
-        if (fp2) {
-            if (ftell(fp2) == 0) {
-                fclose(fp2);
+            fclose(fp2);
+
+            if (async) {
+                /* Empty unique items file is removed by the writer. */
+                if (empty) {
+                    free(items_data);
+                    items_data = NULL;
+                    items_len = 0;
+                }
+
+                swap_write_file(buf, items_data, items_len, SAVE_MODE, NULL);
+            } else if (empty) {
                 unlink(buf);
             } else {
-                fclose(fp2);
                 chmod(buf, SAVE_MODE);
             }
         }
     } else {
         /* Otherwise to the same file, like apartments */
-        save_objects(m, fp, fp);
+        save_objects(m, fp, fp, ob, ob);
     }
 
-    if (fp) {
-        fclose(fp);
+    if (ob != NULL) {
+        object_binary_free(ob);
+    }
+
+    fclose(fp);
+
+    if (async) {
+        swap_write_file(filename, data, len, SAVE_MODE, NULL);
+    } else {
+        chmod(filename, SAVE_MODE);
     }
 
-    chmod(filename, SAVE_MODE);
     return 0;
 }
 
+/**
+ * Saves a map to file.
+ *
+ * See map_save() for details.
+ * @param m
+ * The map to save.
+ * @param flag
+ * Save flag.
+ * @return
+ * 0 on success, -1 on failure.
+ */
+int new_save_map(mapstruct *m, int flag)
+{
+    return map_save(m, flag, false);
+}
+
+/**
+ * Saves a map to its temporary file asynchronously. The map is
+ * serialized into memory, so it can be freed as soon as this returns.
+ * @param m
+ * The map to save.
+ * @return
+ * 0 on success, -1 on failure.
+ */
+int new_save_map_async(mapstruct *m)
+{
+    return map_save(m, 0, true);
+}
+
 /**
  * Remove and free all objects in the given map.
  * @param m
@@ -1499,6 +1760,7 @@ void free_map(mapstruct *m, int flag)
     }
 
     remove_light_source_list(m);
+    path_cluster_free(m);
 
     if (m->buttons) {
         free_objectlinkpt(m->buttons);
@@ -1512,6 +1774,12 @@ void free_map(mapstruct *m, int flag)
     FREE_AND_CLEAR_HASH(m->bg_music);
     FREE_AND_CLEAR_HASH(m->weather);
     FREE_AND_NULL_PTR(m->spaces);
+    FREE_AND_NULL_PTR(m->space_flags);
+    FREE_AND_NULL_PTR(m->space_move_flags);
+    FREE_AND_NULL_PTR(m->space_light);
+    FREE_AND_NULL_PTR(m->space_update);
+    FREE_AND_NULL_PTR(m->live_buckets);
+    FREE_AND_NULL_PTR(m->render_cache);
     FREE_AND_NULL_PTR(m->msg);
     m->buttons = NULL;
     m->first_light = NULL;
@@ -1524,6 +1792,7 @@ void free_map(mapstruct *m, int flag)
             }
 
             m->tile_map[i]->tile_map[map_tiled_reverse[i]] = NULL;
+            path_cluster_free(m->tile_map[i]);
             m->tile_map[i] = NULL;
         }
 
@@ -1541,8 +1810,6 @@ void free_map(mapstruct *m, int flag)
         m->events = NULL;
     }
 
-    FREE_AND_NULL_PTR(m->bitmap);
-    FREE_AND_NULL_PTR(m->path_nodes);
     m->in_memory = MAP_SWAPPED;
 }
 
@@ -1665,6 +1932,7 @@ void clean_tmp_map(mapstruct *m)
         return;
     }
 
+    swap_cancel(m->tmpname);
     unlink(m->tmpname);
 
     efree(m->tmpname);
@@ -1688,112 +1956,179 @@ void free_all_maps(void)
 
         delete_map(map);
     }
+
+    FREE_AND_NULL_PTR(map_live_candidates);
+    FREE_AND_NULL_PTR(map_live_results);
+    map_live_size = 0;
 }
 
+/** Index of @ref P_PASS_THRU in MapSpace::flag_count. */
+#define P_PASS_THRU_BIT 10
+/** Index of @ref P_BLOCKER in MapSpace::flag_count. */
+#define P_BLOCKER_BIT 11
+
 /**
- * This function updates various attributes about a specific space on the
- * map (what it looks like, whether it blocks magic, has a living
- * creatures, prevents people from passing through, etc).
- *
- * @param m
- * Map to update.
- * @param x
- * X position on the given map.
- * @param y
- * Y position on the given map.
+ * Calculates the map space flags an object contributes to the tile it is
+ * on.
+ * @param op
+ * The object.
+ * @param[out] terrain
+ * Will contain the terrain flags the object contributes.
+ * @return
+ * Combination of @ref map_look_flags; @ref P_PASS_THRU and @ref P_BLOCKER
+ * have the special meaning described in map_space_derive().
  */
-void
-update_position (mapstruct *m, int x, int y)
+static int
+map_space_object_flags (object *op, int *terrain)
 {
-    HARD_ASSERT(m != NULL);
-    HARD_ASSERT(GET_MAP_FLAGS(m, x, y) & P_NEED_UPDATE);
+    int flags = 0;
 
-#if DEBUG_OLDFLAGS
-    int old_flags = GET_MAP_FLAGS(m, x, y) & ~P_NEED_UPDATE;
-    int old_move_flags = GET_MAP_MOVE_FLAGS(m, x, y);
-#endif
+    if (QUERY_FLAG(op, FLAG_PLAYER_ONLY)) {
+        flags |= P_PLAYER_ONLY;
+    }
 
-    int flags = 0;
-    int move_flags = 0;
+    if (op->type == CHECK_INV) {
+        flags |= P_CHECK_INV;
+    }
 
-    for (object *tmp = GET_MAP_OB(m, x, y); tmp != NULL; tmp = tmp->above) {
-        if (QUERY_FLAG(tmp, FLAG_PLAYER_ONLY)) {
-            flags |= P_PLAYER_ONLY;
-        }
+    if (QUERY_FLAG(op, FLAG_IS_PLAYER)) {
+        flags |= P_IS_PLAYER;
+    }
 
-        if (tmp->type == CHECK_INV) {
-            flags |= P_CHECK_INV;
-        }
+    if (QUERY_FLAG(op, FLAG_DOOR_CLOSED)) {
+        flags |= P_DOOR_CLOSED;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_IS_PLAYER)) {
-            flags |= P_IS_PLAYER;
-        }
+    if (QUERY_FLAG(op, FLAG_MONSTER)) {
+        flags |= P_IS_MONSTER;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_DOOR_CLOSED)) {
-            flags |= P_DOOR_CLOSED;
-        }
+    if (QUERY_FLAG(op, FLAG_NO_MAGIC)) {
+        flags |= P_NO_MAGIC;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_MONSTER)) {
-            flags |= P_IS_MONSTER;
-        }
+    if (QUERY_FLAG(op, FLAG_BLOCKSVIEW)) {
+        flags |= P_BLOCKSVIEW;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_NO_MAGIC)) {
-            flags |= P_NO_MAGIC;
-        }
+    if (QUERY_FLAG(op, FLAG_WALK_ON)) {
+        flags |= P_WALK_ON;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_BLOCKSVIEW)) {
-            flags |= P_BLOCKSVIEW;
-        }
+    if (QUERY_FLAG(op, FLAG_WALK_OFF)) {
+        flags |= P_WALK_OFF;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_WALK_ON)) {
-            flags |= P_WALK_ON;
-        }
+    if (QUERY_FLAG(op, FLAG_FLY_ON)) {
+        flags |= P_FLY_ON;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_WALK_OFF)) {
-            flags |= P_WALK_OFF;
-        }
+    if (QUERY_FLAG(op, FLAG_FLY_OFF)) {
+        flags |= P_FLY_OFF;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_FLY_ON)) {
-            flags |= P_FLY_ON;
-        }
+    if (QUERY_FLAG(op, FLAG_NO_PASS)) {
+        flags |= P_NO_PASS;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_FLY_OFF)) {
-            flags |= P_FLY_OFF;
-        }
+    if (QUERY_FLAG(op, FLAG_NO_PVP)) {
+        flags |= P_NO_PVP;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_NO_PASS)) {
-            flags |= P_NO_PASS;
-        }
+    if (op->type == MAGIC_MIRROR) {
+        flags |= P_MAGIC_MIRROR;
+    }
 
-        if (QUERY_FLAG(tmp, FLAG_IS_FLOOR)) {
-            move_flags |= tmp->terrain_type;
-        }
+    if (op->type == EXIT) {
+        flags |= P_IS_EXIT;
+    }
+
+    if (QUERY_FLAG(op, FLAG_OUTDOOR)) {
+        flags |= P_OUTDOOR;
+    }
+
+    if (flags & (P_NO_PASS | P_DOOR_CLOSED)) {
+        flags |= P_BLOCKER;
 
-        if (QUERY_FLAG(tmp, FLAG_NO_PVP)) {
-            flags |= P_NO_PVP;
+        if (QUERY_FLAG(op, FLAG_PASS_THRU)) {
+            flags |= P_PASS_THRU;
         }
+    }
+
+    *terrain = QUERY_FLAG(op, FLAG_IS_FLOOR) ? op->terrain_type : 0;
 
-        if (tmp->type == MAGIC_MIRROR) {
-            flags |= P_MAGIC_MIRROR;
+    return flags;
+}
+
+/**
+ * Adjusts the per-tile object counters by the given flags.
+ * @param msp
+ * Map space.
+ * @param flags
+ * Flags to adjust, as returned by map_space_object_flags().
+ * @param terrain
+ * Terrain flags to adjust.
+ * @param mod
+ * 1 to count the flags, -1 to uncount them.
+ */
+static void
+map_space_count (MapSpace *msp, int flags, int terrain, int mod)
+{
+    for (int i = 0; flags != 0; i++, flags >>= 1) {
+        if (flags & 1) {
+            HARD_ASSERT(i < MAP_SPACE_FLAG_COUNTS);
+            msp->flag_count[i] += mod;
         }
+    }
 
-        if (tmp->type == EXIT) {
-            flags |= P_IS_EXIT;
+    for (int i = 0; terrain != 0; i++, terrain >>= 1) {
+        if (terrain & 1) {
+            msp->terrain_count[i] += mod;
         }
+    }
+}
 
-        if (QUERY_FLAG(tmp, FLAG_OUTDOOR)) {
-            flags |= P_OUTDOOR;
+/**
+ * Derives the flags of a map space from its object counters.
+ *
+ * A tile gets @ref P_PASS_THRU when it is blocked and every object blocking
+ * it (those counted with @ref P_BLOCKER) has pass_thru; a single real
+ * no_pass overrules it.
+ * @param m
+ * Map.
+ * @param x
+ * X position on the map.
+ * @param y
+ * Y position on the map.
+ */
+static void
+map_space_derive (mapstruct *m, int x, int y)
+{
+    MapSpace *msp = GET_MAP_SPACE_PTR(m, x, y);
+    int old_flags = GET_MAP_FLAGS(m, x, y) & ~P_NEED_UPDATE;
+    int old_move_flags = GET_MAP_MOVE_FLAGS(m, x, y);
+
+    int flags = 0;
+    for (int i = 0; i < MAP_SPACE_FLAG_COUNTS; i++) {
+        if (msp->flag_count[i] != 0) {
+            flags |= 1 << i;
         }
+    }
 
-        if (flags & (P_NO_PASS | P_DOOR_CLOSED)) {
-            if (!QUERY_FLAG(tmp, FLAG_PASS_THRU)) {
-                flags &= ~P_PASS_THRU;
-            } else {
-                flags |= P_PASS_THRU;
-            }
+    int move_flags = 0;
+    for (int i = 0; i < MAP_SPACE_TERRAIN_COUNTS; i++) {
+        if (msp->terrain_count[i] != 0) {
+            move_flags |= 1 << i;
         }
     }
 
+    flags &= ~(P_PASS_THRU | P_BLOCKER);
+
+    if (msp->flag_count[P_BLOCKER_BIT] != 0 &&
+        msp->flag_count[P_PASS_THRU_BIT] == msp->flag_count[P_BLOCKER_BIT]) {
+        flags |= P_PASS_THRU;
+    }
+
 #if DEBUG_OLDFLAGS
     if (flags == old_flags && move_flags == old_move_flags) {
         LOG(DEVEL,
@@ -1804,6 +2139,131 @@ update_position (mapstruct *m, int x, int y)
 
     SET_MAP_FLAGS(m, x, y, flags);
     SET_MAP_MOVE_FLAGS(m, x, y, move_flags);
+
+    /* Passability of the tile changed, so the pathfinding abstraction needs
+     * to be rebuilt. */
+    if ((old_flags ^ flags) & (P_NO_PASS | P_DOOR_CLOSED) ||
+        old_move_flags != move_flags) {
+        path_cluster_tile_changed(m, x, y);
+    }
+}
+
+/**
+ * Counts an object that was inserted on a map into the flags of the tile it
+ * is on.
+ * @param op
+ * The object.
+ */
+void
+map_space_add_object (object *op)
+{
+    HARD_ASSERT(op != NULL);
+    HARD_ASSERT(op->map != NULL);
+
+    int terrain;
+    int flags = map_space_object_flags(op, &terrain);
+
+    op->map_flags = flags;
+    op->map_terrain = terrain;
+
+    if (flags == 0 && terrain == 0) {
+        return;
+    }
+
+    map_space_count(GET_MAP_SPACE_PTR(op->map, op->x, op->y), flags,
+                    terrain, 1);
+    map_space_derive(op->map, op->x, op->y);
+}
+
+/**
+ * Uncounts an object that is being removed from a map from the flags of the
+ * tile it is on.
+ * @param op
+ * The object.
+ */
+void
+map_space_remove_object (object *op)
+{
+    HARD_ASSERT(op != NULL);
+    HARD_ASSERT(op->map != NULL);
+
+    if (op->map_flags == 0 && op->map_terrain == 0) {
+        return;
+    }
+
+    map_space_count(GET_MAP_SPACE_PTR(op->map, op->x, op->y), op->map_flags,
+                    op->map_terrain, -1);
+    op->map_flags = 0;
+    op->map_terrain = 0;
+    map_space_derive(op->map, op->x, op->y);
+}
+
+/**
+ * Recounts an object on a map after its flags were changed.
+ * @param op
+ * The object.
+ */
+void
+map_space_update_object (object *op)
+{
+    HARD_ASSERT(op != NULL);
+    HARD_ASSERT(op->map != NULL);
+
+    /* Removed objects were already uncounted. */
+    if (QUERY_FLAG(op, FLAG_REMOVED)) {
+        return;
+    }
+
+    int terrain;
+    int flags = map_space_object_flags(op, &terrain);
+
+    if (flags == (int) op->map_flags && terrain == op->map_terrain) {
+        return;
+    }
+
+    MapSpace *msp = GET_MAP_SPACE_PTR(op->map, op->x, op->y);
+    map_space_count(msp, op->map_flags, op->map_terrain, -1);
+    map_space_count(msp, flags, terrain, 1);
+    op->map_flags = flags;
+    op->map_terrain = terrain;
+    map_space_derive(op->map, op->x, op->y);
+}
+
+/**
+ * This function updates various attributes about a specific space on the
+ * map (what it looks like, whether it blocks magic, has a living
+ * creatures, prevents people from passing through, etc).
+ *
+ * The tile flags are normally kept up to date incrementally by
+ * map_space_add_object() and friends; this recounts every object on the
+ * tile from scratch.
+ *
+ * @param m
+ * Map to update.
+ * @param x
+ * X position on the given map.
+ * @param y
+ * Y position on the given map.
+ */
+void
+update_position (mapstruct *m, int x, int y)
+{
+    HARD_ASSERT(m != NULL);
+    HARD_ASSERT(GET_MAP_FLAGS(m, x, y) & P_NEED_UPDATE);
+
+    MapSpace *msp = GET_MAP_SPACE_PTR(m, x, y);
+    memset(msp->flag_count, 0, sizeof(msp->flag_count));
+    memset(msp->terrain_count, 0, sizeof(msp->terrain_count));
+
+    for (object *tmp = GET_MAP_OB(m, x, y); tmp != NULL; tmp = tmp->above) {
+        int terrain;
+        int flags = map_space_object_flags(tmp, &terrain);
+        map_space_count(msp, flags, terrain, 1);
+        tmp->map_flags = flags;
+        tmp->map_terrain = terrain;
+    }
+
+    map_space_derive(m, x, y);
 }
 
 /**
@@ -2493,7 +2953,7 @@ int map_get_darkness(mapstruct *m, int x, int y, object **mirror)
 {
     MapSpace *msp;
     uint8_t outdoor;
-    int darkness;
+    int darkness, flags, light;
 
     if (mirror) {
         *mirror = NULL;
@@ -2502,8 +2962,11 @@ int map_get_darkness(mapstruct *m, int x, int y, object **mirror)
     msp = GET_MAP_SPACE_PTR(m, x, y);
     outdoor = MAP_OUTDOORS(m) || (msp->map_info && OBJECT_VALID(msp->map_info, msp->map_info_count) && msp->map_info->item_power == -2);
 
-    if (((outdoor && !(msp->flags & P_OUTDOOR)) || (!outdoor && msp->flags & P_OUTDOOR)) && (!msp->map_info || !OBJECT_VALID(msp->map_info, msp->map_info_count) || msp->map_info->item_power < 0)) {
-        darkness = msp->light_value + global_darkness_table[world_darkness];
+    flags = GET_MAP_FLAGS(m, x, y);
+    light = GET_MAP_LIGHT(m, x, y);
+
+    if (((outdoor && !(flags & P_OUTDOOR)) || (!outdoor && flags & P_OUTDOOR)) && (!msp->map_info || !OBJECT_VALID(msp->map_info, msp->map_info_count) || msp->map_info->item_power < 0)) {
+        darkness = light + global_darkness_table[world_darkness];
     } else {
         /* Check if map info object bound to this tile has a darkness. */
         if (msp->map_info && OBJECT_VALID(msp->map_info, msp->map_info_count) && msp->map_info->item_power != -1) {
@@ -2515,13 +2978,13 @@ int map_get_darkness(mapstruct *m, int x, int y, object **mirror)
                 dark_value = MAX_DARKNESS;
             }
 
-            darkness = global_darkness_table[dark_value] + msp->light_value;
+            darkness = global_darkness_table[dark_value] + light;
         } else {
-            darkness = m->light_value + msp->light_value;
+            darkness = m->light_value + light;
         }
     }
 
-    if (msp->flags & P_MAGIC_MIRROR) {
+    if (flags & P_MAGIC_MIRROR) {
         object *tmp;
         magic_mirror_struct *m_data;
         mapstruct *mirror_map;
@@ -2536,12 +2999,13 @@ int map_get_darkness(mapstruct *m, int x, int y, object **mirror)
                 m_data = MMIRROR(tmp);
 
                 if (m_data && (mirror_map = magic_mirror_get_map(tmp)) && !OUT_OF_MAP(mirror_map, m_data->x, m_data->y)) {
-                    MapSpace *mirror_msp = GET_MAP_SPACE_PTR(mirror_map, m_data->x, m_data->y);
+                    int mirror_flags = GET_MAP_FLAGS(mirror_map, m_data->x, m_data->y);
+                    int mirror_light = GET_MAP_LIGHT(mirror_map, m_data->x, m_data->y);
 
-                    if ((MAP_OUTDOORS(mirror_map) && !(mirror_msp->flags & P_OUTDOOR)) || (!MAP_OUTDOORS(mirror_map) && mirror_msp->flags & P_OUTDOOR)) {
-                        darkness = mirror_msp->light_value + global_darkness_table[world_darkness];
+                    if ((MAP_OUTDOORS(mirror_map) && !(mirror_flags & P_OUTDOOR)) || (!MAP_OUTDOORS(mirror_map) && mirror_flags & P_OUTDOOR)) {
+                        darkness = mirror_light + global_darkness_table[world_darkness];
                     } else {
-                        darkness = mirror_map->light_value + mirror_msp->light_value;
+                        darkness = mirror_map->light_value + mirror_light;
                     }
                 }
 
@@ -2554,6 +3018,55 @@ int map_get_darkness(mapstruct *m, int x, int y, object **mirror)
     return darkness;
 }
 
+/**
+ * Start a new map update pass, invalidating the render cache entries of all
+ * the map spaces.
+ */
+void
+map_render_cache_pass (void)
+{
+    map_render_tag++;
+
+    /* Zero is the tag of entries that were never computed. */
+    if (map_render_tag == 0) {
+        map_render_tag = 1;
+    }
+}
+
+/**
+ * Acquire the render cache entry of the specified map space.
+ *
+ * @param m
+ * Map.
+ * @param x
+ * X coordinate.
+ * @param y
+ * Y coordinate.
+ * @param[out] entry
+ * Will contain the entry.
+ * @return
+ * True if the entry is valid for the current map update pass. Otherwise,
+ * the entry is marked as valid and the caller must fill it in.
+ */
+bool
+map_render_cache_get (mapstruct *m, int x, int y, map_render_cache_t **entry)
+{
+    HARD_ASSERT(m != NULL);
+    HARD_ASSERT(entry != NULL);
+
+    *entry = &m->render_cache[GET_MAP_SPACE_INDEX(m, x, y)];
+    uint32_t update_tile = GET_MAP_UPDATE_COUNTER(m, x, y);
+
+    if ((*entry)->tag == map_render_tag &&
+            (*entry)->update_tile == update_tile) {
+        return true;
+    }
+
+    (*entry)->tag = map_render_tag;
+    (*entry)->update_tile = update_tile;
+    return false;
+}
+
 int map_path_isabs(const char *path)
 {
     if (path == NULL) {
@@ -3023,3 +3536,263 @@ map_free_spot_first (mapstruct   *m,
 
     return -1;
 }
+
+/**
+ * Adds a part of a living object to the spatial index of the map it is on.
+ * @param op
+ * Object part to add; must be on a map.
+ */
+void
+map_live_add (object *op)
+{
+    HARD_ASSERT(op != NULL);
+    HARD_ASSERT(op->map != NULL);
+
+    if (op->live_bucket != NULL || op->map->live_buckets == NULL) {
+        return;
+    }
+
+    object **bucket = &op->map->live_buckets[
+        (op->y >> MAP_LIVE_BUCKET_SHIFT) * MAP_LIVE_BUCKETS_X(op->map) +
+        (op->x >> MAP_LIVE_BUCKET_SHIFT)];
+
+    op->live_prev = NULL;
+    op->live_next = *bucket;
+
+    if (*bucket != NULL) {
+        (*bucket)->live_prev = op;
+    }
+
+    *bucket = op;
+    op->live_bucket = bucket;
+}
+
+/**
+ * Removes an object part from the spatial index of its map, if it was
+ * indexed.
+ * @param op
+ * Object part to remove.
+ */
+void
+map_live_remove (object *op)
+{
+    HARD_ASSERT(op != NULL);
+
+    if (op->live_bucket == NULL) {
+        return;
+    }
+
+    if (op->live_prev != NULL) {
+        op->live_prev->live_next = op->live_next;
+    } else {
+        *op->live_bucket = op->live_next;
+    }
+
+    if (op->live_next != NULL) {
+        op->live_next->live_prev = op->live_prev;
+    }
+
+    op->live_next = NULL;
+    op->live_prev = NULL;
+    op->live_bucket = NULL;
+}
+
+/**
+ * Brings the spatial index in line with the object's current
+ * IS_LIVE() state. The index is only maintained on map insertion and
+ * removal, so this must be called whenever the type or ::FLAG_MONSTER of
+ * an object that is already on a map changes; object_update() does so for
+ * the flag updates.
+ * @param op
+ * Object to update; any part of a multi-part object may be given.
+ */
+void
+map_live_update (object *op)
+{
+    HARD_ASSERT(op != NULL);
+
+    op = HEAD(op);
+
+    if (op->map == NULL || op->env != NULL ||
+        QUERY_FLAG(op, FLAG_REMOVED)) {
+        return;
+    }
+
+    bool live = IS_LIVE(op);
+
+    for (object *part = op; part != NULL; part = part->more) {
+        if (live) {
+            map_live_add(part);
+        } else {
+            map_live_remove(part);
+        }
+    }
+}
+
+/**
+ * Compare two live object candidates by their distance.
+ */
+static int
+map_live_candidate_cmp (const void *a, const void *b)
+{
+    const map_live_candidate_t *c1 = a;
+    const map_live_candidate_t *c2 = b;
+
+    return c1->distance - c2->distance;
+}
+
+/**
+ * Find all the living objects (heads of players and monsters) in the square
+ * of the given range around the specified coordinates, using the spatial
+ * index of the map and its loaded tiled neighbours.
+ *
+ * Tiled maps that are not in memory are not loaded; they cannot hold any
+ * living objects anyway.
+ * @param m
+ * Map.
+ * @param x
+ * X coordinate.
+ * @param y
+ * Y coordinate.
+ * @param range
+ * Range of the square to search.
+ * @param[out] num
+ * Will contain the number of objects found.
+ * @return
+ * Array of the objects found, sorted nearest first. The array is only
+ * valid until the next call.
+ */
+object **
+map_live_find (mapstruct *m, int x, int y, int range, size_t *num)
+{
+    HARD_ASSERT(m != NULL);
+    HARD_ASSERT(num != NULL);
+
+    struct {
+        mapstruct *m;
+        int x;
+        int y;
+    } maps[MAP_LIVE_FIND_MAPS];
+    size_t maps_num = 0, found = 0;
+
+    *num = 0;
+
+    if (m->live_buckets == NULL) {
+        return NULL;
+    }
+
+    maps[maps_num].m = m;
+    maps[maps_num].x = 0;
+    maps[maps_num].y = 0;
+    maps_num++;
+
+    for (size_t i = 0; i < maps_num; i++) {
+        mapstruct *tiled = maps[i].m;
+        int ox = maps[i].x, oy = maps[i].y;
+
+        /* Collect the indexed objects in the part of the square this map
+         * covers. */
+        int lx = MAX(0, x - range - ox);
+        int hx = MIN(MAP_WIDTH(tiled) - 1, x + range - ox);
+        int ly = MAX(0, y - range - oy);
+        int hy = MIN(MAP_HEIGHT(tiled) - 1, y + range - oy);
+
+        for (int by = ly >> MAP_LIVE_BUCKET_SHIFT;
+             by <= hy >> MAP_LIVE_BUCKET_SHIFT;
+             by++) {
+            for (int bx = lx >> MAP_LIVE_BUCKET_SHIFT;
+                 bx <= hx >> MAP_LIVE_BUCKET_SHIFT;
+                 bx++) {
+                object *tmp = tiled->live_buckets[by *
+                                                  MAP_LIVE_BUCKETS_X(tiled) +
+                                                  bx];
+
+                for ( ; tmp != NULL; tmp = tmp->live_next) {
+                    if (tmp->x < lx || tmp->x > hx ||
+                        tmp->y < ly || tmp->y > hy) {
+                        continue;
+                    }
+
+                    if (found == map_live_size) {
+                        map_live_size = map_live_size == 0 ? 16 :
+                                        map_live_size * 2;
+                        map_live_candidates = erealloc(map_live_candidates,
+                            sizeof(*map_live_candidates) * map_live_size);
+                        map_live_results = erealloc(map_live_results,
+                            sizeof(*map_live_results) * map_live_size);
+                    }
+
+                    int dx = tmp->x + ox - x, dy = tmp->y + oy - y;
+                    map_live_candidates[found].op = HEAD(tmp);
+                    map_live_candidates[found].distance = MAX(ABS(dx),
+                                                              ABS(dy));
+                    found++;
+                }
+            }
+        }
+
+        /* Queue up the loaded neighbours that overlap the square. */
+        for (int tile = 0; tile < TILED_NUM_DIR; tile++) {
+            mapstruct *neighbour = tiled->tile_map[tile];
+
+            if (neighbour == NULL ||
+                neighbour->in_memory != MAP_IN_MEMORY ||
+                neighbour->live_buckets == NULL ||
+                maps_num == MAP_LIVE_FIND_MAPS) {
+                continue;
+            }
+
+            int nx = ox + map_tiled_coords[tile][0] *
+                     (map_tiled_coords[tile][0] > 0 ? MAP_WIDTH(tiled) :
+                                                      MAP_WIDTH(neighbour));
+            int ny = oy + map_tiled_coords[tile][1] *
+                     (map_tiled_coords[tile][1] > 0 ? MAP_HEIGHT(tiled) :
+                                                      MAP_HEIGHT(neighbour));
+
+            if (nx > x + range || nx + MAP_WIDTH(neighbour) <= x - range ||
+                ny > y + range || ny + MAP_HEIGHT(neighbour) <= y - range) {
+                continue;
+            }
+
+            size_t j;
+            for (j = 0; j < maps_num; j++) {
+                if (maps[j].m == neighbour) {
+                    break;
+                }
+            }
+
+            if (j != maps_num) {
+                continue;
+            }
+
+            maps[maps_num].m = neighbour;
+            maps[maps_num].x = nx;
+            maps[maps_num].y = ny;
+            maps_num++;
+        }
+    }
+
+    if (found == 0) {
+        return NULL;
+    }
+
+    qsort(map_live_candidates, found, sizeof(*map_live_candidates),
+          map_live_candidate_cmp);
+
+    /* Multi-part objects have each of their parts indexed; only report the
+     * nearest one. */
+    for (size_t i = 0; i < found; i++) {
+        size_t j;
+        for (j = 0; j < *num; j++) {
+            if (map_live_results[j] == map_live_candidates[i].op) {
+                break;
+            }
+        }
+
+        if (j == *num) {
+            map_live_results[(*num)++] = map_live_candidates[i].op;
+        }
+    }
+
+    return map_live_results;
+}
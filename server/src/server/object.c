@@ -41,6 +41,24 @@
 /** List of active objects that need to be processed */
 object *active_objects;
 
+/** Number of bits used to index the slots of each timer wheel level. */
+#define ACTIVE_WHEEL_BITS 6
+/** Number of slots in each timer wheel level. */
+#define ACTIVE_WHEEL_SLOTS (1 << ACTIVE_WHEEL_BITS)
+/** Number of timer wheel levels. */
+#define ACTIVE_WHEEL_LEVELS 4
+/** Longest delay the timer wheel can hold, in ticks. */
+#define ACTIVE_WHEEL_MAX_DELAY \
+    ((1L << (ACTIVE_WHEEL_BITS * ACTIVE_WHEEL_LEVELS)) - 1)
+
+/**
+ * Hierarchical timer wheel of the active objects that are not due to be
+ * processed for a number of ticks; see object_active_sleep().
+ */
+static object *active_wheel[ACTIVE_WHEEL_LEVELS][ACTIVE_WHEEL_SLOTS];
+/** Tick the timer wheel has been advanced to. */
+static long active_wheel_tick;
+
 /**
  * Gender nouns.
  */
@@ -230,6 +248,79 @@ object_deinit (void)
 {
 }
 
+/**
+ * Add a field to the key-values index of an object.
+ *
+ * @param op
+ * The object.
+ * @param field
+ * Field to add.
+ */
+static void
+object_key_values_index_add (object *op, key_value_t *field)
+{
+    key_value_index_t *entry = emalloc(sizeof(*entry));
+    entry->key = field->key;
+    entry->field = field;
+    HASH_ADD_PTR(op->key_values_index, key, entry);
+}
+
+/**
+ * Build the key-values index of an object.
+ *
+ * @param op
+ * The object.
+ */
+static void
+object_key_values_index_build (object *op)
+{
+    HARD_ASSERT(op->key_values_index == NULL);
+
+    key_value_t *field;
+    LL_FOREACH(op->key_values, field) {
+        object_key_values_index_add(op, field);
+    }
+}
+
+/**
+ * Free the key-values index of an object, if any.
+ *
+ * @param op
+ * The object.
+ */
+static void
+object_key_values_index_free (object *op)
+{
+    key_value_index_t *entry, *tmp;
+    HASH_ITER(hh, op->key_values_index, entry, tmp) {
+        HASH_DEL(op->key_values_index, entry);
+        efree(entry);
+    }
+
+    op->key_values_index = NULL;
+}
+
+/**
+ * Account for a field that was linked to the object's key-values, indexing
+ * it if needed.
+ *
+ * @param op
+ * The object.
+ * @param field
+ * The field.
+ */
+static void
+object_key_values_linked (object *op, key_value_t *field)
+{
+    op->key_values_num++;
+
+    if (op->key_values_index != NULL) {
+        object_key_values_index_add(op, field);
+    } else if (op->key_values_num > KEY_VALUES_INDEX_MIN) {
+        object_key_values_index_build(op);
+    }
+}
+
 /**
  * Compares value lists.
  *
@@ -925,6 +1016,9 @@ object_copy (object *op, const object *src, bool no_speed)
     }
 
     /* Copy over key_values, if any. */
+    op->key_values_index = NULL;
+    op->key_values_num = 0;
+
     if (src->key_values != NULL) {
         op->key_values = NULL;
 
@@ -950,6 +1044,12 @@ object_copy (object *op, const object *src, bool no_speed)
                 tail->next = new_link;
                 tail = new_link;
             }
+
+            op->key_values_num++;
+        }
+
+        if (op->key_values_num > KEY_VALUES_INDEX_MIN) {
+            object_key_values_index_build(op);
         }
     }
 
@@ -1030,6 +1130,222 @@ object_update_turnable (object *op)
     object_update(op, UP_OBJ_FACE);
 }
 
+/**
+ * Adds an object to the beginning of the active list.
+ *
+ * process_events() expects new objects to be inserted at the beginning of
+ * the list, so that they are not processed until the next tick.
+ * @param op
+ * The object.
+ */
+static void
+object_active_list_add (object *op)
+{
+    op->active_next = active_objects;
+
+    if (op->active_next != NULL) {
+        op->active_next->active_prev = op;
+    }
+
+    active_objects = op;
+    op->active_prev = NULL;
+}
+
+/**
+ * Removes an object from the active list.
+ * @param op
+ * The object.
+ */
+static void
+object_active_list_remove (object *op)
+{
+    if (op->active_prev == NULL) {
+        active_objects = op->active_next;
+
+        if (op->active_next != NULL) {
+            op->active_next->active_prev = NULL;
+        }
+    } else {
+        op->active_prev->active_next = op->active_next;
+
+        if (op->active_next != NULL) {
+            op->active_next->active_prev = op->active_prev;
+        }
+    }
+
+    op->active_next = NULL;
+    op->active_prev = NULL;
+}
+
+/**
+ * Puts an object into the timer wheel slot for its wake up tick.
+ * @param op
+ * The object.
+ */
+static void
+object_active_wheel_insert (object *op)
+{
+    long delta = op->active_wake - active_wheel_tick;
+    int level;
+
+    for (level = 0; level < ACTIVE_WHEEL_LEVELS - 1; level++) {
+        if (delta < 1L << (ACTIVE_WHEEL_BITS * (level + 1))) {
+            break;
+        }
+    }
+
+    object **slot = &active_wheel[level][(op->active_wake >>
+        (ACTIVE_WHEEL_BITS * level)) & (ACTIVE_WHEEL_SLOTS - 1)];
+
+    op->active_prev = NULL;
+    op->active_next = *slot;
+
+    if (*slot != NULL) {
+        (*slot)->active_prev = op;
+    }
+
+    *slot = op;
+    op->active_slot = slot;
+}
+
+/**
+ * Takes an object out of the timer wheel.
+ * @param op
+ * The object.
+ */
+static void
+object_active_wheel_remove (object *op)
+{
+    if (op->active_prev != NULL) {
+        op->active_prev->active_next = op->active_next;
+    } else {
+        *op->active_slot = op->active_next;
+    }
+
+    if (op->active_next != NULL) {
+        op->active_next->active_prev = op->active_prev;
+    }
+
+    op->active_next = NULL;
+    op->active_prev = NULL;
+    op->active_slot = NULL;
+}
+
+/**
+ * Moves all the objects in a timer wheel slot either to the active list, if
+ * they are due, or to the lower level slots.
+ * @param slot
+ * The slot.
+ */
+static void
+object_active_wheel_cascade (object **slot)
+{
+    object *tmp, *next;
+
+    for (tmp = *slot; tmp != NULL; tmp = next) {
+        next = tmp->active_next;
+        tmp->active_slot = NULL;
+
+        if (tmp->active_wake <= active_wheel_tick) {
+            object_active_list_add(tmp);
+        } else {
+            object_active_wheel_insert(tmp);
+        }
+    }
+
+    *slot = NULL;
+}
+
+/**
+ * Puts an active object that was just processed to sleep in the timer
+ * wheel, until the given number of ticks has passed.
+ *
+ * The ticks the object sleeps through are accounted for by process_events()
+ * when it is processed again, which may be sooner if object_update_speed()
+ * is called on it.
+ * @param op
+ * The object; must be on the active list.
+ * @param delay
+ * Number of ticks to sleep for.
+ */
+void
+object_active_sleep (object *op, long delay)
+{
+    HARD_ASSERT(op != NULL);
+    HARD_ASSERT(op->active_slot == NULL);
+
+    if (delay <= 1) {
+        return;
+    }
+
+    object_active_list_remove(op);
+    op->active_wake = pticks + MIN(delay, ACTIVE_WHEEL_MAX_DELAY);
+    op->active_skipped = pticks + 1;
+    object_active_wheel_insert(op);
+}
+
+/**
+ * Advances the timer wheel to the current tick, moving the objects that
+ * are due to the beginning of the active list.
+ */
+void
+object_active_wake (void)
+{
+    if (active_wheel_tick == 0) {
+        active_wheel_tick = pticks - 1;
+    }
+
+    while (active_wheel_tick < pticks) {
+        active_wheel_tick++;
+
+        /* Cascade the higher levels down once all the slots of the levels
+         * below them have been passed. */
+        for (int level = 1; level < ACTIVE_WHEEL_LEVELS; level++) {
+            if (active_wheel_tick &
+                ((1L << (ACTIVE_WHEEL_BITS * level)) - 1)) {
+                break;
+            }
+
+            object_active_wheel_cascade(&active_wheel[level][
+                (active_wheel_tick >> (ACTIVE_WHEEL_BITS * level)) &
+                (ACTIVE_WHEEL_SLOTS - 1)]);
+        }
+
+        object_active_wheel_cascade(&active_wheel[0][active_wheel_tick &
+            (ACTIVE_WHEEL_SLOTS - 1)]);
+    }
+}
+
+/**
+ * Counts the active objects sleeping in the timer wheel.
+ * @param show_list
+ * If true, log each of the objects.
+ * @return
+ * Number of the sleeping objects.
+ */
+uint64_t
+object_active_wheel_count (bool show_list)
+{
+    uint64_t num = 0;
+
+    for (int level = 0; level < ACTIVE_WHEEL_LEVELS; level++) {
+        for (int i = 0; i < ACTIVE_WHEEL_SLOTS; i++) {
+            for (object *tmp = active_wheel[level][i];
+                 tmp != NULL;
+                 tmp = tmp->active_next) {
+                num++;
+
+                if (show_list) {
+                    LOG(INFO, "%s (sleeping until tick %ld)",
+                        object_get_str(tmp), tmp->active_wake);
+                }
+            }
+        }
+    }
+
+    return num;
+}
+
 /**
  * Updates the speed of an object. If the speed changes from 0 to another
  * value, or vice versa, then add/remove the object from the active list.
@@ -1062,22 +1378,27 @@ object_update_speed (object *op)
     }
 
     if (FABS(op->speed) > MIN_ACTIVE_SPEED) {
+        /* Sleeping in the timer wheel; wake it up, so that the change in
+         * speed takes effect on the next tick. */
+        if (op->active_slot != NULL) {
+            object_active_wheel_remove(op);
+            object_active_list_add(op);
+            return;
+        }
+
         /* If already on active list, don't do anything */
         if (op->active_next || op->active_prev || op == active_objects) {
             return;
         }
 
-        /* process_events() expects us to insert the object at the beginning
-         * of the list. */
-        op->active_next = active_objects;
-
-        if (op->active_next != NULL) {
-            op->active_next->active_prev = op;
+        object_active_list_add(op);
+    } else {
+        if (op->active_slot != NULL) {
+            object_active_wheel_remove(op);
+            op->active_skipped = 0;
+            return;
         }
 
-        active_objects = op;
-        op->active_prev = NULL;
-    } else {
         /* If not on the active list, nothing needs to be done. */
         if (op->active_next == NULL &&
             op->active_prev == NULL &&
@@ -1085,22 +1406,7 @@ object_update_speed (object *op)
             return;
         }
 
-        if (op->active_prev == NULL) {
-            active_objects = op->active_next;
-
-            if (op->active_next != NULL) {
-                op->active_next->active_prev = NULL;
-            }
-        } else {
-            op->active_prev->active_next = op->active_next;
-
-            if (op->active_next != NULL) {
-                op->active_next->active_prev = op->active_prev;
-            }
-        }
-
-        op->active_next = NULL;
-        op->active_prev = NULL;
+        object_active_list_remove(op);
     }
 }
 
@@ -1130,140 +1436,45 @@ object_update (object *op, int action)
         return;
     }
 
-    MapSpace *msp = GET_MAP_SPACE_PTR(op->map, op->x, op->y);
-    int newflags = msp->flags;
-    int flags = newflags;
-
     if (action == UP_OBJ_INSERT) {
-        msp->update_tile++;
+        INC_MAP_UPDATE_COUNTER(op->map, op->x, op->y);
 
         if (op->glow_radius != 0) {
             adjust_light_source(op->map, op->x, op->y, op->glow_radius);
         }
 
-        if (QUERY_FLAG(op, FLAG_NO_PASS) ||
-            QUERY_FLAG(op, FLAG_PASS_THRU) ||
-            QUERY_FLAG(op, FLAG_DOOR_CLOSED)) {
-            newflags |= P_NEED_UPDATE;
-        } else if (QUERY_FLAG(op, FLAG_IS_FLOOR)) {
-            /* Floors define our node - force an update. */
-            newflags |= P_NEED_UPDATE;
-            msp->light_value += op->last_sp;
-        } else {
-            if (op->type == CHECK_INV) {
-                newflags |= P_CHECK_INV;
-            }
-
-            if (QUERY_FLAG(op, FLAG_MONSTER)) {
-                newflags |= P_IS_MONSTER;
-            }
-
-            if (QUERY_FLAG(op, FLAG_IS_PLAYER)) {
-                newflags |= P_IS_PLAYER;
-            }
-
-            if (QUERY_FLAG(op, FLAG_PLAYER_ONLY)) {
-                newflags |= P_PLAYER_ONLY;
-            }
-
-            if (QUERY_FLAG(op, FLAG_BLOCKSVIEW)) {
-                newflags |= P_BLOCKSVIEW;
-            }
-
-            if (QUERY_FLAG(op, FLAG_NO_MAGIC)) {
-                newflags |= P_NO_MAGIC;
-            }
-
-            if (QUERY_FLAG(op, FLAG_WALK_ON)) {
-                newflags |= P_WALK_ON;
-            }
-
-            if (QUERY_FLAG(op, FLAG_FLY_ON)) {
-                newflags |= P_FLY_ON;
-            }
-
-            if (QUERY_FLAG(op, FLAG_WALK_OFF)) {
-                newflags |= P_WALK_OFF;
-            }
-
-            if (QUERY_FLAG(op, FLAG_FLY_OFF)) {
-                newflags |= P_FLY_OFF;
-            }
-
-            if (QUERY_FLAG(op, FLAG_DOOR_CLOSED)) {
-                newflags |= P_DOOR_CLOSED;
-            }
-
-            if (QUERY_FLAG(op, FLAG_NO_PVP)) {
-                newflags |= P_NO_PVP;
-            }
-
-            if (op->type == MAGIC_MIRROR) {
-                newflags |= P_MAGIC_MIRROR;
-            }
-
-            if (op->type == EXIT) {
-                newflags |= P_IS_EXIT;
-            }
-
-            if (QUERY_FLAG(op, FLAG_OUTDOOR)) {
-                newflags |= P_OUTDOOR;
-            }
+        if (QUERY_FLAG(op, FLAG_IS_FLOOR) &&
+            !QUERY_FLAG(op, FLAG_NO_PASS) &&
+            !QUERY_FLAG(op, FLAG_PASS_THRU) &&
+            !QUERY_FLAG(op, FLAG_DOOR_CLOSED)) {
+            GET_MAP_LIGHT(op->map, op->x, op->y) += op->last_sp;
         }
+
+        map_space_add_object(op);
     } else if (action == UP_OBJ_REMOVE) {
-        msp->update_tile++;
+        /* The object's flags were already uncounted by object_remove(). */
+        INC_MAP_UPDATE_COUNTER(op->map, op->x, op->y);
 
         if (op->glow_radius != 0) {
             adjust_light_source(op->map, op->x, op->y, -op->glow_radius);
         }
-
-        /* We must rebuild the flags when one of these flags is touched from our
-         * object */
-        if (QUERY_FLAG(op, FLAG_MONSTER) ||
-            QUERY_FLAG(op, FLAG_IS_PLAYER) ||
-            QUERY_FLAG(op, FLAG_BLOCKSVIEW) ||
-            QUERY_FLAG(op, FLAG_DOOR_CLOSED) ||
-            QUERY_FLAG(op, FLAG_PASS_THRU) ||
-            QUERY_FLAG(op, FLAG_NO_PASS) ||
-            QUERY_FLAG(op, FLAG_PLAYER_ONLY) ||
-            QUERY_FLAG(op, FLAG_NO_MAGIC) ||
-            QUERY_FLAG(op, FLAG_WALK_ON) ||
-            QUERY_FLAG(op, FLAG_FLY_ON) ||
-            QUERY_FLAG(op, FLAG_WALK_OFF) ||
-            QUERY_FLAG(op, FLAG_FLY_OFF) ||
-            QUERY_FLAG(op, FLAG_IS_FLOOR) ||
-            QUERY_FLAG(op, FLAG_OUTDOOR) ||
-            QUERY_FLAG(op, FLAG_NO_PVP) ||
-            op->type == CHECK_INV ||
-            op->type == MAGIC_MIRROR ||
-            op->type == EXIT) {
-            newflags |= P_NEED_UPDATE;
-        }
     } else if (action == UP_OBJ_FLAGS) {
-        /* Force flags rebuild but no tile counter. */
-        newflags |= P_NEED_UPDATE;
+        /* Recount the flags but no tile counter. */
+        map_space_update_object(op);
+        map_live_update(op);
     } else if (action == UP_OBJ_FLAGFACE) {
-        /* Force flags rebuild */
-        newflags |= P_NEED_UPDATE;
-        msp->update_tile++;
+        map_space_update_object(op);
+        map_live_update(op);
+        INC_MAP_UPDATE_COUNTER(op->map, op->x, op->y);
     } else if (action == UP_OBJ_ALL) {
         /* Force full tile update */
-        newflags |= P_NEED_UPDATE;
-        msp->update_tile++;
+        GET_MAP_FLAGS(op->map, op->x, op->y) |= P_NEED_UPDATE;
+        update_position(op->map, op->x, op->y);
+        INC_MAP_UPDATE_COUNTER(op->map, op->x, op->y);
     } else {
         return;
     }
 
-    if (flags != newflags) {
-        /* Rebuild flags */
-        if (newflags & P_NEED_UPDATE) {
-            msp->flags |= newflags;
-            update_position(op->map, op->x, op->y);
-        } else {
-            msp->flags |= newflags;
-        }
-    }
-
     if (op->more != NULL && action != UP_OBJ_INSERT) {
         object_update(op->more, action);
     }
@@ -1552,9 +1763,8 @@ object_check_move_on (object *op, object *originator, int state)
         return false;
     }
 
-    MapSpace *msp = GET_MAP_SPACE_PTR(op->map, op->x, op->y);
     /* No event on this tile. */
-    if (!(msp->flags &
+    if (!(GET_MAP_FLAGS(op->map, op->x, op->y) &
           (state == 1 ? (P_WALK_ON | P_FLY_ON) : (P_WALK_OFF | P_FLY_OFF)))) {
         return false;
     }
@@ -1709,8 +1919,11 @@ object_remove (object *op, int flags)
         op->below = NULL;
         op->env = NULL;
 
+        map_live_remove(op);
+        map_space_remove_object(op);
+
         if (op->map->in_memory != MAP_SAVING) {
-            msp->update_tile++;
+            INC_MAP_UPDATE_COUNTER(op->map, op->x, op->y);
             object_update(op, UP_OBJ_REMOVE);
         }
 
@@ -1945,6 +2158,10 @@ object_insert_map (object *op, mapstruct *m, object *originator, int flag)
         SET_MAP_SPACE_FIRST(msp, op);
     }
 
+    if (IS_LIVE(HEAD(op))) {
+        map_live_add(op);
+    }
+
     /* Some object-type-specific adjustments/initialization. */
     if (op->type == PLAYER) {
         CONTR(op)->cs->update_tile = 0;
@@ -1963,7 +2180,7 @@ object_insert_map (object *op, mapstruct *m, object *originator, int flag)
     }
 
     /* Mark this tile as changed. */
-    msp->update_tile++;
+    INC_MAP_UPDATE_COUNTER(m, x, y);
     /* Update flags for this tile. */
     object_update(op, UP_OBJ_INSERT);
 
@@ -1971,7 +2188,8 @@ object_insert_map (object *op, mapstruct *m, object *originator, int flag)
     door_try_open(op, op->map, op->x, op->y, false);
 
     if (!(flag & INS_NO_WALK_ON) &&
-        (msp->flags & (P_WALK_ON | P_FLY_ON) || op->more != NULL) &&
+        (GET_MAP_FLAGS(m, x, y) & (P_WALK_ON | P_FLY_ON) ||
+         op->more != NULL) &&
         op->head == NULL) {
         for (object *tmp = op; tmp != NULL; tmp = tmp->more) {
             if (object_check_move_on(tmp, originator, 1)) {
@@ -2355,7 +2573,7 @@ object_can_pick (const object *op, const object *item)
             return false;
         }
 
-        shstr *name = object_get_value(item, "soulbound_name");
+        shstr *name = object_get_value_s(item, shstr_cons.soulbound_name);
         if (name == NULL) {
             return false;
         }
@@ -2457,6 +2675,8 @@ object_free_key_values (object *op)
 {
     HARD_ASSERT(op != NULL);
 
+    object_key_values_index_free(op);
+
     key_value_t *field, *tmp;
     LL_FOREACH_SAFE(op->key_values, field, tmp) {
         if (field->key != NULL) {
@@ -2471,6 +2691,7 @@ object_free_key_values (object *op)
     }
 
     op->key_values = NULL;
+    op->key_values_num = 0;
 }
 
 /**
@@ -2489,6 +2710,12 @@ object_get_key_link (const object *op, shstr *key)
     HARD_ASSERT(op != NULL);
     HARD_ASSERT(key != NULL);
 
+    if (op->key_values_index != NULL) {
+        key_value_index_t *entry;
+        HASH_FIND_PTR(op->key_values_index, &key, entry);
+        return entry != NULL ? entry->field : NULL;
+    }
+
     key_value_t *field;
     LL_FOREACH(op->key_values, field) {
         if (field->key == key) {
@@ -2499,6 +2726,36 @@ object_get_key_link (const object *op, shstr *key)
     return NULL;
 }
 
+/**
+ * Get an extra value by key, which is already a shared string.
+ *
+ * Frequently used keys should be kept as shared strings (for example, in
+ * ::shstr_cons) and looked up with this, which avoids having to look up
+ * the key in the shared strings first.
+ *
+ * @param op
+ * Object to search in.
+ * @param key
+ * Key of which to retrieve the value. Must be a shared string.
+ * @return
+ * The value if found, NULL otherwise.
+ * @note
+ * The returned string is shared.
+ */
+shstr *
+object_get_value_s (const object *op, shstr *key)
+{
+    HARD_ASSERT(op != NULL);
+    HARD_ASSERT(key != NULL);
+
+    key_value_t *field = object_get_key_link(op, key);
+    if (field == NULL) {
+        return NULL;
+    }
+
+    return field->value;
+}
+
 /**
  * Get an extra value by key.
  *
@@ -2517,19 +2774,17 @@ object_get_value (const object *op, const char *const key)
     HARD_ASSERT(op != NULL);
     HARD_ASSERT(key != NULL);
 
-    shstr *shared_key = find_string(key);
-    if (shared_key == NULL) {
+    /* Nothing to find; don't bother looking up the key. */
+    if (op->key_values == NULL) {
         return NULL;
     }
 
-    key_value_t *field;
-    LL_FOREACH(op->key_values, field) {
-        if (field->key == shared_key) {
-            return field->value;
-        }
+    shstr *shared_key = find_string(key);
+    if (shared_key == NULL) {
+        return NULL;
     }
 
-    return NULL;
+    return object_get_value_s(op, shared_key);
 }
 
 /**
@@ -2552,14 +2807,8 @@ object_set_value_s (object *op, shstr *key, const char *value, bool add_key)
     HARD_ASSERT(op != NULL);
     HARD_ASSERT(key != NULL);
 
-    key_value_t *field;
-    key_value_t *last = NULL;
-    LL_FOREACH(op->key_values, field) {
-        if (field->key != key) {
-            last = field;
-            continue;
-        }
-
+    key_value_t *field = object_get_key_link(op, key);
+    if (field != NULL) {
         if (field->value != NULL) {
             free_string_shared(field->value);
         }
@@ -2575,14 +2824,18 @@ object_set_value_s (object *op, shstr *key, const char *value, bool add_key)
                 field->value = NULL;
             } else {
                 /* Delete this link */
-                if (field->key != NULL) {
-                    free_string_shared(field->key);
+                if (op->key_values_index != NULL) {
+                    key_value_index_t *entry;
+                    HASH_FIND_PTR(op->key_values_index, &key, entry);
+                    HASH_DEL(op->key_values_index, entry);
+                    efree(entry);
                 }
 
-                if (last != NULL) {
-                    last->next = field->next;
-                } else {
-                    op->key_values = field->next;
+                LL_DELETE(op->key_values, field);
+                op->key_values_num--;
+
+                if (field->key != NULL) {
+                    free_string_shared(field->key);
                 }
 
                 efree(field);
@@ -2610,6 +2863,7 @@ object_set_value_s (object *op, shstr *key, const char *value, bool add_key)
     /* Usual prepend-addition. */
     field->next = op->key_values;
     op->key_values = field;
+    object_key_values_linked(op, field);
 
     return true;
 }
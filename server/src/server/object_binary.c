@@ -0,0 +1,1288 @@
+/*************************************************************************
+ *           Atrinik, a Multiplayer Online Role Playing Game             *
+ *                                                                       *
+ *   Copyright (C) 2009-2014 Alex Tokar and Atrinik Development Team     *
+ *                                                                       *
+ * Fork from Crossfire (Multiplayer game for X-windows).                 *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 2 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the Free Software           *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.             *
+ *                                                                       *
+ * The author can be reached at admin@atrinik.org                        *
+ ************************************************************************/
+
+/**
+ * @file
+ * Compact binary format for saving and loading objects.
+ *
+ * Used for files that are only ever read back by the server, such as
+ * temporary maps and unique items; authored maps are kept in the text
+ * format handled by object.l.
+ *
+ * A file starts with ::OBJECT_BINARY_MAGIC and ::OBJECT_BINARY_VERSION.
+ * An object is stored as its archetype name, followed by tagged attributes
+ * that differ from the archetype, tagged inventory objects and
+ * ::OBJECT_BINARY_TAG_END. Integers are stored as varints, and strings are
+ * stored the first time they are used and referenced by index afterwards.
+ *
+ * The loader applies attributes with the same semantics as the text
+ * loader.
+ */
+
+#include <global.h>
+#include <loader.h>
+#include <arch.h>
+#include <object.h>
+#include <object_methods.h>
+#include <toolkit/string.h>
+#include <toolkit/gitversion.h>
+
+/**
+ * Magic the binary files start with. The first byte can't begin a text
+ * file.
+ */
+#define OBJECT_BINARY_MAGIC "\177ATB"
+/**
+ * Length of ::OBJECT_BINARY_MAGIC.
+ */
+#define OBJECT_BINARY_MAGIC_LEN 4
+/**
+ * Version of the binary format. Must be increased whenever the meaning of
+ * the existing tags changes.
+ */
+#define OBJECT_BINARY_VERSION 1
+/**
+ * Maximum depth of nested inventories.
+ */
+#define OBJECT_BINARY_MAXDEPTH 64
+
+/**
+ * Integer attributes that are saved and loaded as-is.
+ */
+#define OBJECT_BINARY_INT_FIELDS \
+    FIELD(ANIM_SPEED, anim_speed) \
+    FIELD(WC_RANGE, stats.wc_range) \
+    FIELD(STR, stats.Str) \
+    FIELD(DEX, stats.Dex) \
+    FIELD(CON, stats.Con) \
+    FIELD(POW, stats.Pow) \
+    FIELD(INT, stats.Int) \
+    FIELD(HP, stats.hp) \
+    FIELD(MAXHP, stats.maxhp) \
+    FIELD(SP, stats.sp) \
+    FIELD(MAXSP, stats.maxsp) \
+    FIELD(EXP, stats.exp) \
+    FIELD(FOOD, stats.food) \
+    FIELD(DAM, stats.dam) \
+    FIELD(WC, stats.wc) \
+    FIELD(AC, stats.ac) \
+    FIELD(X, x) \
+    FIELD(Y, y) \
+    FIELD(Z, z) \
+    FIELD(ZOOM_X, zoom_x) \
+    FIELD(ZOOM_Y, zoom_y) \
+    FIELD(ALIGN, align) \
+    FIELD(ALPHA, alpha) \
+    FIELD(GLOW_SPEED, glow_speed) \
+    FIELD(ROTATE, rotate) \
+    FIELD(SUB_TYPE, sub_type) \
+    FIELD(TERRAIN_FLAG, terrain_flag) \
+    FIELD(TERRAIN_TYPE, terrain_type) \
+    FIELD(ITEM_QUALITY, item_quality) \
+    FIELD(ITEM_CONDITION, item_condition) \
+    FIELD(ITEM_RACE, item_race) \
+    FIELD(ITEM_SKILL, item_skill) \
+    FIELD(ITEM_LEVEL, item_level) \
+    FIELD(ENEMY_COUNT, enemy_count) \
+    FIELD(ATTACKED_BY_COUNT, attacked_by_count) \
+    FIELD(OWNERCOUNT, ownercount) \
+    FIELD(MOVE_STATUS, move_status) \
+    FIELD(MOVE_TYPE, move_type) \
+    FIELD(ATTACK_MOVE_TYPE, attack_move_type) \
+    FIELD(NROF, nrof) \
+    FIELD(LEVEL, level) \
+    FIELD(TYPE, type) \
+    FIELD(PATH_ATTUNED, path_attuned) \
+    FIELD(PATH_REPELLED, path_repelled) \
+    FIELD(PATH_DENIED, path_denied) \
+    FIELD(MATERIAL, material) \
+    FIELD(VALUE, value) \
+    FIELD(CARRYING, carrying) \
+    FIELD(WEIGHT, weight) \
+    FIELD(STATE, state) \
+    FIELD(MAGIC, magic) \
+    FIELD(LAST_HEAL, last_heal) \
+    FIELD(LAST_SP, last_sp) \
+    FIELD(LAST_GRACE, last_grace) \
+    FIELD(LAST_EAT, last_eat) \
+    FIELD(GLOW_RADIUS, glow_radius) \
+    FIELD(RUN_AWAY, run_away) \
+    FIELD(WEIGHT_LIMIT, weight_limit) \
+    FIELD(BEHAVIOR, behavior) \
+    FIELD(QUICKSLOT, quickslot) \
+    FIELD(ITEM_POWER, item_power) \
+    FIELD(BLOCK, block) \
+    FIELD(ABSORB, absorb) \
+    FIELD(QUICK_POS, quick_pos)
+
+/**
+ * Attribute tags. New tags must only ever be appended.
+ */
+enum {
+    OBJECT_BINARY_TAG_END, ///< End of the object.
+    OBJECT_BINARY_TAG_INV, ///< Inventory object follows.
+    OBJECT_BINARY_TAG_KEY_VALUE, ///< Key/value pair.
+    OBJECT_BINARY_TAG_NAME, ///< Name.
+    OBJECT_BINARY_TAG_CUSTOM_NAME, ///< Custom name.
+    OBJECT_BINARY_TAG_GLOW, ///< Glow.
+    OBJECT_BINARY_TAG_TITLE, ///< Title.
+    OBJECT_BINARY_TAG_RACE, ///< Race.
+    OBJECT_BINARY_TAG_SLAYING, ///< Slaying.
+    OBJECT_BINARY_TAG_MSG, ///< Message.
+    OBJECT_BINARY_TAG_ARTIFACT, ///< Artifact.
+    OBJECT_BINARY_TAG_OTHER_ARCH, ///< Other archetype.
+    OBJECT_BINARY_TAG_FACE, ///< Face.
+    OBJECT_BINARY_TAG_INV_FACE, ///< Inventory face.
+    OBJECT_BINARY_TAG_ANIMATION, ///< Animation.
+    OBJECT_BINARY_TAG_INV_ANIMATION, ///< Inventory animation.
+    OBJECT_BINARY_TAG_RANDOMITEMS, ///< Treasure list.
+    OBJECT_BINARY_TAG_SPEED, ///< Speed.
+    OBJECT_BINARY_TAG_SPEED_LEFT, ///< Speed left.
+    OBJECT_BINARY_TAG_WEAPON_SPEED, ///< Weapon speed.
+    OBJECT_BINARY_TAG_MATERIAL_REAL, ///< Real material.
+    OBJECT_BINARY_TAG_DIRECTION, ///< Direction.
+    OBJECT_BINARY_TAG_LAYER, ///< Layer.
+    OBJECT_BINARY_TAG_SUB_LAYER, ///< Sub-layer.
+    OBJECT_BINARY_TAG_ATTACK, ///< Attack type index and value.
+    OBJECT_BINARY_TAG_PROTECTION, ///< Protection index and value.
+    OBJECT_BINARY_TAG_CONNECTED, ///< Connection value.
+    OBJECT_BINARY_TAG_FLAG, ///< Flag index and value.
+
+#define FIELD(_tag, _field) OBJECT_BINARY_TAG_ ## _tag,
+    OBJECT_BINARY_INT_FIELDS
+#undef FIELD
+};
+
+/**
+ * String saved to a binary file.
+ */
+typedef struct object_binary_string {
+    shstr *str; ///< The string.
+    uint32_t idx; ///< Index of the string in the file.
+    UT_hash_handle hh; ///< Hash handle.
+} object_binary_string_t;
+
+/**
+ * Binary file being saved or loaded.
+ */
+struct object_binary {
+    FILE *fp; ///< The file.
+
+    /**
+     * Strings saved so far, when saving.
+     */
+    object_binary_string_t *strings_hash;
+
+    /**
+     * Strings loaded so far, when loading.
+     */
+    shstr **strings;
+
+    size_t strings_num; ///< Number of strings saved or loaded.
+    size_t strings_size; ///< Allocated size of ::strings.
+    bool error; ///< Whether an error was encountered when loading.
+};
+
+/**
+ * Maps indices of ::object_flag_names to the flags the text loader sets
+ * for them; -1 if the text loader ignores the flag name.
+ */
+static int object_binary_flags[NUM_FLAGS + 1];
+/**
+ * Whether ::object_binary_flags has been initialized.
+ */
+static bool object_binary_flags_init = false;
+
+/**
+ * Initializes ::object_binary_flags, using the text loader to find out
+ * what each flag name does.
+ */
+static void
+object_binary_init_flags (void)
+{
+    object_binary_flags_init = true;
+
+    for (int i = 0; i <= NUM_FLAGS; i++) {
+        object_binary_flags[i] = -1;
+
+        if (object_flag_names[i] == NULL) {
+            continue;
+        }
+
+        object tmp;
+        memset(&tmp, 0, sizeof(tmp));
+
+        char buf[MAX_BUF];
+        snprintf(VS(buf), "%s 1\n", object_flag_names[i]);
+        set_variable(&tmp, buf);
+
+        for (int flag = 0; flag <= NUM_FLAGS; flag++) {
+            if (QUERY_FLAG(&tmp, flag)) {
+                object_binary_flags[i] = flag;
+                break;
+            }
+        }
+
+        object_free_key_values(&tmp);
+    }
+}
+
+/**
+ * Check whether the specified file is in the binary format, without
+ * consuming any data.
+ *
+ * @param fp
+ * The file.
+ * @return
+ * Whether the file is binary.
+ */
+bool
+object_binary_check (FILE *fp)
+{
+    HARD_ASSERT(fp != NULL);
+
+    int c = getc(fp);
+    if (c == EOF) {
+        return false;
+    }
+
+    ungetc(c, fp);
+    return c == (unsigned char) OBJECT_BINARY_MAGIC[0];
+}
+
+/**
+ * Calculate a checksum of the binary format and the loader, for files that
+ * must be discarded whenever either changes, such as the archetype cache.
+ * Covers ::OBJECT_BINARY_VERSION, the flag numbers in #object_flag_names
+ * and the Git version the server was built from, if known.
+ *
+ * @return
+ * The checksum.
+ */
+uint64_t
+object_binary_format_checksum (void)
+{
+    StringBuffer *sb = stringbuffer_new();
+    stringbuffer_append_printf(sb, "%d\n", OBJECT_BINARY_VERSION);
+
+    for (int i = 0; i <= NUM_FLAGS; i++) {
+        if (object_flag_names[i] != NULL) {
+            stringbuffer_append_printf(sb, "%d %s\n", i, object_flag_names[i]);
+        }
+    }
+
+#ifdef GITVERSION
+    stringbuffer_append_string(sb, STRINGIFY(GITVERSION));
+#endif
+
+    char *str = stringbuffer_finish(sb);
+
+    /* 64-bit FNV-1a. */
+    uint64_t checksum = UINT64_C(14695981039346656037);
+    for (const char *cp = str; *cp != '\0'; cp++) {
+        checksum ^= (unsigned char) *cp;
+        checksum *= UINT64_C(1099511628211);
+    }
+
+    efree(str);
+    return checksum;
+}
+
+/**
+ * Start saving a binary file.
+ *
+ * @param fp
+ * The file to save to.
+ * @return
+ * The binary file. Must be freed with object_binary_free().
+ */
+object_binary_t *
+object_binary_create (FILE *fp)
+{
+    HARD_ASSERT(fp != NULL);
+
+    object_binary_t *ob = ecalloc(1, sizeof(*ob));
+    ob->fp = fp;
+
+    fwrite(OBJECT_BINARY_MAGIC, 1, OBJECT_BINARY_MAGIC_LEN, fp);
+    putc(OBJECT_BINARY_VERSION, fp);
+
+    return ob;
+}
+
+/**
+ * Start loading a binary file.
+ *
+ * @param fp
+ * The file to load from.
+ * @return
+ * The binary file, NULL if the file is not in a supported binary format.
+ * Must be freed with object_binary_free().
+ */
+object_binary_t *
+object_binary_open (FILE *fp)
+{
+    HARD_ASSERT(fp != NULL);
+
+    char magic[OBJECT_BINARY_MAGIC_LEN];
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+        memcmp(magic, OBJECT_BINARY_MAGIC, sizeof(magic)) != 0) {
+        LOG(ERROR, "Not a binary object file.");
+        return NULL;
+    }
+
+    int version = getc(fp);
+    if (version != OBJECT_BINARY_VERSION) {
+        LOG(ERROR, "Unsupported binary object file version: %d", version);
+        return NULL;
+    }
+
+    object_binary_t *ob = ecalloc(1, sizeof(*ob));
+    ob->fp = fp;
+    return ob;
+}
+
+/**
+ * Free the specified binary file. Doesn't close the underlying file.
+ *
+ * @param ob
+ * The binary file.
+ */
+void
+object_binary_free (object_binary_t *ob)
+{
+    HARD_ASSERT(ob != NULL);
+
+    object_binary_string_t *string, *tmp;
+    HASH_ITER(hh, ob->strings_hash, string, tmp) {
+        HASH_DEL(ob->strings_hash, string);
+        free_string_shared(string->str);
+        efree(string);
+    }
+
+    for (size_t i = 0; i < ob->strings_num && ob->strings != NULL; i++) {
+        free_string_shared(ob->strings[i]);
+    }
+
+    if (ob->strings != NULL) {
+        efree(ob->strings);
+    }
+
+    efree(ob);
+}
+
+/**
+ * Save an unsigned varint.
+ *
+ * @param ob
+ * The binary file.
+ * @param val
+ * Value to save.
+ */
+void
+object_binary_put_uint (object_binary_t *ob, uint64_t val)
+{
+    while (val >= 0x80) {
+        putc((int) (val & 0x7f) | 0x80, ob->fp);
+        val >>= 7;
+    }
+
+    putc((int) val, ob->fp);
+}
+
+/**
+ * Save a signed (zigzag encoded) varint.
+ *
+ * @param ob
+ * The binary file.
+ * @param val
+ * Value to save.
+ */
+static void
+object_binary_put_int (object_binary_t *ob, int64_t val)
+{
+    object_binary_put_uint(ob, ((uint64_t) val << 1) ^
+                               (uint64_t) (val >> 63));
+}
+
+/**
+ * Save a double.
+ *
+ * @param ob
+ * The binary file.
+ * @param val
+ * Value to save.
+ */
+static void
+object_binary_put_double (object_binary_t *ob, double val)
+{
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+
+    for (int i = 0; i < 8; i++) {
+        putc((int) ((bits >> (i * 8)) & 0xff), ob->fp);
+    }
+}
+
+/**
+ * Save a string. The string itself is only saved the first time,
+ * afterwards its index is saved.
+ *
+ * @param ob
+ * The binary file.
+ * @param str
+ * String to save. Can be NULL.
+ */
+void
+object_binary_put_string (object_binary_t *ob, const char *str)
+{
+    if (str == NULL) {
+        object_binary_put_uint(ob, 0);
+        return;
+    }
+
+    shstr *sh = add_string(str);
+
+    object_binary_string_t *string;
+    HASH_FIND_PTR(ob->strings_hash, &sh, string);
+
+    if (string != NULL) {
+        free_string_shared(sh);
+        object_binary_put_uint(ob, string->idx + 1);
+        return;
+    }
+
+    string = emalloc(sizeof(*string));
+    string->str = sh;
+    string->idx = ob->strings_num++;
+    HASH_ADD_PTR(ob->strings_hash, str, string);
+
+    size_t len = strlen(sh);
+    object_binary_put_uint(ob, string->idx + 1);
+    object_binary_put_uint(ob, len);
+    fwrite(sh, 1, len, ob->fp);
+}
+
+/**
+ * Save an arbitrary blob of data, such as a map header.
+ *
+ * @param ob
+ * The binary file.
+ * @param data
+ * The data.
+ * @param len
+ * Length of the data.
+ */
+void
+object_binary_put_data (object_binary_t *ob, const void *data, size_t len)
+{
+    HARD_ASSERT(ob != NULL);
+    HARD_ASSERT(data != NULL || len == 0);
+
+    object_binary_put_uint(ob, len);
+    fwrite(data, 1, len, ob->fp);
+}
+
+/**
+ * Load an unsigned varint.
+ *
+ * @param ob
+ * The binary file.
+ * @return
+ * The value. On error, 0 is returned and the error flag is set.
+ */
+uint64_t
+object_binary_get_uint (object_binary_t *ob)
+{
+    uint64_t val = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(ob->fp);
+        if (c == EOF) {
+            break;
+        }
+
+        val |= (uint64_t) (c & 0x7f) << shift;
+
+        if (!(c & 0x80)) {
+            return val;
+        }
+    }
+
+    ob->error = true;
+    return 0;
+}
+
+/**
+ * Load a signed (zigzag encoded) varint.
+ *
+ * @param ob
+ * The binary file.
+ * @return
+ * The value.
+ */
+static int64_t
+object_binary_get_int (object_binary_t *ob)
+{
+    uint64_t val = object_binary_get_uint(ob);
+    return (int64_t) (val >> 1) ^ -(int64_t) (val & 1);
+}
+
+/**
+ * Load a double.
+ *
+ * @param ob
+ * The binary file.
+ * @return
+ * The value.
+ */
+static double
+object_binary_get_double (object_binary_t *ob)
+{
+    uint64_t bits = 0;
+
+    for (int i = 0; i < 8; i++) {
+        int c = getc(ob->fp);
+        if (c == EOF) {
+            ob->error = true;
+            return 0.0;
+        }
+
+        bits |= (uint64_t) c << (i * 8);
+    }
+
+    double val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+/**
+ * Load a string.
+ *
+ * @param ob
+ * The binary file.
+ * @return
+ * The string, NULL if the saved string was NULL or on error. The string is
+ * owned by the binary file; use add_refcount() to keep it.
+ */
+shstr *
+object_binary_get_string (object_binary_t *ob)
+{
+    uint64_t idx = object_binary_get_uint(ob);
+    if (idx == 0) {
+        return NULL;
+    }
+
+    idx--;
+
+    if (idx < ob->strings_num) {
+        return ob->strings[idx];
+    }
+
+    if (idx != ob->strings_num) {
+        LOG(ERROR, "Invalid string index: %" PRIu64, idx);
+        ob->error = true;
+        return NULL;
+    }
+
+    uint64_t len = object_binary_get_uint(ob);
+    if (ob->error || len >= HUGE_BUF * 16) {
+        ob->error = true;
+        return NULL;
+    }
+
+    char *buf = emalloc(len + 1);
+    if (fread(buf, 1, len, ob->fp) != len) {
+        efree(buf);
+        ob->error = true;
+        return NULL;
+    }
+
+    buf[len] = '\0';
+
+    if (ob->strings_num == ob->strings_size) {
+        ob->strings_size = ob->strings_size != 0 ? ob->strings_size * 2 : 64;
+        ob->strings = erealloc(ob->strings,
+                               sizeof(*ob->strings) * ob->strings_size);
+    }
+
+    ob->strings[ob->strings_num] = add_string(buf);
+    efree(buf);
+
+    return ob->strings[ob->strings_num++];
+}
+
+/**
+ * Load a blob of data saved with object_binary_put_data().
+ *
+ * @param ob
+ * The binary file.
+ * @param[out] len
+ * Will contain the length of the data.
+ * @return
+ * The data, NULL on error. Must be freed.
+ */
+void *
+object_binary_get_data (object_binary_t *ob, size_t *len)
+{
+    HARD_ASSERT(ob != NULL);
+    HARD_ASSERT(len != NULL);
+
+    uint64_t size = object_binary_get_uint(ob);
+    if (ob->error) {
+        return NULL;
+    }
+
+    char *data = emalloc(size + 1);
+    if (fread(data, 1, size, ob->fp) != size) {
+        efree(data);
+        ob->error = true;
+        return NULL;
+    }
+
+    data[size] = '\0';
+    *len = size;
+    return data;
+}
+
+/**
+ * Save a string attribute, if it differs from the archetype.
+ */
+#define SAVE_STRING(_tag, _field) \
+    do { \
+        if (op->_field != NULL && op->_field != op2->_field) { \
+            object_binary_put_uint(ob, _tag); \
+            object_binary_put_string(ob, op->_field); \
+        } \
+    } while (0)
+
+/**
+ * Save an integer attribute, if it differs from the archetype.
+ */
+#define SAVE_INT(_tag, _field) \
+    do { \
+        if (op->_field != op2->_field) { \
+            object_binary_put_uint(ob, _tag); \
+            object_binary_put_int(ob, op->_field); \
+        } \
+    } while (0)
+
+/**
+ * Save a double attribute, if it differs from the archetype.
+ */
+#define SAVE_DOUBLE(_tag, _field) \
+    do { \
+        if (!DBL_EQUAL(op->_field, op2->_field)) { \
+            object_binary_put_uint(ob, _tag); \
+            object_binary_put_double(ob, op->_field); \
+        } \
+    } while (0)
+
+/**
+ * Save the attributes of an object that differ from its archetype; the
+ * binary counterpart of get_ob_diff().
+ *
+ * @param ob
+ * The binary file.
+ * @param op
+ * The object.
+ * @param op2
+ * Object's archetype.
+ */
+static void
+object_binary_save_diff (object_binary_t *ob,
+                         const object    *op,
+                         const object    *op2)
+{
+    key_value_t *field;
+    LL_FOREACH(op->key_values, field) {
+        key_value_t *arch_field = object_get_key_link(op2, field->key);
+
+        if (arch_field == NULL || field->value != arch_field->value) {
+            object_binary_put_uint(ob, OBJECT_BINARY_TAG_KEY_VALUE);
+            object_binary_put_string(ob, field->key);
+            object_binary_put_string(ob, field->value);
+        }
+    }
+
+    SAVE_STRING(OBJECT_BINARY_TAG_NAME, name);
+    SAVE_STRING(OBJECT_BINARY_TAG_CUSTOM_NAME, custom_name);
+    SAVE_STRING(OBJECT_BINARY_TAG_GLOW, glow);
+    SAVE_STRING(OBJECT_BINARY_TAG_TITLE, title);
+    SAVE_STRING(OBJECT_BINARY_TAG_RACE, race);
+    SAVE_STRING(OBJECT_BINARY_TAG_SLAYING, slaying);
+    SAVE_STRING(OBJECT_BINARY_TAG_MSG, msg);
+    SAVE_STRING(OBJECT_BINARY_TAG_ARTIFACT, artifact);
+
+    if (op->other_arch != op2->other_arch && op->other_arch != NULL &&
+        op->other_arch->name != NULL) {
+        object_binary_put_uint(ob, OBJECT_BINARY_TAG_OTHER_ARCH);
+        object_binary_put_string(ob, op->other_arch->name);
+    }
+
+    if (op->face != op2->face) {
+        object_binary_put_uint(ob, OBJECT_BINARY_TAG_FACE);
+        object_binary_put_string(ob, op->face->name);
+    }
+
+    if (op->inv_face != op2->inv_face) {
+        object_binary_put_uint(ob, OBJECT_BINARY_TAG_INV_FACE);
+        object_binary_put_string(ob, op->inv_face->name);
+    }
+
+    if (op->animation_id != op2->animation_id) {
+        object_binary_put_uint(ob, OBJECT_BINARY_TAG_ANIMATION);
+        object_binary_put_string(ob, op->animation_id != 0 ?
+                                 animations[GET_ANIM_ID(op)].name : NULL);
+    }
+
+    if (op->inv_animation_id != op2->inv_animation_id) {
+        object_binary_put_uint(ob, OBJECT_BINARY_TAG_INV_ANIMATION);
+        object_binary_put_string(ob, op->inv_animation_id != 0 ?
+                                 animations[GET_INV_ANIM_ID(op)].name : NULL);
+    }
+
+    if (op->randomitems != op2->randomitems) {
+        object_binary_put_uint(ob, OBJECT_BINARY_TAG_RANDOMITEMS);
+        object_binary_put_string(ob, op->randomitems != NULL ?
+                                 op->randomitems->name : NULL);
+    }
+
+    SAVE_DOUBLE(OBJECT_BINARY_TAG_SPEED, speed);
+    SAVE_DOUBLE(OBJECT_BINARY_TAG_SPEED_LEFT, speed_left);
+    SAVE_DOUBLE(OBJECT_BINARY_TAG_WEAPON_SPEED, weapon_speed);
+    SAVE_INT(OBJECT_BINARY_TAG_MATERIAL_REAL, material_real);
+    SAVE_INT(OBJECT_BINARY_TAG_DIRECTION, direction);
+    SAVE_INT(OBJECT_BINARY_TAG_LAYER, layer);
+    SAVE_INT(OBJECT_BINARY_TAG_SUB_LAYER, sub_layer);
+
+#define FIELD(_tag, _field) SAVE_INT(OBJECT_BINARY_TAG_ ## _tag, _field);
+    OBJECT_BINARY_INT_FIELDS
+#undef FIELD
+
+    for (int i = 0; i < NROFATTACKS; i++) {
+        if (op->attack[i] != op2->attack[i]) {
+            object_binary_put_uint(ob, OBJECT_BINARY_TAG_ATTACK);
+            object_binary_put_uint(ob, i);
+            object_binary_put_int(ob, op->attack[i]);
+        }
+
+        if (op->protection[i] != op2->protection[i]) {
+            object_binary_put_uint(ob, OBJECT_BINARY_TAG_PROTECTION);
+            object_binary_put_uint(ob, i);
+            object_binary_put_int(ob, op->protection[i]);
+        }
+    }
+
+    if (QUERY_FLAG(op, FLAG_IS_LINKED)) {
+        int connected = connection_object_get_value(op);
+
+        if (connected != 0) {
+            object_binary_put_uint(ob, OBJECT_BINARY_TAG_CONNECTED);
+            object_binary_put_int(ob, connected);
+        }
+    }
+
+    for (int i = 0; i <= NUM_FLAGS; i++) {
+        if (object_flag_names[i] == NULL) {
+            continue;
+        }
+
+        uint32_t flag = QUERY_FLAG(op, i);
+        if (flag != QUERY_FLAG(op2, i)) {
+            object_binary_put_uint(ob, OBJECT_BINARY_TAG_FLAG);
+            object_binary_put_uint(ob, (i << 1) | (flag ? 1 : 0));
+        }
+    }
+}
+
+#undef SAVE_STRING
+#undef SAVE_INT
+#undef SAVE_DOUBLE
+
+/**
+ * Save an object, including its inventory; the binary counterpart of
+ * object_save().
+ *
+ * @param ob
+ * The binary file.
+ * @param op
+ * The object.
+ */
+void
+object_binary_save (object_binary_t *ob, const object *op)
+{
+    HARD_ASSERT(ob != NULL);
+    HARD_ASSERT(op != NULL);
+
+    archetype_t *at = op->arch;
+    if (at == NULL) {
+        at = arches[ARCH_EMPTY_ARCHETYPE];
+    }
+
+    object_binary_put_string(ob, at->name);
+    object_binary_save_diff(ob, op, &at->clone);
+
+    for (object *tmp = op->inv; tmp != NULL; tmp = tmp->below) {
+        object_binary_put_uint(ob, OBJECT_BINARY_TAG_INV);
+        object_binary_save(ob, tmp);
+    }
+
+    object_binary_put_uint(ob, OBJECT_BINARY_TAG_END);
+}
+
+/**
+ * Save an object, including its inventory, as the difference from the
+ * specified base object instead of its archetype. The loader applies the
+ * attributes to the object it is given as-is; this is used for saving
+ * the archetypes themselves.
+ *
+ * @param ob
+ * The binary file.
+ * @param op
+ * The object.
+ * @param base
+ * Object to compare against.
+ */
+void
+object_binary_save_base (object_binary_t *ob,
+                         const object    *op,
+                         const object    *base)
+{
+    HARD_ASSERT(ob != NULL);
+    HARD_ASSERT(op != NULL);
+    HARD_ASSERT(base != NULL);
+
+    object_binary_put_string(ob, NULL);
+    object_binary_save_diff(ob, op, base);
+
+    for (object *tmp = op->inv; tmp != NULL; tmp = tmp->below) {
+        object_binary_put_uint(ob, OBJECT_BINARY_TAG_INV);
+        object_binary_save(ob, tmp);
+    }
+
+    object_binary_put_uint(ob, OBJECT_BINARY_TAG_END);
+}
+
+/**
+ * Set a string attribute the way the text loader does, which treats
+ * "NONE" as no value.
+ *
+ * @param field
+ * Field to set.
+ * @param str
+ * Value.
+ */
+static void
+object_binary_set_string_none (shstr **field, shstr *str)
+{
+    if (str == NULL || str == shstr_cons.NONE) {
+        FREE_AND_CLEAR_HASH(*field);
+    } else {
+        FREE_AND_ADD_REF_HASH(*field, str);
+    }
+}
+
+/**
+ * Finish loading an object; same as what the text loader does.
+ *
+ * @param op
+ * The object.
+ * @param map_flags
+ * Load flags.
+ */
+static void
+object_binary_load_finish (object *op, int map_flags)
+{
+    if (map_flags & MAP_STYLE) {
+        return;
+    }
+
+    if (op->speed < 0.0 && op->arch != NULL &&
+        DBL_EQUAL(op->speed_left, op->arch->clone.speed_left)) {
+        op->speed_left = op->arch->clone.speed_left + rndm(0, 90) / 100.0f;
+    }
+
+    object_update_speed(op);
+    object_cb_init(op);
+}
+
+static bool
+object_binary_load_object(object_binary_t *ob,
+                          object          *op,
+                          int              map_flags,
+                          int              depth);
+
+/**
+ * Load an inventory object.
+ *
+ * @param ob
+ * The binary file.
+ * @param op
+ * Object to load the inventory object into.
+ * @param map_flags
+ * Load flags.
+ * @param depth
+ * Inventory depth.
+ * @return
+ * True on success, false on failure.
+ */
+static bool
+object_binary_load_inv (object_binary_t *ob,
+                        object          *op,
+                        int              map_flags,
+                        int              depth)
+{
+    object *tmp = object_get();
+
+    if (!object_binary_load_object(ob, tmp, map_flags, depth + 1)) {
+        object_destroy(tmp);
+        return false;
+    }
+
+    if (tmp->arch == NULL) {
+        object_destroy(tmp);
+        return true;
+    }
+
+    tmp = object_insert_into(tmp, op, 0);
+    if (tmp == NULL || (map_flags & MAP_STYLE)) {
+        return true;
+    }
+
+    object_binary_load_finish(tmp, map_flags);
+
+    if (QUERY_FLAG(tmp, FLAG_AUTO_APPLY)) {
+        object_auto_apply(tmp);
+    } else if (tmp->randomitems != NULL && (map_flags & MAP_ORIGINAL) &&
+               op->type != SPAWN_POINT) {
+        treasure_generate(tmp->randomitems,
+                          tmp,
+                          get_environment_level(tmp),
+                          0);
+    }
+
+    return true;
+}
+
+/**
+ * Load an object's attributes and inventory.
+ *
+ * @param ob
+ * The binary file.
+ * @param op
+ * Object to load into.
+ * @param map_flags
+ * Load flags.
+ * @param depth
+ * Inventory depth.
+ * @return
+ * True on success, false on failure.
+ */
+static bool
+object_binary_load_object (object_binary_t *ob,
+                           object          *op,
+                           int              map_flags,
+                           int              depth)
+{
+    if (depth >= OBJECT_BINARY_MAXDEPTH) {
+        LOG(ERROR, "Exhausted maximum inventory depth.");
+        return false;
+    }
+
+    /* Objects saved with object_binary_save_base() have no archetype
+     * name; their attributes are loaded into the object as-is. */
+    shstr *archname = object_binary_get_string(ob);
+    if (ob->error) {
+        return false;
+    }
+
+    if (archname != NULL) {
+        op->arch = arch_find(archname);
+
+        if (op->arch != NULL) {
+            object_copy(op, &op->arch->clone, true);
+        } else if (!arch_in_init) {
+            LOG(DEBUG, "Discarding object without arch: %s", archname);
+        }
+    }
+
+    while (!ob->error) {
+        uint64_t tag = object_binary_get_uint(ob);
+        shstr *str, *str2;
+        int64_t val;
+
+        if (ob->error) {
+            break;
+        }
+
+        switch (tag) {
+        case OBJECT_BINARY_TAG_END:
+            return true;
+
+        case OBJECT_BINARY_TAG_INV:
+            if (!object_binary_load_inv(ob, op, map_flags, depth)) {
+                return false;
+            }
+
+            break;
+
+        case OBJECT_BINARY_TAG_KEY_VALUE:
+            str = object_binary_get_string(ob);
+            str2 = object_binary_get_string(ob);
+
+            if (str != NULL) {
+                object_set_value(op, str, str2, true);
+            }
+
+            break;
+
+        case OBJECT_BINARY_TAG_NAME:
+            str = object_binary_get_string(ob);
+
+            if (str != NULL) {
+                FREE_AND_ADD_REF_HASH(op->name, str);
+            }
+
+            break;
+
+        case OBJECT_BINARY_TAG_CUSTOM_NAME:
+            object_binary_set_string_none(&op->custom_name,
+                                          object_binary_get_string(ob));
+            break;
+
+        case OBJECT_BINARY_TAG_GLOW:
+            object_binary_set_string_none(&op->glow,
+                                          object_binary_get_string(ob));
+            break;
+
+        case OBJECT_BINARY_TAG_TITLE:
+            object_binary_set_string_none(&op->title,
+                                          object_binary_get_string(ob));
+            break;
+
+        case OBJECT_BINARY_TAG_RACE:
+            str = object_binary_get_string(ob);
+            FREE_AND_CLEAR_HASH(op->race);
+
+            if (str != NULL) {
+                FREE_AND_ADD_REF_HASH(op->race, str);
+            }
+
+            break;
+
+        case OBJECT_BINARY_TAG_SLAYING:
+            object_binary_set_string_none(&op->slaying,
+                                          object_binary_get_string(ob));
+            break;
+
+        case OBJECT_BINARY_TAG_MSG:
+            str = object_binary_get_string(ob);
+            FREE_AND_CLEAR_HASH(op->msg);
+
+            if (str != NULL) {
+                FREE_AND_ADD_REF_HASH(op->msg, str);
+            }
+
+            break;
+
+        case OBJECT_BINARY_TAG_ARTIFACT:
+            str = object_binary_get_string(ob);
+            FREE_AND_CLEAR_HASH(op->artifact);
+
+            if (str != NULL) {
+                FREE_AND_ADD_REF_HASH(op->artifact, str);
+            }
+
+            break;
+
+        case OBJECT_BINARY_TAG_OTHER_ARCH:
+            str = object_binary_get_string(ob);
+            op->other_arch = str != NULL ? arch_find(str) : NULL;
+            break;
+
+        case OBJECT_BINARY_TAG_FACE:
+        case OBJECT_BINARY_TAG_INV_FACE: {
+            str = object_binary_get_string(ob);
+            int face = str != NULL ? find_face(str, 0) : 0;
+
+            if (face == 0) {
+                LOG(ERROR, "Can't find face %s for object: %s",
+                    STRING_SAFE(str), object_get_str(op));
+            }
+
+            if (tag == OBJECT_BINARY_TAG_FACE) {
+                op->face = &new_faces[face];
+            } else {
+                op->inv_face = &new_faces[face];
+            }
+
+            break;
+        }
+
+        case OBJECT_BINARY_TAG_ANIMATION:
+            str = object_binary_get_string(ob);
+            op->animation_id = str != NULL ? find_animation(str) : 0;
+            break;
+
+        case OBJECT_BINARY_TAG_INV_ANIMATION:
+            str = object_binary_get_string(ob);
+            op->inv_animation_id = str != NULL ? find_animation(str) : 0;
+            break;
+
+        case OBJECT_BINARY_TAG_RANDOMITEMS:
+            str = object_binary_get_string(ob);
+            op->randomitems = str != NULL ? treasure_list_find(str) : NULL;
+            break;
+
+        case OBJECT_BINARY_TAG_SPEED:
+            op->speed = object_binary_get_double(ob);
+            break;
+
+        case OBJECT_BINARY_TAG_SPEED_LEFT:
+            op->speed_left = object_binary_get_double(ob);
+            break;
+
+        case OBJECT_BINARY_TAG_WEAPON_SPEED:
+            op->weapon_speed = object_binary_get_double(ob);
+            op->weapon_speed_left = 0.0;
+            break;
+
+        case OBJECT_BINARY_TAG_MATERIAL_REAL:
+            op->material_real = object_binary_get_int(ob);
+
+            if (op->item_quality == 0) {
+                op->item_quality = materials_real[op->material_real].quality;
+                op->item_condition = op->item_quality;
+            }
+
+            break;
+
+        case OBJECT_BINARY_TAG_DIRECTION:
+            op->direction = object_binary_get_int(ob) % 9;
+            break;
+
+        case OBJECT_BINARY_TAG_LAYER:
+            val = object_binary_get_int(ob);
+            op->layer = MAX(0, MIN(NUM_LAYERS, val));
+            break;
+
+        case OBJECT_BINARY_TAG_SUB_LAYER:
+            val = object_binary_get_int(ob);
+            op->sub_layer = MAX(0, MIN(NUM_SUB_LAYERS - 1, val));
+            break;
+
+        case OBJECT_BINARY_TAG_ATTACK:
+        case OBJECT_BINARY_TAG_PROTECTION: {
+            uint64_t idx = object_binary_get_uint(ob);
+            val = object_binary_get_int(ob);
+
+            if (idx >= NROFATTACKS) {
+                LOG(ERROR, "Invalid attack type: %" PRIu64, idx);
+                ob->error = true;
+            } else if (tag == OBJECT_BINARY_TAG_ATTACK) {
+                op->attack[idx] = val;
+            } else {
+                op->protection[idx] = val;
+            }
+
+            break;
+        }
+
+        case OBJECT_BINARY_TAG_CONNECTED:
+            connection_object_add(op, op->map, object_binary_get_int(ob));
+            break;
+
+        case OBJECT_BINARY_TAG_FLAG: {
+            uint64_t flag = object_binary_get_uint(ob);
+
+            if (!object_binary_flags_init) {
+                object_binary_init_flags();
+            }
+
+            if ((flag >> 1) > NUM_FLAGS) {
+                LOG(ERROR, "Invalid flag: %" PRIu64, flag >> 1);
+                ob->error = true;
+            } else if (object_binary_flags[flag >> 1] != -1) {
+                CHANGE_FLAG(op, object_binary_flags[flag >> 1], flag & 1);
+            }
+
+            break;
+        }
+
+#define FIELD(_tag, _field) \
+        case OBJECT_BINARY_TAG_ ## _tag: \
+            op->_field = object_binary_get_int(ob); \
+            break;
+        OBJECT_BINARY_INT_FIELDS
+#undef FIELD
+
+        default:
+            LOG(ERROR, "Unknown tag: %" PRIu64, tag);
+            ob->error = true;
+            break;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Load an object, including its inventory; the binary counterpart of
+ * load_object_buffer().
+ *
+ * @param ob
+ * The binary file.
+ * @param op
+ * Object to load into.
+ * @param map_flags
+ * Load flags.
+ * @return
+ * One of @ref LL_xxx.
+ */
+int
+object_binary_load (object_binary_t *ob, object *op, int map_flags)
+{
+    HARD_ASSERT(ob != NULL);
+    HARD_ASSERT(op != NULL);
+
+    if (ob->error) {
+        return LL_ERROR;
+    }
+
+    int c = getc(ob->fp);
+    if (c == EOF) {
+        return LL_EOF;
+    }
+
+    ungetc(c, ob->fp);
+
+    if (!object_binary_load_object(ob, op, map_flags, 0)) {
+        ob->error = true;
+        return LL_ERROR;
+    }
+
+    object_binary_load_finish(op, map_flags);
+    return LL_NORMAL;
+}
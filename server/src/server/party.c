@@ -138,7 +138,7 @@ void remove_party_member(party_struct *party, object *op)
 
         for (ol = party->members; ol; ol = ol->next) {
             socket_send_packet(CONTR(ol->objlink.ob)->cs,
-                    packet_dup(packet));
+                    packet_share(packet));
         }
 
         packet_free(packet);
@@ -556,7 +556,7 @@ void party_update_who(player *pl)
 
         for (ol = pl->party->members; ol; ol = ol->next) {
             socket_send_packet(CONTR(ol->objlink.ob)->cs,
-                    packet_dup(packet));
+                    packet_share(packet));
         }
 
         packet_free(packet);
@@ -56,15 +56,59 @@
 #define VISUALIZE_PATHFINDING 0
 
 /**
- * Size of the pathfinder queue.
+ * Default number of pathfinding worker threads.
  */
-#define PATHFINDER_QUEUE_SIZE 100
+#define PATHFINDER_THREADS 2
 
 /**
- * Maximum number of node buffers.
+ * Maximum number of pathfinding worker threads.
+ */
+#define PATHFINDER_THREADS_MAX 16
+
+/**
+ * Number of nodes in a single node buffer chunk.
  */
 #define PATHFINDER_NODEBUF 1000
 
+/**
+ * Maximum number of nodes a single search may allocate before giving up.
+ */
+#define PATHFINDER_NODES_MAX 50000
+
+/**
+ * Initial size of the visited tiles hash table; must be a power of two.
+ */
+#define PATHFINDER_VISITED_SIZE 4096
+
+/**
+ * Maximum number of maps in a single pathfinding snapshot.
+ */
+#define PATHFINDER_SNAPSHOT_MAPS 64
+
+/**
+ * How many tiles around the bounding box of the start and goal positions
+ * to include in a pathfinding snapshot.
+ */
+#define PATHFINDER_SNAPSHOT_MARGIN 32
+
+/**
+ * Paths on the same level that are at most this many tiles long are
+ * computed with path_find() on the main thread; taking a snapshot for them
+ * costs more than the search itself.
+ */
+#define PATHFINDER_INLINE_DISTANCE 12
+
+/**
+ * Maximum number of nodes the hierarchical search may expand.
+ */
+#define PATHFINDER_ABSTRACT_MAX 5000
+
+/**
+ * Border openings of at least this many tiles get a transition at both
+ * ends instead of one in the middle.
+ */
+#define PATHFINDER_TRANSITION_SPLIT 6
+
 /**
  * Path cost when moving in a straight line.
  */
@@ -80,31 +124,349 @@
  */
 #define PATH_COST_LEVEL 1000.
 
+/**
+ * @defgroup PATH_TILE_xxx Snapshot tile flags
+ * Flags of the individual tiles in a pathfinding snapshot.
+ *@{*/
+/** The tile is blocked for the searching object. */
+#define PATH_TILE_BLOCKED 0x01
+/** The tile is a secret passage the searching object will not use. */
+#define PATH_TILE_AVOID 0x02
+/** The tile has exits the searching object can use. */
+#define PATH_TILE_EXIT 0x04
+/*@}*/
+
+/**
+ * A single request in the pathfinder queue.
+ */
+typedef struct path_request {
+    struct path_request *next; ///< Next request.
+    struct path_request *prev; ///< Previous request.
+
+    object *waypoint; ///< Waypoint object.
+    tag_t wp_count; ///< Waypoint's ID.
+} path_request_t;
+
 /**
  * The pathfinder queue.
  */
-static struct {
+static path_request_t *pathfinder_queue = NULL;
+
+/**
+ * A chunk of node buffers.
+ */
+typedef struct path_node_chunk {
+    struct path_node_chunk *next; ///< Next chunk.
+    path_node_t nodes[PATHFINDER_NODEBUF]; ///< The node buffers.
+} path_node_chunk_t;
+
+/**
+ * Entry in the visited tiles hash table.
+ */
+typedef struct path_visited {
+    const void *map; ///< Map (or snapshot map).
+    int16_t x; ///< X position.
+    int16_t y; ///< Y position.
+    uint32_t id; ///< Search the entry is valid for.
+    bool closed; ///< Whether the tile is closed.
+    path_node_t *node; ///< Node on this tile, if any.
+} path_visited_t;
+
+/**
+ * Offset of a map from the map the search started on.
+ */
+typedef struct path_map_offset {
+    mapstruct *map; ///< The map.
+    int x; ///< X offset.
+    int y; ///< Y offset.
+    int z; ///< Z offset.
+    bool valid; ///< Whether the map is connected to the origin.
+} path_map_offset_t;
+
+/**
+ * A transition between two clusters; a tile on the edge of a map that
+ * connects to a tile on the tiled map next to it.
+ */
+typedef struct path_transition {
+    int16_t x; ///< X position.
+    int16_t y; ///< Y position.
+    int dir; ///< Border the transition is on; one of TILED_NORTH..TILED_WEST.
+} path_transition_t;
+
+/**
+ * Pathfinding cluster of a map; the abstraction used by the hierarchical
+ * search. Each map is one cluster.
+ */
+typedef struct path_cluster {
+    path_transition_t *transitions; ///< Transitions on the map's borders.
+    size_t transitions_num; ///< Number of entries in ::transitions.
+
+    /**
+     * Distances between the transitions, transitions_num * transitions_num
+     * entries; negative if unreachable.
+     */
+    float *distances;
+
+    /**
+     * The tiled maps that the transitions were computed against.
+     */
+    mapstruct *tiles[TILED_NUM_DIR / 2];
+} path_cluster_t;
+
+/**
+ * State of a search. The main thread and each of the worker threads have
+ * their own, so that searches can run concurrently.
+ */
+typedef struct path_context {
+    /**
+     * The node buffers. Used to avoid lots of mallocs; chunks are allocated
+     * as needed, and reused by subsequent searches.
+     */
+    path_node_chunk_t *nodebuf;
+
+    /**
+     * Chunk that nodes are currently being allocated from.
+     */
+    path_node_chunk_t *nodebuf_chunk;
+
+    /**
+     * Next node buf in the current chunk.
+     */
+    int nodebuf_next;
+
+    /**
+     * Number of nodes allocated by the current search.
+     */
+    int nodebuf_num;
+
+    /**
+     * The open set; a binary heap ordered by path_node_t::sum.
+     */
+    path_node_t **heap;
+
+    /**
+     * Number of nodes in ::heap.
+     */
+    size_t heap_num;
+
+    /**
+     * Allocated size of ::heap.
+     */
+    size_t heap_size;
+
+    /**
+     * Hash table of the tiles visited by the current search, keyed by map
+     * and coordinates. Uses open addressing; entries are only valid if their
+     * ID matches ::visited_id, so the table doesn't need to be cleared
+     * between searches.
+     */
+    path_visited_t *visited;
+
+    /**
+     * Size of ::visited; always a power of two.
+     */
+    size_t visited_size;
+
+    /**
+     * Number of valid entries in ::visited.
+     */
+    size_t visited_num;
+
+    /**
+     * ID of the current search.
+     */
+    uint32_t visited_id;
+
+    /**
+     * Algorithm used by the current search.
+     */
+    path_algo_t algo;
+
+    /**
+     * Heuristic greed modifier used by the current search.
+     */
+    double greed;
+
+    /**
+     * Map the offsets in ::offsets are relative to.
+     */
+    mapstruct *origin;
+
+    /**
+     * Offsets of the maps used by the current search.
+     */
+    path_map_offset_t *offsets;
+
+    /**
+     * Number of entries in ::offsets.
+     */
+    size_t offsets_num;
+
+    /**
+     * Allocated size of ::offsets.
+     */
+    size_t offsets_size;
+
+    /**
+     * Index of the entry in ::offsets that was looked up last.
+     */
+    size_t offsets_last;
+} path_context_t;
+
+/**
+ * Exit in a pathfinding snapshot.
+ */
+typedef struct path_snapshot_exit {
+    int16_t x; ///< X position of the exit.
+    int16_t y; ///< Y position of the exit.
+    int map; ///< Snapshot map index the exit leads to.
+    int16_t dest_x; ///< Destination X position.
+    int16_t dest_y; ///< Destination Y position.
+} path_snapshot_exit_t;
+
+/**
+ * Map in a pathfinding snapshot. Holds a copy of everything the search needs
+ * to know about the map's tiles, so that it can be done without touching
+ * the live map.
+ */
+typedef struct path_snapshot_map {
+    /**
+     * The live map; only used on the main thread while creating the
+     * snapshot.
+     */
+    mapstruct *map;
+
+    shstr *path; ///< Map path; used to find the map again for the result.
+    int16_t width; ///< Map width.
+    int16_t height; ///< Map height.
+    int offset_x; ///< X offset of the map from the starting map.
+    int offset_y; ///< Y offset of the map from the starting map.
+    int offset_z; ///< Z offset of the map from the starting map.
+    int tiles[TILED_NUM]; ///< Snapshot indices of the tiled maps, or -1.
+    bool whole; ///< Whether to snapshot the whole map, ignoring the box.
+    uint8_t *flags; ///< Tile flags; combination of @ref PATH_TILE_xxx.
+    float *cost; ///< Additional cost of moving onto the tiles.
+    path_snapshot_exit_t *exits; ///< Exits on the map.
+    size_t exits_num; ///< Number of entries in ::exits.
+} path_snapshot_map_t;
+
+/**
+ * Node of a path found by a worker thread.
+ */
+typedef struct path_job_node {
+    int map; ///< Snapshot map index.
+    int16_t x; ///< X position.
+    int16_t y; ///< Y position.
+    uint8_t flags; ///< A combination of @ref PATH_NODE_xxx.
+} path_job_node_t;
+
+/**
+ * Part of a multi-part object in a pathfinding job.
+ */
+typedef struct path_job_part {
+    int16_t x; ///< X offset of the part from the head.
+    int16_t y; ///< Y offset of the part from the head.
+    int map; ///< Snapshot map index the part is currently on, or -1.
+    int16_t map_x; ///< X position the part is currently on.
+    int16_t map_y; ///< Y position the part is currently on.
+} path_job_part_t;
+
+/**
+ * A path computation done on one of the worker threads.
+ */
+typedef struct path_job {
+    struct path_job *next; ///< Next job.
+    struct path_job *prev; ///< Previous job.
+
     object *waypoint; ///< Waypoint object.
     tag_t wp_count; ///< Waypoint's ID.
-} pathfinder_queue[PATHFINDER_QUEUE_SIZE];
 
+    path_algo_t algo; ///< Algorithm to use.
+    double greed; ///< Heuristic greed modifier.
+
+    path_snapshot_map_t *maps; ///< Snapshot of the maps.
+    size_t maps_num; ///< Number of entries in ::maps.
+
+    int16_t start_x; ///< Start X position; always on the first map.
+    int16_t start_y; ///< Start Y position.
+    int goal_map; ///< Snapshot map index of the goal.
+    int16_t goal_x; ///< Goal X position.
+    int16_t goal_y; ///< Goal Y position.
+
+    /**
+     * Box around the start and goal positions, relative to the starting
+     * map. Tiles outside of it are not snapshotted and are considered
+     * blocked.
+     */
+    int min_x;
+    int max_x; ///< @copydoc min_x
+    int min_y; ///< @copydoc min_x
+    int max_y; ///< @copydoc min_x
+
+    path_job_part_t *parts; ///< Parts of the object, including the head.
+    size_t parts_num; ///< Number of entries in ::parts.
+    int goal_range; ///< Heuristic below which to check the parts.
+
+    path_job_node_t *path; ///< The found path.
+    size_t path_num; ///< Number of entries in ::path.
+    bool complete; ///< Whether the path reaches the goal.
+} path_job_t;
+
+/**
+ * Search context of the main thread.
+ */
+static path_context_t pathfinder_context;
+
+/**
+ * Worker threads.
+ */
+static pthread_t pathfinder_threads[PATHFINDER_THREADS_MAX];
+/**
+ * Number of running worker threads.
+ */
+static size_t pathfinder_threads_num = 0;
+/**
+ * Number of worker threads to start.
+ */
+static size_t pathfinder_threads_wanted = PATHFINDER_THREADS;
+/**
+ * Whether the worker threads have been started.
+ */
+static bool pathfinder_threads_started = false;
 /**
- * First in the queue.
+ * Whether the worker threads should stop.
  */
-static int pathfinder_queue_first = 0;
+static bool pathfinder_threads_stop = false;
 /**
- * Last in the queue.
+ * Lock for ::pathfinder_jobs, ::pathfinder_results and
+ * ::pathfinder_threads_stop.
  */
-static int pathfinder_queue_last = 0;
+static pthread_mutex_t pathfinder_mutex;
+/**
+ * Signalled when a job is added or the worker threads should stop.
+ */
+static pthread_cond_t pathfinder_cond;
+/**
+ * Jobs waiting for a worker thread.
+ */
+static path_job_t *pathfinder_jobs = NULL;
+/**
+ * Jobs completed by the worker threads.
+ */
+static path_job_t *pathfinder_results = NULL;
 
 /**
- * The node buffers. Used to avoid lots of mallocs.
+ * Scratch buffer used for calculating distances within a cluster.
+ */
+static uint16_t *pathfinder_cluster_dist = NULL;
+/**
+ * Scratch queue used for calculating distances within a cluster.
  */
-static path_node_t pathfinder_nodebuf[PATHFINDER_NODEBUF];
+static int *pathfinder_cluster_queue = NULL;
 /**
- * Next node buf.
+ * Allocated size of ::pathfinder_cluster_dist and ::pathfinder_cluster_queue.
  */
-static int pathfinder_nodebuf_next = 0;
+static size_t pathfinder_cluster_size = 0;
 
 /**
  * Used to avoid branching when computing sum of node cost/heuristic
@@ -190,6 +552,29 @@ clioptions_option_pathfinder_greed (const char *arg,
     return true;
 }
 
+/**
+ * Description of the --pathfinder_threads command.
+ */
+static const char *clioptions_option_pathfinder_threads_desc =
+"Sets the number of threads used to compute paths for monsters. If 0, the\n"
+"paths are computed on the main thread.";
+/** @copydoc clioptions_handler_func */
+static bool
+clioptions_option_pathfinder_threads (const char *arg,
+                                      char      **errmsg)
+{
+    int num = atoi(arg);
+    if (num < 0 || num > PATHFINDER_THREADS_MAX) {
+        string_fmt(*errmsg,
+                   "Number of threads must be between 0 and %d",
+                   PATHFINDER_THREADS_MAX);
+        return false;
+    }
+
+    pathfinder_threads_wanted = num;
+    return true;
+}
+
 TOOLKIT_INIT_FUNC(pathfinder)
 {
     clioption_t *cli;
@@ -201,70 +586,123 @@ TOOLKIT_INIT_FUNC(pathfinder)
                                pathfinder_greed,
                                "Set pathfinding greed modifier");
     clioptions_enable_changeable(cli);
-}
-TOOLKIT_INIT_FUNC_FINISH
+    CLIOPTIONS_CREATE_ARGUMENT(cli,
+                               pathfinder_threads,
+                               "Set number of pathfinding threads");
 
-TOOLKIT_DEINIT_FUNC(pathfinder)
-{
+    pthread_mutex_init(&pathfinder_mutex, NULL);
+    pthread_cond_init(&pathfinder_cond, NULL);
 }
-TOOLKIT_DEINIT_FUNC_FINISH
+TOOLKIT_INIT_FUNC_FINISH
 
 /**
- * Enqueue a waypoint for path computation.
+ * Free the data of the specified search context.
  *
- * @param waypoint
- * Waypoint.
- * @return
- * True on success, false on failure.
+ * @param ctx
+ * Search context.
  */
-static bool
-pathfinder_queue_enqueue (object *waypoint)
+static void
+path_context_free (path_context_t *ctx)
 {
-    HARD_ASSERT(waypoint != NULL);
+    HARD_ASSERT(ctx != NULL);
 
-    /* Queue full? */
-    if (pathfinder_queue_last == pathfinder_queue_first - 1 ||
-        (pathfinder_queue_first == 0 &&
-         pathfinder_queue_last == PATHFINDER_QUEUE_SIZE - 1)) {
-        return false;
+    path_node_chunk_t *chunk, *tmp;
+    LL_FOREACH_SAFE(ctx->nodebuf, chunk, tmp) {
+        efree(chunk);
     }
 
-    pathfinder_queue[pathfinder_queue_last].waypoint = waypoint;
-    pathfinder_queue[pathfinder_queue_last].wp_count = waypoint->count;
+    if (ctx->heap != NULL) {
+        efree(ctx->heap);
+    }
 
-    if (++pathfinder_queue_last >= PATHFINDER_QUEUE_SIZE) {
-        pathfinder_queue_last = 0;
+    if (ctx->visited != NULL) {
+        efree(ctx->visited);
     }
 
-    return true;
+    if (ctx->offsets != NULL) {
+        efree(ctx->offsets);
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
 }
 
 /**
- * Get the first waypoint from the queue.
+ * Free the specified pathfinding job. Must be called from the main thread,
+ * as it releases the shared strings of the snapshot.
  *
- * @param[out] count Waypoint's ID if there is a valid waypoint.
- * @return
- * The waypoint, NULL if the queue is empty.
+ * @param job
+ * Job to free.
  */
-static object *
-pathfinder_queue_dequeue (tag_t *count)
+static void
+path_job_free (path_job_t *job)
 {
-    HARD_ASSERT(count != NULL);
+    HARD_ASSERT(job != NULL);
 
-    /* Queue empty? */
-    if (pathfinder_queue_last == pathfinder_queue_first) {
-        return NULL;
+    for (size_t i = 0; i < job->maps_num; i++) {
+        path_snapshot_map_t *smap = &job->maps[i];
+        FREE_ONLY_HASH(smap->path);
+        efree(smap->flags);
+        efree(smap->cost);
+
+        if (smap->exits != NULL) {
+            efree(smap->exits);
+        }
     }
 
-    object *waypoint = pathfinder_queue[pathfinder_queue_first].waypoint;
-    *count = pathfinder_queue[pathfinder_queue_first].wp_count;
+    efree(job->maps);
+    efree(job->parts);
 
-    if (++pathfinder_queue_first >= PATHFINDER_QUEUE_SIZE) {
-        pathfinder_queue_first = 0;
+    if (job->path != NULL) {
+        efree(job->path);
     }
 
-    return waypoint;
+    efree(job);
+}
+
+TOOLKIT_DEINIT_FUNC(pathfinder)
+{
+    pthread_mutex_lock(&pathfinder_mutex);
+    pathfinder_threads_stop = true;
+    pthread_cond_broadcast(&pathfinder_cond);
+    pthread_mutex_unlock(&pathfinder_mutex);
+
+    for (size_t i = 0; i < pathfinder_threads_num; i++) {
+        pthread_join(pathfinder_threads[i], NULL);
+    }
+
+    pathfinder_threads_num = 0;
+
+    path_job_t *job, *tmp;
+    DL_FOREACH_SAFE(pathfinder_jobs, job, tmp) {
+        DL_DELETE(pathfinder_jobs, job);
+        path_job_free(job);
+    }
+
+    DL_FOREACH_SAFE(pathfinder_results, job, tmp) {
+        DL_DELETE(pathfinder_results, job);
+        path_job_free(job);
+    }
+
+    path_request_t *request, *request_tmp;
+    DL_FOREACH_SAFE(pathfinder_queue, request, request_tmp) {
+        DL_DELETE(pathfinder_queue, request);
+        efree(request);
+    }
+
+    path_context_free(&pathfinder_context);
+
+    if (pathfinder_cluster_dist != NULL) {
+        efree(pathfinder_cluster_dist);
+        efree(pathfinder_cluster_queue);
+        pathfinder_cluster_dist = NULL;
+        pathfinder_cluster_queue = NULL;
+        pathfinder_cluster_size = 0;
+    }
+
+    pthread_cond_destroy(&pathfinder_cond);
+    pthread_mutex_destroy(&pathfinder_mutex);
 }
+TOOLKIT_DEINIT_FUNC_FINISH
 
 /**
  * Request a new path.
@@ -286,11 +724,35 @@ void path_request(object *waypoint)
         waypoint->name);
 #endif
 
-    if (pathfinder_queue_enqueue(waypoint)) {
-        SET_FLAG(waypoint, FLAG_WP_PATH_REQUESTED);
-        waypoint->owner = waypoint->env;
-        waypoint->ownercount = waypoint->env->count;
-    }
+    path_request_t *request = emalloc(sizeof(*request));
+    request->waypoint = waypoint;
+    request->wp_count = waypoint->count;
+    DL_APPEND(pathfinder_queue, request);
+
+    SET_FLAG(waypoint, FLAG_WP_PATH_REQUESTED);
+    waypoint->owner = waypoint->env;
+    waypoint->ownercount = waypoint->env->count;
+}
+
+/**
+ * Check whether the specified waypoint is still valid for path computation.
+ *
+ * @param waypoint
+ * Waypoint.
+ * @param count
+ * Waypoint's ID at the time of the request.
+ * @return
+ * Whether the waypoint is valid.
+ */
+static bool
+path_request_is_valid (object *waypoint, tag_t count)
+{
+    return OBJECT_VALID(waypoint, count) &&
+           OBJECT_VALID(waypoint->owner, waypoint->ownercount) &&
+           (QUERY_FLAG(waypoint, FLAG_CURSED) ||
+            QUERY_FLAG(waypoint, FLAG_DAMNED)) &&
+           (!QUERY_FLAG(waypoint, FLAG_DAMNED) ||
+            OBJECT_VALID(waypoint->enemy, waypoint->enemy_count));
 }
 
 /**
@@ -305,22 +767,20 @@ path_get_next_request (void)
     object *waypoint;
 
     do {
-        tag_t count;
-        waypoint = pathfinder_queue_dequeue(&count);
-
-        if (waypoint == NULL) {
+        path_request_t *request = pathfinder_queue;
+        if (request == NULL) {
             return NULL;
         }
 
+        DL_DELETE(pathfinder_queue, request);
+        waypoint = request->waypoint;
+
         /* Verify the waypoint and its monster. */
-        if (!OBJECT_VALID(waypoint, count) ||
-            !OBJECT_VALID(waypoint->owner, waypoint->ownercount) ||
-            !(QUERY_FLAG(waypoint, FLAG_CURSED) ||
-              QUERY_FLAG(waypoint, FLAG_DAMNED)) ||
-            (QUERY_FLAG(waypoint, FLAG_DAMNED) &&
-             !OBJECT_VALID(waypoint->enemy, waypoint->enemy_count))) {
+        if (!path_request_is_valid(waypoint, request->wp_count)) {
             waypoint = NULL;
         }
+
+        efree(request);
     } while (waypoint == NULL);
 
 #ifdef DEBUG_PATHFINDING
@@ -334,515 +794,2373 @@ path_get_next_request (void)
 }
 
 /**
- * Allocate and initialize a node.
- *
- * Also calculates the appropriate heuristics from 'start' and 'goal'
- * parameters.
+ * Calculate the sum of the specified node's cost and heuristic, depending
+ * on the algorithm selected for the search.
  *
- * @param map
- * Map.
- * @param x
- * X position.
- * @param y
- * Y position.
- * @param cost
- * Cost.
- * @param start
- * Starting node.
- * @param goal
- * Goal node.
- * @param parent
- * Parent node.
- * @return
- * New node.
+ * @param ctx
+ * Search context.
+ * @param node
+ * Node.
  */
-static path_node_t *path_node_new (mapstruct   *map,
-                                   int16_t      x,
-                                   int16_t      y,
-                                   double       cost,
-                                   path_node_t *start,
-                                   path_node_t *goal,
-                                   path_node_t *parent)
+static inline void
+path_node_update_sum (path_context_t *ctx, path_node_t *node)
 {
-    HARD_ASSERT(map != NULL);
-    HARD_ASSERT(start != NULL);
-    HARD_ASSERT(goal != NULL);
-
-    SOFT_ASSERT_RC(!OUT_OF_MAP(map, x, y),
-                   NULL,
-                   "Out of map: %s %d,%d",
-                   map->path,
-                   x,
-                   y);
-
-    /* Out of memory? */
-    if (unlikely(pathfinder_nodebuf_next == PATHFINDER_NODEBUF)) {
-#ifdef DEBUG_PATHFINDING
-        LOG(DEBUG, "Out of static buffer memory");
-#endif
-        return NULL;
-    }
-
-    rv_vector rv;
-    if (!get_rangevector_from_mapcoords(map,
-                                        x,
-                                        y,
-                                        goal->map,
-                                        goal->x,
-                                        goal->y,
-                                        &rv,
-                                        RV_RECURSIVE_SEARCH | RV_NO_DISTANCE)) {
-        return NULL;
-    }
-
-    rv_vector rv2;
-    if (!get_rangevector_from_mapcoords(start->map,
-                                        start->x,
-                                        start->y,
-                                        goal->map,
-                                        goal->x,
-                                        goal->y,
-                                        &rv2,
-                                        RV_RECURSIVE_SEARCH | RV_NO_DISTANCE)) {
-        return NULL;
-    }
-
-    int cross = abs(rv.distance_x * rv2.distance_y -
-                    rv2.distance_x * rv.distance_y);
-    int straight = abs(abs(rv.distance_x) - abs(rv.distance_y));
-    int diagonal = MAX(abs(rv.distance_x), abs(rv.distance_y)) - straight;
-
-    path_node_t *node = &pathfinder_nodebuf[pathfinder_nodebuf_next++];
-
-    node->next = NULL;
-    node->prev = NULL;
-    node->parent = parent;
-    node->map = map;
-    node->x = x;
-    node->y = y;
-    node->cost = cost;
-    node->flags = 0;
-    node->distance_z = abs(rv.distance_z);
-    node->heuristic = straight + PATH_COST_DIAG * diagonal + cross * 0.001 +
-                      abs(rv.distance_z) * PATH_COST_LEVEL;
-    node->heuristic *= path_greed;
-
-    const double modifier = algo_modifiers[path_algo];
+    const double modifier = algo_modifiers[ctx->algo];
     node->sum = (modifier * node->cost + (1 - modifier) * node->heuristic) /
                 MAX(modifier, 1 - modifier);
-
-    return node;
 }
 
 /**
- * Remove a node from a list.
+ * Restart a search; resets the open set and the visited tiles table, but
+ * keeps the nodes allocated so far.
  *
- * @param node
- * Node to remove.
- * @param[out] list List to remove from.
+ * @param ctx
+ * Search context.
  */
 static void
-path_node_remove (path_node_t *node, path_node_t **list)
+path_search_restart (path_context_t *ctx)
 {
-    HARD_ASSERT(node != NULL);
-    HARD_ASSERT(list != NULL);
+    HARD_ASSERT(ctx != NULL);
 
-    SOFT_ASSERT(*list != NULL,
-                "Removing node from an empty list: %s, %d, %d",
-                node->map->path,
-                node->x,
-                node->y);
+    ctx->heap_num = 0;
 
-    if (node->prev != NULL) {
-        node->prev->next = node->next;
-    } else {
-        *list = node->next;
+    if (ctx->visited == NULL) {
+        ctx->visited_size = PATHFINDER_VISITED_SIZE;
+        ctx->visited = ecalloc(ctx->visited_size, sizeof(*ctx->visited));
     }
 
-    if (node->next != NULL) {
-        node->next->prev = node->prev;
+    /* Avoid overflow of the search ID. */
+    if (ctx->visited_id == UINT32_MAX) {
+        for (size_t i = 0; i < ctx->visited_size; i++) {
+            ctx->visited[i].id = 0;
+        }
+
+        ctx->visited_id = 0;
     }
 
-    node->next = node->prev = NULL;
+    ctx->visited_id++;
+    ctx->visited_num = 0;
 }
 
 /**
- * Insert a node into a list.
+ * Start a new search; resets the node buffers, the open set and the
+ * visited tiles table.
  *
- * @param node
- * Node to insert.
- * @param[out] list List to insert into.
+ * @param ctx
+ * Search context.
+ * @param algo
+ * Algorithm to use for the search.
+ * @param greed
+ * Heuristic greed modifier to use for the search.
  */
 static void
-path_node_insert (path_node_t *node, path_node_t **list)
+path_search_start (path_context_t *ctx, path_algo_t algo, double greed)
 {
-    HARD_ASSERT(node != NULL);
-    HARD_ASSERT(list != NULL);
+    HARD_ASSERT(ctx != NULL);
 
-    if (*list != NULL) {
-        (*list)->prev = node;
+    if (ctx->nodebuf == NULL) {
+        ctx->nodebuf = emalloc(sizeof(*ctx->nodebuf));
+        ctx->nodebuf->next = NULL;
     }
 
-    node->next = *list;
-    node->prev = NULL;
+    ctx->nodebuf_chunk = ctx->nodebuf;
+    ctx->nodebuf_next = 0;
+    ctx->nodebuf_num = 0;
 
-    *list = node;
+    path_search_restart(ctx);
+
+    ctx->algo = algo;
+    ctx->greed = greed;
+
+    ctx->origin = NULL;
+    ctx->offsets_num = 0;
+    ctx->offsets_last = 0;
 }
 
 /**
- * Insert a node in a sorted list (lowest path_node_t::sum first in list).
+ * Get the offset of the specified map from the map the search started on.
  *
- * @param node
- * Node to insert.
- * @param list
- * List to insert into.
- * @todo Make more efficient by using skip list or heaps.
- */
-static void
-path_node_insert_priority (path_node_t *node, path_node_t **list)
+ * The offsets are cached for the duration of the search, so that the
+ * tile relationships only have to be resolved once per map, instead of
+ * once per node.
+ *
+ * @param ctx
+ * Search context.
+ * @param map
+ * Map.
+ * @param[out] x
+ * Will contain the X offset.
+ * @param[out] y
+ * Will contain the Y offset.
+ * @param[out] z
+ * Will contain the Z offset.
+ * @return
+ * False if the map is not connected to the map the search started on.
+ */
+static bool
+path_map_offset (path_context_t *ctx, mapstruct *map, int *x, int *y, int *z)
 {
-    HARD_ASSERT(node != NULL);
-    HARD_ASSERT(list != NULL);
-
-    /* Figure out which node to insert in front of. */
-    path_node_t *insert_before = NULL;
-    path_node_t *last;
-    for (path_node_t *tmp = *list; tmp != NULL; tmp = tmp->next) {
-        last = tmp;
+    HARD_ASSERT(ctx != NULL);
+    HARD_ASSERT(map != NULL);
 
-        if (node->sum <= tmp->sum) {
-            insert_before = tmp;
-            break;
-        }
+    if (ctx->origin == NULL) {
+        ctx->origin = map;
     }
 
-    if (insert_before == *list) {
-        /* Insert first. */
-        path_node_insert(node, list);
-    } else if (insert_before == NULL) {
-        /* Insert last. */
-        node->next = NULL;
-        node->prev = last;
-        last->next = node;
+    path_map_offset_t *offset = NULL;
+
+    if (ctx->offsets_last < ctx->offsets_num &&
+        ctx->offsets[ctx->offsets_last].map == map) {
+        offset = &ctx->offsets[ctx->offsets_last];
     } else {
-        /* Insert in middle. */
-        node->next = insert_before;
-        node->prev = insert_before->prev;
-        insert_before->prev = node;
+        for (size_t i = 0; i < ctx->offsets_num; i++) {
+            if (ctx->offsets[i].map == map) {
+                offset = &ctx->offsets[i];
+                ctx->offsets_last = i;
+                break;
+            }
+        }
+    }
 
-        if (node->prev != NULL) {
-            node->prev->next = node;
+    if (offset == NULL) {
+        if (ctx->offsets_num == ctx->offsets_size) {
+            ctx->offsets_size = MAX(ctx->offsets_size * 2, 16);
+            ctx->offsets = erealloc(ctx->offsets,
+                                    sizeof(*ctx->offsets) * ctx->offsets_size);
         }
+
+        ctx->offsets_last = ctx->offsets_num;
+        offset = &ctx->offsets[ctx->offsets_num++];
+        offset->map = map;
+
+        rv_vector rv;
+        offset->valid = get_rangevector_from_mapcoords(ctx->origin,
+                                                       0,
+                                                       0,
+                                                       map,
+                                                       0,
+                                                       0,
+                                                       &rv,
+                                                       RV_RECURSIVE_SEARCH |
+                                                       RV_NO_DISTANCE);
+        offset->x = rv.distance_x;
+        offset->y = rv.distance_y;
+        offset->z = rv.distance_z;
     }
+
+    *x = offset->x;
+    *y = offset->y;
+    *z = offset->z;
+
+    return offset->valid;
 }
 
 /**
- * Check if the specified tile is blocked.
+ * Calculate the hash of the specified tile.
  *
- * @param op
- * Object.
  * @param map
  * Map.
  * @param x
- * X coordinate.
+ * X position.
  * @param y
- * Y coordinate.
+ * Y position.
  * @return
- * 0 if the tile is not blocked, non-zero otherwise.
+ * The hash.
  */
-static int
-tile_is_blocked (object *op, mapstruct *map, int x, int y)
+static inline size_t
+path_visited_hash (const void *map, int16_t x, int16_t y)
 {
-    int block;
-    if (op->type == PLAYER && CONTR(op)->tcl) {
-        block = 0;
-    } else {
-        block = object_blocked(op, map, x, y);
-    }
-
-    return block;
+    uint64_t hash = (uint64_t) (uintptr_t) map;
+    hash ^= ((uint64_t) (uint16_t) x << 16 | (uint16_t) y) *
+            UINT64_C(0x9E3779B97F4A7C15);
+    hash ^= hash >> 29;
+    return (size_t) hash;
 }
 
 /**
- * Generate a string representation of a path.
- *
- * Ideas on how to store paths:
- * - a) Store path as real waypoint objects (might be a lot of objects...)
- * - b) Store path as field in waypoints
- *   - b1) Linked list in i.e. ob->enemy (needs special free() call when
- * removing object).
- *   - b2) In ASCII in waypoint->msg (will even be saved out).
- *     - b2.1) Direction list (e.g. 1234155532, compact but fragile)
- *     - b2.2) Map / coordinate list: (/dev/testmaps:13,12 14,12 ...)
- * (human-readable (and editable), complex parsing)
- *             Approx: 600 steps in one 4096 bytes msg field
- *     - b2.2.1) Hex (/dev/testmaps/xxx D,C E,C ...) (harder to read and write,
- * more compact)
- *               Approx: 1000 steps in one 4096 bytes msg field
+ * Find the visited tiles table entry for the specified tile.
  *
- * @param path
- * Path node.
+ * @param ctx
+ * Search context.
+ * @param map
+ * Map.
+ * @param x
+ * X position.
+ * @param y
+ * Y position.
+ * @param create
+ * If true, create the entry if it doesn't exist yet.
  * @return
- * Encoded path as a shared string.
+ * The entry; NULL if it doesn't exist and 'create' is false.
  */
-shstr *
-path_encode (path_node_t *path)
+static path_visited_t *
+path_visited_get (path_context_t *ctx,
+                  const void     *map,
+                  int16_t         x,
+                  int16_t         y,
+                  bool            create)
 {
-    mapstruct *last_map;
-    StringBuffer *sb;
-    path_node_t *tmp;
-    char *cp;
-    shstr *ret;
+    /* Keep the load factor at or below one half. */
+    if (create && (ctx->visited_num + 1) * 2 > ctx->visited_size) {
+        path_visited_t *old = ctx->visited;
+        size_t old_size = ctx->visited_size;
 
-    HARD_ASSERT(path != NULL);
+        ctx->visited_size *= 2;
+        ctx->visited = ecalloc(ctx->visited_size, sizeof(*ctx->visited));
 
-    last_map = NULL;
-    sb = stringbuffer_new();
+        for (size_t i = 0; i < old_size; i++) {
+            if (old[i].id != ctx->visited_id) {
+                continue;
+            }
 
-    for (tmp = path; tmp != NULL; tmp = tmp->next) {
-        if (tmp->map != last_map) {
-            if (last_map != NULL) {
-                stringbuffer_append_char(sb, '\n');
+            size_t idx = path_visited_hash(old[i].map, old[i].x, old[i].y);
+            while (ctx->visited[idx & (ctx->visited_size - 1)].id ==
+                   ctx->visited_id) {
+                idx++;
             }
 
-            stringbuffer_append_string(sb, tmp->map->path);
-            last_map = tmp->map;
+            ctx->visited[idx & (ctx->visited_size - 1)] = old[i];
         }
 
-        stringbuffer_append_printf(sb, " %d,%d,%d", tmp->x, tmp->y, tmp->flags);
+        efree(old);
     }
 
-    cp = stringbuffer_finish(sb);
-    ret = add_string(cp);
-    efree(cp);
+    size_t idx = path_visited_hash(map, x, y);
+    path_visited_t *visited;
+    for ( ; ; idx++) {
+        visited = &ctx->visited[idx & (ctx->visited_size - 1)];
 
-    return ret;
+        if (visited->id != ctx->visited_id) {
+            break;
+        }
+
+        if (visited->map == map && visited->x == x && visited->y == y) {
+            return visited;
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    visited->map = map;
+    visited->x = x;
+    visited->y = y;
+    visited->id = ctx->visited_id;
+    visited->closed = false;
+    visited->node = NULL;
+    ctx->visited_num++;
+
+    return visited;
 }
 
 /**
- * Get the next location from a textual path description (generated by
- * path_encode()) starting from the character index indicated by off.
+ * Mark the specified tile as closed.
  *
- * Example text path description:
- * - /dev/testmaps/testmap_waypoints 17,7 17,10 18,11 19,10 20,10
- * - /dev/testmaps/testmap_waypoints2 8,22
- * - /dev/testmaps/testmap_waypoints3 0,22 1,23
- * - /dev/testmaps/testmap_waypoints4 1,1 2,2
- * @param buf
- * Buffer.
- * @param off
- * Offset.
- * @param mappath
- * Map path.
- * @param map
- * Map. Should be initialized with whatever map the object we are
- * working on currently lives on (to handle paths without map strings).
+ * @param ctx
+ * Search context.
+ * @param m
+ * Map.
  * @param x
  * X position.
  * @param y
  * Y position.
- * @param flags
- * Flags.
+ * @param visualizer
+ * Visualizer list; can be NULL.
+ */
+#define PATHFINDING_SET_CLOSED(ctx, m, x, y, visualizer) \
+    { \
+        PATHFINDING_VISUALIZER_APPEND(visualizer, m, x, y, true, NULL); \
+        path_visited_get(ctx, m, x, y, true)->closed = true; \
+    }
+
+/**
+ * Compare two nodes in the open set heap.
+ *
+ * @param a
+ * First node.
+ * @param b
+ * Second node.
  * @return
- * If a location is found, will return 1 and update map, x, y and off
- * (off will be set to the index to use for the next call to this function).
- * Otherwise 0 will be returned and the values of map, x and y will be undefined
- * and off will not be touched.
+ * True if 'a' should be expanded before 'b'.
  */
-int path_get_next(shstr *buf, int16_t *off, shstr **mappath, mapstruct **map,
-        int *x, int *y, uint32_t *flags)
+static inline bool
+path_heap_less (const path_node_t *a, const path_node_t *b)
 {
-    const char *coord_start, *coord_end, *map_def;
+    if (a->sum < b->sum) {
+        return true;
+    } else if (a->sum > b->sum) {
+        return false;
+    }
 
-    HARD_ASSERT(buf != NULL);
-    HARD_ASSERT(off != NULL);
-    HARD_ASSERT(mappath != NULL);
-    HARD_ASSERT(map != NULL && *map != NULL);
-    HARD_ASSERT(x != NULL);
-    HARD_ASSERT(y != NULL);
-    HARD_ASSERT(flags != NULL);
+    /* Prefer nodes that are closer to the goal. */
+    return a->heuristic < b->heuristic;
+}
 
-    map_def = coord_start = buf + *off;
+/**
+ * Move the node at the specified heap index towards the root until the
+ * heap property is restored.
+ *
+ * @param ctx
+ * Search context.
+ * @param idx
+ * Heap index.
+ */
+static void
+path_heap_sift_up (path_context_t *ctx, size_t idx)
+{
+    path_node_t *node = ctx->heap[idx];
 
-    if (string_isempty(*mappath)) {
-        /* Scan backwards from requested offset to previous linebreak or start
-         * of string */
-        for (map_def = coord_start; map_def > buf && *(map_def - 1) != '\n';
-                map_def--) {
+    while (idx > 0) {
+        size_t parent = (idx - 1) / 2;
+        if (!path_heap_less(node, ctx->heap[parent])) {
+            break;
         }
+
+        ctx->heap[idx] = ctx->heap[parent];
+        ctx->heap[idx]->heap_index = idx;
+        idx = parent;
     }
 
-    /* Extract map path if any at the current position (this part is only used
-     * when we go between map tiles, or when we extract the first step). */
-    if (!isdigit(*map_def)) {
-        /* Temporary buffer for map path extraction */
-        char map_name[HUGE_BUF];
-        const char *mapend;
+    ctx->heap[idx] = node;
+    node->heap_index = idx;
+}
 
-        /* Find the end of the map path */
-        mapend = strchr(map_def, ' ');
+/**
+ * Move the node at the specified heap index towards the leaves until the
+ * heap property is restored.
+ *
+ * @param ctx
+ * Search context.
+ * @param idx
+ * Heap index.
+ */
+static void
+path_heap_sift_down (path_context_t *ctx, size_t idx)
+{
+    path_node_t *node = ctx->heap[idx];
 
-        if (mapend == NULL) {
-            LOG(BUG, "No delimeter after map name in path description "
-                    "'%s' off %d", buf, *off);
-            return 0;
+    for ( ; ; ) {
+        size_t child = idx * 2 + 1;
+        if (child >= ctx->heap_num) {
+            break;
         }
 
-        strncpy(map_name, map_def, mapend - map_def);
-        map_name[mapend - map_def] = '\0';
-
-        /* Store the new map path in the given shared string */
-        FREE_AND_COPY_HASH(*mappath, map_name);
-
-        /* Adjust coordinate pointer to point after map path */
-        if (!isdigit(*coord_start)) {
-            coord_start = mapend + 1;
+        if (child + 1 < ctx->heap_num &&
+            path_heap_less(ctx->heap[child + 1], ctx->heap[child])) {
+            child++;
         }
-    }
 
-    /* Select the map we are aiming at. */
-    if (*mappath) {
-        /* We assume map name is already normalized. */
-        if (*map == NULL || (*map)->path != *mappath) {
-            *map = ready_map_name(*mappath, NULL, MAP_NAME_SHARED);
+        if (!path_heap_less(ctx->heap[child], node)) {
+            break;
         }
-    }
 
-    if (*map == NULL) {
-        LOG(BUG, "Couldn't load map from description '%s' off %d", buf,
-                *off);
-        return 0;
+        ctx->heap[idx] = ctx->heap[child];
+        ctx->heap[idx]->heap_index = idx;
+        idx = child;
     }
 
-    /* Get the requested coordinate pair. */
-    coord_end = coord_start + strcspn(coord_start, " \n");
+    ctx->heap[idx] = node;
+    node->heap_index = idx;
+}
 
-    if (coord_end == coord_start || sscanf(coord_start, "%d,%d,%d", x, y,
-            flags) != 3) {
-        LOG(BUG, "Illegal coordinate pair in '%s' off %d", buf, *off);
-        return 0;
+/**
+ * Insert a node into the open set.
+ *
+ * @param ctx
+ * Search context.
+ * @param node
+ * Node to insert.
+ */
+static void
+path_heap_push (path_context_t *ctx, path_node_t *node)
+{
+    HARD_ASSERT(node != NULL);
+
+    if (ctx->heap_num == ctx->heap_size) {
+        ctx->heap_size = MAX(ctx->heap_size * 2, 256);
+        ctx->heap = erealloc(ctx->heap, sizeof(*ctx->heap) * ctx->heap_size);
     }
 
-    /* Adjust coordinates to be on the safe side */
-    *map = get_map_from_coord(*map, x, y);
+    ctx->heap[ctx->heap_num] = node;
+    path_heap_sift_up(ctx, ctx->heap_num++);
+}
 
-    if (*map == NULL) {
-        LOG(BUG, "Location (%d, %d) is out of map", *x, *y);
-        return 0;
+/**
+ * Remove the node with the lowest path_node_t::sum from the open set.
+ *
+ * @param ctx
+ * Search context.
+ * @return
+ * The node, NULL if the open set is empty.
+ */
+static path_node_t *
+path_heap_pop (path_context_t *ctx)
+{
+    if (ctx->heap_num == 0) {
+        return NULL;
     }
 
-    /* Adjust the offset */
-    *off = coord_end - buf + (*coord_end ? 1 : 0);
+    path_node_t *node = ctx->heap[0];
+    node->heap_index = -1;
 
-    return 1;
+    if (--ctx->heap_num != 0) {
+        ctx->heap[0] = ctx->heap[ctx->heap_num];
+        path_heap_sift_down(ctx, 0);
+    }
+
+    return node;
 }
 
 /**
- * Compress a path by removing redundant segments.
- *
- * Current implementation removes segments that can be traversed by
- * walking in a single direction.
- *
- * Something advanced could be to use a Hough transform / or something smart
- * with cross products.
- *
- * Rules:
- *  - always leave first and last path nodes
- *  - if the movement direction of node n to n+1 is the same
- *    as for n-1 to n, then remove node n.
+ * Allocate a node from the node buffers of the specified search context.
  *
- * @param path
- * Path node.
+ * @param ctx
+ * Search context.
  * @return
- * 'path' with redundant segments removed.
+ * The node, NULL if the search has allocated too many nodes already.
  */
-path_node_t *path_compress(path_node_t *path)
+static path_node_t *
+path_node_alloc (path_context_t *ctx)
 {
-    path_node_t *tmp, *next;
-    int last_dir;
-    rv_vector v;
+    /* Searched too many nodes? */
+    if (unlikely(ctx->nodebuf_num == PATHFINDER_NODES_MAX)) {
 #ifdef DEBUG_PATHFINDING
-    int removed_nodes = 0, total_nodes = 2;
+        LOG(DEBUG, "Reached maximum number of nodes");
 #endif
-
-    /* Guarantee at least length 3 */
-    if (path == NULL || path->next == NULL) {
-        return path;
+        return NULL;
     }
 
-    next = path->next;
+    /* Move on to the next chunk, allocating it if necessary. */
+    if (ctx->nodebuf_next == PATHFINDER_NODEBUF) {
+        if (ctx->nodebuf_chunk->next == NULL) {
+            ctx->nodebuf_chunk->next =
+                emalloc(sizeof(*ctx->nodebuf_chunk->next));
+            ctx->nodebuf_chunk->next->next = NULL;
+        }
 
-    get_rangevector_from_mapcoords(path->map, path->x, path->y, next->map,
-            next->x, next->y, &v, RV_EUCLIDIAN_DISTANCE);
-    last_dir = v.direction;
+        ctx->nodebuf_chunk = ctx->nodebuf_chunk->next;
+        ctx->nodebuf_next = 0;
+    }
 
-    for (tmp = next; tmp != NULL && tmp->next != NULL; tmp = next) {
-        next = tmp->next;
+    path_node_t *node = &ctx->nodebuf_chunk->nodes[ctx->nodebuf_next++];
+    ctx->nodebuf_num++;
 
-#ifdef DEBUG_PATHFINDING
+    node->next = NULL;
+    node->prev = NULL;
+    node->parent = NULL;
+    node->map = NULL;
+    node->map_id = -1;
+    node->flags = 0;
+    node->heap_index = -1;
+    node->distance_z = 0;
+    node->cost = 0.0;
+    node->heuristic = 0.0;
+    node->sum = 0.0;
+
+    return node;
+}
+
+/**
+ * Calculate the heuristic of a node.
+ *
+ * @param ctx
+ * Search context.
+ * @param node
+ * The node.
+ * @param dx
+ * X distance from the node to the goal.
+ * @param dy
+ * Y distance from the node to the goal.
+ * @param dz
+ * Z distance from the node to the goal.
+ * @param start_dx
+ * X distance from the start to the goal.
+ * @param start_dy
+ * Y distance from the start to the goal.
+ */
+static void
+path_node_set_heuristic (path_context_t *ctx,
+                         path_node_t    *node,
+                         int             dx,
+                         int             dy,
+                         int             dz,
+                         int             start_dx,
+                         int             start_dy)
+{
+    int cross = abs(dx * start_dy - start_dx * dy);
+    int straight = abs(abs(dx) - abs(dy));
+    int diagonal = MAX(abs(dx), abs(dy)) - straight;
+
+    node->distance_z = abs(dz);
+    node->heuristic = straight + PATH_COST_DIAG * diagonal + cross * 0.001 +
+                      abs(dz) * PATH_COST_LEVEL;
+    node->heuristic *= ctx->greed;
+    path_node_update_sum(ctx, node);
+}
+
+/**
+ * Allocate and initialize a node.
+ *
+ * Also calculates the appropriate heuristics from 'start' and 'goal'
+ * parameters.
+ *
+ * @param ctx
+ * Search context.
+ * @param map
+ * Map.
+ * @param x
+ * X position.
+ * @param y
+ * Y position.
+ * @param cost
+ * Cost.
+ * @param start
+ * Starting node.
+ * @param goal
+ * Goal node.
+ * @param parent
+ * Parent node.
+ * @return
+ * New node.
+ */
+static path_node_t *path_node_new (path_context_t *ctx,
+                                   mapstruct      *map,
+                                   int16_t         x,
+                                   int16_t         y,
+                                   double          cost,
+                                   path_node_t    *start,
+                                   path_node_t    *goal,
+                                   path_node_t    *parent)
+{
+    HARD_ASSERT(map != NULL);
+    HARD_ASSERT(start != NULL);
+    HARD_ASSERT(goal != NULL);
+
+    SOFT_ASSERT_RC(!OUT_OF_MAP(map, x, y),
+                   NULL,
+                   "Out of map: %s %d,%d",
+                   map->path,
+                   x,
+                   y);
+
+    if (unlikely(ctx->nodebuf_num == PATHFINDER_NODES_MAX)) {
+        return NULL;
+    }
+
+    int map_x, map_y, map_z;
+    int start_x, start_y, start_z;
+    int goal_x, goal_y, goal_z;
+    if (!path_map_offset(ctx, map, &map_x, &map_y, &map_z) ||
+        !path_map_offset(ctx, start->map, &start_x, &start_y, &start_z) ||
+        !path_map_offset(ctx, goal->map, &goal_x, &goal_y, &goal_z)) {
+        return NULL;
+    }
+
+    goal_x += goal->x;
+    goal_y += goal->y;
+
+    path_node_t *node = path_node_alloc(ctx);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->parent = parent;
+    node->map = map;
+    node->x = x;
+    node->y = y;
+    node->cost = cost;
+    path_node_set_heuristic(ctx,
+                            node,
+                            goal_x - (map_x + x),
+                            goal_y - (map_y + y),
+                            goal_z - map_z,
+                            goal_x - (start_x + start->x),
+                            goal_y - (start_y + start->y));
+
+    return node;
+}
+
+/**
+ * Remove a node from a list.
+ *
+ * @param node
+ * Node to remove.
+ * @param[out] list List to remove from.
+ */
+static void
+path_node_remove (path_node_t *node, path_node_t **list)
+{
+    HARD_ASSERT(node != NULL);
+    HARD_ASSERT(list != NULL);
+
+    SOFT_ASSERT(*list != NULL,
+                "Removing node from an empty list: %s, %d, %d",
+                node->map->path,
+                node->x,
+                node->y);
+
+    if (node->prev != NULL) {
+        node->prev->next = node->next;
+    } else {
+        *list = node->next;
+    }
+
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    }
+
+    node->next = node->prev = NULL;
+}
+
+/**
+ * Insert a node into a list.
+ *
+ * @param node
+ * Node to insert.
+ * @param[out] list List to insert into.
+ */
+static void
+path_node_insert (path_node_t *node, path_node_t **list)
+{
+    HARD_ASSERT(node != NULL);
+    HARD_ASSERT(list != NULL);
+
+    if (*list != NULL) {
+        (*list)->prev = node;
+    }
+
+    node->next = *list;
+    node->prev = NULL;
+
+    *list = node;
+}
+
+/**
+ * Check if the specified tile is blocked.
+ *
+ * @param op
+ * Object.
+ * @param map
+ * Map.
+ * @param x
+ * X coordinate.
+ * @param y
+ * Y coordinate.
+ * @return
+ * 0 if the tile is not blocked, non-zero otherwise.
+ */
+static int
+tile_is_blocked (object *op, mapstruct *map, int x, int y)
+{
+    int block;
+    if (op->type == PLAYER && CONTR(op)->tcl) {
+        block = 0;
+    } else {
+        block = object_blocked(op, map, x, y);
+    }
+
+    return block;
+}
+
+/**
+ * Generate a string representation of a path.
+ *
+ * Ideas on how to store paths:
+ * - a) Store path as real waypoint objects (might be a lot of objects...)
+ * - b) Store path as field in waypoints
+ *   - b1) Linked list in i.e. ob->enemy (needs special free() call when
+ * removing object).
+ *   - b2) In ASCII in waypoint->msg (will even be saved out).
+ *     - b2.1) Direction list (e.g. 1234155532, compact but fragile)
+ *     - b2.2) Map / coordinate list: (/dev/testmaps:13,12 14,12 ...)
+ * (human-readable (and editable), complex parsing)
+ *             Approx: 600 steps in one 4096 bytes msg field
+ *     - b2.2.1) Hex (/dev/testmaps/xxx D,C E,C ...) (harder to read and write,
+ * more compact)
+ *               Approx: 1000 steps in one 4096 bytes msg field
+ *
+ * @param path
+ * Path node.
+ * @return
+ * Encoded path as a shared string.
+ */
+shstr *
+path_encode (path_node_t *path)
+{
+    mapstruct *last_map;
+    StringBuffer *sb;
+    path_node_t *tmp;
+    char *cp;
+    shstr *ret;
+
+    HARD_ASSERT(path != NULL);
+
+    last_map = NULL;
+    sb = stringbuffer_new();
+
+    for (tmp = path; tmp != NULL; tmp = tmp->next) {
+        if (tmp->map != last_map) {
+            if (last_map != NULL) {
+                stringbuffer_append_char(sb, '\n');
+            }
+
+            stringbuffer_append_string(sb, tmp->map->path);
+            last_map = tmp->map;
+        }
+
+        stringbuffer_append_printf(sb, " %d,%d,%d", tmp->x, tmp->y, tmp->flags);
+    }
+
+    cp = stringbuffer_finish(sb);
+    ret = add_string(cp);
+    efree(cp);
+
+    return ret;
+}
+
+/**
+ * Get the next location from a textual path description (generated by
+ * path_encode()) starting from the character index indicated by off.
+ *
+ * Example text path description:
+ * - /dev/testmaps/testmap_waypoints 17,7 17,10 18,11 19,10 20,10
+ * - /dev/testmaps/testmap_waypoints2 8,22
+ * - /dev/testmaps/testmap_waypoints3 0,22 1,23
+ * - /dev/testmaps/testmap_waypoints4 1,1 2,2
+ * @param buf
+ * Buffer.
+ * @param off
+ * Offset.
+ * @param mappath
+ * Map path.
+ * @param map
+ * Map. Should be initialized with whatever map the object we are
+ * working on currently lives on (to handle paths without map strings).
+ * @param x
+ * X position.
+ * @param y
+ * Y position.
+ * @param flags
+ * Flags.
+ * @return
+ * If a location is found, will return 1 and update map, x, y and off
+ * (off will be set to the index to use for the next call to this function).
+ * Otherwise 0 will be returned and the values of map, x and y will be undefined
+ * and off will not be touched.
+ */
+int path_get_next(shstr *buf, int16_t *off, shstr **mappath, mapstruct **map,
+        int *x, int *y, uint32_t *flags)
+{
+    const char *coord_start, *coord_end, *map_def;
+
+    HARD_ASSERT(buf != NULL);
+    HARD_ASSERT(off != NULL);
+    HARD_ASSERT(mappath != NULL);
+    HARD_ASSERT(map != NULL && *map != NULL);
+    HARD_ASSERT(x != NULL);
+    HARD_ASSERT(y != NULL);
+    HARD_ASSERT(flags != NULL);
+
+    map_def = coord_start = buf + *off;
+
+    if (string_isempty(*mappath)) {
+        /* Scan backwards from requested offset to previous linebreak or start
+         * of string */
+        for (map_def = coord_start; map_def > buf && *(map_def - 1) != '\n';
+                map_def--) {
+        }
+    }
+
+    /* Extract map path if any at the current position (this part is only used
+     * when we go between map tiles, or when we extract the first step). */
+    if (!isdigit(*map_def)) {
+        /* Temporary buffer for map path extraction */
+        char map_name[HUGE_BUF];
+        const char *mapend;
+
+        /* Find the end of the map path */
+        mapend = strchr(map_def, ' ');
+
+        if (mapend == NULL) {
+            LOG(BUG, "No delimeter after map name in path description "
+                    "'%s' off %d", buf, *off);
+            return 0;
+        }
+
+        strncpy(map_name, map_def, mapend - map_def);
+        map_name[mapend - map_def] = '\0';
+
+        /* Store the new map path in the given shared string */
+        FREE_AND_COPY_HASH(*mappath, map_name);
+
+        /* Adjust coordinate pointer to point after map path */
+        if (!isdigit(*coord_start)) {
+            coord_start = mapend + 1;
+        }
+    }
+
+    /* Select the map we are aiming at. */
+    if (*mappath) {
+        /* We assume map name is already normalized. */
+        if (*map == NULL || (*map)->path != *mappath) {
+            *map = ready_map_name(*mappath, NULL, MAP_NAME_SHARED);
+        }
+    }
+
+    if (*map == NULL) {
+        LOG(BUG, "Couldn't load map from description '%s' off %d", buf,
+                *off);
+        return 0;
+    }
+
+    /* Get the requested coordinate pair. */
+    coord_end = coord_start + strcspn(coord_start, " \n");
+
+    if (coord_end == coord_start || sscanf(coord_start, "%d,%d,%d", x, y,
+            flags) != 3) {
+        LOG(BUG, "Illegal coordinate pair in '%s' off %d", buf, *off);
+        return 0;
+    }
+
+    /* Adjust coordinates to be on the safe side */
+    *map = get_map_from_coord(*map, x, y);
+
+    if (*map == NULL) {
+        LOG(BUG, "Location (%d, %d) is out of map", *x, *y);
+        return 0;
+    }
+
+    /* Adjust the offset */
+    *off = coord_end - buf + (*coord_end ? 1 : 0);
+
+    return 1;
+}
+
+/**
+ * Compress a path by removing redundant segments.
+ *
+ * Current implementation removes segments that can be traversed by
+ * walking in a single direction.
+ *
+ * Something advanced could be to use a Hough transform / or something smart
+ * with cross products.
+ *
+ * Rules:
+ *  - always leave first and last path nodes
+ *  - if the movement direction of node n to n+1 is the same
+ *    as for n-1 to n, then remove node n.
+ *
+ * @param path
+ * Path node.
+ * @return
+ * 'path' with redundant segments removed.
+ */
+path_node_t *path_compress(path_node_t *path)
+{
+    path_node_t *tmp, *next;
+    int last_dir;
+    rv_vector v;
+#ifdef DEBUG_PATHFINDING
+    int removed_nodes = 0, total_nodes = 2;
+#endif
+
+    /* Guarantee at least length 3 */
+    if (path == NULL || path->next == NULL) {
+        return path;
+    }
+
+    next = path->next;
+
+    get_rangevector_from_mapcoords(path->map, path->x, path->y, next->map,
+            next->x, next->y, &v, RV_EUCLIDIAN_DISTANCE);
+    last_dir = v.direction;
+
+    for (tmp = next; tmp != NULL && tmp->next != NULL; tmp = next) {
+        next = tmp->next;
+
+#ifdef DEBUG_PATHFINDING
         total_nodes++;
 #endif
-        get_rangevector_from_mapcoords(tmp->map, tmp->x, tmp->y, next->map,
-                next->x, next->y, &v, RV_EUCLIDIAN_DISTANCE);
+        get_rangevector_from_mapcoords(tmp->map, tmp->x, tmp->y, next->map,
+                next->x, next->y, &v, RV_EUCLIDIAN_DISTANCE);
+
+        if (last_dir == v.direction) {
+            path_node_remove(tmp, &path);
+#ifdef DEBUG_PATHFINDING
+            removed_nodes++;
+#endif
+        } else {
+            last_dir = v.direction;
+        }
+    }
+
+#ifdef DEBUG_PATHFINDING
+    LOG(DEBUG, "removed %d nodes of %d (%.0f%%)", removed_nodes,
+            total_nodes, (float) removed_nodes * 100.0 / (float) total_nodes);
+#endif
+
+    return path;
+}
+
+/**
+ * Build a visualization hash table out of a list of visited/closed nodes.
+ * @param[out] visualization Hash table to use. Must be initialized to NULL.
+ * @param[out] visualizer List of the visited/closed nodes.
+ */
+void path_visualize(path_visualization_t **visualization,
+        path_visualizer_t **visualizer)
+{
+    path_visualizer_t *node, *tmp;
+    path_visualization_t *visualization_node;
+
+    HARD_ASSERT(visualization != NULL);
+    HARD_ASSERT(visualizer != NULL);
+
+    DL_FOREACH_SAFE(*visualizer, node, tmp)
+    {
+        HASH_FIND(hh, *visualization, &node->map->path, sizeof(shstr *),
+                visualization_node);
+
+        if (visualization_node == NULL) {
+            visualization_node = ecalloc(1, sizeof(*visualization_node));
+            FREE_AND_ADD_REF_HASH(visualization_node->path, node->map->path);
+            HASH_ADD(hh, *visualization, path, sizeof(shstr *),
+                    visualization_node);
+        }
+
+        DL_DELETE(*visualizer, node);
+        DL_APPEND(visualization_node->nodes, node);
+    }
+}
+
+/**
+ * Find a path for op from location on map1 to location on map2, by
+ * searching the individual tiles.
+ * @param ctx
+ * Search context. Nodes allocated by previous searches done with the
+ * context since the last path_search_start() are kept.
+ * @param op
+ * Object.
+ * @param map1
+ * From map.
+ * @param x1
+ * From X position.
+ * @param y1
+ * From Y position.
+ * @param map2
+ * To map.
+ * @param x2
+ * To X position.
+ * @param y2
+ * To Y position.
+ * @param visualizer[out]
+ * Visualizer pointer where to store visited/closed
+ * nodes. Can be NULL, otherwise the pointer MUST be initialized to NULL.
+ * @param[out] complete
+ * If not NULL, will contain whether the path reaches the goal.
+ * @return
+ * Found path.
+ */
+static path_node_t *
+path_find_local (path_context_t     *ctx,
+                 object             *op,
+                 mapstruct          *map1,
+                 int                 x,
+                 int                 y,
+                 mapstruct          *map2,
+                 int                 x2,
+                 int                 y2,
+                 path_visualizer_t **visualizer,
+                 bool               *complete)
+{
+    path_node_t *found_path, *node, *new_node, *best;
+    path_node_t start, goal;
+    int i, nx, ny, is_diagonal, node_x, node_y;
+    mapstruct *m, *node_map;
+    double cost;
+    rv_vector rv;
+    uint32_t node_id;
+#if VISUALIZE_PATHFINDING
+    path_visualizer_t *visualizer_tmp;
+#endif
+#if TIME_PATHFINDING
+    int searched;
+#endif
+
+    start.x = x;
+    start.y = y;
+    start.map = map1;
+
+    goal.x = x2;
+    goal.y = y2;
+    goal.map = map2;
+
+#if TIME_PATHFINDING
+    searched = 0;
+    TIMER_START(1);
+#endif
+
+    path_search_restart(ctx);
+    node_id = 0;
+    found_path = NULL;
+
+    if (complete != NULL) {
+        *complete = false;
+    }
+
+#if VISUALIZE_PATHFINDING
+    visualizer_tmp = NULL;
+
+    if (visualizer == NULL) {
+        visualizer = &visualizer_tmp;
+    }
+#endif
+
+    /* The initial tile. */
+    best = path_node_new(ctx, map1, x, y, 0.0, &start, &goal, NULL);
+    if (best == NULL) {
+        return NULL;
+    }
+
+    path_heap_push(ctx, best);
+
+    while (ctx->nodebuf_num < PATHFINDER_NODES_MAX &&
+           (node = path_heap_pop(ctx)) != NULL) {
+        bool reached_goal = node->heuristic <= 1.2;
+        if (op->more != NULL && !reached_goal &&
+            node->heuristic <= (op->quick_pos >> 4) + 1) {
+            for (object *tmp = op; tmp != NULL; tmp = tmp->more) {
+                int tmp_x = node->x + tmp->arch->clone.x;
+                int tmp_y = node->y + tmp->arch->clone.y;
+                mapstruct *tmp_map = get_map_from_coord(node->map,
+                                                        &tmp_x,
+                                                        &tmp_y);
+                if (tmp_map == NULL) {
+                    continue;
+                }
+
+                get_rangevector_from_mapcoords(tmp_map, tmp_x, tmp_y, goal.map,
+                                               goal.x, goal.y, &rv, 0);
+                if (rv.distance <= 1) {
+                    reached_goal = true;
+                    break;
+                }
+            }
+        }
+
+        if (reached_goal) {
+            if (visualizer != NULL) {
+                PATHFINDING_SET_CLOSED(ctx, node->map, node->x, node->y,
+                        visualizer);
+                PATHFINDING_SET_CLOSED(ctx, goal.map, goal.x, goal.y,
+                        visualizer);
+            }
+
+            for ( ; node != NULL; node = node->parent) {
+                path_node_insert(node, &found_path);
+            }
+
+            break;
+        }
+
+        /* Close this tile. */
+        PATHFINDING_SET_CLOSED(ctx, node->map, node->x, node->y, visualizer);
+
+        node_map = node->map;
+        node_x = node->x;
+        node_y = node->y;
+
+        if (GET_MAP_FLAGS(node_map, node_x, node_y) & P_IS_EXIT &&
+                op->behavior & BEHAVIOR_EXITS) {
+            object *tmp;
+
+            for (tmp = GET_MAP_OB(node_map, node_x, node_y); tmp != NULL;
+                    tmp = tmp->above) {
+                if (tmp->type == EXIT) {
+                    m = exit_get_destination(tmp, &nx, &ny, true);
+
+                    /* Do not enter exits that have worse z distance than the
+                     * current node. */
+                    if (m != NULL && get_rangevector_from_mapcoords(m, node_x,
+                            node_y, goal.map, goal.x, goal.y, &rv,
+                            RV_RECURSIVE_SEARCH) && abs(rv.distance_z) <=
+                            node->distance_z) {
+                        node_map = m;
+                        node_x = nx;
+                        node_y = ny;
+
+                        /* Add exit flag to the node with the exit, to indicate
+                         * that the path user needs to use an exit on that tile
+                         * (possibly having to apply it, in case it's not a
+                         * portal or the like). */
+                        node->flags |= PATH_NODE_EXIT;
+
+                        /* Close the tile that the exit leads to. */
+                        PATHFINDING_SET_CLOSED(ctx, node_map, node_x, node_y,
+                                visualizer);
+
+                        break;
+                    }
+                }
+            }
+        }
+
+        for (i = 1; i <= SIZEOFFREE1; i++) {
+            nx = node_x + freearr_x[i];
+            ny = node_y + freearr_y[i];
+            is_diagonal = nx != node_x && ny != node_y;
+
+            m = get_map_from_coord(node_map, &nx, &ny);
+
+            if (m == NULL) {
+                continue;
+            }
+
+            /* Get the visited tile, if any. */
+            path_visited_t *visited = path_visited_get(ctx, m, nx, ny, false);
+
+            /* Skip closed tiles. */
+            if (visited != NULL && visited->closed) {
+                continue;
+            }
+
+            /* Skip blocked tiles. */
+            if (tile_is_blocked(op, m, nx, ny) != 0) {
+                continue;
+            }
+
+            /* If the object can't use secret passages and they're a player or a
+             * that is not chasing an enemy, and this tile is a secret passage,
+             * skip it. */
+            if (!(GET_MAP_FLAGS(m, nx, ny) & P_DOOR_CLOSED) &&
+                    (op->type != PLAYER || !CONTR(op)->tcl) &&
+                    !(op->behavior & BEHAVIOR_SECRET_PASSAGES) &&
+                    (op->type == PLAYER || !OBJECT_VALID(op->enemy,
+                    op->enemy_count)) && blocks_view(m, nx, ny)) {
+                continue;
+            }
+
+            /* Calculate the cost. */
+            cost = node->cost + (is_diagonal ? PATH_COST_DIAG : PATH_COST);
+            cost += GET_MAP_MOVE_FLAGS(m, nx, ny) * 0.001;
+
+            if (op->behavior & BEHAVIOR_STEALTH) {
+                cost += GET_MAP_LIGHT(m, nx, ny) * 0.001;
+            }
+
+            if (visited != NULL && visited->node != NULL) {
+                new_node = visited->node;
+
+                /* If we have visited this node previously, and the cost is not
+                 * any better, skip it. */
+                if (cost >= new_node->cost || new_node->heap_index == -1) {
+                    continue;
+                }
+
+                /* Found a cheaper way to reach the node; update it in place
+                 * (the heuristic doesn't change) and move it up in the open
+                 * set accordingly. */
+                new_node->cost = cost;
+                new_node->parent = node;
+                path_node_update_sum(ctx, new_node);
+                path_heap_sift_up(ctx, new_node->heap_index);
+            } else {
+#if TIME_PATHFINDING
+                searched++;
+#endif
+                new_node = path_node_new(ctx, m, nx, ny, cost, &start, &goal, node);
+
+                if (new_node == NULL) {
+                    continue;
+                }
+
+                path_heap_push(ctx, new_node);
+
+                if (visited == NULL) {
+                    visited = path_visited_get(ctx, m, nx, ny, true);
+                }
+
+                visited->node = new_node;
+                PATHFINDING_VISUALIZER_APPEND(visualizer, m, nx, ny, false,
+                        new_node);
+            }
+
+            if (new_node->sum < best->sum) {
+                best = new_node;
+            }
+        }
+    }
+
+    if (complete != NULL) {
+        *complete = found_path != NULL;
+    }
+
+    if (found_path == NULL) {
+        for (node = best; node != NULL; node = node->parent) {
+            path_node_insert(node, &found_path);
+        }
+    }
+
+#if TIME_PATHFINDING
+    TIMER_UPDATE(1);
+    LOG(DEVEL, "Pathfinding took %f seconds (searched %d nodes)",
+            TIMER_GET(1), searched);
+#endif
+
+#if VISUALIZE_PATHFINDING
+    {
+        char path[HUGE_BUF];
+        FILE *fp;
+
+        snprintf(path, sizeof(path), "%s/pathfinding/%u.json",
+                settings.datapath, ctx->visited_id);
+        path_ensure_directories(path);
+
+        fp = fopen(path, "w");
+
+        if (fp == NULL) {
+            LOG(BUG, "Could not open %s for writing.", path);
+        } else {
+            path_visualization_t *visualization, *curr, *tmp;
+            path_visualizer_t *visualizer_node, *visualizer_node_tmp;
+            StringBuffer *sb;
+            char *cp;
+
+            visualization = NULL;
+            path_visualize(&visualization, visualizer);
+
+            fprintf(fp, "{\"start\": {\"map\": \"%s\", \"x\": %d, \"y\": %d},\n"
+                    "\"goal\": {\"map\": \"%s\", \"x\": %d, \"y\": %d},\n"
+                    "\"nodes\": {\n", start.map->path, start.x, start.y,
+                    goal.map->path, goal.x, goal.y);
+
+            HASH_ITER(hh, visualization, curr, tmp)
+            {
+                m = has_been_loaded_sh(curr->path);
+                fprintf(fp, "\"%s\": {\"walked\": [\n", m->path);
+
+                DL_FOREACH_SAFE(curr->nodes, visualizer_node,
+                        visualizer_node_tmp)
+                {
+                    fprintf(fp, "{\"id\": %u, \"x\": %d, \"y\": %d, "
+                            "\"closed\": %s, \"exit\": %s", visualizer_node->id,
+                            visualizer_node->x, visualizer_node->y,
+                            visualizer_node->closed ? "true" : "false",
+                            GET_MAP_FLAGS(m, visualizer_node->x,
+                            visualizer_node->y) & P_IS_EXIT ? "true" : "false");
+
+                    if (visualizer_node->node == NULL) {
+                        fprintf(fp, ", \"cost\": NaN, \"heuristic\": NaN, "
+                                "\"sum\": NaN");
+                    } else {
+                        fprintf(fp, ", \"cost\": %f, \"heuristic\": %f, "
+                                "\"sum\": %f", visualizer_node->node->cost,
+                                visualizer_node->node->heuristic,
+                                visualizer_node->node->sum);
+                    }
+
+                    fprintf(fp, "}");
+
+                    if (visualizer_node_tmp != NULL) {
+                        fprintf(fp, ",");
+                    }
+
+                    fprintf(fp, "\n");
+
+                    DL_DELETE(curr->nodes, visualizer_node);
+                    efree(visualizer_node);
+                }
+
+                sb = stringbuffer_new();
+
+                for (x = 0; x < m->width; x++) {
+                    for (y = 0; y < m->height; y++) {
+                        if (!tile_is_blocked(op, m, x, y)) {
+                            continue;
+                        }
+
+                        if (stringbuffer_length(sb) != 0) {
+                            stringbuffer_append_char(sb, ',');
+                        }
+
+                        stringbuffer_append_printf(sb, "\n{\"x\": %d, "
+                                "\"y\": %d}", x, y);
+                    }
+                }
+
+                cp = stringbuffer_finish(sb);
+                fprintf(fp, "],\n\"walls\": [%s\n]}%s\n", cp,
+                        tmp != NULL ? "," : "");
+                efree(cp);
+
+                HASH_DEL(visualization, curr);
+                FREE_ONLY_HASH(curr->path);
+                efree(curr);
+            }
+
+            fprintf(fp, "},\n\"path\": [\n");
+
+            for (node = found_path; node != NULL; node = node->next) {
+                m = NULL;
+
+                if (node->flags & PATH_NODE_EXIT) {
+                    object *exit;
+
+                    for (exit = GET_MAP_OB(node->map, node->x, node->y);
+                            exit != NULL; exit = exit->above) {
+                        if (exit->type == EXIT) {
+                            m = exit_get_destination(exit, &nx, &ny, true);
+                        }
+                    }
+                }
+
+                fprintf(fp, "{\"map\": \"%s\", \"x\": %d, \"y\": %d, "
+                        "\"flags\": %d}%s\n", node->map->path, node->x, node->y,
+                        node->flags, node->next != NULL || m != NULL ? "," :
+                            "");
+
+                if (m != NULL) {
+                    fprintf(fp, "{\"map\": \"%s\", \"x\": %d, \"y\": %d}%s\n",
+                            m->path, nx, ny, node->next != NULL ? "," : "");
+
+                }
+            }
+
+            fprintf(fp, "],\n\"time_taken\": ");
+
+#if TIME_PATHFINDING
+            fprintf(fp, "%f", TIMER_GET(1));
+#else
+            fprintf(fp, "NaN");
+#endif
+
+            fprintf(fp, ",\n\"num_searched\": ");
+
+#if TIME_PATHFINDING
+            fprintf(fp, "%d", searched);
+#else
+            fprintf(fp, "NaN");
+#endif
+
+            fprintf(fp, "\n}\n");
+
+            fclose(fp);
+
+            LOG(DEVEL, "Generated pathfinding visualization for '%s': %s",
+                    op->name, path);
+        }
+    }
+#endif
+
+    return found_path;
+}
+
+/**
+ * Check whether the specified tile can be walked on, for the purposes of
+ * the cluster abstraction. This doesn't depend on the object the path is
+ * for; the abstract path is refined with the regular search, which takes
+ * care of that.
+ *
+ * @param m
+ * Map.
+ * @param x
+ * X position.
+ * @param y
+ * Y position.
+ * @return
+ * Whether the tile can be walked on.
+ */
+static inline bool
+path_cluster_is_walkable (mapstruct *m, int x, int y)
+{
+    return !(GET_MAP_FLAGS(m, x, y) & P_NO_PASS) &&
+           !(GET_MAP_MOVE_FLAGS(m, x, y) & ~TERRAIN_AIRBREATH);
+}
+
+/**
+ * Get the tiled map in the specified direction, if it's loaded.
+ *
+ * @param m
+ * Map.
+ * @param dir
+ * Direction; one of TILED_NORTH..TILED_WEST.
+ * @return
+ * The tiled map, NULL if there isn't one or it's not loaded.
+ */
+static inline mapstruct *
+path_cluster_get_tiled (mapstruct *m, int dir)
+{
+    mapstruct *tiled = m->tile_map[dir];
+    if (tiled == NULL || tiled->in_memory != MAP_IN_MEMORY) {
+        return NULL;
+    }
+
+    return tiled;
+}
+
+/**
+ * Calculate the distances (in steps) from the specified tile to all the
+ * other walkable tiles on the map. The result is stored in
+ * ::pathfinder_cluster_dist.
+ *
+ * @param m
+ * Map.
+ * @param x
+ * X position.
+ * @param y
+ * Y position.
+ */
+static void
+path_cluster_distances (mapstruct *m, int x, int y)
+{
+    int width = MAP_WIDTH(m);
+    int height = MAP_HEIGHT(m);
+    size_t size = width * height;
+
+    if (size > pathfinder_cluster_size) {
+        pathfinder_cluster_size = size;
+        pathfinder_cluster_dist = erealloc(pathfinder_cluster_dist,
+                                           sizeof(*pathfinder_cluster_dist) *
+                                           size);
+        pathfinder_cluster_queue = erealloc(pathfinder_cluster_queue,
+                                            sizeof(*pathfinder_cluster_queue) *
+                                            size);
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        pathfinder_cluster_dist[i] = UINT16_MAX;
+    }
+
+    size_t head = 0, tail = 0;
+    pathfinder_cluster_dist[y * width + x] = 0;
+    pathfinder_cluster_queue[tail++] = y * width + x;
+
+    while (head < tail) {
+        int tile = pathfinder_cluster_queue[head++];
+        int tile_x = tile % width;
+        int tile_y = tile / width;
+
+        for (int i = 1; i <= SIZEOFFREE1; i++) {
+            int nx = tile_x + freearr_x[i];
+            int ny = tile_y + freearr_y[i];
+            if (nx < 0 || ny < 0 || nx >= width || ny >= height) {
+                continue;
+            }
+
+            int next = ny * width + nx;
+            if (pathfinder_cluster_dist[next] != UINT16_MAX ||
+                !path_cluster_is_walkable(m, nx, ny)) {
+                continue;
+            }
+
+            pathfinder_cluster_dist[next] = pathfinder_cluster_dist[tile] + 1;
+            pathfinder_cluster_queue[tail++] = next;
+        }
+    }
+}
+
+/**
+ * Get the coordinates of a tile on the border between a map and its tiled
+ * map.
+ *
+ * @param m
+ * Map.
+ * @param tiled
+ * The tiled map.
+ * @param dir
+ * Direction of the tiled map; one of TILED_NORTH..TILED_WEST.
+ * @param i
+ * Index of the tile along the border.
+ * @param[out] x
+ * X position on 'm'.
+ * @param[out] y
+ * Y position on 'm'.
+ * @param[out] tiled_x
+ * X position on 'tiled'.
+ * @param[out] tiled_y
+ * Y position on 'tiled'.
+ */
+static void
+path_cluster_border_tile (mapstruct *m,
+                          mapstruct *tiled,
+                          int        dir,
+                          int        i,
+                          int       *x,
+                          int       *y,
+                          int       *tiled_x,
+                          int       *tiled_y)
+{
+    switch (dir) {
+    case TILED_NORTH:
+        *x = *tiled_x = i;
+        *y = 0;
+        *tiled_y = MAP_HEIGHT(tiled) - 1;
+        break;
+
+    case TILED_EAST:
+        *x = MAP_WIDTH(m) - 1;
+        *tiled_x = 0;
+        *y = *tiled_y = i;
+        break;
+
+    case TILED_SOUTH:
+        *x = *tiled_x = i;
+        *y = MAP_HEIGHT(m) - 1;
+        *tiled_y = 0;
+        break;
+
+    case TILED_WEST:
+        *x = 0;
+        *tiled_x = MAP_WIDTH(tiled) - 1;
+        *y = *tiled_y = i;
+        break;
+    }
+}
+
+/**
+ * Add a transition to a cluster.
+ *
+ * @param cluster
+ * Cluster.
+ * @param x
+ * X position.
+ * @param y
+ * Y position.
+ * @param dir
+ * Border the transition is on.
+ */
+static void
+path_cluster_add_transition (path_cluster_t *cluster, int x, int y, int dir)
+{
+    cluster->transitions = erealloc(cluster->transitions,
+                                    sizeof(*cluster->transitions) *
+                                    (cluster->transitions_num + 1));
+    path_transition_t *transition =
+        &cluster->transitions[cluster->transitions_num++];
+    transition->x = x;
+    transition->y = y;
+    transition->dir = dir;
+}
+
+/**
+ * Free the pathfinding cluster of the specified map, if any.
+ *
+ * @param m
+ * Map.
+ */
+void
+path_cluster_free (mapstruct *m)
+{
+    HARD_ASSERT(m != NULL);
+
+    path_cluster_t *cluster = m->path_cluster;
+    if (cluster == NULL) {
+        return;
+    }
+
+    if (cluster->transitions != NULL) {
+        efree(cluster->transitions);
+    }
+
+    efree(cluster->distances);
+    efree(cluster);
+    m->path_cluster = NULL;
+}
+
+/**
+ * Invalidate the pathfinding clusters affected by a change in the
+ * passability of the specified tile.
+ *
+ * @param m
+ * Map.
+ * @param x
+ * X position.
+ * @param y
+ * Y position.
+ */
+void
+path_cluster_tile_changed (mapstruct *m, int x, int y)
+{
+    HARD_ASSERT(m != NULL);
+
+    path_cluster_free(m);
+
+    /* Transitions on the borders depend on the tiles on both sides. */
+    if (y == 0 && m->tile_map[TILED_NORTH] != NULL) {
+        path_cluster_free(m->tile_map[TILED_NORTH]);
+    }
+
+    if (x == MAP_WIDTH(m) - 1 && m->tile_map[TILED_EAST] != NULL) {
+        path_cluster_free(m->tile_map[TILED_EAST]);
+    }
+
+    if (y == MAP_HEIGHT(m) - 1 && m->tile_map[TILED_SOUTH] != NULL) {
+        path_cluster_free(m->tile_map[TILED_SOUTH]);
+    }
+
+    if (x == 0 && m->tile_map[TILED_WEST] != NULL) {
+        path_cluster_free(m->tile_map[TILED_WEST]);
+    }
+}
+
+/**
+ * Get the pathfinding cluster of the specified map, building it if
+ * necessary.
+ *
+ * The cluster has transitions in the middle of each opening on the borders
+ * with the loaded tiled maps (or at both ends, if the opening is wide), and
+ * a table of the distances between the transitions.
+ *
+ * @param m
+ * Map.
+ * @return
+ * The cluster.
+ */
+static path_cluster_t *
+path_cluster_get (mapstruct *m)
+{
+    HARD_ASSERT(m != NULL);
+
+    path_cluster_t *cluster = m->path_cluster;
+    if (cluster != NULL) {
+        /* Rebuild the cluster if tiled maps were loaded or swapped out. */
+        for (int dir = 0; dir < TILED_NUM_DIR / 2; dir++) {
+            if (cluster->tiles[dir] != path_cluster_get_tiled(m, dir)) {
+                path_cluster_free(m);
+                cluster = NULL;
+                break;
+            }
+        }
 
-        if (last_dir == v.direction) {
-            path_node_remove(tmp, &path);
-#ifdef DEBUG_PATHFINDING
-            removed_nodes++;
-#endif
+        if (cluster != NULL) {
+            return cluster;
+        }
+    }
+
+    cluster = ecalloc(1, sizeof(*cluster));
+
+    for (int dir = 0; dir < TILED_NUM_DIR / 2; dir++) {
+        mapstruct *tiled = path_cluster_get_tiled(m, dir);
+        cluster->tiles[dir] = tiled;
+
+        if (tiled == NULL) {
+            continue;
+        }
+
+        int len;
+        if (dir == TILED_NORTH || dir == TILED_SOUTH) {
+            len = MIN(MAP_WIDTH(m), MAP_WIDTH(tiled));
         } else {
-            last_dir = v.direction;
+            len = MIN(MAP_HEIGHT(m), MAP_HEIGHT(tiled));
+        }
+
+        int x, y, tiled_x, tiled_y;
+        int run_start = -1;
+        for (int i = 0; i <= len; i++) {
+            if (i < len) {
+                path_cluster_border_tile(m, tiled, dir, i, &x, &y, &tiled_x,
+                                         &tiled_y);
+                if (path_cluster_is_walkable(m, x, y) &&
+                    path_cluster_is_walkable(tiled, tiled_x, tiled_y)) {
+                    if (run_start == -1) {
+                        run_start = i;
+                    }
+
+                    continue;
+                }
+            }
+
+            if (run_start == -1) {
+                continue;
+            }
+
+            int run_len = i - run_start;
+            if (run_len >= PATHFINDER_TRANSITION_SPLIT) {
+                path_cluster_border_tile(m, tiled, dir, run_start, &x, &y,
+                                         &tiled_x, &tiled_y);
+                path_cluster_add_transition(cluster, x, y, dir);
+                path_cluster_border_tile(m, tiled, dir, i - 1, &x, &y,
+                                         &tiled_x, &tiled_y);
+                path_cluster_add_transition(cluster, x, y, dir);
+            } else {
+                path_cluster_border_tile(m, tiled, dir, run_start + run_len / 2,
+                                         &x, &y, &tiled_x, &tiled_y);
+                path_cluster_add_transition(cluster, x, y, dir);
+            }
+
+            run_start = -1;
+        }
+    }
+
+    size_t num = cluster->transitions_num;
+    cluster->distances = emalloc(sizeof(*cluster->distances) *
+                                 MAX(num * num, 1));
+
+    for (size_t i = 0; i < num; i++) {
+        path_cluster_distances(m,
+                               cluster->transitions[i].x,
+                               cluster->transitions[i].y);
+
+        for (size_t j = 0; j < num; j++) {
+            uint16_t dist = pathfinder_cluster_dist[
+                cluster->transitions[j].y * MAP_WIDTH(m) +
+                cluster->transitions[j].x];
+            cluster->distances[i * num + j] = dist == UINT16_MAX ? -1.0f :
+                                              dist;
+        }
+    }
+
+    m->path_cluster = cluster;
+    return cluster;
+}
+
+/**
+ * Calculate the distances from the specified tile to the transitions of
+ * the map's cluster.
+ *
+ * @param m
+ * Map.
+ * @param cluster
+ * The map's cluster.
+ * @param x
+ * X position.
+ * @param y
+ * Y position.
+ * @return
+ * The distances; negative if unreachable. Must be freed.
+ */
+static float *
+path_cluster_distances_from (mapstruct *m,
+                             path_cluster_t *cluster,
+                             int x,
+                             int y)
+{
+    float *distances = emalloc(sizeof(*distances) *
+                               MAX(cluster->transitions_num, 1));
+    path_cluster_distances(m, x, y);
+
+    for (size_t i = 0; i < cluster->transitions_num; i++) {
+        uint16_t dist = pathfinder_cluster_dist[
+            cluster->transitions[i].y * MAP_WIDTH(m) +
+            cluster->transitions[i].x];
+        distances[i] = dist == UINT16_MAX ? -1.0f : dist;
+    }
+
+    return distances;
+}
+
+/**
+ * Check whether a path between the specified maps should be planned with
+ * the hierarchical search first.
+ *
+ * @param map1
+ * From map.
+ * @param map2
+ * To map.
+ * @return
+ * Whether to use the hierarchical search.
+ */
+static bool
+path_use_hierarchy (mapstruct *map1, mapstruct *map2)
+{
+    if (map1 == map2) {
+        return false;
+    }
+
+    for (int i = 0; i < TILED_NUM; i++) {
+        if (map1->tile_map[i] == map2) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Relax an edge of the abstract graph during the hierarchical search.
+ *
+ * @param ctx
+ * Search context.
+ * @param node
+ * Node the edge starts at.
+ * @param m
+ * Map the edge leads to.
+ * @param x
+ * X position the edge leads to.
+ * @param y
+ * Y position the edge leads to.
+ * @param transition
+ * Transition index the edge leads to, -1 if it's not a transition.
+ * @param cost
+ * Cost of reaching the tile through this edge.
+ * @param start
+ * Starting node.
+ * @param goal
+ * Goal node.
+ */
+static void
+path_hierarchical_relax (path_context_t *ctx,
+                         path_node_t    *node,
+                         mapstruct      *m,
+                         int             x,
+                         int             y,
+                         int             transition,
+                         double          cost,
+                         path_node_t    *start,
+                         path_node_t    *goal)
+{
+    path_visited_t *visited = path_visited_get(ctx, m, x, y, false);
+    if (visited != NULL && visited->closed) {
+        return;
+    }
+
+    if (visited != NULL && visited->node != NULL) {
+        path_node_t *new_node = visited->node;
+        if (cost >= new_node->cost || new_node->heap_index == -1) {
+            return;
+        }
+
+        new_node->cost = cost;
+        new_node->parent = node;
+        path_node_update_sum(ctx, new_node);
+        path_heap_sift_up(ctx, new_node->heap_index);
+        return;
+    }
+
+    path_node_t *new_node = path_node_new(ctx, m, x, y, cost, start, goal,
+                                          node);
+    if (new_node == NULL) {
+        return;
+    }
+
+    new_node->map_id = transition;
+    path_heap_push(ctx, new_node);
+
+    if (visited == NULL) {
+        visited = path_visited_get(ctx, m, x, y, true);
+    }
+
+    visited->node = new_node;
+}
+
+/**
+ * Find a path for op from location on map1 to location on map2, by first
+ * planning a path over the map clusters and their transitions, and then
+ * refining the individual legs of the abstract path with
+ * path_find_local().
+ *
+ * Only maps that are already loaded are considered.
+ *
+ * @param ctx
+ * Search context.
+ * @param op
+ * Object.
+ * @param map1
+ * From map.
+ * @param x
+ * From X position.
+ * @param y
+ * From Y position.
+ * @param map2
+ * To map.
+ * @param x2
+ * To X position.
+ * @param y2
+ * To Y position.
+ * @return
+ * Found path, NULL if no complete path was found.
+ */
+static path_node_t *
+path_find_hierarchical (path_context_t *ctx,
+                        object         *op,
+                        mapstruct      *map1,
+                        int             x,
+                        int             y,
+                        mapstruct      *map2,
+                        int             x2,
+                        int             y2)
+{
+    int start_x, start_y, start_z;
+    int goal_x, goal_y, goal_z;
+    if (!path_map_offset(ctx, map1, &start_x, &start_y, &start_z) ||
+        !path_map_offset(ctx, map2, &goal_x, &goal_y, &goal_z) ||
+        start_z != goal_z) {
+        return NULL;
+    }
+
+    path_cluster_t *start_cluster = path_cluster_get(map1);
+    path_cluster_t *goal_cluster = path_cluster_get(map2);
+    if (start_cluster->transitions_num == 0 ||
+        goal_cluster->transitions_num == 0) {
+        return NULL;
+    }
+
+    float *start_dist = path_cluster_distances_from(map1, start_cluster, x, y);
+    float *goal_dist = path_cluster_distances_from(map2, goal_cluster, x2, y2);
+
+    path_node_t start, goal;
+    start.map = map1;
+    start.x = x;
+    start.y = y;
+    goal.map = map2;
+    goal.x = x2;
+    goal.y = y2;
+
+    path_search_restart(ctx);
+
+    path_node_t *node = path_node_new(ctx, map1, x, y, 0.0, &start, &goal,
+                                      NULL);
+    if (node != NULL) {
+        path_heap_push(ctx, node);
+        path_visited_get(ctx, map1, x, y, true)->node = node;
+    }
+
+    path_node_t *found = NULL;
+    int expanded = 0;
+
+    while (expanded++ < PATHFINDER_ABSTRACT_MAX &&
+           (node = path_heap_pop(ctx)) != NULL) {
+        if (node->map == map2 && node->x == x2 && node->y == y2) {
+            found = node;
+            break;
+        }
+
+        path_visited_get(ctx, node->map, node->x, node->y, true)->closed =
+            true;
+
+        path_cluster_t *cluster = path_cluster_get(node->map);
+        size_t num = cluster->transitions_num;
+
+        /* Edges to the other transitions on the same map. */
+        for (size_t i = 0; i < num; i++) {
+            double dist;
+            if (node->map_id == -1) {
+                dist = node->map == map1 ? start_dist[i] : -1.0;
+            } else {
+                dist = cluster->distances[node->map_id * num + i];
+            }
+
+            if (dist < 0) {
+                continue;
+            }
+
+            path_hierarchical_relax(ctx,
+                                    node,
+                                    node->map,
+                                    cluster->transitions[i].x,
+                                    cluster->transitions[i].y,
+                                    i,
+                                    node->cost + dist,
+                                    &start,
+                                    &goal);
+        }
+
+        if (node->map_id == -1) {
+            continue;
+        }
+
+        /* Edge to the goal. */
+        if (node->map == map2 && goal_dist[node->map_id] >= 0) {
+            path_hierarchical_relax(ctx,
+                                    node,
+                                    map2,
+                                    x2,
+                                    y2,
+                                    -1,
+                                    node->cost + goal_dist[node->map_id],
+                                    &start,
+                                    &goal);
+        }
+
+        /* Edges across the borders. A tile in a corner can be a transition
+         * on two borders. */
+        for (size_t i = 0; i < num; i++) {
+            path_transition_t *transition = &cluster->transitions[i];
+            if (transition->x != node->x || transition->y != node->y) {
+                continue;
+            }
+
+            mapstruct *tiled = path_cluster_get_tiled(node->map,
+                                                      transition->dir);
+            if (tiled == NULL) {
+                continue;
+            }
+
+            int tmp_x, tmp_y, tiled_x, tiled_y;
+            path_cluster_border_tile(node->map,
+                                     tiled,
+                                     transition->dir,
+                                     transition->dir == TILED_NORTH ||
+                                     transition->dir == TILED_SOUTH ?
+                                     node->x : node->y,
+                                     &tmp_x,
+                                     &tmp_y,
+                                     &tiled_x,
+                                     &tiled_y);
+
+            path_cluster_t *tiled_cluster = path_cluster_get(tiled);
+            for (size_t j = 0; j < tiled_cluster->transitions_num; j++) {
+                path_transition_t *tiled_transition =
+                    &tiled_cluster->transitions[j];
+                if (tiled_transition->dir !=
+                    map_tiled_reverse[transition->dir] ||
+                    tiled_transition->x != tiled_x ||
+                    tiled_transition->y != tiled_y) {
+                    continue;
+                }
+
+                path_hierarchical_relax(ctx,
+                                        node,
+                                        tiled,
+                                        tiled_x,
+                                        tiled_y,
+                                        j,
+                                        node->cost + PATH_COST,
+                                        &start,
+                                        &goal);
+                break;
+            }
+        }
+    }
+
+    efree(start_dist);
+    efree(goal_dist);
+
+    if (found == NULL) {
+        return NULL;
+    }
+
+    /* Store the abstract path, as the refinement below reuses the node
+     * buffers. */
+    size_t points_num = 0;
+    for (node = found; node != NULL; node = node->parent) {
+        points_num++;
+    }
+
+    path_node_t *points = emalloc(sizeof(*points) * points_num);
+    size_t idx = points_num;
+    for (node = found; node != NULL; node = node->parent) {
+        points[--idx] = *node;
+    }
+
+    path_search_start(ctx, ctx->algo, ctx->greed);
+
+    path_node_t *path = NULL, *tail = NULL;
+    for (size_t i = 0; i + 1 < points_num; i++) {
+        bool complete;
+        path_node_t *segment = path_find_local(ctx,
+                                               op,
+                                               points[i].map,
+                                               points[i].x,
+                                               points[i].y,
+                                               points[i + 1].map,
+                                               points[i + 1].x,
+                                               points[i + 1].y,
+                                               NULL,
+                                               &complete);
+        if (segment == NULL || !complete) {
+            path = NULL;
+            break;
+        }
+
+        /* Skip the starting node of the segment if the previous segment
+         * already ended there. */
+        if (tail != NULL && segment->map == tail->map &&
+            segment->x == tail->x && segment->y == tail->y) {
+            segment = segment->next;
+        }
+
+        if (segment == NULL) {
+            continue;
+        }
+
+        if (tail == NULL) {
+            path = segment;
+        } else {
+            tail->next = segment;
+            segment->prev = tail;
+        }
+
+        for (tail = segment; tail->next != NULL; tail = tail->next) {
+        }
+    }
+
+    efree(points);
+
+    return path;
+}
+
+/**
+ * Find a path for op from location on map1 to location on map2.
+ *
+ * Paths to maps that are further away than the tiled maps next to map1 are
+ * planned with the hierarchical search first, falling back to searching the
+ * individual tiles.
+ *
+ * @param op
+ * Object.
+ * @param map1
+ * From map.
+ * @param x
+ * From X position.
+ * @param y
+ * From Y position.
+ * @param map2
+ * To map.
+ * @param x2
+ * To X position.
+ * @param y2
+ * To Y position.
+ * @param visualizer[out]
+ * Visualizer pointer where to store visited/closed
+ * nodes. Can be NULL, otherwise the pointer MUST be initialized to NULL.
+ * @return
+ * Found path.
+ */
+path_node_t *path_find(object *op, mapstruct *map1, int x, int y,
+        mapstruct *map2, int x2, int y2, path_visualizer_t **visualizer)
+{
+    path_context_t *ctx = &pathfinder_context;
+    path_search_start(ctx, path_algo, path_greed);
+
+    if (visualizer == NULL && path_use_hierarchy(map1, map2)) {
+        path_node_t *path = path_find_hierarchical(ctx, op, map1, x, y, map2,
+                                                   x2, y2);
+        if (path != NULL) {
+            return path;
+        }
+
+        path_search_start(ctx, path_algo, path_greed);
+    }
+
+    return path_find_local(ctx, op, map1, x, y, map2, x2, y2, visualizer,
+                           NULL);
+}
+
+/**
+ * Find the snapshot index of the specified map.
+ *
+ * @param job
+ * Pathfinding job.
+ * @param m
+ * Map to find.
+ * @return
+ * Index of the map, -1 if it's not in the snapshot.
+ */
+static int
+path_snapshot_find (path_job_t *job, mapstruct *m)
+{
+    for (size_t i = 0; i < job->maps_num; i++) {
+        if (job->maps[i].map == m) {
+            return (int) i;
         }
     }
 
-#ifdef DEBUG_PATHFINDING
-    LOG(DEBUG, "removed %d nodes of %d (%.0f%%)", removed_nodes,
-            total_nodes, (float) removed_nodes * 100.0 / (float) total_nodes);
-#endif
+    return -1;
+}
+
+/**
+ * Add a map to the snapshot of a pathfinding job. The tiles of the map are
+ * filled in later by path_snapshot_fill().
+ *
+ * @param job
+ * Pathfinding job.
+ * @param m
+ * Map to add.
+ * @param offset_x
+ * X offset of the map from the starting map.
+ * @param offset_y
+ * Y offset of the map from the starting map.
+ * @param offset_z
+ * Z offset of the map from the starting map.
+ * @return
+ * Index of the map, -1 if the snapshot is full.
+ */
+static int
+path_snapshot_add (path_job_t *job,
+                   mapstruct  *m,
+                   int         offset_x,
+                   int         offset_y,
+                   int         offset_z)
+{
+    if (job->maps_num == PATHFINDER_SNAPSHOT_MAPS) {
+        return -1;
+    }
+
+    path_snapshot_map_t *smap = &job->maps[job->maps_num];
+    smap->map = m;
+    smap->path = add_refcount(m->path);
+    smap->width = MAP_WIDTH(m);
+    smap->height = MAP_HEIGHT(m);
+    smap->offset_x = offset_x;
+    smap->offset_y = offset_y;
+    smap->offset_z = offset_z;
+
+    for (int i = 0; i < TILED_NUM; i++) {
+        smap->tiles[i] = -1;
+    }
+
+    return (int) job->maps_num++;
+}
+
+/**
+ * Find the snapshot index of the specified map, adding it to the snapshot
+ * if it's connected to the starting map, but not in the snapshot yet.
+ *
+ * @param job
+ * Pathfinding job.
+ * @param m
+ * Map.
+ * @return
+ * Index of the map, -1 on failure.
+ */
+static int
+path_snapshot_get (path_job_t *job, mapstruct *m)
+{
+    int idx = path_snapshot_find(job, m);
+    if (idx != -1) {
+        return idx;
+    }
+
+    rv_vector rv;
+    if (!get_rangevector_from_mapcoords(job->maps[0].map,
+                                        0,
+                                        0,
+                                        m,
+                                        0,
+                                        0,
+                                        &rv,
+                                        RV_RECURSIVE_SEARCH | RV_NO_LOAD |
+                                        RV_NO_DISTANCE)) {
+        return -1;
+    }
 
-    return path;
+    idx = path_snapshot_add(job,
+                            m,
+                            rv.distance_x,
+                            rv.distance_y,
+                            rv.distance_z);
+    if (idx != -1) {
+        /* Maps reached through exits can be anywhere relative to the box
+         * around the start and goal. */
+        job->maps[idx].whole = true;
+    }
+
+    return idx;
 }
 
 /**
- * Build a visualization hash table out of a list of visited/closed nodes.
- * @param[out] visualization Hash table to use. Must be initialized to NULL.
- * @param[out] visualizer List of the visited/closed nodes.
+ * Fill in the tiles of a map in the snapshot of a pathfinding job. Only the
+ * tiles within the job's box are examined, unless the map is to be
+ * snapshotted whole.
+ *
+ * @param job
+ * Pathfinding job.
+ * @param idx
+ * Index of the map in the snapshot.
+ * @param op
+ * Object the path is being computed for.
  */
-void path_visualize(path_visualization_t **visualization,
-        path_visualizer_t **visualizer)
+static void
+path_snapshot_fill (path_job_t *job, int idx, object *op)
 {
-    path_visualizer_t *node, *tmp;
-    path_visualization_t *visualization_node;
+    path_snapshot_map_t *smap = &job->maps[idx];
+    mapstruct *m = smap->map;
 
-    HARD_ASSERT(visualization != NULL);
-    HARD_ASSERT(visualizer != NULL);
+    smap->flags = emalloc(sizeof(*smap->flags) * smap->width * smap->height);
+    smap->cost = emalloc(sizeof(*smap->cost) * smap->width * smap->height);
 
-    DL_FOREACH_SAFE(*visualizer, node, tmp)
-    {
-        HASH_FIND(hh, *visualization, &node->map->path, sizeof(shstr *),
-                visualization_node);
+    bool avoid_secret = !(op->behavior & BEHAVIOR_SECRET_PASSAGES) &&
+                        !OBJECT_VALID(op->enemy, op->enemy_count);
 
-        if (visualization_node == NULL) {
-            visualization_node = ecalloc(1, sizeof(*visualization_node));
-            FREE_AND_ADD_REF_HASH(visualization_node->path, node->map->path);
-            HASH_ADD(hh, *visualization, path, sizeof(shstr *),
-                    visualization_node);
-        }
+    int min_x = 0, max_x = smap->width - 1;
+    int min_y = 0, max_y = smap->height - 1;
 
-        DL_DELETE(*visualizer, node);
-        DL_APPEND(visualization_node->nodes, node);
+    if (!smap->whole) {
+        min_x = MAX(min_x, job->min_x - smap->offset_x);
+        max_x = MIN(max_x, job->max_x - smap->offset_x);
+        min_y = MAX(min_y, job->min_y - smap->offset_y);
+        max_y = MIN(max_y, job->max_y - smap->offset_y);
+    }
+
+    for (int y = 0; y < smap->height; y++) {
+        for (int x = 0; x < smap->width; x++) {
+            size_t tile = y * smap->width + x;
+
+            if (x < min_x || x > max_x || y < min_y || y > max_y) {
+                smap->flags[tile] = PATH_TILE_BLOCKED;
+                smap->cost[tile] = 0.0f;
+                continue;
+            }
+
+            int flags = GET_MAP_FLAGS(m, x, y);
+
+            smap->flags[tile] = 0;
+            smap->cost[tile] = GET_MAP_MOVE_FLAGS(m, x, y) * 0.001;
+
+            if (op->behavior & BEHAVIOR_STEALTH) {
+                smap->cost[tile] += GET_MAP_LIGHT(m, x, y) * 0.001;
+            }
+
+            if (blocked(op, m, x, y, op->terrain_flag) != 0) {
+                smap->flags[tile] |= PATH_TILE_BLOCKED;
+            }
+
+            if (avoid_secret && !(flags & P_DOOR_CLOSED) &&
+                flags & P_BLOCKSVIEW) {
+                smap->flags[tile] |= PATH_TILE_AVOID;
+            }
+
+            if (!(flags & P_IS_EXIT) || !(op->behavior & BEHAVIOR_EXITS)) {
+                continue;
+            }
+
+            for (object *tmp = GET_MAP_OB(m, x, y); tmp != NULL;
+                 tmp = tmp->above) {
+                if (tmp->type != EXIT) {
+                    continue;
+                }
+
+                int nx, ny;
+                mapstruct *dest = exit_get_destination(tmp, &nx, &ny, false);
+                if (dest == NULL || dest->in_memory != MAP_IN_MEMORY) {
+                    continue;
+                }
+
+                int dest_idx = path_snapshot_get(job, dest);
+                if (dest_idx == -1) {
+                    continue;
+                }
+
+                /* The snapshot maps are allocated upfront, so adding a map
+                 * above doesn't invalidate 'smap'. */
+                smap->exits = erealloc(smap->exits,
+                                       sizeof(*smap->exits) *
+                                       (smap->exits_num + 1));
+                path_snapshot_exit_t *exit = &smap->exits[smap->exits_num++];
+                exit->x = x;
+                exit->y = y;
+                exit->map = dest_idx;
+                exit->dest_x = nx;
+                exit->dest_y = ny;
+                smap->flags[tile] |= PATH_TILE_EXIT;
+            }
+        }
     }
 }
 
 /**
- * Find a path for op from location on map1 to location on map2.
+ * Create a pathfinding job, taking a snapshot of the loaded maps around the
+ * start and goal positions.
+ *
  * @param op
- * Object.
+ * Object to find a path for.
  * @param map1
  * From map.
- * @param x1
+ * @param x
  * From X position.
- * @param y1
+ * @param y
  * From Y position.
  * @param map2
  * To map.
@@ -850,91 +3168,397 @@ void path_visualize(path_visualization_t **visualization,
  * To X position.
  * @param y2
  * To Y position.
- * @param visualizer[out]
- * Visualizer pointer where to store visited/closed
- * nodes. Can be NULL, otherwise the pointer MUST be initialized to NULL.
  * @return
- * Found path.
+ * The job, NULL if the goal is not connected to the start.
  */
-path_node_t *path_find(object *op, mapstruct *map1, int x, int y,
-        mapstruct *map2, int x2, int y2, path_visualizer_t **visualizer)
+static path_job_t *
+path_job_create (object    *op,
+                 mapstruct *map1,
+                 int        x,
+                 int        y,
+                 mapstruct *map2,
+                 int        x2,
+                 int        y2)
 {
-    path_node_t *open_list, *found_path, *visited, *node, *new_node, *best;
-    path_node_t start, goal;
-    static uint32_t traversal_id = 0;
-    int i, nx, ny, is_diagonal, node_x, node_y;
-    mapstruct *m, *node_map;
-    double cost;
     rv_vector rv;
-    uint32_t node_id;
-#if VISUALIZE_PATHFINDING
-    path_visualizer_t *visualizer_tmp;
-#endif
-#if TIME_PATHFINDING
-    int searched;
-#endif
+    if (!get_rangevector_from_mapcoords(map1,
+                                        0,
+                                        0,
+                                        map2,
+                                        0,
+                                        0,
+                                        &rv,
+                                        RV_RECURSIVE_SEARCH | RV_NO_LOAD |
+                                        RV_NO_DISTANCE)) {
+        return NULL;
+    }
 
-    start.x = x;
-    start.y = y;
-    start.map = map1;
+    op = HEAD(op);
+
+    path_job_t *job = ecalloc(1, sizeof(*job));
+    job->maps = ecalloc(PATHFINDER_SNAPSHOT_MAPS, sizeof(*job->maps));
+    job->start_x = x;
+    job->start_y = y;
+    job->goal_x = x2;
+    job->goal_y = y2;
+
+    path_snapshot_add(job, map1, 0, 0, 0);
+    job->goal_map = path_snapshot_find(job, map2);
+    if (job->goal_map == -1) {
+        job->goal_map = path_snapshot_add(job,
+                                          map2,
+                                          rv.distance_x,
+                                          rv.distance_y,
+                                          rv.distance_z);
+    }
 
-    goal.x = x2;
-    goal.y = y2;
-    goal.map = map2;
+    /* Only include the parts of maps that are near the box spanned by the
+     * start and goal positions. */
+    int min_x = job->min_x = MIN(x, rv.distance_x + x2) -
+                             PATHFINDER_SNAPSHOT_MARGIN;
+    int max_x = job->max_x = MAX(x, rv.distance_x + x2) +
+                             PATHFINDER_SNAPSHOT_MARGIN;
+    int min_y = job->min_y = MIN(y, rv.distance_y + y2) -
+                             PATHFINDER_SNAPSHOT_MARGIN;
+    int max_y = job->max_y = MAX(y, rv.distance_y + y2) +
+                             PATHFINDER_SNAPSHOT_MARGIN;
+    int min_z = MIN(0, rv.distance_z) - 1;
+    int max_z = MAX(0, rv.distance_z) + 1;
+
+    for (size_t i = 0; i < job->maps_num; i++) {
+        path_snapshot_map_t *smap = &job->maps[i];
+        mapstruct *m = smap->map;
+
+        for (int tile_id = 0; tile_id < TILED_NUM; tile_id++) {
+            mapstruct *tiled = m->tile_map[tile_id];
+            if (tiled == NULL || tiled->in_memory != MAP_IN_MEMORY ||
+                path_snapshot_find(job, tiled) != -1) {
+                continue;
+            }
+
+            int offset_x = smap->offset_x;
+            int offset_y = smap->offset_y;
+            int offset_z = smap->offset_z;
+
+            switch (tile_id) {
+            case TILED_NORTH:
+                offset_y -= MAP_HEIGHT(tiled);
+                break;
+
+            case TILED_EAST:
+                offset_x += smap->width;
+                break;
+
+            case TILED_SOUTH:
+                offset_y += smap->height;
+                break;
+
+            case TILED_WEST:
+                offset_x -= MAP_WIDTH(tiled);
+                break;
+
+            case TILED_NORTHEAST:
+                offset_x += smap->width;
+                offset_y -= MAP_HEIGHT(tiled);
+                break;
+
+            case TILED_SOUTHEAST:
+                offset_x += smap->width;
+                offset_y += smap->height;
+                break;
+
+            case TILED_SOUTHWEST:
+                offset_x -= MAP_WIDTH(tiled);
+                offset_y += smap->height;
+                break;
+
+            case TILED_NORTHWEST:
+                offset_x -= MAP_WIDTH(tiled);
+                offset_y -= MAP_HEIGHT(tiled);
+                break;
+
+            case TILED_UP:
+                offset_z++;
+                break;
+
+            case TILED_DOWN:
+                offset_z--;
+                break;
+            }
+
+            if (offset_x + MAP_WIDTH(tiled) <= min_x || offset_x > max_x ||
+                offset_y + MAP_HEIGHT(tiled) <= min_y || offset_y > max_y ||
+                offset_z < min_z || offset_z > max_z) {
+                continue;
+            }
 
-    /* Avoid overflow of traversal_id */
-    if (traversal_id == UINT32_MAX) {
-        DL_FOREACH(first_map, m) {
-            m->pathfinding_id = 0;
+            path_snapshot_add(job, tiled, offset_x, offset_y, offset_z);
         }
 
-        traversal_id = 0;
+        path_snapshot_fill(job, i, op);
     }
 
-#if TIME_PATHFINDING
-    searched = 0;
-    TIMER_START(1);
-#endif
+    /* Link up the tiled maps now that all the maps are known. */
+    for (size_t i = 0; i < job->maps_num; i++) {
+        path_snapshot_map_t *smap = &job->maps[i];
 
-    traversal_id++;
-    pathfinder_nodebuf_next = 0;
-    node_id = 0;
-    found_path = NULL;
+        for (int tile_id = 0; tile_id < TILED_NUM; tile_id++) {
+            mapstruct *tiled = smap->map->tile_map[tile_id];
+            if (tiled != NULL && tiled->in_memory == MAP_IN_MEMORY) {
+                smap->tiles[tile_id] = path_snapshot_find(job, tiled);
+            }
+        }
+    }
 
-#if VISUALIZE_PATHFINDING
-    visualizer_tmp = NULL;
+    /* Store the parts of the object, and where they are right now; the
+     * tiles occupied by the object itself are not considered blocked. */
+    for (object *tmp = op; tmp != NULL; tmp = tmp->more) {
+        job->parts_num++;
+    }
 
-    if (visualizer == NULL) {
-        visualizer = &visualizer_tmp;
+    job->parts = emalloc(sizeof(*job->parts) * job->parts_num);
+    job->parts_num = 0;
+
+    for (object *tmp = op; tmp != NULL; tmp = tmp->more) {
+        path_job_part_t *part = &job->parts[job->parts_num++];
+        part->x = tmp->arch->clone.x;
+        part->y = tmp->arch->clone.y;
+        part->map = tmp->map != NULL ? path_snapshot_find(job, tmp->map) : -1;
+        part->map_x = tmp->x;
+        part->map_y = tmp->y;
     }
-#endif
 
-    /* The initial tile. */
-    open_list = best = path_node_new(map1, x, y, 0.0, &start, &goal, NULL);
-    if (open_list == NULL) {
+    job->goal_range = (op->quick_pos >> 4) + 1;
+
+    return job;
+}
+
+/**
+ * Snapshot equivalent of get_map_from_coord().
+ *
+ * @param job
+ * Pathfinding job.
+ * @param map
+ * Snapshot map index.
+ * @param[out] x
+ * Will contain the real X position.
+ * @param[out] y
+ * Will contain the real Y position.
+ * @return
+ * Snapshot map index at the specified location, -1 if it's not in the
+ * snapshot.
+ */
+static int
+path_snapshot_get_map (const path_job_t *job, int map, int *x, int *y)
+{
+    while (map != -1) {
+        const path_snapshot_map_t *smap = &job->maps[map];
+        int tile_id;
+
+        if (*x < 0) {
+            if (*y < 0) {
+                tile_id = TILED_NORTHWEST;
+            } else if (*y >= smap->height) {
+                tile_id = TILED_SOUTHWEST;
+            } else {
+                tile_id = TILED_WEST;
+            }
+        } else if (*x >= smap->width) {
+            if (*y < 0) {
+                tile_id = TILED_NORTHEAST;
+            } else if (*y >= smap->height) {
+                tile_id = TILED_SOUTHEAST;
+            } else {
+                tile_id = TILED_EAST;
+            }
+        } else if (*y < 0) {
+            tile_id = TILED_NORTH;
+        } else if (*y >= smap->height) {
+            tile_id = TILED_SOUTH;
+        } else {
+            return map;
+        }
+
+        int next = smap->tiles[tile_id];
+        if (next == -1) {
+            return -1;
+        }
+
+        const path_snapshot_map_t *tiled = &job->maps[next];
+
+        if (*x < 0) {
+            *x += tiled->width;
+        } else if (*x >= smap->width) {
+            *x -= smap->width;
+        }
+
+        if (*y < 0) {
+            *y += tiled->height;
+        } else if (*y >= smap->height) {
+            *y -= smap->height;
+        }
+
+        map = next;
+    }
+
+    return -1;
+}
+
+/**
+ * Snapshot equivalent of tile_is_blocked().
+ *
+ * @param job
+ * Pathfinding job.
+ * @param map
+ * Snapshot map index.
+ * @param x
+ * X position.
+ * @param y
+ * Y position.
+ * @return
+ * Whether the tile is blocked.
+ */
+static bool
+path_snapshot_is_blocked (const path_job_t *job, int map, int x, int y)
+{
+    if (job->parts_num == 1) {
+        const path_snapshot_map_t *smap = &job->maps[map];
+        return smap->flags[y * smap->width + x] & PATH_TILE_BLOCKED;
+    }
+
+    for (size_t i = 0; i < job->parts_num; i++) {
+        int xt = x + job->parts[i].x;
+        int yt = y + job->parts[i].y;
+        int mt = path_snapshot_get_map(job, map, &xt, &yt);
+        if (mt == -1) {
+            return true;
+        }
+
+        /* If this part is a different part of the head, then skip checking
+         * this tile. */
+        size_t j;
+        for (j = 0; j < job->parts_num; j++) {
+            if (job->parts[j].map == mt && job->parts[j].map_x == xt &&
+                job->parts[j].map_y == yt) {
+                break;
+            }
+        }
+
+        if (j != job->parts_num) {
+            continue;
+        }
+
+        const path_snapshot_map_t *smap = &job->maps[mt];
+        if (smap->flags[yt * smap->width + xt] & PATH_TILE_BLOCKED) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Allocate and initialize a node for a search on a snapshot.
+ *
+ * @param ctx
+ * Search context.
+ * @param job
+ * Pathfinding job.
+ * @param map
+ * Snapshot map index.
+ * @param x
+ * X position.
+ * @param y
+ * Y position.
+ * @param cost
+ * Cost.
+ * @param parent
+ * Parent node.
+ * @return
+ * New node.
+ */
+static path_node_t *
+path_snapshot_node_new (path_context_t   *ctx,
+                        const path_job_t *job,
+                        int               map,
+                        int16_t           x,
+                        int16_t           y,
+                        double            cost,
+                        path_node_t      *parent)
+{
+    path_node_t *node = path_node_alloc(ctx);
+    if (node == NULL) {
         return NULL;
     }
 
-    while (open_list != NULL && pathfinder_nodebuf_next < PATHFINDER_NODEBUF) {
-        node = open_list;
-        path_node_remove(node, &open_list);
+    const path_snapshot_map_t *smap = &job->maps[map];
+    const path_snapshot_map_t *goal = &job->maps[job->goal_map];
+    int goal_x = goal->offset_x + job->goal_x;
+    int goal_y = goal->offset_y + job->goal_y;
+
+    node->parent = parent;
+    node->map_id = map;
+    node->x = x;
+    node->y = y;
+    node->cost = cost;
+    path_node_set_heuristic(ctx,
+                            node,
+                            goal_x - (smap->offset_x + x),
+                            goal_y - (smap->offset_y + y),
+                            goal->offset_z - smap->offset_z,
+                            goal_x - job->start_x,
+                            goal_y - job->start_y);
+
+    return node;
+}
+
+/**
+ * Run a pathfinding job; this is the equivalent of path_find(), operating
+ * on the job's snapshot instead of the live maps.
+ *
+ * @param ctx
+ * Search context.
+ * @param job
+ * Pathfinding job.
+ */
+static void
+path_job_run (path_context_t *ctx, path_job_t *job)
+{
+    path_search_start(ctx, job->algo, job->greed);
+
+    const path_snapshot_map_t *goal = &job->maps[job->goal_map];
+    int goal_x = goal->offset_x + job->goal_x;
+    int goal_y = goal->offset_y + job->goal_y;
+
+    path_node_t *best = path_snapshot_node_new(ctx,
+                                               job,
+                                               0,
+                                               job->start_x,
+                                               job->start_y,
+                                               0.0,
+                                               NULL);
+    if (best == NULL) {
+        return;
+    }
+
+    path_heap_push(ctx, best);
 
+    path_node_t *node, *found = NULL;
+    while (ctx->nodebuf_num < PATHFINDER_NODES_MAX &&
+           (node = path_heap_pop(ctx)) != NULL) {
         bool reached_goal = node->heuristic <= 1.2;
-        if (op->more != NULL && !reached_goal &&
-            node->heuristic <= (op->quick_pos >> 4) + 1) {
-            for (object *tmp = op; tmp != NULL; tmp = tmp->more) {
-                int tmp_x = node->x + tmp->arch->clone.x;
-                int tmp_y = node->y + tmp->arch->clone.y;
-                mapstruct *tmp_map = get_map_from_coord(node->map,
-                                                        &tmp_x,
-                                                        &tmp_y);
-                if (tmp_map == NULL) {
+        if (job->parts_num > 1 && !reached_goal &&
+            node->heuristic <= job->goal_range) {
+            for (size_t i = 0; i < job->parts_num; i++) {
+                int xt = node->x + job->parts[i].x;
+                int yt = node->y + job->parts[i].y;
+                int mt = path_snapshot_get_map(job, node->map_id, &xt, &yt);
+                if (mt == -1) {
                     continue;
                 }
 
-                get_rangevector_from_mapcoords(tmp_map, tmp_x, tmp_y, goal.map,
-                                               goal.x, goal.y, &rv, 0);
-                if (rv.distance <= 1) {
+                if (abs(goal_x - (job->maps[mt].offset_x + xt)) +
+                    abs(goal_y - (job->maps[mt].offset_y + yt)) <= 1) {
                     reached_goal = true;
                     break;
                 }
@@ -942,296 +3566,383 @@ path_node_t *path_find(object *op, mapstruct *map1, int x, int y,
         }
 
         if (reached_goal) {
-            if (visualizer != NULL) {
-                PATHFINDING_SET_CLOSED(node->map, node->x, node->y,
-                        traversal_id, visualizer);
-                PATHFINDING_SET_CLOSED(goal.map, goal.x, goal.y,
-                        traversal_id, visualizer);
-            }
-
-            for ( ; node != NULL; node = node->parent) {
-                path_node_insert(node, &found_path);
-            }
-
+            found = node;
             break;
         }
 
-        /* Close this tile. */
-        PATHFINDING_SET_CLOSED(node->map, node->x, node->y, traversal_id,
-                visualizer);
-
-        node_map = node->map;
-        node_x = node->x;
-        node_y = node->y;
-
-        if (GET_MAP_FLAGS(node_map, node_x, node_y) & P_IS_EXIT &&
-                op->behavior & BEHAVIOR_EXITS) {
-            object *tmp;
-
-            for (tmp = GET_MAP_OB(node_map, node_x, node_y); tmp != NULL;
-                    tmp = tmp->above) {
-                if (tmp->type == EXIT) {
-                    m = exit_get_destination(tmp, &nx, &ny, true);
-
-                    /* Do not enter exits that have worse z distance than the
-                     * current node. */
-                    if (m != NULL && get_rangevector_from_mapcoords(m, node_x,
-                            node_y, goal.map, goal.x, goal.y, &rv,
-                            RV_RECURSIVE_SEARCH) && abs(rv.distance_z) <=
-                            node->distance_z) {
-                        node_map = m;
-                        node_x = nx;
-                        node_y = ny;
-
-                        /* Add exit flag to the node with the exit, to indicate
-                         * that the path user needs to use an exit on that tile
-                         * (possibly having to apply it, in case it's not a
-                         * portal or the like). */
-                        node->flags |= PATH_NODE_EXIT;
+        /* Close this tile. */
+        const path_snapshot_map_t *smap = &job->maps[node->map_id];
+        path_visited_get(ctx, smap, node->x, node->y, true)->closed = true;
 
-                        /* Close the tile that the exit leads to. */
-                        PATHFINDING_SET_CLOSED(node_map, node_x, node_y,
-                                traversal_id, visualizer);
+        int node_map = node->map_id;
+        int node_x = node->x;
+        int node_y = node->y;
 
-                        break;
-                    }
+        if (smap->flags[node_y * smap->width + node_x] & PATH_TILE_EXIT) {
+            for (size_t i = 0; i < smap->exits_num; i++) {
+                const path_snapshot_exit_t *exit = &smap->exits[i];
+                if (exit->x != node_x || exit->y != node_y) {
+                    continue;
+                }
+
+                /* Do not enter exits that have worse z distance than the
+                 * current node. */
+                if (abs(goal->offset_z - job->maps[exit->map].offset_z) >
+                    node->distance_z) {
+                    continue;
                 }
+
+                node_map = exit->map;
+                node_x = exit->dest_x;
+                node_y = exit->dest_y;
+                node->flags |= PATH_NODE_EXIT;
+
+                /* Close the tile that the exit leads to. */
+                path_visited_get(ctx,
+                                 &job->maps[node_map],
+                                 node_x,
+                                 node_y,
+                                 true)->closed = true;
+                break;
             }
         }
 
-        for (i = 1; i <= SIZEOFFREE1; i++) {
-            nx = node_x + freearr_x[i];
-            ny = node_y + freearr_y[i];
-            is_diagonal = nx != node_x && ny != node_y;
-
-            m = get_map_from_coord(node_map, &nx, &ny);
+        for (int i = 1; i <= SIZEOFFREE1; i++) {
+            int nx = node_x + freearr_x[i];
+            int ny = node_y + freearr_y[i];
+            bool is_diagonal = nx != node_x && ny != node_y;
 
-            if (m == NULL) {
+            int m = path_snapshot_get_map(job, node_map, &nx, &ny);
+            if (m == -1) {
                 continue;
             }
 
-            /* Skip closed tiles. */
-            if (PATHFINDING_QUERY_CLOSED(m, nx, ny, traversal_id)) {
-                continue;
-            }
+            const path_snapshot_map_t *tiled = &job->maps[m];
+            path_visited_t *visited = path_visited_get(ctx,
+                                                       tiled,
+                                                       nx,
+                                                       ny,
+                                                       false);
 
-            /* Skip blocked tiles. */
-            if (tile_is_blocked(op, m, nx, ny) != 0) {
+            /* Skip closed tiles. */
+            if (visited != NULL && visited->closed) {
                 continue;
             }
 
-            /* If the object can't use secret passages and they're a player or a
-             * that is not chasing an enemy, and this tile is a secret passage,
-             * skip it. */
-            if (!(GET_MAP_FLAGS(m, nx, ny) & P_DOOR_CLOSED) &&
-                    (op->type != PLAYER || !CONTR(op)->tcl) &&
-                    !(op->behavior & BEHAVIOR_SECRET_PASSAGES) &&
-                    (op->type == PLAYER || !OBJECT_VALID(op->enemy,
-                    op->enemy_count)) && blocks_view(m, nx, ny)) {
+            /* Skip blocked tiles and secret passages. */
+            size_t tile = ny * tiled->width + nx;
+            if (tiled->flags[tile] & PATH_TILE_AVOID ||
+                path_snapshot_is_blocked(job, m, nx, ny)) {
                 continue;
             }
 
-            /* Calculate the cost. */
-            cost = node->cost + (is_diagonal ? PATH_COST_DIAG : PATH_COST);
-            cost += GET_MAP_MOVE_FLAGS(m, nx, ny) * 0.001;
+            double cost = node->cost + (is_diagonal ? PATH_COST_DIAG :
+                                        PATH_COST);
+            cost += tiled->cost[tile];
 
-            if (op->behavior & BEHAVIOR_STEALTH) {
-                cost += GET_MAP_LIGHT(m, nx, ny) * 0.001;
-            }
+            path_node_t *new_node;
+            if (visited != NULL && visited->node != NULL) {
+                new_node = visited->node;
 
-            /* Get the visited path node on this tile, if any. */
-            visited = PATHFINDING_NODE_GET(m, nx, ny, traversal_id);
+                if (cost >= new_node->cost || new_node->heap_index == -1) {
+                    continue;
+                }
 
-            /* If we have visited this node previously, and the cost is not any
-             * better, skip it. */
-            if (visited != NULL && cost >= visited->cost) {
-                continue;
-            }
+                new_node->cost = cost;
+                new_node->parent = node;
+                path_node_update_sum(ctx, new_node);
+                path_heap_sift_up(ctx, new_node->heap_index);
+            } else {
+                new_node = path_snapshot_node_new(ctx,
+                                                  job,
+                                                  m,
+                                                  nx,
+                                                  ny,
+                                                  cost,
+                                                  node);
+                if (new_node == NULL) {
+                    continue;
+                }
 
-            if (visited != NULL) {
-                /* Remove previously visited node from the open list. */
-                path_node_remove(visited, &open_list);
+                path_heap_push(ctx, new_node);
 
-                if (visited == best) {
-                    best = NULL;
+                if (visited == NULL) {
+                    visited = path_visited_get(ctx, tiled, nx, ny, true);
                 }
-            } else {
-#if TIME_PATHFINDING
-                searched++;
-#endif
-            }
 
-            new_node = path_node_new(m, nx, ny, cost, &start, &goal, node);
-
-            if (new_node == NULL) {
-                continue;
+                visited->node = new_node;
             }
 
-            path_node_insert_priority(new_node, &open_list);
-            PATHFINDING_NODE_SET(m, nx, ny, traversal_id, new_node, visualizer);
-
-            if (best == NULL || new_node->sum < best->sum) {
+            if (new_node->sum < best->sum) {
                 best = new_node;
             }
         }
     }
 
-    if (found_path == NULL) {
-        for (node = best; node != NULL; node = node->parent) {
-            path_node_insert(node, &found_path);
-        }
-    }
+    job->complete = found != NULL;
 
-#if TIME_PATHFINDING
-    TIMER_UPDATE(1);
-    LOG(DEVEL, "Pathfinding took %f seconds (searched %d nodes)",
-            TIMER_GET(1), searched);
-#endif
+    if (found == NULL) {
+        found = best;
+    }
 
-#if VISUALIZE_PATHFINDING
-    {
-        char path[HUGE_BUF];
-        FILE *fp;
+    for (node = found; node != NULL; node = node->parent) {
+        job->path_num++;
+    }
 
-        snprintf(path, sizeof(path), "%s/pathfinding/%u.json",
-                settings.datapath, traversal_id);
-        path_ensure_directories(path);
+    job->path = emalloc(sizeof(*job->path) * job->path_num);
 
-        fp = fopen(path, "w");
+    size_t idx = job->path_num;
+    for (node = found; node != NULL; node = node->parent) {
+        path_job_node_t *job_node = &job->path[--idx];
+        job_node->map = node->map_id;
+        job_node->x = node->x;
+        job_node->y = node->y;
+        job_node->flags = node->flags;
+    }
+}
 
-        if (fp == NULL) {
-            LOG(BUG, "Could not open %s for writing.", path);
-        } else {
-            path_visualization_t *visualization, *curr, *tmp;
-            path_visualizer_t *visualizer_node, *visualizer_node_tmp;
-            StringBuffer *sb;
-            char *cp;
+/**
+ * Pathfinding worker thread.
+ *
+ * @param arg
+ * Unused.
+ * @return
+ * NULL.
+ */
+static void *
+path_worker_thread (void *arg)
+{
+    path_context_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
 
-            visualization = NULL;
-            path_visualize(&visualization, visualizer);
+    pthread_mutex_lock(&pathfinder_mutex);
 
-            fprintf(fp, "{\"start\": {\"map\": \"%s\", \"x\": %d, \"y\": %d},\n"
-                    "\"goal\": {\"map\": \"%s\", \"x\": %d, \"y\": %d},\n"
-                    "\"nodes\": {\n", start.map->path, start.x, start.y,
-                    goal.map->path, goal.x, goal.y);
+    while (!pathfinder_threads_stop) {
+        path_job_t *job = pathfinder_jobs;
+        if (job == NULL) {
+            pthread_cond_wait(&pathfinder_cond, &pathfinder_mutex);
+            continue;
+        }
 
-            HASH_ITER(hh, visualization, curr, tmp)
-            {
-                m = has_been_loaded_sh(curr->path);
-                fprintf(fp, "\"%s\": {\"walked\": [\n", m->path);
+        DL_DELETE(pathfinder_jobs, job);
+        pthread_mutex_unlock(&pathfinder_mutex);
 
-                DL_FOREACH_SAFE(curr->nodes, visualizer_node,
-                        visualizer_node_tmp)
-                {
-                    fprintf(fp, "{\"id\": %u, \"x\": %d, \"y\": %d, "
-                            "\"closed\": %s, \"exit\": %s", visualizer_node->id,
-                            visualizer_node->x, visualizer_node->y,
-                            visualizer_node->closed ? "true" : "false",
-                            GET_MAP_FLAGS(m, visualizer_node->x,
-                            visualizer_node->y) & P_IS_EXIT ? "true" : "false");
+        path_job_run(&ctx, job);
 
-                    if (visualizer_node->node == NULL) {
-                        fprintf(fp, ", \"cost\": NaN, \"heuristic\": NaN, "
-                                "\"sum\": NaN");
-                    } else {
-                        fprintf(fp, ", \"cost\": %f, \"heuristic\": %f, "
-                                "\"sum\": %f", visualizer_node->node->cost,
-                                visualizer_node->node->heuristic,
-                                visualizer_node->node->sum);
-                    }
+        pthread_mutex_lock(&pathfinder_mutex);
+        DL_APPEND(pathfinder_results, job);
+    }
 
-                    fprintf(fp, "}");
+    pthread_mutex_unlock(&pathfinder_mutex);
+    path_context_free(&ctx);
 
-                    if (visualizer_node_tmp != NULL) {
-                        fprintf(fp, ",");
-                    }
+    return NULL;
+}
 
-                    fprintf(fp, "\n");
+/**
+ * Start the pathfinding worker threads.
+ */
+static void
+path_threads_start (void)
+{
+    pathfinder_threads_started = true;
+
+    for (size_t i = 0; i < pathfinder_threads_wanted; i++) {
+        int rc = pthread_create(&pathfinder_threads[i],
+                                NULL,
+                                path_worker_thread,
+                                NULL);
+        if (rc != 0) {
+            LOG(ERROR, "Failed to create thread: %s (%d)", strerror(rc), rc);
+            break;
+        }
 
-                    DL_DELETE(curr->nodes, visualizer_node);
-                    efree(visualizer_node);
-                }
+        pathfinder_threads_num++;
+    }
+}
 
-                sb = stringbuffer_new();
+/**
+ * Queue a path computation for a waypoint on the pathfinding worker threads.
+ *
+ * A snapshot of the loaded maps around the start and goal positions is
+ * taken, and the search runs on that. The result can be acquired with
+ * path_get_next_result().
+ *
+ * @param waypoint
+ * Waypoint the path is for.
+ * @param op
+ * Object to find the path for.
+ * @param map1
+ * From map.
+ * @param x
+ * From X position.
+ * @param y
+ * From Y position.
+ * @param map2
+ * To map.
+ * @param x2
+ * To X position.
+ * @param y2
+ * To Y position.
+ * @return
+ * True if the computation was queued, false if the path should be computed
+ * with path_find() instead.
+ */
+bool
+path_find_async (object    *waypoint,
+                 object    *op,
+                 mapstruct *map1,
+                 int        x,
+                 int        y,
+                 mapstruct *map2,
+                 int        x2,
+                 int        y2)
+{
+    HARD_ASSERT(waypoint != NULL);
+    HARD_ASSERT(op != NULL);
+    HARD_ASSERT(map1 != NULL);
+    HARD_ASSERT(map2 != NULL);
 
-                for (x = 0; x < m->width; x++) {
-                    for (y = 0; y < m->height; y++) {
-                        if (!tile_is_blocked(op, m, x, y)) {
-                            continue;
-                        }
+    if (!pathfinder_threads_started) {
+        path_threads_start();
+    }
 
-                        if (stringbuffer_length(sb) != 0) {
-                            stringbuffer_append_char(sb, ',');
-                        }
+    /* Paths to maps further away are planned with the hierarchical
+     * search, which is cheap enough to do on the main thread. */
+    if (pathfinder_threads_num == 0 || op->type == PLAYER ||
+        path_use_hierarchy(map1, map2)) {
+        return false;
+    }
 
-                        stringbuffer_append_printf(sb, "\n{\"x\": %d, "
-                                "\"y\": %d}", x, y);
-                    }
-                }
+    rv_vector rv;
+    if (!get_rangevector_from_mapcoords(map1,
+                                        x,
+                                        y,
+                                        map2,
+                                        x2,
+                                        y2,
+                                        &rv,
+                                        RV_RECURSIVE_SEARCH | RV_NO_LOAD |
+                                        RV_NO_DISTANCE) ||
+        (rv.distance_z == 0 &&
+         MAX(abs(rv.distance_x), abs(rv.distance_y)) <=
+         PATHFINDER_INLINE_DISTANCE)) {
+        return false;
+    }
 
-                cp = stringbuffer_finish(sb);
-                fprintf(fp, "],\n\"walls\": [%s\n]}%s\n", cp,
-                        tmp != NULL ? "," : "");
-                efree(cp);
+    path_job_t *job = path_job_create(op, map1, x, y, map2, x2, y2);
+    if (job == NULL) {
+        return false;
+    }
 
-                HASH_DEL(visualization, curr);
-                FREE_ONLY_HASH(curr->path);
-                efree(curr);
-            }
+    job->waypoint = waypoint;
+    job->wp_count = waypoint->count;
+    job->algo = path_algo;
+    job->greed = path_greed;
 
-            fprintf(fp, "},\n\"path\": [\n");
+    /* Don't accept new requests for the waypoint until the result is in. */
+    SET_FLAG(waypoint, FLAG_WP_PATH_REQUESTED);
 
-            for (node = found_path; node != NULL; node = node->next) {
-                m = NULL;
+    pthread_mutex_lock(&pathfinder_mutex);
+    DL_APPEND(pathfinder_jobs, job);
+    pthread_cond_signal(&pathfinder_cond);
+    pthread_mutex_unlock(&pathfinder_mutex);
 
-                if (node->flags & PATH_NODE_EXIT) {
-                    object *exit;
+    return true;
+}
 
-                    for (exit = GET_MAP_OB(node->map, node->x, node->y);
-                            exit != NULL; exit = exit->above) {
-                        if (exit->type == EXIT) {
-                            m = exit_get_destination(exit, &nx, &ny, true);
-                        }
-                    }
-                }
+/**
+ * Convert the result of a pathfinding job into a path on the live maps.
+ *
+ * @param job
+ * Pathfinding job.
+ * @return
+ * The path, NULL if the maps of the path are no longer loaded.
+ */
+static path_node_t *
+path_job_get_path (path_job_t *job)
+{
+    mapstruct *maps[PATHFINDER_SNAPSHOT_MAPS];
+    memset(maps, 0, sizeof(maps));
 
-                fprintf(fp, "{\"map\": \"%s\", \"x\": %d, \"y\": %d, "
-                        "\"flags\": %d}%s\n", node->map->path, node->x, node->y,
-                        node->flags, node->next != NULL || m != NULL ? "," :
-                            "");
+    path_search_start(&pathfinder_context, path_algo, path_greed);
+    path_node_t *path = NULL;
 
-                if (m != NULL) {
-                    fprintf(fp, "{\"map\": \"%s\", \"x\": %d, \"y\": %d}%s\n",
-                            m->path, nx, ny, node->next != NULL ? "," : "");
+    for (size_t i = job->path_num; i-- > 0; ) {
+        path_job_node_t *job_node = &job->path[i];
 
-                }
+        if (maps[job_node->map] == NULL) {
+            mapstruct *m = has_been_loaded_sh(job->maps[job_node->map].path);
+            if (m == NULL || m->in_memory != MAP_IN_MEMORY) {
+                return NULL;
             }
 
-            fprintf(fp, "],\n\"time_taken\": ");
+            maps[job_node->map] = m;
+        }
 
-#if TIME_PATHFINDING
-            fprintf(fp, "%f", TIMER_GET(1));
-#else
-            fprintf(fp, "NaN");
-#endif
+        if (OUT_OF_MAP(maps[job_node->map], job_node->x, job_node->y)) {
+            return NULL;
+        }
 
-            fprintf(fp, ",\n\"num_searched\": ");
+        path_node_t *node = path_node_alloc(&pathfinder_context);
+        if (node == NULL) {
+            return NULL;
+        }
 
-#if TIME_PATHFINDING
-            fprintf(fp, "%d", searched);
-#else
-            fprintf(fp, "NaN");
-#endif
+        node->map = maps[job_node->map];
+        node->x = job_node->x;
+        node->y = job_node->y;
+        node->flags = job_node->flags;
+        path_node_insert(node, &path);
+    }
 
-            fprintf(fp, "\n}\n");
+    return path;
+}
 
-            fclose(fp);
+/**
+ * Get the next waypoint whose path has been computed by the pathfinding
+ * worker threads.
+ *
+ * @param[out] path
+ * Will contain the path. If NULL, the path could not be computed from the
+ * snapshot, and it should be computed with path_find() instead.
+ * @return
+ * Waypoint, NULL if there isn't any left.
+ */
+object *
+path_get_next_result (path_node_t **path)
+{
+    HARD_ASSERT(path != NULL);
 
-            LOG(DEVEL, "Generated pathfinding visualization for '%s': %s",
-                    op->name, path);
+    for ( ; ; ) {
+        pthread_mutex_lock(&pathfinder_mutex);
+        path_job_t *job = pathfinder_results;
+        if (job != NULL) {
+            DL_DELETE(pathfinder_results, job);
         }
-    }
-#endif
+        pthread_mutex_unlock(&pathfinder_mutex);
 
-    return found_path;
+        if (job == NULL) {
+            return NULL;
+        }
+
+        object *waypoint = job->waypoint;
+        if (!path_request_is_valid(waypoint, job->wp_count)) {
+            path_job_free(job);
+            continue;
+        }
+
+        CLEAR_FLAG(waypoint, FLAG_WP_PATH_REQUESTED);
+
+        /* Only use paths that reach the goal; otherwise, the goal may be
+         * behind maps that were not loaded at the time of the snapshot. */
+        if (job->complete) {
+            *path = path_job_get_path(job);
+        } else {
+            *path = NULL;
+        }
+
+        path_job_free(job);
+        return waypoint;
+    }
 }
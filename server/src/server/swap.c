@@ -25,12 +25,520 @@
 /**
  * @file
  * Controls map swap functions.
+ *
+ * Maps being swapped out and player files being saved are serialized into
+ * memory on the main thread, and the resulting files are written to disk
+ * by a separate writer thread, so that the disk I/O does not stall the
+ * game tick. Until a file has been written, swap_open() reads it from the
+ * pending data. Queueing a file that is already queued supersedes the
+ * earlier write, so that only the latest contents get written.
+ *
+ * On platforms without memory streams (see swap_memstream()) the files are
+ * written synchronously instead.
+ *
+ * If the writer thread fails to write a file, the main thread retries the
+ * write synchronously when it frees the finished writes. If that fails as
+ * well, the failure is logged and the player the file belongs to, if any,
+ * is told about it.
  */
 
 #include <global.h>
 #include <toolkit/string.h>
+#include <toolkit/path.h>
+#include <player.h>
 #include <plugin.h>
 
+/**
+ * A file write queued on the swap writer thread.
+ */
+typedef struct swap_write {
+    struct swap_write *next; ///< Next write.
+    struct swap_write *prev; ///< Previous write.
+
+    char *path; ///< Path of the file to write.
+
+    /**
+     * Contents of the file, allocated with malloc(). If NULL, the file is
+     * removed instead.
+     */
+    char *data;
+
+    size_t len; ///< Length of ::data.
+    int mode; ///< Permissions of the file.
+
+    /**
+     * Name of the player the file belongs to, to notify if the write
+     * fails; NULL for other files.
+     */
+    char *player_name;
+
+    bool failed; ///< Whether the write failed.
+
+    /**
+     * If set, the write is no longer wanted, either because it has been
+     * cancelled or superseded by a later write; the file is left alone.
+     */
+    bool cancelled;
+} swap_write_t;
+
+/**
+ * The writer thread.
+ */
+static pthread_t swap_thread;
+/**
+ * Whether the writer thread is running.
+ */
+static bool swap_thread_started = false;
+/**
+ * Whether the writer thread should stop once it has written all the queued
+ * files.
+ */
+static bool swap_thread_stop = false;
+/**
+ * Lock for ::swap_queue, ::swap_done, ::swap_thread_stop and the
+ * swap_write_t::cancelled and swap_write_t::failed flags. Also held while the writer thread renames a
+ * written file into place.
+ */
+static pthread_mutex_t swap_mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Signalled when a write is queued or the writer thread should stop.
+ */
+static pthread_cond_t swap_cond = PTHREAD_COND_INITIALIZER;
+/**
+ * Signalled when the writer thread has finished a write.
+ */
+static pthread_cond_t swap_done_cond = PTHREAD_COND_INITIALIZER;
+/**
+ * Writes waiting to be done. The head of the list is the one being written
+ * by the writer thread.
+ */
+static swap_write_t *swap_queue = NULL;
+/**
+ * Writes done by the writer thread, to be freed by the main thread.
+ */
+static swap_write_t *swap_done = NULL;
+
+/**
+ * Free a swap write.
+ * @param job
+ * The write to free.
+ */
+static void swap_write_free(swap_write_t *job)
+{
+    efree(job->path);
+    /* Allocated by swap_memstream(). */
+    free(job->data);
+
+    if (job->player_name != NULL) {
+        efree(job->player_name);
+    }
+
+    efree(job);
+}
+
+/**
+ * Opens a stream that serializes a file into memory, to be queued with
+ * swap_write_file() once it has been closed.
+ * @param[out] data
+ * Will contain the contents once the stream is closed; must be freed with
+ * free().
+ * @param[out] len
+ * Will contain the length of the contents.
+ * @return
+ * The stream, NULL if files can't be serialized into memory on this
+ * platform, in which case they should be written synchronously.
+ */
+FILE *swap_memstream(char **data, size_t *len)
+{
+    HARD_ASSERT(data != NULL);
+    HARD_ASSERT(len != NULL);
+
+#ifdef HAVE_OPEN_MEMSTREAM
+    FILE *fp = open_memstream(data, len);
+
+    if (fp == NULL) {
+        LOG(ERROR, "Failed to open memory stream: %d (%s)", errno,
+                strerror(errno));
+    }
+
+    return fp;
+#else
+    *data = NULL;
+    *len = 0;
+    return NULL;
+#endif
+}
+
+/**
+ * Writes a file to disk. The contents are written to a temporary file
+ * first, which is then renamed over the destination.
+ * @param job
+ * The write to do.
+ * @return
+ * False if writing the file failed, true otherwise.
+ */
+static bool swap_write_do(swap_write_t *job)
+{
+    char path[HUGE_BUF];
+    FILE *fp;
+    bool ok;
+
+    pthread_mutex_lock(&swap_mutex);
+    ok = !job->cancelled;
+    pthread_mutex_unlock(&swap_mutex);
+
+    if (!ok) {
+        return true;
+    }
+
+    if (job->data == NULL) {
+        pthread_mutex_lock(&swap_mutex);
+
+        if (!job->cancelled) {
+            unlink(job->path);
+        }
+
+        pthread_mutex_unlock(&swap_mutex);
+        return true;
+    }
+
+    snprintf(VS(path), "%s.swp", job->path);
+    fp = fopen(path, "w");
+
+    if (fp == NULL) {
+        LOG(ERROR, "Can't open file %s for saving: %d (%s)", path, errno,
+                strerror(errno));
+        return false;
+    }
+
+    ok = fwrite(job->data, 1, job->len, fp) == job->len;
+    ok = fflush(fp) == 0 && ok;
+    ok = fsync(fileno(fp)) == 0 && ok;
+
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+
+    if (!ok) {
+        LOG(ERROR, "Failed to write %s: %d (%s)", path, errno,
+                strerror(errno));
+        unlink(path);
+        return false;
+    }
+
+    chmod(path, job->mode);
+
+    pthread_mutex_lock(&swap_mutex);
+
+    if (job->cancelled) {
+        unlink(path);
+    } else if (path_rename(path, job->path) != 0) {
+        LOG(ERROR, "Failed to rename %s to %s: %d (%s)", path, job->path,
+                errno, strerror(errno));
+        unlink(path);
+        ok = false;
+    }
+
+    pthread_mutex_unlock(&swap_mutex);
+    return ok;
+}
+
+/**
+ * The writer thread.
+ * @param arg
+ * Unused.
+ * @return
+ * NULL.
+ */
+static void *swap_writer_thread(void *arg)
+{
+    pthread_mutex_lock(&swap_mutex);
+
+    while (true) {
+        swap_write_t *job = swap_queue;
+
+        if (job == NULL) {
+            if (swap_thread_stop) {
+                break;
+            }
+
+            pthread_cond_wait(&swap_cond, &swap_mutex);
+            continue;
+        }
+
+        pthread_mutex_unlock(&swap_mutex);
+        bool ok = swap_write_do(job);
+        pthread_mutex_lock(&swap_mutex);
+
+        job->failed = !ok;
+        DL_DELETE(swap_queue, job);
+        DL_APPEND(swap_done, job);
+        pthread_cond_broadcast(&swap_done_cond);
+    }
+
+    pthread_mutex_unlock(&swap_mutex);
+    return NULL;
+}
+
+/**
+ * Handles a write that the writer thread failed to do; the write is retried
+ * on the main thread, and if that fails as well, the player the file belongs
+ * to is told about it.
+ * @param job
+ * The failed write.
+ */
+static void swap_write_failed(swap_write_t *job)
+{
+    LOG(ERROR, "Writing %s failed, retrying.", job->path);
+
+    if (swap_write_do(job)) {
+        return;
+    }
+
+    LOG(ERROR, "Failed to write %s, the file was not saved.", job->path);
+
+    if (job->player_name != NULL) {
+        player *pl = find_player(job->player_name);
+
+        if (pl != NULL) {
+            draw_info(COLOR_RED, pl->ob, "Your character couldn't be saved.");
+        }
+    }
+}
+
+/**
+ * Free the writes that have been done by the writer thread, retrying the
+ * ones that failed. Must be called from the main thread.
+ */
+static void swap_write_reap(void)
+{
+    swap_write_t *done, *job, *tmp;
+
+    pthread_mutex_lock(&swap_mutex);
+    done = swap_done;
+    swap_done = NULL;
+    pthread_mutex_unlock(&swap_mutex);
+
+    DL_FOREACH_SAFE(done, job, tmp)
+    {
+        DL_DELETE(done, job);
+
+        /* Cancelled writes include those superseded by a later write of
+         * the same file. */
+        if (job->failed && !job->cancelled) {
+            swap_write_failed(job);
+        }
+
+        swap_write_free(job);
+    }
+}
+
+/**
+ * Queues a file to be written by the writer thread. Pending writes of the
+ * same file are superseded.
+ * @param path
+ * Path of the file.
+ * @param data
+ * Contents of the file, allocated with malloc(); the writer takes
+ * ownership of it. If NULL, the file is removed instead.
+ * @param len
+ * Length of the data.
+ * @param mode
+ * Permissions of the file.
+ * @param player_name
+ * Name of the player the file belongs to, who is told if writing the
+ * file fails; NULL for other files.
+ */
+void swap_write_file(const char *path, char *data, size_t len, int mode,
+        const char *player_name)
+{
+    swap_write_t *job, *tmp;
+
+    HARD_ASSERT(path != NULL);
+
+    job = ecalloc(1, sizeof(*job));
+    job->path = estrdup(path);
+    job->data = data;
+    job->len = len;
+    job->mode = mode;
+
+    if (player_name != NULL) {
+        job->player_name = estrdup(player_name);
+    }
+
+    if (!swap_thread_started) {
+        int rc = pthread_create(&swap_thread, NULL, swap_writer_thread, NULL);
+
+        if (rc != 0) {
+            LOG(ERROR, "Failed to create thread: %s (%d)", strerror(rc), rc);
+
+            if (!swap_write_do(job)) {
+                swap_write_failed(job);
+            }
+
+            swap_write_free(job);
+            return;
+        }
+
+        swap_thread_started = true;
+    }
+
+    pthread_mutex_lock(&swap_mutex);
+
+    DL_FOREACH(swap_queue, tmp)
+    {
+        if (strcmp(tmp->path, path) == 0) {
+            tmp->cancelled = true;
+        }
+    }
+
+    /* Failed writes of the file must not be retried over this one. */
+    DL_FOREACH(swap_done, tmp)
+    {
+        if (strcmp(tmp->path, path) == 0) {
+            tmp->cancelled = true;
+        }
+    }
+
+    DL_APPEND(swap_queue, job);
+    pthread_cond_signal(&swap_cond);
+    pthread_mutex_unlock(&swap_mutex);
+}
+
+/**
+ * Opens a file for reading, taking pending writes of the writer thread
+ * into account.
+ * @param path
+ * Path of the file.
+ * @return
+ * The file, NULL if it doesn't exist.
+ */
+FILE *swap_open(const char *path)
+{
+    swap_write_t *job, *found = NULL;
+
+    HARD_ASSERT(path != NULL);
+
+    /* Retry failed writes before the file is read. */
+    swap_write_reap();
+
+    pthread_mutex_lock(&swap_mutex);
+
+    /* The last queued write of the file is the one that ends up on disk. */
+    DL_FOREACH(swap_queue, job)
+    {
+        if (!job->cancelled && strcmp(job->path, path) == 0) {
+            found = job;
+        }
+    }
+
+    pthread_mutex_unlock(&swap_mutex);
+
+    /* Queued writes are only freed by the main thread, so the data stays
+     * valid while it is being read. */
+    if (found != NULL) {
+        if (found->data == NULL) {
+            errno = ENOENT;
+            return NULL;
+        }
+
+#ifdef HAVE_FMEMOPEN
+        return fmemopen(found->data, found->len, "r");
+#else
+        swap_wait(path);
+#endif
+    }
+
+    return fopen(path, "rb");
+}
+
+/**
+ * Cancels pending writes of the specified file. The file will not be
+ * touched by the writer thread after this returns.
+ * @param path
+ * Path of the file.
+ */
+void swap_cancel(const char *path)
+{
+    swap_write_t *job;
+
+    HARD_ASSERT(path != NULL);
+
+    pthread_mutex_lock(&swap_mutex);
+
+    DL_FOREACH(swap_queue, job)
+    {
+        if (strcmp(job->path, path) == 0) {
+            job->cancelled = true;
+        }
+    }
+
+    DL_FOREACH(swap_done, job)
+    {
+        if (strcmp(job->path, path) == 0) {
+            job->cancelled = true;
+        }
+    }
+
+    pthread_mutex_unlock(&swap_mutex);
+}
+
+/**
+ * Waits until the pending writes of the specified file have been written
+ * to disk, so that the file can be opened directly.
+ * @param path
+ * Path of the file.
+ */
+void swap_wait(const char *path)
+{
+    HARD_ASSERT(path != NULL);
+
+    pthread_mutex_lock(&swap_mutex);
+
+    while (true) {
+        swap_write_t *job;
+        bool pending = false;
+
+        DL_FOREACH(swap_queue, job)
+        {
+            if (!job->cancelled && strcmp(job->path, path) == 0) {
+                pending = true;
+                break;
+            }
+        }
+
+        if (!pending) {
+            break;
+        }
+
+        pthread_cond_wait(&swap_done_cond, &swap_mutex);
+    }
+
+    pthread_mutex_unlock(&swap_mutex);
+
+    /* Retry failed writes of the file, if any. */
+    swap_write_reap();
+}
+
+/**
+ * Writes all the pending files and stops the writer thread.
+ */
+void swap_deinit(void)
+{
+    if (swap_thread_started) {
+        pthread_mutex_lock(&swap_mutex);
+        swap_thread_stop = true;
+        pthread_cond_signal(&swap_cond);
+        pthread_mutex_unlock(&swap_mutex);
+
+        pthread_join(swap_thread, NULL);
+        swap_thread_started = false;
+        swap_thread_stop = false;
+    }
+
+    swap_write_reap();
+}
+
 /**
  * Write maps log.
  */
@@ -159,7 +667,7 @@ void swap_map(mapstruct *map, int force_flag)
         return;
     }
 
-    if (new_save_map(map, 0) == -1) {
+    if (new_save_map_async(map) == -1) {
         LOG(BUG, "Failed to swap map %s.", map->path);
         /* Need to reset the in_memory flag so that delete map will also
          * free the objects with it. */
@@ -177,6 +685,8 @@ void check_active_maps(void)
 {
     mapstruct *map, *tmp;
 
+    swap_write_reap();
+
     DL_FOREACH_SAFE(first_map, map, tmp)
     {
         if (map->in_memory != MAP_IN_MEMORY) {
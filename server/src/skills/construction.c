@@ -395,6 +395,8 @@ static void fix_walls(mapstruct *map, int x, int y)
     for (flag = 0; flag < NUM_FLAGS_32; flag++) {
         wall_ob->flags[flag] = old_flags[flag];
     }
+
+    object_update(wall_ob, UP_OBJ_FLAGS);
 }
 
 /**
@@ -531,6 +533,7 @@ static int builder_window(object *op, int x, int y)
     }
 
     CLEAR_FLAG(window, FLAG_BLOCKSVIEW);
+    object_update(window, UP_OBJ_FLAGS);
     draw_info(COLOR_WHITE, op, "You build a window in the wall.");
     return 1;
 }
@@ -46,6 +46,12 @@ typedef struct FaceInfo {
 
     /** Checksum of face data */
     uint32_t checksum;
+
+    /**
+     * Packet with the face data, built on the first request and shared
+     * by all the requests of the face.
+     */
+    packet_struct *packet;
 } FaceInfo;
 
 /** Face sets structure. */
@@ -101,6 +107,10 @@ void free_socket_images(void)
                 if (facesets[num].faces[q].data) {
                     efree(facesets[num].faces[q].data);
                 }
+
+                if (facesets[num].faces[q].packet != NULL) {
+                    packet_free(facesets[num].faces[q].packet);
+                }
             }
 
             efree(facesets[num].prefix);
@@ -241,7 +251,7 @@ void socket_command_ask_face(socket_struct *ns, player *pl, uint8_t *data,
         size_t len, size_t pos)
 {
     uint16_t facenum;
-    packet_struct *packet;
+    FaceInfo *face;
 
     facenum = packet_to_uint16(data, len, &pos);
 
@@ -250,15 +260,20 @@ void socket_command_ask_face(socket_struct *ns, player *pl, uint8_t *data,
         return;
     }
 
-    packet = packet_new(CLIENT_CMD_IMAGE, 16, 0);
-    packet_debug_data(packet, 0, "Face ID");
-    packet_append_uint32(packet, facenum);
-    packet_debug_data(packet, 0, "Face size");
-    packet_append_uint32(packet, facesets[0].faces[facenum].datalen);
-    packet_debug_data(packet, 0, "Face data");
-    packet_append_data_len(packet, facesets[0].faces[facenum].data,
-            facesets[0].faces[facenum].datalen);
-    socket_send_packet(ns, packet);
+    face = &facesets[0].faces[facenum];
+
+    if (face->packet == NULL) {
+        face->packet = packet_new(CLIENT_CMD_IMAGE, 8 + face->datalen, 0);
+        packet_debug_data(face->packet, 0, "Face ID");
+        packet_append_uint32(face->packet, facenum);
+        packet_debug_data(face->packet, 0, "Face size");
+        packet_append_uint32(face->packet, face->datalen);
+        packet_debug_data(face->packet, 0, "Face data");
+        packet_append_data_len(face->packet, face->data, face->datalen);
+        packet_precompress(face->packet);
+    }
+
+    socket_send_packet(ns, packet_share(face->packet));
 }
 
 /**
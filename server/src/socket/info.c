@@ -47,8 +47,21 @@
     vsnprintf(buf, sizeof(buf), format, ap); \
     va_end(ap);
 
-void draw_info_send(uint8_t type, const char *name, const char *color,
-        socket_struct *ns, const char *buf)
+/**
+ * Construct a packet with a message to draw in the client's text windows.
+ * @param type
+ * One of @ref CHAT_TYPE_xxx.
+ * @param name
+ * Name of the message's sender, can be NULL.
+ * @param color
+ * Color of the message.
+ * @param buf
+ * The message.
+ * @return
+ * The packet.
+ */
+static packet_struct *draw_info_packet(uint8_t type, const char *name,
+        const char *color, const char *buf)
 {
     packet_struct *packet;
 
@@ -68,7 +81,45 @@ void draw_info_send(uint8_t type, const char *name, const char *color,
     }
 
     packet_append_string_terminated(packet, buf);
-    socket_send_packet(ns, packet);
+
+    return packet;
+}
+
+void draw_info_send(uint8_t type, const char *name, const char *color,
+        socket_struct *ns, const char *buf)
+{
+    socket_send_packet(ns, draw_info_packet(type, name, color, buf));
+}
+
+/**
+ * Like draw_info_type(), but for messages drawn to many players: the
+ * packet is only constructed once, and shared by all the players.
+ * @param[in,out] packet
+ * The shared packet; constructed on first use, and must be freed by the
+ * caller.
+ * @param type
+ * One of @ref CHAT_TYPE_xxx.
+ * @param name
+ * Name of the message's sender, can be NULL.
+ * @param color
+ * Color of the message.
+ * @param pl
+ * The player object to write the message to.
+ * @param buf
+ * The message.
+ */
+static void draw_info_shared(packet_struct **packet, uint8_t type,
+        const char *name, const char *color, object *pl, const char *buf)
+{
+    if (pl->type != PLAYER || CONTR(pl)->cs->state != ST_PLAYING) {
+        return;
+    }
+
+    if (*packet == NULL) {
+        *packet = draw_info_packet(type, name, color, buf);
+    }
+
+    socket_send_packet(CONTR(pl)->cs, packet_share(*packet));
 }
 
 /**
@@ -87,9 +138,14 @@ void draw_info_full(uint8_t type, const char *name, const char *color, StringBuf
     /* Handle global messages. */
     if (!pl) {
         player *tmppl;
+        packet_struct *packet = NULL;
 
         for (tmppl = first_player; tmppl; tmppl = tmppl->next) {
-            draw_info_full(type, name, color, NULL, tmppl->ob, buf);
+            draw_info_shared(&packet, type, name, color, tmppl->ob, buf);
+        }
+
+        if (packet != NULL) {
+            packet_free(packet);
         }
 
         return;
@@ -150,9 +206,10 @@ void draw_info_format(const char *color, object *pl, const char *format, ...)
     draw_info_full(CHAT_TYPE_GAME, NULL, color, NULL, pl, buf);
 }
 
-static int draw_info_map_internal(mapstruct *tiled, mapstruct *map, uint8_t type,
-        const char *name, const char *color, object *op, object *op2,
-        const char *buf, int dist, int x, int y)
+static int draw_info_map_internal(mapstruct *tiled, mapstruct *map,
+        packet_struct **packet, uint8_t type, const char *name,
+        const char *color, object *op, object *op2, const char *buf, int dist,
+        int x, int y)
 {
     object *pl;
     rv_vector rv;
@@ -161,7 +218,7 @@ static int draw_info_map_internal(mapstruct *tiled, mapstruct *map, uint8_t type
         if (pl != op && pl != op2 && get_rangevector_from_mapcoords(map, x, y,
                 pl->map, pl->x, pl->y, &rv, RV_NO_DISTANCE) &&
                 POW2(rv.distance_x) + POW2(rv.distance_y) <= dist) {
-            draw_info_type(type, name, color, pl, buf);
+            draw_info_shared(packet, type, name, color, pl, buf);
         }
     }
 
@@ -195,28 +252,33 @@ static int draw_info_map_internal(mapstruct *tiled, mapstruct *map, uint8_t type
 void draw_info_map(uint8_t type, const char *name, const char *color, mapstruct *map, int x, int y, int dist, object *op, object *op2, const char *buf)
 {
     int distance;
+    packet_struct *packet;
 
     if (!map || map->in_memory != MAP_IN_MEMORY) {
         return;
     }
 
+    packet = NULL;
+
     if (dist == MAP_INFO_ALL) {
         object *pl;
 
         for (pl = map->player_first; pl; pl = CONTR(pl)->map_above) {
             if (pl != op && pl != op2) {
-                draw_info_type(type, name, color, pl, buf);
+                draw_info_shared(&packet, type, name, color, pl, buf);
             }
         }
+    } else {
+        distance = POW2(dist);
 
-        return;
+        MAP_TILES_WALK_START(map, draw_info_map_internal, &packet, type,
+                name, color, op, op2, buf, distance, x, y)
+        {
+        }
+        MAP_TILES_WALK_END
     }
 
-    distance = POW2(dist);
-
-    MAP_TILES_WALK_START(map, draw_info_map_internal, type, name, color, op,
-            op2, buf, distance, x, y)
-    {
+    if (packet != NULL) {
+        packet_free(packet);
     }
-    MAP_TILES_WALK_END
 }
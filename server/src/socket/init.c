@@ -34,6 +34,7 @@
 #include <toolkit/string.h>
 #include <exp.h>
 #include <toolkit/path.h>
+#include <server.h>
 
 /** Socket information. */
 Socket_Info socket_info;
@@ -112,6 +113,7 @@ void free_all_newserver(void)
  */
 void free_newsocket(socket_struct *ns)
 {
+    socket_server_unwatch(ns);
     socket_destroy(ns->sc);
 
     if (ns->account) {
@@ -126,6 +128,10 @@ void free_newsocket(socket_struct *ns)
         packet_free(ns->packet_recv_cmd);
     }
 
+    if (ns->compressor != NULL) {
+        packet_compressor_free(ns->compressor);
+    }
+
     socket_buffer_clear(ns);
     efree(ns);
 }
@@ -32,6 +32,11 @@
 #include <toolkit/string.h>
 #include <toolkit/socket_crypto.h>
 
+/**
+ * Maximum number of queued packets to gather into a single write.
+ */
+#define SOCKET_BUFFER_IOV_MAX 64
+
 static void socket_packet_enqueue(socket_struct *ns, packet_struct *packet)
 {
 #ifndef DEBUG
@@ -81,38 +86,88 @@ void socket_buffer_clear(socket_struct *ns)
 }
 
 /**
- * Write data to socket.
+ * Write out as much of the socket's packet queue as the socket accepts.
+ *
+ * The queued packets are gathered into as few writes as possible, and
+ * TCP_NODELAY is toggled at most once per call if any of the packets
+ * requested it. Packets that were sent completely are released.
  * @param ns
  * The socket we are writing to.
+ * @return
+ * True if the whole queue was written out, false otherwise.
  */
-void socket_buffer_write(socket_struct *ns)
+bool socket_buffer_flush(socket_struct *ns)
 {
-    while (ns->packets != NULL) {
-        packet_struct *packet = ns->packets;
+    HARD_ASSERT(ns != NULL);
 
-        if (packet->ndelay) {
-            socket_opt_ndelay(ns->sc, true);
-        }
+    bool ndelay = false;
 
-        size_t amt;
-        bool success = socket_write(ns->sc, (const void *) (packet->data +
-                packet->pos), packet->len - packet->pos, &amt);
+    while (ns->packets != NULL) {
+        struct iovec iov[SOCKET_BUFFER_IOV_MAX];
+        int iovcnt = 0;
+        size_t len = 0;
+
+        packet_struct *packet;
+        DL_FOREACH(ns->packets, packet) {
+            if (iovcnt == SOCKET_BUFFER_IOV_MAX) {
+                break;
+            }
+
+            iov[iovcnt].iov_base = packet->data + packet->pos;
+            iov[iovcnt].iov_len = packet->len - packet->pos;
+            len += iov[iovcnt].iov_len;
+            iovcnt++;
 
-        if (packet->ndelay) {
-            socket_opt_ndelay(ns->sc, false);
+            if (packet->ndelay && !ndelay) {
+                socket_opt_ndelay(ns->sc, true);
+                ndelay = true;
+            }
         }
 
-        if (!success) {
+        size_t amt;
+        if (!socket_writev(ns->sc, iov, iovcnt, &amt)) {
             ns->state = ST_DEAD;
             break;
         }
 
-        packet->pos += amt;
+        /* Release the packets that were sent completely, and advance the
+         * position of the one that was sent partially, if any. */
+        for (size_t left = amt; left != 0; ) {
+            packet = ns->packets;
 
-        if (packet->len - packet->pos == 0) {
+            if (left < packet->len - packet->pos) {
+                packet->pos += left;
+                break;
+            }
+
+            left -= packet->len - packet->pos;
             DL_DELETE(ns->packets, packet);
             packet_free(packet);
         }
+
+        /* Failed to send everything; it's unlikely we can retry
+         * immediately, so just stop here. */
+        if (amt != len) {
+            break;
+        }
+    }
+
+    if (ndelay) {
+        socket_opt_ndelay(ns->sc, false);
+    }
+
+    return ns->packets == NULL;
+}
+
+/**
+ * Write data to socket, until the whole packet queue is written out or an
+ * error occurs.
+ * @param ns
+ * The socket we are writing to.
+ */
+void socket_buffer_write(socket_struct *ns)
+{
+    while (!socket_buffer_flush(ns) && ns->state != ST_DEAD) {
     }
 }
 
@@ -147,7 +202,15 @@ void socket_send_packet(socket_struct *ns, struct packet_struct *packet)
             return;
         }
     } else {
-        packet_compress(packet);
+        /* Precompressed data is sent as is, bypassing the stream. */
+        if (!packet_compress_cached(packet)) {
+            if (ns->compressor != NULL) {
+                packet_compress_stream(packet, ns->compressor);
+            } else {
+                packet_compress(packet);
+            }
+        }
+
         packet_append_uint16(packet_meta, (uint16_t) packet->len + 1);
         packet_append_uint8(packet_meta, packet->type);
     }
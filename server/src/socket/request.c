@@ -57,6 +57,7 @@ void socket_command_setup(socket_struct *ns, player *pl, uint8_t *data, size_t l
 {
     packet_struct *packet;
     uint8_t type;
+    bool compression = false;
 
     packet = packet_new(CLIENT_CMD_SETUP, 256, 256);
 
@@ -110,12 +111,27 @@ void socket_command_setup(socket_struct *ns, player *pl, uint8_t *data, size_t l
             } else {
                 packet_append_string_terminated(packet, settings.http_url);
             }
+        } else if (type == CMD_SETUP_COMPRESSION) {
+            /* Secure sockets are never compressed, as compressing data
+             * before encrypting it can leak its contents. */
+            compression = packet_to_uint8(data, len, &pos) == 1 &&
+                    ns->socket_version >= 1067 &&
+                    settings.compression_level != 0 &&
+                    ns->compressor == NULL && !socket_is_secure(ns->sc);
+            packet_debug_data(packet, 0, "Compression");
+            packet_append_uint8(packet, compression);
         } else {
             LOG(PACKET, "Unknown type: %d", type);
         }
     }
 
     socket_send_packet(ns, packet);
+
+    /* Only compress the packets that follow the setup reply, so that the
+     * client knows to expect them. */
+    if (compression) {
+        ns->compressor = packet_compressor_create(settings.compression_level);
+    }
 }
 
 void socket_command_player_cmd(socket_struct *ns, player *pl, uint8_t *data, size_t len, size_t pos)
@@ -869,7 +885,7 @@ void draw_client_map2(object *pl)
             /* Border tile, we can ignore every LOS change */
             if (!(d & BLOCKED_LOS_IGNORE)) {
                 /* Tile has blocksview set? */
-                if (msp->flags & P_BLOCKSVIEW) {
+                if (GET_MAP_FLAGS(m, nx, ny) & P_BLOCKSVIEW) {
                     if (!d) {
                         CONTR(pl)->update_los = 1;
                     }
@@ -897,61 +913,87 @@ void draw_client_map2(object *pl)
             uint8_t anim_type[NUM_SUB_LAYERS] = {0};
             int16_t anim_value[NUM_SUB_LAYERS] = {0};
 
-            /* Check if we have a map under this tile. */
-            if (get_map_from_tiled(m, TILED_DOWN) != NULL &&
-                    MAP_TILE_IS_SAME_LEVEL(m, -1)) {
-                have_down = 1;
-            }
-
             bool override_rendering = true;
             mapstruct *bottom_map = NULL;
             int bottom_map_depth = 0;
+            map_render_cache_t *render_cache;
+
+            /* The levels above and below the tile are the same for all the
+             * players that see it, so only walk them once per pass. */
+            if (map_render_cache_get(m, nx, ny, &render_cache)) {
+                have_down = render_cache->have_down;
+                override_rendering = render_cache->override_rendering;
+                zadj = render_cache->zadj;
+                bottom_map_depth = render_cache->bottom_map_depth;
+
+                for (tiled_depth = 0, bottom_map = m;
+                        tiled_depth > bottom_map_depth && bottom_map != NULL;
+                        tiled_depth--) {
+                    bottom_map = get_map_from_tiled(bottom_map, TILED_DOWN);
+                }
 
-            for (tiled_dir = TILED_DOWN; tiled_dir >= TILED_UP; tiled_dir--) {
-                tiled = m;
-                tiled_depth = 0;
+                if (bottom_map == m) {
+                    bottom_map = NULL;
+                }
+            } else {
+                /* Check if we have a map under this tile. */
+                if (get_map_from_tiled(m, TILED_DOWN) != NULL &&
+                        MAP_TILE_IS_SAME_LEVEL(m, -1)) {
+                    have_down = 1;
+                }
 
-                do {
-                    if (m != tiled) {
-                        tiled_depth += tiled_dir == TILED_UP ? 1 : -1;
+                for (tiled_dir = TILED_DOWN; tiled_dir >= TILED_UP;
+                        tiled_dir--) {
+                    tiled = m;
+                    tiled_depth = 0;
 
-                        if (!MAP_TILE_IS_SAME_LEVEL(m, tiled_depth)) {
-                            break;
-                        }
-                    }
+                    do {
+                        if (m != tiled) {
+                            tiled_depth += tiled_dir == TILED_UP ? 1 : -1;
 
-                    msp_tmp = GET_MAP_SPACE_PTR(tiled, nx, ny);
+                            if (!MAP_TILE_IS_SAME_LEVEL(m, tiled_depth)) {
+                                break;
+                            }
+                        }
 
-                    if (OBJECT_VALID(msp_tmp->map_info,
-                            msp_tmp->map_info_count) && msp_tmp->extra_flags &
-                            (MSP_EXTRA_IS_BUILDING | MSP_EXTRA_IS_BALCONY |
-                            MSP_EXTRA_IS_OVERLOOK)) {
-                        override_rendering = false;
-                    }
+                        msp_tmp = GET_MAP_SPACE_PTR(tiled, nx, ny);
 
-                    if (tiled_dir == TILED_DOWN) {
-                        if (m != tiled) {
-                            bottom_map = tiled;
-                            bottom_map_depth--;
+                        if (OBJECT_VALID(msp_tmp->map_info,
+                                msp_tmp->map_info_count) &&
+                                msp_tmp->extra_flags & (MSP_EXTRA_IS_BUILDING |
+                                MSP_EXTRA_IS_BALCONY | MSP_EXTRA_IS_OVERLOOK)) {
+                            override_rendering = false;
                         }
 
-                        for (sub_layer = 0; sub_layer < NUM_SUB_LAYERS;
-                                sub_layer++) {
-                            tmp = GET_MAP_OB_LAYER(tiled, nx, ny, LAYER_FLOOR,
-                                    sub_layer);
-
-                            if (tmp == NULL) {
-                                continue;
+                        if (tiled_dir == TILED_DOWN) {
+                            if (m != tiled) {
+                                bottom_map = tiled;
+                                bottom_map_depth--;
                             }
 
-                            if (tmp->z > zadj) {
-                                zadj = tmp->z;
+                            for (sub_layer = 0; sub_layer < NUM_SUB_LAYERS;
+                                    sub_layer++) {
+                                tmp = GET_MAP_OB_LAYER(tiled, nx, ny,
+                                        LAYER_FLOOR, sub_layer);
+
+                                if (tmp == NULL) {
+                                    continue;
+                                }
+
+                                if (tmp->z > zadj) {
+                                    zadj = tmp->z;
+                                }
                             }
                         }
-                    }
 
-                    tiled = get_map_from_tiled(tiled, tiled_dir);
-                } while (tiled != NULL);
+                        tiled = get_map_from_tiled(tiled, tiled_dir);
+                    } while (tiled != NULL);
+                }
+
+                render_cache->have_down = have_down;
+                render_cache->override_rendering = override_rendering;
+                render_cache->zadj = zadj;
+                render_cache->bottom_map_depth = bottom_map_depth;
             }
 
             if (override_rendering) {
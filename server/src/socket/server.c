@@ -57,6 +57,19 @@ TOOLKIT_API(DEPENDS(socket), IMPORTS(logger));
  */
 #define SOCKET_SERVER_PLAYER_MAX_COMMANDS 15
 
+/**
+ * Maximum number of events that are collected by a single epoll_wait()
+ * call. Sockets that don't fit are reported again by the next call.
+ */
+#define SOCKET_SERVER_EPOLL_EVENTS 256
+
+/**
+ * Maximum number of epoll_wait() calls done by a single
+ * socket_server_poll() call when the event buffer keeps filling up.
+ * Sockets that didn't get their turn are handled in the next tick.
+ */
+#define SOCKET_SERVER_EPOLL_PASSES 4
+
 typedef enum socket_server_id {
     SOCKET_SERVER_ID_CLASSIC_V4,
     SOCKET_SERVER_ID_SECURE_V4,
@@ -90,6 +103,25 @@ typedef struct socket_command {
     int flags;
 } socket_command_t;
 
+#ifdef HAVE_SYS_EPOLL_H
+/**
+ * The epoll instance that the server's listening sockets and all the client
+ * sockets are registered with.
+ */
+static int epoll_fd = -1;
+/**
+ * Events collected by the last epoll_wait() call.
+ */
+static struct epoll_event epoll_events[SOCKET_SERVER_EPOLL_EVENTS];
+/**
+ * Number of events in ::epoll_events that are being dispatched.
+ */
+static int epoll_events_num;
+/**
+ * Index of the event in ::epoll_events that is currently being dispatched.
+ */
+static int epoll_events_idx;
+#else
 /**
  * File descriptors that have data available.
  */
@@ -102,6 +134,11 @@ static fd_set fds_write;
  * File descriptors with errors.
  */
 static fd_set fds_error;
+/**
+ * Highest file descriptor in the above sets.
+ */
+static int fds_max;
+#endif
 /**
  * The server's listening sockets.
  */
@@ -343,6 +380,29 @@ TOOLKIT_INIT_FUNC(socket_server)
         if (!socket_bind(server_sockets[i])) {
             exit(1);
         }
+
+#ifdef HAVE_SYS_EPOLL_H
+        if (epoll_fd == -1) {
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_fd == -1) {
+                LOG(ERROR, "epoll_create1() failed: %s (%d)",
+                    strerror(errno), errno);
+                exit(1);
+            }
+        }
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = server_sockets[i];
+        if (epoll_ctl(epoll_fd,
+                      EPOLL_CTL_ADD,
+                      socket_fd(server_sockets[i]),
+                      &event) == -1) {
+            LOG(ERROR, "epoll_ctl() failed: %s (%d)", strerror(errno), errno);
+            exit(1);
+        }
+#endif
     }
 
     client_sockets = NULL;
@@ -361,9 +421,106 @@ TOOLKIT_DEINIT_FUNC(socket_server)
 
         socket_destroy(server_sockets[i]);
     }
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (epoll_fd != -1) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+#endif
 }
 TOOLKIT_DEINIT_FUNC_FINISH
 
+/**
+ * Register the specified client socket with the event polling backend, or
+ * update the events it's registered for if it's registered already.
+ *
+ * The socket is always polled for incoming data, but only polled for
+ * write readiness if there are packets in its queue that could not be
+ * written out immediately. Does nothing if the events don't change, so
+ * this is cheap to call after every write.
+ *
+ * Dead and zombie sockets are removed from the polling backend instead;
+ * their errors and hangups would otherwise keep being reported until
+ * they're freed.
+ *
+ * @param cs
+ * Client socket.
+ */
+static void
+socket_server_watch (socket_struct *cs)
+{
+    HARD_ASSERT(cs != NULL);
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (cs->state == ST_DEAD || cs->state == ST_ZOMBIE) {
+        socket_server_unwatch(cs);
+        return;
+    }
+
+    uint32_t events = EPOLLIN;
+    if (cs->packets != NULL) {
+        events |= EPOLLOUT;
+    }
+
+    if (cs->polled && cs->poll_events == events) {
+        return;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = cs;
+    if (epoll_ctl(epoll_fd,
+                  cs->polled ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                  socket_fd(cs->sc),
+                  &event) == -1) {
+        LOG(ERROR, "epoll_ctl() failed for %s: %s (%d)",
+            socket_get_str(cs->sc), strerror(errno), errno);
+        cs->state = ST_DEAD;
+        return;
+    }
+
+    cs->polled = true;
+    cs->poll_events = events;
+#endif
+}
+
+/**
+ * Unregister the specified client socket from the event polling backend.
+ * Must be called before the client socket is freed.
+ *
+ * @param cs
+ * Client socket.
+ */
+void
+socket_server_unwatch (socket_struct *cs)
+{
+    HARD_ASSERT(cs != NULL);
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (!cs->polled) {
+        return;
+    }
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, socket_fd(cs->sc), NULL) == -1) {
+        LOG(ERROR, "epoll_ctl() failed for %s: %s (%d)",
+            socket_get_str(cs->sc), strerror(errno), errno);
+    }
+
+    cs->polled = false;
+
+    /* The socket may be freed while events are being dispatched (for
+     * example, when a command handler disconnects another client), so
+     * make sure none of the events that are still pending refer to it. */
+    for (int i = epoll_events_idx + 1; i < epoll_events_num; i++) {
+        if (epoll_events[i].data.ptr == cs) {
+            epoll_events[i].data.ptr = NULL;
+        }
+    }
+#endif
+}
+
 /**
  * Attempt to handle a command from the client.
  *
@@ -455,6 +612,7 @@ socket_server_csocket_create (socket_t *server_socket)
     }
 
     init_connection(entry->cs);
+    socket_server_watch(entry->cs);
     DL_APPEND(client_sockets, entry);
 }
 
@@ -504,10 +662,11 @@ socket_server_handle_client (player *pl)
 {
     HARD_ASSERT(pl != NULL);
 
+    size_t pos = 0;
     for (int num_cmds = 0;
          num_cmds < SOCKET_SERVER_PLAYER_MAX_COMMANDS;
          num_cmds++) {
-        if (pl->cs->packet_recv_cmd->len == 0) {
+        if (pl->cs->packet_recv_cmd->len - pos == 0) {
             break;
         }
 
@@ -521,8 +680,8 @@ socket_server_handle_client (player *pl)
             break;
         }
 
-        size_t len = 2 + (pl->cs->packet_recv_cmd->data[0] << 8) +
-                     pl->cs->packet_recv_cmd->data[1];
+        uint8_t *data = pl->cs->packet_recv_cmd->data + pos;
+        size_t len = 2 + (data[0] << 8) + data[1];
 
         /* Reset idle counter. */
         if (pl->cs->state == ST_PLAYING) {
@@ -530,11 +689,12 @@ socket_server_handle_client (player *pl)
             pl->cs->keepalive = 0;
         }
 
-        socket_server_handle_command(pl->cs,
-                                     pl,
-                                     pl->cs->packet_recv_cmd->data + 2,
-                                     len - 2);
-        packet_delete(pl->cs->packet_recv_cmd, 0, len);
+        pos += len;
+        socket_server_handle_command(pl->cs, pl, data + 2, len - 2);
+    }
+
+    if (pos != 0) {
+        packet_delete(pl->cs->packet_recv_cmd, 0, pos);
     }
 }
 
@@ -618,19 +778,21 @@ socket_server_csocket_read (socket_struct *cs)
 
     cs->packet_recv->len += amt;
 
-    while (cs->packet_recv->len >= 2) {
-        size_t size = 2 + (cs->packet_recv->data[0] << 8) +
-                      cs->packet_recv->data[1];
-        if (size > cs->packet_recv->len) {
+    /* Handle all the complete commands in the buffer, and only discard
+     * them once we're done, so that the remaining partial command (if
+     * any) is moved to the start of the buffer just once. */
+    size_t pos = 0;
+    while (cs->packet_recv->len - pos >= 2) {
+        uint8_t *data = cs->packet_recv->data + pos;
+        size_t len = 2 + (data[0] << 8) + data[1];
+        if (len > cs->packet_recv->len - pos) {
             break;
         }
 
-        uint8_t *data = cs->packet_recv->data;
-        size_t len = size;
+        pos += len;
 
         uint8_t *decrypted_data;
         size_t decrypted_len;
-        bool was_decrypted = true;
         if (socket_is_secure(cs->sc)) {
             if (!socket_crypto_decrypt(cs->sc,
                                        data + 2,
@@ -643,7 +805,6 @@ socket_server_csocket_read (socket_struct *cs)
         } else {
             decrypted_data = data + 2;
             decrypted_len = len - 2;
-            was_decrypted = false;
         }
 
         /* Try to handle the command. */
@@ -658,161 +819,170 @@ socket_server_csocket_read (socket_struct *cs)
                                    decrypted_data,
                                    decrypted_len);
         }
+    }
 
-        if (was_decrypted) {
-            efree(decrypted_data);
-        }
-
-        packet_delete(cs->packet_recv, 0, size);
+    if (pos != 0) {
+        packet_delete(cs->packet_recv, 0, pos);
     }
 }
 
 /**
- * Write out the packet queue to the specified client socket.
+ * Flush the packet queue of the specified client socket, and update the
+ * events it is polled for, depending on whether the whole queue could be
+ * written out.
  *
  * @param cs
  * Client socket.
  */
 static inline void
-socket_server_csocket_write (socket_struct *cs)
+socket_server_csocket_flush (socket_struct *cs)
 {
     HARD_ASSERT(cs != NULL);
 
-    while (cs->packets != NULL) {
-        packet_struct *packet = cs->packets;
-
-        if (packet->ndelay) {
-            socket_opt_ndelay(cs->sc, true);
-        }
-
-        size_t amt;
-        bool success = socket_write(cs->sc,
-                                    (const void *) (packet->data + packet->pos),
-                                    packet->len - packet->pos,
-                                    &amt);
-
-        if (packet->ndelay) {
-            socket_opt_ndelay(cs->sc, false);
-        }
-
-        if (!success) {
-            cs->state = ST_DEAD;
-            break;
-        }
-
-        packet->pos += amt;
-
-        if (packet->len - packet->pos == 0) {
-            DL_DELETE(cs->packets, packet);
-            packet_free(packet);
-            continue;
-        }
+    if (cs->state == ST_DEAD || cs->state == ST_ZOMBIE) {
+        return;
+    }
 
-        /* Failed to send the entire packet; it's unlikely we can retry
-         * immediately, so just stop here. */
-        break;
+    if (cs->packets != NULL) {
+        socket_buffer_flush(cs);
     }
+
+    socket_server_watch(cs);
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+
 /**
- * Accept incoming connections, read data from clients and write data to
- * clients.
+ * Handle an event for one of the server's listening sockets.
+ *
+ * @param ptr
+ * Event's data pointer.
+ * @return
+ * True if the event was for a listening socket and was handled, false
+ * otherwise.
  */
-void
-socket_server_process (void)
+static inline bool
+socket_server_poll_listener (void *ptr)
 {
-    FD_ZERO(&fds_read);
-    FD_ZERO(&fds_write);
-    FD_ZERO(&fds_error);
-
-    int nfds = 0;
-
     for (socket_server_id_t i = 0; i < SOCKET_SERVER_ID_NUM; i++) {
-        if (server_sockets[i] == NULL) {
-            continue;
+        if (server_sockets[i] != NULL && server_sockets[i] == ptr) {
+            socket_server_csocket_create(server_sockets[i]);
+            return true;
         }
+    }
 
-        int fd = socket_fd(server_sockets[i]);
-        if (nfds < fd) {
-            nfds = fd;
-        }
+    return false;
+}
 
-        FD_SET(fd, &fds_read);
-    }
+/**
+ * Wait for events on the server's sockets and dispatch them. Only the
+ * sockets that are actually ready are visited.
+ */
+static void
+socket_server_poll (void)
+{
+    int ready;
+    int passes = 0;
+    do {
+        ready = epoll_wait(epoll_fd,
+                           epoll_events,
+                           SOCKET_SERVER_EPOLL_EVENTS,
+                           0);
+        if (unlikely(ready == -1)) {
+            if (errno != EINTR) {
+                LOG(ERROR, "epoll_wait() returned an error: %s (%d)",
+                    strerror(errno), errno);
+            }
 
-    csocket_entry_t *entry, *entry_tmp;
-    DL_FOREACH_SAFE(client_sockets, entry, entry_tmp) {
-        if (unlikely(!socket_is_fd_valid(entry->cs->sc))) {
-            LOG(ERROR, "Invalid waiting socket: %s",
-                socket_get_str(entry->cs->sc));
-            entry->cs->state = ST_DEAD;
+            return;
         }
 
-        if (entry->cs->state == ST_DEAD) {
-            socket_server_csocket_drop(entry);
-            continue;
-        }
+        epoll_events_num = ready;
 
-        if (server_socket_csocket_is_zombie(entry->cs)) {
-            continue;
-        }
+        for (epoll_events_idx = 0;
+             epoll_events_idx < epoll_events_num;
+             epoll_events_idx++) {
+            struct epoll_event *event = &epoll_events[epoll_events_idx];
 
-        int fd = socket_fd(entry->cs->sc);
-        if (nfds < fd) {
-            nfds = fd;
-        }
+            /* The socket was freed by one of the previous events. */
+            if (event->data.ptr == NULL) {
+                continue;
+            }
 
-        FD_SET(fd, &fds_read);
-        FD_SET(fd, &fds_write);
-        FD_SET(fd, &fds_error);
-    }
+            if (socket_server_poll_listener(event->data.ptr)) {
+                continue;
+            }
 
-    player *pl, *pl_tmp;
-    DL_FOREACH_SAFE(first_player, pl, pl_tmp) {
-        if (pl->cs->state == ST_DEAD) {
-            player_logout(pl);
-            continue;
-        }
+            socket_struct *cs = event->data.ptr;
 
-        if (unlikely(!socket_is_fd_valid(pl->cs->sc))) {
-            LOG(ERROR, "Invalid waiting socket: %s",
-                socket_get_str(pl->cs->sc));
-            pl->cs->state = ST_DEAD;
-        }
+            if (cs->state != ST_DEAD && cs->state != ST_ZOMBIE) {
+                if (event->events & (EPOLLERR | EPOLLHUP)) {
+                    cs->state = ST_DEAD;
+                } else {
+                    if (event->events & EPOLLIN) {
+                        socket_server_csocket_read(cs);
+                    }
 
-        if (pl->cs->keepalive++ >= SOCKET_KEEPALIVE_TIMEOUT) {
-            LOG(SYSTEM, "Keepalive: disconnecting %s [%s]: %d",
-                object_get_str(pl->ob),
-                socket_get_str(pl->cs->sc),
-                socket_fd(pl->cs->sc));
-            pl->cs->state = ST_DEAD;
-        }
+                    if (event->events & EPOLLOUT) {
+                        socket_server_csocket_flush(cs);
+                    }
+                }
+            }
 
-        if (pl->cs->state == ST_DEAD) {
-            player_logout(pl);
-            continue;
+            /* Stop polling sockets that are going away. */
+            if (cs->state == ST_DEAD || cs->state == ST_ZOMBIE) {
+                socket_server_unwatch(cs);
+            }
         }
 
-        if (server_socket_csocket_is_zombie(pl->cs)) {
-            continue;
-        }
+        epoll_events_num = 0;
+        epoll_events_idx = 0;
+        /* Keep going if the event buffer was filled up completely. */
+    } while (ready == SOCKET_SERVER_EPOLL_EVENTS &&
+             ++passes < SOCKET_SERVER_EPOLL_PASSES);
+
+    /* Write out whatever the handled commands have queued up for clients
+     * that are not playing yet; players are flushed in
+     * socket_server_post_process(). */
+    csocket_entry_t *entry;
+    DL_FOREACH(client_sockets, entry) {
+        socket_server_csocket_flush(entry->cs);
+    }
+}
 
-        int fd = socket_fd(pl->cs->sc);
-        if (nfds < fd) {
-            nfds = fd;
-        }
+#else
 
-        FD_SET(fd, &fds_read);
-        FD_SET(fd, &fds_write);
-        FD_SET(fd, &fds_error);
+/**
+ * Add the specified client socket to the file descriptor sets.
+ *
+ * @param cs
+ * Client socket.
+ */
+static inline void
+socket_server_select_add (socket_struct *cs)
+{
+    int fd = socket_fd(cs->sc);
+    if (fds_max < fd) {
+        fds_max = fd;
     }
 
+    FD_SET(fd, &fds_read);
+    FD_SET(fd, &fds_write);
+    FD_SET(fd, &fds_error);
+}
+
+/**
+ * Wait for events on the server's sockets and dispatch them.
+ */
+static void
+socket_server_poll (void)
+{
     int ready;
 #ifdef HAVE_PSELECT
     static struct timespec timeout;
     /* pselect does not change the timeout argument, so we're OK with a
      * static storage duration one. */
-    ready = pselect(nfds + 1,
+    ready = pselect(fds_max + 1,
                     &fds_read,
                     &fds_write,
                     &fds_error,
@@ -822,7 +992,7 @@ socket_server_process (void)
     struct timeval timeout;
     timeout.tv_sec = 0;
     timeout.tv_usec = 0;
-    ready = select(nfds + 1,
+    ready = select(fds_max + 1,
                    &fds_read,
                    &fds_write,
                    &fds_error,
@@ -851,6 +1021,7 @@ socket_server_process (void)
         socket_server_csocket_create(server_sockets[i]);
     }
 
+    csocket_entry_t *entry, *entry_tmp;
     DL_FOREACH_SAFE(client_sockets, entry, entry_tmp) {
         int fd = socket_fd(entry->cs->sc);
 
@@ -868,10 +1039,11 @@ socket_server_process (void)
         }
 
         if (FD_ISSET(fd, &fds_write)) {
-            socket_server_csocket_write(entry->cs);
+            socket_buffer_flush(entry->cs);
         }
     }
 
+    player *pl, *pl_tmp;
     DL_FOREACH_SAFE(first_player, pl, pl_tmp) {
         int fd = socket_fd(pl->cs->sc);
 
@@ -889,18 +1061,122 @@ socket_server_process (void)
         }
 
         if (FD_ISSET(fd, &fds_write)) {
-            socket_server_csocket_write(pl->cs);
+            socket_buffer_flush(pl->cs);
+        }
+    }
+}
+
+#endif
+
+/**
+ * Accept incoming connections, read data from clients and write data to
+ * clients.
+ */
+void
+socket_server_process (void)
+{
+#ifndef HAVE_SYS_EPOLL_H
+    FD_ZERO(&fds_read);
+    FD_ZERO(&fds_write);
+    FD_ZERO(&fds_error);
+    fds_max = 0;
+
+    for (socket_server_id_t i = 0; i < SOCKET_SERVER_ID_NUM; i++) {
+        if (server_sockets[i] == NULL) {
+            continue;
+        }
+
+        int fd = socket_fd(server_sockets[i]);
+        if (fds_max < fd) {
+            fds_max = fd;
+        }
+
+        FD_SET(fd, &fds_read);
+    }
+#endif
+
+    csocket_entry_t *entry, *entry_tmp;
+    DL_FOREACH_SAFE(client_sockets, entry, entry_tmp) {
+#ifndef HAVE_SYS_EPOLL_H
+        if (unlikely(!socket_is_fd_valid(entry->cs->sc))) {
+            LOG(ERROR, "Invalid waiting socket: %s",
+                socket_get_str(entry->cs->sc));
+            entry->cs->state = ST_DEAD;
+        }
+#endif
+
+        if (entry->cs->state == ST_DEAD) {
+            socket_server_csocket_drop(entry);
+            continue;
+        }
+
+        if (server_socket_csocket_is_zombie(entry->cs)) {
+            continue;
+        }
+
+#ifndef HAVE_SYS_EPOLL_H
+        socket_server_select_add(entry->cs);
+#endif
+    }
+
+    player *pl, *pl_tmp;
+    DL_FOREACH_SAFE(first_player, pl, pl_tmp) {
+        if (pl->cs->state == ST_DEAD) {
+            player_logout(pl);
+            continue;
+        }
+
+#ifndef HAVE_SYS_EPOLL_H
+        if (unlikely(!socket_is_fd_valid(pl->cs->sc))) {
+            LOG(ERROR, "Invalid waiting socket: %s",
+                socket_get_str(pl->cs->sc));
+            pl->cs->state = ST_DEAD;
         }
+#endif
+
+        if (pl->cs->keepalive++ >= SOCKET_KEEPALIVE_TIMEOUT) {
+            LOG(SYSTEM, "Keepalive: disconnecting %s [%s]: %d",
+                object_get_str(pl->ob),
+                socket_get_str(pl->cs->sc),
+                socket_fd(pl->cs->sc));
+            pl->cs->state = ST_DEAD;
+        }
+
+        if (pl->cs->state == ST_DEAD) {
+            player_logout(pl);
+            continue;
+        }
+
+        if (server_socket_csocket_is_zombie(pl->cs)) {
+            continue;
+        }
+
+#ifndef HAVE_SYS_EPOLL_H
+        socket_server_select_add(pl->cs);
+#endif
     }
+
+    socket_server_poll();
 }
 
 /**
  * Update player socket-related data, render the map for them, etc.
  * Afterwards, attempt to write to the players' clients.
+ *
+ * The rendering is done one player at a time. It cannot be spread across
+ * threads until get_map_from_coord() and the magic mirror code stop loading
+ * maps on demand, the look and name functions stop using static buffers and
+ * the shared string table, and the packet memory pool and the
+ * map_render_cache_pass() tile cache become safe to use from several
+ * threads.
  */
 void
 socket_server_post_process (void)
 {
+    /* Start a new map update pass, so that the players' map views are
+     * rendered using up-to-date information. */
+    map_render_cache_pass();
+
     player *pl, *pl_tmp;
     DL_FOREACH_SAFE(first_player, pl, pl_tmp) {
         if (pl->cs->state == ST_DEAD) {
@@ -933,8 +1209,15 @@ socket_server_post_process (void)
             }
         }
 
+#ifdef HAVE_SYS_EPOLL_H
+        /* Sockets are non-blocking, so just try to write; if the kernel
+         * buffer fills up, the socket gets polled for write readiness and
+         * the rest is written out once it's ready. */
+        socket_server_csocket_flush(pl->cs);
+#else
         if (FD_ISSET(socket_fd(pl->cs->sc), &fds_write)) {
-            socket_server_csocket_write(pl->cs);
+            socket_buffer_flush(pl->cs);
         }
+#endif
     }
 }
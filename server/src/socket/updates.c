@@ -93,6 +93,9 @@ static void updates_file_new(const char *filename, struct stat *sb)
     packet_append_uint32(update_files[update_files_num].packet, update_files[update_files_num].ucomp_len);
     packet_debug_data(update_files[update_files_num].packet, 0, "File data");
     packet_append_data_len(update_files[update_files_num].packet, update_files[update_files_num].contents, update_files[update_files_num].len);
+    /* The file data is compressed already; this just makes sure the
+     * packet isn't compressed again each time it is sent. */
+    packet_precompress(update_files[update_files_num].packet);
     update_files_num++;
 }
 
@@ -219,5 +222,5 @@ void socket_command_request_update(socket_struct *ns, player *pl, uint8_t *data,
         return;
     }
 
-    socket_send_packet(ns, packet_dup(tmp->packet));
+    socket_send_packet(ns, packet_share(tmp->packet));
 }
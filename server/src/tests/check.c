@@ -110,6 +110,16 @@ void check_setup_env_pl(mapstruct **map, object **pl)
     ck_assert(*pl != NULL);
 }
 
+/*
+ * Checks whether the benchmarks should be run. They are timing loops rather
+ * than tests, so they are only run if the ATRINIK_CHECK_BENCHMARK
+ * environment variable is set.
+ */
+bool check_benchmarks(void)
+{
+    return getenv("ATRINIK_CHECK_BENCHMARK") != NULL;
+}
+
 /*
  * Runs the specified test suite.
  */
@@ -181,6 +191,7 @@ void check_main(int argc, char **argv)
     check_server_ban();
     check_server_bank();
     check_server_cache();
+    check_server_map();
     check_server_object();
     check_server_re_cmp();
     check_server_shop();
@@ -191,6 +202,7 @@ void check_main(int argc, char **argv)
     check_server_packet();
     check_server_pbkdf2();
     check_server_shstr();
+    check_server_socket_crypto();
     check_server_string();
     check_server_stringbuffer();
 
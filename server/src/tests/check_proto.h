@@ -5,6 +5,7 @@ extern void check_teardown(void);
 extern void check_test_setup(void);
 extern void check_test_teardown(void);
 extern void check_setup_env_pl(mapstruct **map, object **pl);
+extern bool check_benchmarks(void);
 extern void check_run_suite(Suite *suite, const char *file);
 extern void check_main(int argc, char **argv);
 /* src/tests/bugs/cursed_treasures.c */
@@ -21,6 +22,8 @@ extern void check_server_ban(void);
 extern void check_server_bank(void);
 /* src/tests/unit/server/cache.c */
 extern void check_server_cache(void);
+/* src/tests/unit/server/map.c */
+extern void check_server_map(void);
 /* src/tests/unit/server/math.c */
 extern void check_server_math(void);
 /* src/tests/unit/server/memory.c */
@@ -37,6 +40,8 @@ extern void check_server_re_cmp(void);
 extern void check_server_shop(void);
 /* src/tests/unit/server/shstr.c */
 extern void check_server_shstr(void);
+/* src/tests/unit/server/socket_crypto.c */
+extern void check_server_socket_crypto(void);
 /* src/tests/unit/server/string.c */
 extern void check_server_string(void);
 /* src/tests/unit/server/stringbuffer.c */
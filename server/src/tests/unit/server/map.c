@@ -0,0 +1,229 @@
+/*************************************************************************
+ *           Atrinik, a Multiplayer Online Role Playing Game             *
+ *                                                                       *
+ *   Copyright (C) 2009-2014 Alex Tokar and Atrinik Development Team     *
+ *                                                                       *
+ * Fork from Crossfire (Multiplayer game for X-windows).                 *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 2 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the Free Software           *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.             *
+ *                                                                       *
+ * The author can be reached at admin@atrinik.org                        *
+ ************************************************************************/
+
+#include <global.h>
+#include <check.h>
+#include <checkstd.h>
+#include <check_proto.h>
+#include <arch.h>
+#include <player.h>
+#include <object.h>
+
+/** Number of full map sweeps done by the map benchmarks. */
+#define MAP_BENCHMARK_SWEEPS 2000
+
+START_TEST(test_map_space_flags)
+{
+    mapstruct *map;
+    object *pl, *monster, *torch;
+
+    check_setup_env_pl(&map, &pl);
+    ck_assert(GET_MAP_FLAGS(map, pl->x, pl->y) & P_IS_PLAYER);
+
+    monster = arch_get("raas");
+    monster->x = 5;
+    monster->y = 5;
+    monster = object_insert_map(monster, map, NULL, 0);
+    ck_assert_ptr_ne(monster, NULL);
+    ck_assert(GET_MAP_FLAGS(map, 5, 5) & P_IS_MONSTER);
+    ck_assert(!(GET_MAP_FLAGS(map, 5, 6) & P_IS_MONSTER));
+    ck_assert_int_ne(blocked(pl, map, 5, 5, TERRAIN_ALL), 0);
+
+    object_remove(monster, 0);
+    ck_assert(!(GET_MAP_FLAGS(map, 5, 5) & P_IS_MONSTER));
+    ck_assert_int_eq(blocked(pl, map, 5, 5, TERRAIN_ALL), 0);
+    object_destroy(monster);
+
+    ck_assert_int_eq(GET_MAP_LIGHT(map, 10, 10), 0);
+    torch = arch_get("torch");
+    torch->x = 10;
+    torch->y = 10;
+    torch = object_insert_map(torch, map, NULL, 0);
+    manual_apply(torch, torch, 0);
+    ck_assert_int_ne(torch->glow_radius, 0);
+    ck_assert_int_gt(GET_MAP_LIGHT(map, 10, 10), 0);
+}
+END_TEST
+
+START_TEST(test_map_space_flag_counts)
+{
+    mapstruct *map;
+    object *pl, *monster1, *monster2;
+
+    check_setup_env_pl(&map, &pl);
+
+    monster1 = arch_get("raas");
+    monster1->x = 7;
+    monster1->y = 7;
+    monster1 = object_insert_map(monster1, map, NULL, 0);
+    ck_assert_ptr_ne(monster1, NULL);
+
+    monster2 = arch_get("raas");
+    monster2->x = 7;
+    monster2->y = 7;
+    monster2 = object_insert_map(monster2, map, NULL, 0);
+    ck_assert_ptr_ne(monster2, NULL);
+    ck_assert(GET_MAP_FLAGS(map, 7, 7) & P_IS_MONSTER);
+
+    /* One of the monsters is still there. */
+    object_remove(monster1, 0);
+    ck_assert(GET_MAP_FLAGS(map, 7, 7) & P_IS_MONSTER);
+
+    /* Flag changes of objects on the map are recounted. */
+    SET_FLAG(monster2, FLAG_BLOCKSVIEW);
+    object_update(monster2, UP_OBJ_FLAGS);
+    ck_assert(GET_MAP_FLAGS(map, 7, 7) & P_BLOCKSVIEW);
+    CLEAR_FLAG(monster2, FLAG_BLOCKSVIEW);
+    object_update(monster2, UP_OBJ_FLAGS);
+    ck_assert(!(GET_MAP_FLAGS(map, 7, 7) & P_BLOCKSVIEW));
+
+    object_remove(monster2, 0);
+    ck_assert(!(GET_MAP_FLAGS(map, 7, 7) & P_IS_MONSTER));
+
+    /* Removed objects are not recounted. */
+    SET_FLAG(monster2, FLAG_NO_PASS);
+    object_update(monster2, UP_OBJ_FLAGS);
+    ck_assert(!(GET_MAP_FLAGS(map, 7, 7) & P_NO_PASS));
+
+    object_destroy(monster1);
+    object_destroy(monster2);
+}
+END_TEST
+
+START_TEST(test_map_live_find)
+{
+    mapstruct *map;
+    object *pl, *monster, **live;
+    size_t num;
+
+    check_setup_env_pl(&map, &pl);
+
+    monster = arch_get("raas");
+    monster->x = 12;
+    monster->y = 12;
+    monster = object_insert_map(monster, map, NULL, 0);
+    ck_assert_ptr_ne(monster, NULL);
+
+    live = map_live_find(map, 12, 12, 3, &num);
+    ck_assert_uint_eq(num, 1);
+    ck_assert_ptr_eq(live[0], monster);
+
+    live = map_live_find(map, 2, 2, 12, &num);
+    ck_assert_uint_eq(num, 2);
+    ck_assert_ptr_eq(live[0], pl);
+    ck_assert_ptr_eq(live[1], monster);
+
+    /* Changing the monster flag on the map must update the index. */
+    CLEAR_FLAG(monster, FLAG_MONSTER);
+    map_live_update(monster);
+    live = map_live_find(map, 12, 12, 3, &num);
+    ck_assert_uint_eq(num, 0);
+
+    SET_FLAG(monster, FLAG_MONSTER);
+    map_live_update(monster);
+    live = map_live_find(map, 12, 12, 3, &num);
+    ck_assert_uint_eq(num, 1);
+    ck_assert_ptr_eq(live[0], monster);
+
+    object_remove(monster, 0);
+    live = map_live_find(map, 12, 12, 3, &num);
+    ck_assert_uint_eq(num, 0);
+    object_destroy(monster);
+}
+END_TEST
+
+/*
+ * Benchmark of blocked() and map_get_darkness() sweeps over a whole map; the
+ * latter reads the same per-space data as the map drawing code. Only run
+ * if check_benchmarks() is true.
+ */
+START_TEST(test_map_benchmark)
+{
+    mapstruct *map;
+    object *pl;
+    int x, y, i;
+
+    check_setup_env_pl(&map, &pl);
+
+    TIMER_START(1);
+
+    for (i = 0; i < MAP_BENCHMARK_SWEEPS; i++) {
+        for (y = 0; y < MAP_HEIGHT(map); y++) {
+            for (x = 0; x < MAP_WIDTH(map); x++) {
+                blocked(pl, map, x, y, TERRAIN_ALL);
+            }
+        }
+    }
+
+    TIMER_UPDATE(1);
+    LOG(DEVEL, "%d blocked() sweeps took %f seconds", MAP_BENCHMARK_SWEEPS,
+            TIMER_GET(1));
+
+    TIMER_START(2);
+
+    for (i = 0; i < MAP_BENCHMARK_SWEEPS; i++) {
+        for (y = 0; y < MAP_HEIGHT(map); y++) {
+            for (x = 0; x < MAP_WIDTH(map); x++) {
+                map_get_darkness(map, x, y, NULL);
+            }
+        }
+    }
+
+    TIMER_UPDATE(2);
+    LOG(DEVEL, "%d map_get_darkness() sweeps took %f seconds",
+            MAP_BENCHMARK_SWEEPS, TIMER_GET(2));
+}
+END_TEST
+
+static Suite *suite(void)
+{
+    Suite *s = suite_create("map");
+    TCase *tc_core = tcase_create("Core");
+
+    tcase_add_unchecked_fixture(tc_core, check_setup, check_teardown);
+    tcase_add_checked_fixture(tc_core, check_test_setup, check_test_teardown);
+
+    suite_add_tcase(s, tc_core);
+    tcase_add_test(tc_core, test_map_space_flags);
+    tcase_add_test(tc_core, test_map_space_flag_counts);
+    tcase_add_test(tc_core, test_map_live_find);
+
+    if (check_benchmarks()) {
+        TCase *tc_benchmark = tcase_create("Benchmark");
+
+        tcase_add_unchecked_fixture(tc_benchmark, check_setup, check_teardown);
+        tcase_add_checked_fixture(tc_benchmark, check_test_setup,
+                check_test_teardown);
+
+        suite_add_tcase(s, tc_benchmark);
+        tcase_add_test(tc_benchmark, test_map_benchmark);
+    }
+
+    return s;
+}
+
+void check_server_map(void)
+{
+    check_run_suite(suite(), __FILE__);
+}
@@ -29,6 +29,7 @@
 #include <toolkit/string.h>
 #include <arch.h>
 #include <object.h>
+#include <loader.h>
 #include <toolkit/path.h>
 
 START_TEST(test_object_can_merge)
@@ -396,6 +397,119 @@ START_TEST(test_object_load_str)
 }
 END_TEST
 
+START_TEST(test_object_binary)
+{
+    object *ob, *sword, *loaded;
+    object_binary_t *bin;
+    char *text, *text2;
+    StringBuffer *sb;
+    FILE *fp;
+
+    ob = arch_get("sack");
+    FREE_AND_COPY_HASH(ob->name, "magic sack");
+    ob->weight = 129;
+    ob->speed_left = -0.25;
+    object_set_value(ob, "foo", "bar", true);
+    sword = arch_get("sword");
+    FREE_AND_COPY_HASH(sword->title, "of swords");
+    SET_FLAG(sword, FLAG_IDENTIFIED);
+    sword->protection[ATNR_FIRE] = -30;
+    object_insert_into(sword, ob, 0);
+
+    fp = tmpfile();
+    ck_assert_ptr_ne(fp, NULL);
+    bin = object_binary_create(fp);
+    object_binary_save(bin, ob);
+    object_binary_save(bin, ob);
+    object_binary_free(bin);
+    rewind(fp);
+
+    ck_assert(object_binary_check(fp));
+    bin = object_binary_open(fp);
+    ck_assert_ptr_ne(bin, NULL);
+
+    sb = stringbuffer_new();
+    object_dump_rec(ob, sb);
+    text = stringbuffer_finish(sb);
+
+    for (int i = 0; i < 2; i++) {
+        loaded = object_get();
+        ck_assert_int_eq(object_binary_load(bin, loaded, 0), LL_NORMAL);
+        ck_assert_str_eq(loaded->name, "magic sack");
+        ck_assert_str_eq(object_get_value(loaded, "foo"), "bar");
+        ck_assert_ptr_ne(loaded->inv, NULL);
+        ck_assert_str_eq(loaded->inv->title, "of swords");
+        ck_assert(QUERY_FLAG(loaded->inv, FLAG_IDENTIFIED));
+
+        /* Same as load_objects() does for containers. */
+        object_weight_sum(loaded);
+        sb = stringbuffer_new();
+        object_dump_rec(loaded, sb);
+        text2 = stringbuffer_finish(sb);
+        ck_assert_str_eq(text, text2);
+        efree(text2);
+        object_destroy(loaded);
+    }
+
+    loaded = object_get();
+    ck_assert_int_eq(object_binary_load(bin, loaded, 0), LL_EOF);
+    object_destroy(loaded);
+
+    object_binary_free(bin);
+    fclose(fp);
+    efree(text);
+    object_destroy(ob);
+}
+END_TEST
+
+START_TEST(test_object_key_values)
+{
+    object *ob, *ob2;
+    char key[MAX_BUF], value[MAX_BUF];
+
+    ob = arch_get("sack");
+    ck_assert_ptr_eq(object_get_value(ob, "key_0"), NULL);
+
+    /* Enough keys to have the key-values indexed. */
+    for (int i = 0; i < KEY_VALUES_INDEX_MIN * 4; i++) {
+        snprintf(VS(key), "key_%d", i);
+        snprintf(VS(value), "value_%d", i);
+        ck_assert(object_set_value(ob, key, value, true));
+    }
+
+    ck_assert_ptr_ne(ob->key_values_index, NULL);
+    ck_assert_uint_eq(ob->key_values_num, KEY_VALUES_INDEX_MIN * 4);
+
+    for (int i = 0; i < KEY_VALUES_INDEX_MIN * 4; i += 2) {
+        snprintf(VS(key), "key_%d", i);
+        ck_assert(object_set_value(ob, key, NULL, false));
+    }
+
+    ck_assert_uint_eq(ob->key_values_num, KEY_VALUES_INDEX_MIN * 2);
+
+    ob2 = object_get();
+    object_copy(ob2, ob, false);
+
+    for (int i = 0; i < KEY_VALUES_INDEX_MIN * 4; i++) {
+        snprintf(VS(key), "key_%d", i);
+        snprintf(VS(value), "value_%d", i);
+
+        if (i % 2 == 0) {
+            ck_assert_ptr_eq(object_get_value(ob, key), NULL);
+            ck_assert_ptr_eq(object_get_value(ob2, key), NULL);
+        } else {
+            ck_assert_str_eq(object_get_value(ob, key), value);
+            ck_assert_str_eq(object_get_value(ob2, key), value);
+            ck_assert_ptr_eq(object_get_value_s(ob2, find_string(key)),
+                             object_get_value(ob, key));
+        }
+    }
+
+    object_destroy(ob);
+    object_destroy(ob2);
+}
+END_TEST
+
 START_TEST(test_object_reverse_inventory)
 {
     char *cp, *cp2;
@@ -484,6 +598,8 @@ static Suite *suite(void)
     tcase_add_test(tc_core, test_object_can_pick);
     tcase_add_test(tc_core, test_object_clone);
     tcase_add_test(tc_core, test_object_load_str);
+    tcase_add_test(tc_core, test_object_binary);
+    tcase_add_test(tc_core, test_object_key_values);
     tcase_add_test(tc_core, test_object_reverse_inventory);
     tcase_add_test(tc_core, test_object_create_singularity);
     tcase_add_test(tc_core, test_OBJECT_DESTROYED);
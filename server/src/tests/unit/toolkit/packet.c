@@ -28,6 +28,7 @@
 #include <check_proto.h>
 #include <toolkit/packet.h>
 #include <toolkit/string.h>
+#include <zlib.h>
 
 #define packet_verify_data(packet, str) \
 { \
@@ -105,6 +106,140 @@ START_TEST(test_packet_dup)
 }
 END_TEST
 
+START_TEST(test_packet_share)
+{
+    packet_struct *packet, *packet2, *packet3;
+
+    packet = packet_new(0, 0, 0);
+    packet_append_int32(packet, 50);
+    packet2 = packet_share(packet);
+    packet_verify_data(packet2, "00000032");
+    ck_assert_ptr_eq(packet2->data, packet->data);
+    packet3 = packet_share(packet2);
+    ck_assert_ptr_eq(packet3->data, packet->data);
+
+    /* Modifying a shared packet must not affect the other packets. */
+    packet_append_uint8(packet2, 1);
+    ck_assert_ptr_ne(packet2->data, packet->data);
+    packet_verify_data(packet2, "0000003201");
+    packet_verify_data(packet, "00000032");
+    packet_verify_data(packet3, "00000032");
+
+    packet_free(packet);
+    packet_verify_data(packet3, "00000032");
+    packet_free(packet3);
+    packet_free(packet2);
+
+    packet = packet_new(0, 0, 0);
+    packet2 = packet_share(packet);
+    packet_verify_data(packet2, "");
+    packet_free(packet2);
+    packet_free(packet);
+}
+END_TEST
+
+START_TEST(test_packet_precompress)
+{
+    packet_struct *packet, *packet2;
+
+    packet = packet_new(1, 0, 0);
+
+    for (int i = 0; i < 1000; i++) {
+        packet_append_uint8(packet, i % 4);
+    }
+
+    ck_assert(!packet_compress_cached(packet));
+    packet_precompress(packet);
+    packet2 = packet_share(packet);
+    ck_assert(packet_compress_cached(packet2));
+    ck_assert_uint_eq(packet2->type, CLIENT_CMD_COMPRESSED);
+    ck_assert(packet2->len < packet->len);
+    ck_assert_uint_eq(packet2->data[0], 1);
+    /* The raw data is still available. */
+    ck_assert_uint_eq(packet->type, 1);
+    ck_assert_uint_eq(packet->len, 1000);
+    packet_free(packet2);
+    packet_free(packet);
+
+    packet = packet_new(1, 0, 0);
+    packet_append_uint32(packet, 50);
+    packet_precompress(packet);
+    packet2 = packet_share(packet);
+    ck_assert(packet_compress_cached(packet2));
+    ck_assert_uint_eq(packet2->type, 1);
+    packet_verify_data(packet2, "00000032");
+    packet_free(packet2);
+    packet_free(packet);
+}
+END_TEST
+
+START_TEST(test_packet_compress_stream)
+{
+    static const char *const msg = "You hit the orc with your sword for "
+            "12 points of damage.";
+    packet_compressor_t *compressor;
+    packet_struct *packet;
+    z_stream stream;
+    size_t first_len = 0;
+    uint8_t buf[HUGE_BUF];
+
+    compressor = packet_compressor_create(6);
+    ck_assert(compressor != NULL);
+    memset(&stream, 0, sizeof(stream));
+    ck_assert_int_eq(inflateInit(&stream), Z_OK);
+
+    for (int i = 0; i < 5; i++) {
+        packet = packet_new(1, 0, 0);
+        packet_append_string_terminated(packet, msg);
+        packet_append_uint8(packet, i);
+        ck_assert(packet->len > PACKET_COMPRESS_STREAM_SIZE);
+
+        packet_compress_stream(packet, compressor);
+        ck_assert_uint_eq(packet->type, CLIENT_CMD_COMPRESSED_STREAM);
+        ck_assert_uint_eq(packet->data[0], 1);
+        ck_assert_uint_eq((packet->data[1] << 24) + (packet->data[2] << 16) +
+                (packet->data[3] << 8) + packet->data[4], strlen(msg) + 2);
+
+        /* The packets repeat each other, so the ones after the first only
+         * refer to the earlier data. */
+        if (i == 0) {
+            first_len = packet->len;
+        } else {
+            ck_assert(packet->len < first_len);
+        }
+
+        /* Inflate the packets in order with a single stream, like the
+         * client does. */
+        stream.next_in = packet->data + 5;
+        stream.avail_in = packet->len - 5;
+        stream.next_out = buf;
+        stream.avail_out = sizeof(buf);
+        ck_assert_int_eq(inflate(&stream, Z_SYNC_FLUSH), Z_OK);
+        ck_assert_uint_eq(stream.avail_in, 0);
+        ck_assert_uint_eq(sizeof(buf) - stream.avail_out, strlen(msg) + 2);
+        ck_assert_str_eq((char *) buf, msg);
+        ck_assert_uint_eq(buf[strlen(msg) + 1], i);
+
+        packet_free(packet);
+    }
+
+    /* Short packets are left alone. */
+    packet = packet_new(1, 0, 0);
+
+    for (int i = 0; i < PACKET_COMPRESS_STREAM_SIZE; i++) {
+        packet_append_uint8(packet, 'a');
+    }
+
+    packet_compress_stream(packet, compressor);
+    ck_assert_uint_eq(packet->type, 1);
+    ck_assert_uint_eq(packet->len, PACKET_COMPRESS_STREAM_SIZE);
+    packet_free(packet);
+
+    inflateEnd(&stream);
+    packet_compressor_free(compressor);
+}
+END_TEST
+
 START_TEST(test_packet_save)
 {
     packet_struct *packet;
@@ -861,6 +996,9 @@ static Suite *suite(void)
     suite_add_tcase(s, tc_core);
     tcase_add_test(tc_core, test_packet_new);
     tcase_add_test(tc_core, test_packet_dup);
+    tcase_add_test(tc_core, test_packet_share);
+    tcase_add_test(tc_core, test_packet_precompress);
+    tcase_add_test(tc_core, test_packet_compress_stream);
     tcase_add_test(tc_core, test_packet_save);
     tcase_add_test(tc_core, test_packet_load);
     tcase_add_test(tc_core, test_packet_append_uint8);
@@ -127,6 +127,54 @@ START_TEST(test_free_string_shared)
 
 END_TEST
 
+START_TEST(test_shstr_len)
+{
+    shstr *str1, *str2;
+
+    str1 = add_string("Hello world");
+    ck_assert_uint_eq(shstr_len(str1), strlen("Hello world"));
+    str2 = add_string("");
+    ck_assert_uint_eq(shstr_len(str2), 0);
+
+    free_string_shared(str1);
+    free_string_shared(str2);
+}
+
+END_TEST
+
+START_TEST(test_shstr_resize)
+{
+    /* Enough strings to force the table to grow a few times; the strings
+     * share a long prefix, so the whole string must be hashed. */
+    const size_t num = SHSTR_TABLE_SIZE_MIN * 4;
+    shstr **strs = emalloc(sizeof(*strs) * num);
+    char buf[MAX_BUF];
+
+    for (size_t i = 0; i < num; i++) {
+        snprintf(VS(buf), "/shattered_islands/world/world_%04" PRIu64,
+                 (uint64_t) i);
+        strs[i] = add_string(buf);
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        snprintf(VS(buf), "/shattered_islands/world/world_%04" PRIu64,
+                 (uint64_t) i);
+        ck_assert_ptr_eq(find_string(buf), strs[i]);
+        ck_assert_str_eq(strs[i], buf);
+        ck_assert_uint_eq(shstr_len(strs[i]), strlen(buf));
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        free_string_shared(strs[i]);
+    }
+
+    ck_assert_ptr_eq(find_string("/shattered_islands/world/world_0000"),
+                     NULL);
+    efree(strs);
+}
+
+END_TEST
+
 static Suite *suite(void)
 {
     Suite *s = suite_create("shstr");
@@ -141,6 +189,8 @@ static Suite *suite(void)
     tcase_add_test(tc_core, test_query_refcount);
     tcase_add_test(tc_core, test_find_string);
     tcase_add_test(tc_core, test_free_string_shared);
+    tcase_add_test(tc_core, test_shstr_len);
+    tcase_add_test(tc_core, test_shstr_resize);
 
     return s;
 }
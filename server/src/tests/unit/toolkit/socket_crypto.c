@@ -0,0 +1,205 @@
+/*************************************************************************
+ *           Atrinik, a Multiplayer Online Role Playing Game             *
+ *                                                                       *
+ *   Copyright (C) 2009-2014 Alex Tokar and Atrinik Development Team     *
+ *                                                                       *
+ * Fork from Crossfire (Multiplayer game for X-windows).                 *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 2 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the Free Software           *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.             *
+ *                                                                       *
+ * The author can be reached at admin@atrinik.org                        *
+ ************************************************************************/
+
+#include <global.h>
+#include <check.h>
+#include <checkstd.h>
+#include <check_proto.h>
+#include <toolkit/packet.h>
+#include <toolkit/socket.h>
+#include <toolkit/socket_crypto.h>
+
+/** Number of packets sent by the socket crypto benchmark. */
+#define SOCKET_CRYPTO_BENCHMARK_PACKETS 50000
+
+/**
+ * Create a socket for testing, optionally with an established AES key.
+ */
+static socket_t *
+crypto_socket_create (bool secure)
+{
+    socket_t *sc = socket_create("127.0.0.1", 1728, secure,
+                                 SOCKET_ROLE_CLIENT, false);
+    ck_assert_ptr_ne(sc, NULL);
+
+    if (secure) {
+        socket_crypto_t *crypto = socket_crypto_create(sc);
+        ck_assert(socket_crypto_check_cmd(CMD_CRYPTO_KEY, crypto));
+
+        uint8_t len;
+        ck_assert_ptr_ne(socket_crypto_create_key(crypto, &len), NULL);
+    }
+
+    return sc;
+}
+
+/**
+ * Create a packet with some test data.
+ */
+static packet_struct *
+crypto_packet_create (size_t len)
+{
+    packet_struct *packet = packet_new(1, len, 0);
+
+    for (size_t i = 0; i < len; i++) {
+        packet_append_uint8(packet, (uint8_t) i);
+    }
+
+    return packet;
+}
+
+/**
+ * Send a packet over the specified socket the way socket_send_packet()
+ * does, and receive it back.
+ */
+static void
+crypto_packet_roundtrip (socket_t *sc, size_t len, bool verify)
+{
+    packet_struct *packet = crypto_packet_create(len);
+    packet_struct *packet_meta = packet_new(0, 4, 0);
+
+    if (socket_is_secure(sc)) {
+        packet = socket_crypto_encrypt(sc, packet, packet_meta, false);
+        ck_assert_ptr_ne(packet, NULL);
+    } else {
+        packet_compress(packet);
+        packet_append_uint16(packet_meta, (uint16_t) packet->len + 1);
+        packet_append_uint8(packet_meta, packet->type);
+    }
+
+    /* Gather the frame, like the socket's write does; it starts after the
+     * packet length. */
+    uint8_t buf[UINT16_MAX];
+    size_t buf_len = packet_meta->len - 2;
+    memcpy(buf, packet_meta->data + 2, buf_len);
+    memcpy(buf + buf_len, packet->data, packet->len);
+    buf_len += packet->len;
+    ck_assert_uint_eq((packet_meta->data[0] << 8) + packet_meta->data[1],
+                      buf_len);
+    packet_free(packet_meta);
+    packet_free(packet);
+
+    uint8_t *data;
+    size_t data_len;
+    if (socket_is_secure(sc)) {
+        ck_assert(socket_crypto_decrypt(sc, buf, buf_len, &data, &data_len));
+    } else {
+        data = buf;
+        data_len = buf_len;
+    }
+
+    if (verify) {
+        ck_assert_uint_eq(data_len, len + 1);
+        ck_assert_uint_eq(data[0], 1);
+
+        for (size_t i = 0; i < len; i++) {
+            ck_assert_uint_eq(data[i + 1], (uint8_t) i);
+        }
+    }
+}
+
+START_TEST(test_socket_crypto_roundtrip)
+{
+    socket_t *sc = crypto_socket_create(true);
+
+    crypto_packet_roundtrip(sc, 0, true);
+    crypto_packet_roundtrip(sc, 1, true);
+    crypto_packet_roundtrip(sc, 15, true);
+    crypto_packet_roundtrip(sc, 16, true);
+    crypto_packet_roundtrip(sc, 1000, true);
+    crypto_packet_roundtrip(sc, 5, true);
+
+    socket_destroy(sc);
+}
+END_TEST
+
+START_TEST(test_socket_crypto_roundtrip_plain)
+{
+    socket_t *sc = crypto_socket_create(false);
+
+    crypto_packet_roundtrip(sc, 0, true);
+    crypto_packet_roundtrip(sc, 1, true);
+    crypto_packet_roundtrip(sc, 1000, true);
+
+    socket_destroy(sc);
+}
+END_TEST
+
+/*
+ * Benchmark of the number of packets per second that can be sent over
+ * secure sockets, compared to plain sockets. Only run if
+ * check_benchmarks() is true.
+ */
+START_TEST(test_socket_crypto_benchmark)
+{
+    for (int secure = 0; secure <= 1; secure++) {
+        socket_t *sc = crypto_socket_create(secure);
+
+        TIMER_START(1);
+
+        for (int i = 0; i < SOCKET_CRYPTO_BENCHMARK_PACKETS; i++) {
+            crypto_packet_roundtrip(sc, 8 + i % 256, false);
+        }
+
+        TIMER_UPDATE(1);
+        LOG(DEVEL, "%s sockets: %d packets took %f seconds (%.0f packets/s)",
+                secure ? "Secure" : "Plain", SOCKET_CRYPTO_BENCHMARK_PACKETS,
+                TIMER_GET(1), SOCKET_CRYPTO_BENCHMARK_PACKETS /
+                MAX(TIMER_GET(1), 0.000001));
+
+        socket_destroy(sc);
+    }
+}
+END_TEST
+
+static Suite *suite(void)
+{
+    Suite *s = suite_create("socket_crypto");
+    TCase *tc_core = tcase_create("Core");
+
+    tcase_add_unchecked_fixture(tc_core, check_setup, check_teardown);
+    tcase_add_checked_fixture(tc_core, check_test_setup, check_test_teardown);
+
+    suite_add_tcase(s, tc_core);
+    tcase_add_test(tc_core, test_socket_crypto_roundtrip);
+    tcase_add_test(tc_core, test_socket_crypto_roundtrip_plain);
+
+    if (check_benchmarks()) {
+        TCase *tc_benchmark = tcase_create("Benchmark");
+
+        tcase_add_unchecked_fixture(tc_benchmark, check_setup, check_teardown);
+        tcase_add_checked_fixture(tc_benchmark, check_test_setup,
+                check_test_teardown);
+
+        suite_add_tcase(s, tc_benchmark);
+        tcase_add_test(tc_benchmark, test_socket_crypto_benchmark);
+    }
+
+    return s;
+}
+
+void check_server_socket_crypto(void)
+{
+    check_run_suite(suite(), __FILE__);
+}
@@ -39,7 +39,9 @@ waypoint_get_aggro(object *npc);
 object *
 waypoint_get_home(object *npc);
 void
-waypoint_compute_path(object *op);
+waypoint_compute_path(object *op, bool async);
+void
+waypoint_set_path(object *op, path_node_t *path);
 void
 waypoint_move(object *op, object *npc);
 
@@ -252,7 +252,7 @@ static void monster_enemy_signal_map(object *npc, mapstruct *map,
             continue;
         }
 
-        if (object_get_value(npc, "was_provoked") != NULL) {
+        if (object_get_value_s(npc, shstr_cons.was_provoked) != NULL) {
             object_set_value(ol->objlink.ob->enemy, "was_provoked", "1", 1);
         }
 
@@ -861,11 +861,10 @@ static int can_detect_target(object *op, object *target, unsigned int range,
  */
 static object *find_nearest_enemy(object *ob)
 {
-    object *tmp;
+    object *tmp, **live;
     int aggro_range, aggro_stealth;
     rv_vector rv;
-    int i, j, xt, yt;
-    mapstruct *m;
+    size_t i, num;
 
     aggro_range = ob->item_power;
 
@@ -884,48 +883,35 @@ static object *find_nearest_enemy(object *ob)
         aggro_stealth = MIN_MON_RADIUS;
     }
 
-    for (i = -aggro_range; i <= aggro_range; i++) {
-        for (j = -aggro_range; j <= aggro_range; j++) {
-            xt = ob->x + i;
-            yt = ob->y + j;
+    /* Only look at the living objects around us, nearest first. */
+    live = map_live_find(ob->map, ob->x, ob->y, aggro_range, &num);
 
-            if (!(m = get_map_from_coord2(ob->map, &xt, &yt))) {
-                continue;
-            }
-
-            /* Nothing alive here? Move on... */
-            if (!(GET_MAP_FLAGS(m, xt, yt) & (P_IS_MONSTER | P_IS_PLAYER))) {
-                continue;
-            }
-
-            for (tmp = GET_MAP_OB(m, xt, yt); tmp; tmp = tmp->above) {
-                /* Get head. */
-                if (tmp->head) {
-                    tmp = tmp->head;
-                }
+    for (i = 0; i < num; i++) {
+        tmp = live[i];
 
-                /* Skip the monster looking for enemy and not alive objects. */
-                if (tmp == ob || !IS_LIVE(tmp)) {
-                    continue;
-                }
+        /* Skip the monster looking for enemy and not alive objects. */
+        if (tmp == ob || !IS_LIVE(tmp)) {
+            continue;
+        }
 
-                if (!can_detect_target(ob, tmp, aggro_range, aggro_stealth,
-                        &rv)) {
-                    continue;
-                }
+        if (!can_detect_target(ob, tmp, aggro_range, aggro_stealth, &rv)) {
+            continue;
+        }
 
-                if (!obj_in_line_of_sight(tmp, &rv)) {
-                    continue;
-                }
+        if (!obj_in_line_of_sight(tmp, &rv)) {
+            continue;
+        }
 
-                /* Now check the friend status, whether we can reach the enemy,
-                 * and LOS. */
-                if (!is_friend_of(ob, tmp)) {
-                    return tmp;
-                }
+        /* Now check the friend status, whether we can reach the enemy,
+         * and LOS. */
+        if (!is_friend_of(ob, tmp)) {
+            return tmp;
+        }
 
-                monster_guard_check(ob, tmp, NULL, rv.distance);
-            }
+        /* The guard event may run scripts that change the surroundings
+         * (and the live object array), so stop looking if it triggered. */
+        if (monster_guard_check(ob, tmp, NULL, rv.distance)) {
+            break;
         }
     }
 
@@ -1726,7 +1712,7 @@ int is_friend_of(object *op, object *obj)
     }
 
     if (op->type != PLAYER) {
-        shstr *name = object_get_value(op, "faction");
+        shstr *name = object_get_value_s(op, shstr_cons.faction);
         if (name == NULL) {
             return 0;
         }
@@ -1738,7 +1724,7 @@ int is_friend_of(object *op, object *obj)
     }
 
     if (obj->type != PLAYER) {
-        shstr *name = object_get_value(obj, "faction");
+        shstr *name = object_get_value_s(obj, shstr_cons.faction);
         if (name == NULL) {
             return 0;
         }
@@ -1851,13 +1837,13 @@ int check_good_armour(object *who, object *item)
 
 bool monster_is_ally_of(object *op, object *target)
 {
-    shstr *op_faction_name = object_get_value(op, "faction");
+    shstr *op_faction_name = object_get_value_s(op, shstr_cons.faction);
 
     if (op_faction_name == NULL) {
         return false;
     }
 
-    shstr *target_faction_name = object_get_value(target, "faction");
+    shstr *target_faction_name = object_get_value_s(target, shstr_cons.faction);
 
     if (target_faction_name == NULL) {
         return false;
@@ -105,7 +105,7 @@ static bool monster_guard_get_bounty(object *op, player *pl, double *bounty)
     HARD_ASSERT(pl != NULL);
     HARD_ASSERT(bounty != NULL);
 
-    shstr *faction_name = object_get_value(op, "faction");
+    shstr *faction_name = object_get_value_s(op, shstr_cons.faction);
 
     if (faction_name == NULL) {
         LOG(ERROR, "Monster has no faction: %s", object_get_str(op));
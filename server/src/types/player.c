@@ -1775,7 +1775,8 @@ examine (object *op, object *tmp, StringBuffer *sb_capture)
                                   op, "%s would become soulbound to you.",
                                   tmp->nrof > 1 ? "They" : "It");
         } else {
-            shstr *soulbound_name = object_get_value(tmp, "soulbound_name");
+            shstr *soulbound_name = object_get_value_s(tmp,
+                    shstr_cons.soulbound_name);
             if (soulbound_name == NULL) {
                 draw_info_full_format(CHAT_TYPE_GAME, NULL, COLOR_WHITE,
                                       sb_capture, op,
@@ -2370,34 +2371,18 @@ player_exists (const char *name)
 }
 
 /**
- * Saves the specified player.
+ * Writes the player data of the specified player to a file.
  *
  * @param op
- * Player object to save.
+ * Player object.
+ * @param fp
+ * File to write to.
  */
-void
-player_save (object *op)
+static void
+player_save_fp (object *op, FILE *fp)
 {
-    HARD_ASSERT(op != NULL);
-
-    /* Is this a map players can't save on? */
-    if (op->map != NULL && MAP_PLAYER_NO_SAVE(op->map)) {
-        return;
-    }
-
-    char *path = player_make_path(op->name, "player.dat");
-    char *path_tmp = player_make_path(op->name, "player.dat.tmp");
-
     player *pl = CONTR(op);
 
-    path_ensure_directories(path_tmp);
-    FILE *fp = fopen(path_tmp, "w");
-    if (unlikely(fp == NULL)) {
-        LOG(ERROR, "Failure opening %s for writing: %s",
-            path_tmp, strerror(errno));
-        goto error;
-    }
-
     fprintf(fp, "no_chat %d\n", pl->no_chat);
     fprintf(fp, "tcl %d\n", pl->tcl);
     fprintf(fp, "tgm %d\n", pl->tgm);
@@ -2427,6 +2412,33 @@ player_save (object *op)
     SET_FLAG(op, FLAG_NO_FIX_PLAYER);
     object_save(op, fp);
     CLEAR_FLAG(op, FLAG_NO_FIX_PLAYER);
+}
+
+/**
+ * Saves the specified player directly to disk, without going through the
+ * swap writer thread.
+ *
+ * @param op
+ * Player object to save.
+ * @param path
+ * Path of the player file.
+ */
+static void
+player_save_sync (object *op, const char *path)
+{
+    /* Make sure a pending save can't overwrite this one later. */
+    swap_cancel(path);
+
+    char *path_tmp = player_make_path(op->name, "player.dat.tmp");
+
+    FILE *fp = fopen(path_tmp, "w");
+    if (unlikely(fp == NULL)) {
+        LOG(ERROR, "Failure opening %s for writing: %s",
+            path_tmp, strerror(errno));
+        goto error;
+    }
+
+    player_save_fp(op, fp);
 
     /* Make sure the write succeeded. */
     if (unlikely(fclose(fp) == EOF)) {
@@ -2462,10 +2474,64 @@ error:
     }
 
 out:
-    efree(path);
     efree(path_tmp);
 }
 
+/**
+ * Saves the specified player.
+ *
+ * The player file is serialized into memory and handed to the swap
+ * writer thread, which writes it to disk; see swap_write_file(). Saving
+ * the same player again before the file has been written replaces the
+ * pending data. If the writer thread fails to write the file, the write
+ * is retried on the main thread and the player is told if that fails as
+ * well.
+ *
+ * On platforms without memory streams, the player is saved synchronously
+ * instead.
+ *
+ * @param op
+ * Player object to save.
+ */
+void
+player_save (object *op)
+{
+    HARD_ASSERT(op != NULL);
+
+    /* Is this a map players can't save on? */
+    if (op->map != NULL && MAP_PLAYER_NO_SAVE(op->map)) {
+        return;
+    }
+
+    char *path = player_make_path(op->name, "player.dat");
+    path_ensure_directories(path);
+
+    char *data;
+    size_t len;
+    FILE *fp = swap_memstream(&data, &len);
+    if (fp == NULL) {
+        player_save_sync(op, path);
+        efree(path);
+        return;
+    }
+
+    player_save_fp(op, fp);
+
+    /* Make sure the serialization succeeded. */
+    if (unlikely(fclose(fp) == EOF)) {
+        LOG(ERROR, "Failure serializing player %s: %s",
+            op->name, strerror(errno));
+        /* Allocated by the memory stream. */
+        free(data);
+        player_save_sync(op, path);
+        efree(path);
+        return;
+    }
+
+    swap_write_file(path, data, len, SAVE_MODE, op->name);
+    efree(path);
+}
+
 /**
  * Loads player data from the specified file into the player.
  *
@@ -2762,6 +2828,8 @@ player_login (socket_struct *ns, const char *name, struct archetype *at)
     }
 
     char *path = player_make_path(name, "player.dat");
+    /* Make sure a pending save of the character has been written. */
+    swap_wait(path);
     FILE *fp = fopen(path, "rb");
     /* This shouldn't happen, because creating a new character creates an
      * empty file (to reserve the character name until the player actually
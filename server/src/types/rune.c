@@ -119,6 +119,7 @@ rune_spring (object *op, object *victim)
         op->type = MISC_OBJECT;
         CLEAR_FLAG(op, FLAG_FLY_ON);
         CLEAR_FLAG(op, FLAG_WALK_ON);
+        object_update(op, UP_OBJ_FLAGS);
         FREE_AND_CLEAR_HASH2(op->msg);
         /* Make it stick around until its spells are gone */
         op->stats.food = 20;
@@ -173,11 +173,14 @@ waypoint_load_destination (object *op, object *npc)
  *
  * This function is called whenever our path request is dequeued.
  *
- * @param waypoint
+ * @param op
  * The waypoint object.
+ * @param async
+ * If true, try to compute the path on the pathfinding worker threads; the
+ * result is later applied by waypoint_set_path().
  */
 void
-waypoint_compute_path (object *op)
+waypoint_compute_path (object *op, bool async)
 {
     HARD_ASSERT(op != NULL);
 
@@ -215,6 +218,17 @@ waypoint_compute_path (object *op)
         return;
     }
 
+    if (async && path_find_async(op,
+                                 op->env,
+                                 op->env->map,
+                                 op->env->x,
+                                 op->env->y,
+                                 destmap,
+                                 op->stats.hp,
+                                 op->stats.sp)) {
+        return;
+    }
+
     path_node_t *path = path_find(op->env,
                                   op->env->map,
                                   op->env->x,
@@ -223,6 +237,26 @@ waypoint_compute_path (object *op)
                                   op->stats.hp,
                                   op->stats.sp,
                                   NULL);
+    waypoint_set_path(op, path);
+}
+
+/**
+ * Store a computed path in the waypoint object.
+ *
+ * @param op
+ * The waypoint object.
+ * @param path
+ * The path; can be NULL.
+ */
+void
+waypoint_set_path (object *op, path_node_t *path)
+{
+    HARD_ASSERT(op != NULL);
+
+    if (unlikely(op->env == NULL)) {
+        return;
+    }
+
     path = path_compress(path);
     if (path == NULL) {
         if (!QUERY_FLAG(op, FLAG_DAMNED)) {
@@ -234,7 +268,7 @@ waypoint_compute_path (object *op)
                 op->env->x,
                 op->env->y,
                 op->name,
-                destmap->path,
+                op->slaying != NULL ? op->slaying : op->env->map->path,
                 op->stats.hp,
                 op->stats.sp,
                 object_get_str(op));